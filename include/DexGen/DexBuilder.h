@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace DexGen
+{
+struct MethodRef
+{
+  std::string class_descriptor;
+  std::string name;
+};
+
+struct FieldRef
+{
+  std::string class_descriptor;
+  std::string name;
+  std::string type_descriptor;
+};
+
+// Code units of one method. Method, field, type and string references
+// are patched with the final indexes when the dex is built.
+class CodeBuilder
+{
+public:
+  CodeBuilder& unit(uint16_t code_unit);
+  CodeBuilder& units(std::vector<uint16_t> const& code_units);
+  // Append the code of other, keeping its references and payloads.
+  CodeBuilder& append(CodeBuilder const& other);
+
+  // const/4 vA, #+B
+  CodeBuilder& const4(uint8_t reg, int8_t value);
+  // if-eqz vAA, +BBBB (offset in code units from this instruction)
+  CodeBuilder& if_eqz(uint8_t reg, int16_t offset);
+  // goto/16 +AAAA
+  CodeBuilder& goto16(int16_t offset);
+  // invoke-kind {vC, vD, vE, vF, vG}, meth@BBBB with up to 5 arguments,
+  // opcode 0x6e (virtual) to 0x72 (interface)
+  CodeBuilder& invoke(uint8_t opcode, MethodRef const& method,
+                      std::vector<uint8_t> const& args);
+  // invoke-static {}, meth@BBBB
+  CodeBuilder& invoke_static(MethodRef const& method);
+  // invoke-virtual {vC}, meth@BBBB
+  CodeBuilder& invoke_virtual(MethodRef const& method, uint8_t reg);
+  // invoke-interface {vC}, meth@BBBB
+  CodeBuilder& invoke_interface(MethodRef const& method, uint8_t reg);
+  // new-instance vAA, type@BBBB
+  CodeBuilder& new_instance(uint8_t reg, std::string const& descriptor);
+  // check-cast vAA, type@BBBB
+  CodeBuilder& check_cast(uint8_t reg, std::string const& descriptor);
+  // const-string vAA, string@BBBB
+  CodeBuilder& const_string(uint8_t reg, std::string const& value);
+  // sget-kind and sput-kind vAA, field@BBBB, opcode 0x60 to 0x6d
+  CodeBuilder& static_field(uint8_t opcode, uint8_t reg, FieldRef const& field);
+  // iget-kind and iput-kind vA, vB, field@CCCC, opcode 0x52 to 0x5f
+  CodeBuilder& instance_field(uint8_t opcode, uint8_t reg, uint8_t object,
+                              FieldRef const& field);
+  // move-result vAA
+  CodeBuilder& move_result(uint8_t reg);
+  // return vAA
+  CodeBuilder& return_value(uint8_t reg);
+  // packed-switch vAA, +BBBBBBBB; targets are offsets from the switch
+  // instruction. The payload is appended after the last instruction when
+  // the dex is built.
+  CodeBuilder& packed_switch(uint8_t reg, std::vector<int32_t> const& targets);
+  CodeBuilder& return_void();
+  CodeBuilder& nop();
+
+  // Offset of the next instruction, in code units.
+  uint32_t size() const { return (uint32_t)insns.size(); }
+
+  std::vector<uint16_t> insns;
+  std::vector<std::pair<uint32_t, MethodRef>> method_fixups;
+  std::vector<std::pair<uint32_t, FieldRef>> field_fixups;
+  std::vector<std::pair<uint32_t, std::string>> type_fixups;
+  std::vector<std::pair<uint32_t, std::string>> string_fixups;
+  std::vector<std::pair<uint32_t, std::vector<int32_t>>> switch_payloads;
+};
+
+// Instructions [start, start + count) caught by a catch-all handler, all
+// in code units.
+struct TryBlock
+{
+  uint32_t start;
+  uint16_t count;
+  uint32_t handler;
+};
+
+// Every method is a static ()V.
+struct MethodDef
+{
+  std::string name;
+  CodeBuilder code;
+  uint16_t registers = 4;
+  uint16_t ins = 0;  // the last registers, whatever the proto says
+  std::vector<TryBlock> tries;  // ascending, not overlapping
+};
+
+// Superclasses must come before their subclasses.
+struct ClassDef
+{
+  std::string descriptor;
+  std::vector<MethodDef> methods;
+  std::string superclass = "Ljava/lang/Object;";
+  std::vector<std::string> interfaces;  // not repeated
+};
+
+// Serialize a complete, checksummed dex that passes dexFileParse and the
+// structural verifier. Throws std::length_error when the classes do not
+// fit in one dex (more than 65536 methods, fields or types, or a
+// const-string past the first 65536 strings).
+std::vector<uint8_t> build(std::vector<ClassDef> const& classes);
+
+bool write_file(std::string const& filename, std::vector<uint8_t> const& dex);
+}
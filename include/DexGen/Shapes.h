@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <DexGen/DexBuilder.h>
+
+namespace DexGen
+{
+// Knobs of a generated application. Every method is laid out as:
+// an optional packed-switch of switch_cases one-nop cases, then
+// loop_depth nested if-eqz/goto loops around a body of
+// branches_per_method if/else diamonds and calls_per_method
+// invoke-static to methods picked (deterministically, from seed) among
+// all generated methods.
+struct Shape
+{
+  uint32_t classes = 100;
+  uint32_t methods_per_class = 4;
+  uint32_t switch_cases = 0;
+  uint32_t loop_depth = 0;
+  uint32_t branches_per_method = 1;
+  uint32_t calls_per_method = 1;
+  uint32_t seed = 1;
+};
+
+// Throws std::length_error when a method does not fit the 16-bit branch
+// offsets of if-eqz / goto/16 or the packed-switch case count.
+std::vector<ClassDef> generate(Shape const& shape);
+
+// Split classes into consecutive dex files whose method ids (defined and
+// referenced) and type ids each stay within max_ids, as a multidex build
+// does. Throws std::length_error when a single class does not fit.
+std::vector<std::vector<ClassDef>> split_multidex(
+    std::vector<ClassDef> const& classes,
+    uint32_t max_ids = 0x10000);
+}
@@ -0,0 +1,317 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <libdex/DexFile.h>
+#include <libdex/SysUtil.h>
+
+#include <TreeConstructor/Axml.h>
+#include <TreeConstructor/FmtEdg.h>
+#include <TreeConstructor/Liveness.h>
+#include <TreeConstructor/MethodCache.h>
+#include <TreeConstructor/OpcodeType.h>
+#include <TreeConstructor/StringSearch.h>
+#include <TreeConstructor/Xref.h>
+
+// Embeddable front end of dexgraph: open a dex (or the classes.dex of an
+// APK) from a path or a memory buffer and build its graph into a
+// Fmt::Edg::Sink. Nothing here is global, so builds on different Dex
+// objects may run concurrently, each on its own thread.
+namespace DexGraph
+{
+// Receiver of the register liveness of each method built, see
+// Options::liveness. Called on the building thread, with the method's
+// decoded node vector (blocks index it).
+class LivenessSink
+{
+public:
+  virtual ~LivenessSink() {}
+  virtual void method(uint32_t method_idx,
+                      std::vector<TreeConstructor::NodeSPtr> const& nodes,
+                      TreeConstructor::Liveness::Result const& result) = 0;
+};
+
+// Instructions of the built methods referencing each id of the dex, see
+// Options::xrefs.
+struct Xrefs
+{
+  TreeConstructor::Xref::Index fields;   // iget, iput, sget, sput by field_idx
+  TreeConstructor::Xref::Index strings;  // const-string(/jumbo) by string_idx
+};
+
+struct Options
+{
+  bool disassemble = true;          // build method graphs at all (-d)
+  bool exports_only = false;        // public and protected methods only
+  bool stream = false;              // two-pass, bounded memory (-s)
+  bool lazy_verify = false;         // verify classes on first use (-z)
+  bool ignore_bad_checksum = false; // (-i)
+  int verify_threads = 0;           // structural verification threads (-V)
+  // Process wide heap bytes, 0 for none (-B). Only counted when the
+  // executable links TreeConstructor/CountingAllocator.cpp.
+  uint64_t memory_budget = 0;
+  // Reused across builds if set; not thread safe, so not to be shared by
+  // concurrent builds.
+  TreeConstructor::MethodCache* method_cache = nullptr;
+  // Polled between classes and methods: once set, build() returns early
+  // with cancelled set, without finishing the sink.
+  std::atomic<bool> const* cancel = nullptr;
+  // If set, the live registers of every block of each built method, from
+  // the operands recorded as it is decoded. The method cache is not used
+  // then. Methods over the memory budget get none.
+  LivenessSink* liveness = nullptr;
+  // Drop the IF and SWITCH links constant propagation proves are never
+  // taken (opaque predicates), and the code only they reach (-p). The
+  // method cache is not used then.
+  bool prune_infeasible = false;
+  // Retarget virtual and interface calls to the override the receiver's
+  // inferred class dispatches to, where it has code in the dex (-R). The
+  // method cache is not used then.
+  bool sharpen_calls = false;
+  // If set, filled with the references of the methods built as they are
+  // decoded, and finished by build(). The method cache is not used then.
+  // Methods over the memory budget are left out.
+  Xrefs* xrefs = nullptr;
+  // Class descriptor prefixes ("Lcom/example/") or globs ("L*/R$*;"): a
+  // class is built if it matches an include (or none is given) and no
+  // exclude. Calls into left out classes land on an EXTERN stub node.
+  std::vector<std::string> include_classes;
+  std::vector<std::string> exclude_classes;
+};
+
+// Whether the class filters of options keep this class descriptor.
+bool class_selected(Options const& options, char const* descriptor);
+
+class Dex
+{
+public:
+  // Map a .dex file, or extract classes.dex of a .apk/.jar/.zip to memory
+  // (no temporary file). Returns nullptr and sets error on failure.
+  static std::unique_ptr<Dex> map(std::string const& path, std::string& error);
+  // Same, from a copy of a dex or zip image.
+  static std::unique_ptr<Dex> map_memory(void const* data, std::size_t length,
+                                         std::string& error);
+
+  // map() or map_memory(), then parse().
+  static std::unique_ptr<Dex> open(std::string const& path,
+                                   Options const& options,
+                                   std::string& error);
+  static std::unique_ptr<Dex> open_memory(void const* data,
+                                          std::size_t length,
+                                          Options const& options,
+                                          std::string& error);
+
+  ~Dex();
+  Dex(Dex const&) = delete;
+  Dex& operator=(Dex const&) = delete;
+
+  // Verify (options.verify_threads) and parse the mapped bytes. The raw
+  // bytes are available before, e.g. to compute a cache key.
+  bool parse(Options const& options, std::string& error);
+
+  uint8_t const* data() const { return (uint8_t const*)mapping.addr; }
+  std::size_t length() const { return mapping.length; }
+  // nullptr until parse() succeeds.
+  ::DexFile* dex_file() const { return dex; }
+  // Binary AndroidManifest.xml of the archive the dex came from, empty for
+  // a bare dex.
+  std::vector<uint8_t> const& manifest() const { return manifest_data; }
+
+private:
+  Dex();
+
+  MemMapping mapping;
+  ::DexFile* dex = nullptr;
+  std::vector<uint8_t> manifest_data;
+};
+
+struct BuildReport
+{
+  uint64_t skipped_methods = 0;   // reduced to their entry node, over budget
+  bool stream_fallback = false;   // over budget, redone in streaming mode
+  bool cancelled = false;         // see Options::cancel
+  bool write_failed = false;      // the sink's finish() failed
+};
+
+// Build the graph of a parsed dex into sink, finish() included, as the
+// CLI does. The streaming and whole-file modes emit the same nodes and
+// edges; streaming emits each edge once.
+BuildReport build(Dex const& dex, Options const& options,
+                  Fmt::Edg::Sink& sink);
+
+// Summary of one method from a single linear scan of its code item, no
+// graph built (see metrics()).
+struct MethodMetrics
+{
+  uint32_t method_idx = 0;
+  uint32_t instructions = 0;  // switch and array payloads not counted
+  uint32_t branches = 0;      // if-*
+  uint32_t invokes = 0;
+  uint32_t switches = 0;
+  uint32_t switch_cases = 0;  // over all switches of the method
+  uint32_t cyclomatic = 0;    // 1 + branches + switch_cases
+};
+
+// Metrics of every method with code the options select (class filters,
+// exports_only), in class_def order; empty if cancelled.
+std::vector<MethodMetrics> metrics(Dex const& dex, Options const& options);
+
+// Invoke targets of every method with code the options select, keyed by
+// method_idx. Targets are the method_ids the invokes name, the method of
+// the dex each resolves to up the superclasses of the class named, and
+// for virtual and interface invokes every override or implementation in
+// the dex below it. Methods only the framework calls (callbacks of a
+// library type the dex never invokes) are reached through entry points.
+struct CallGraph
+{
+  uint32_t method_count = 0;           // method_ids of the dex
+  std::vector<uint32_t> callee_begin;  // method_count + 1 offsets
+  std::vector<uint32_t> callees;       // sorted, unique per caller
+  std::vector<uint64_t> defined;       // bitmap of the methods scanned
+};
+
+// Empty if cancelled.
+CallGraph call_graph(Dex const& dex, Options const& options);
+
+// method_idx of the methods with code matching a spec: a class pattern
+// (as in Options::include_classes) for all its methods, or
+// "pattern->name" with a name glob ("L*;-><clinit>").
+std::vector<uint32_t> entry_points(Dex const& dex,
+                                   std::vector<std::string> const& specs);
+
+// A component of the manifest and its class definition.
+struct Component
+{
+  TreeConstructor::Axml::ComponentKind kind;
+  std::string name;            // "com.example.Main"
+  std::string descriptor;      // "Lcom/example/Main;"
+  int64_t class_def_idx = -1;  // -1 if the class is not in this dex
+};
+
+// Components of dex.manifest(), looked up in the dex. False with error set
+// if there is no manifest or it is malformed.
+bool components(Dex const& dex, std::vector<Component>& components,
+                std::string& error);
+
+// entry_points() specs for the constructors and lifecycle callbacks of the
+// components found in the dex.
+std::vector<std::string> lifecycle_entry_specs(
+    std::vector<Component> const& components);
+
+// Methods reachable from entries over graph, entries included: bit i % 64
+// of word i / 64 is method_idx i. Dead code is defined & ~reachable.
+std::vector<uint64_t> reachable(CallGraph const& graph,
+                                std::vector<uint32_t> const& entries);
+
+// Substring search over the string_ids of a parsed dex (string_idx
+// order), built on threads (0 for one per CPU). With Xrefs::strings, the
+// methods referencing strings that contain a needle.
+TreeConstructor::StringSearch::Index string_search(Dex const& dex,
+                                                   unsigned threads = 0);
+
+// Interprocedural CFG of the methods the options select: the method
+// graphs as build() emits them, plus for each call site into a built
+// method a CALL edge to its entry, a RETURN edge from each of its return
+// instructions to the return site (the instruction after the call), and
+// a CALL_TO_RETURN edge standing for the intraprocedural fallthrough.
+// Nodes are dense ids, numbered method by method in class_def order.
+enum class EdgeKind : uint8_t
+{
+  INTRA,
+  CALL,
+  RETURN,
+  CALL_TO_RETURN,
+};
+
+struct Icfg
+{
+  std::vector<uint64_t> addrs;       // per node
+  std::vector<OpCodeType> types;     // per node
+  std::vector<uint32_t> succ_begin;  // node count + 1 offsets
+  std::vector<uint32_t> succs;
+  std::vector<EdgeKind> kinds;       // per succs entry
+  std::vector<uint32_t> method_idx;  // per built method
+  std::vector<uint32_t> method_begin;  // first node of each, + end
+
+  std::size_t node_count() const { return addrs.size(); }
+  // Node at addr, or -1.
+  int64_t find(uint64_t addr) const;
+
+private:
+  friend Icfg icfg(Dex const& dex, Options const& options);
+  std::vector<uint32_t> by_addr;
+};
+
+// Honours the class filters, exports_only, prune_infeasible and
+// sharpen_calls; the
+// memory budget and the method cache are not used. Empty if cancelled.
+Icfg icfg(Dex const& dex, Options const& options);
+
+// Source and sink methods of taint(): "Lclass;->name" for all overloads,
+// "Lclass;->name(params)return" for one. An invoke matches if the
+// method_id it names or a method it dispatches to (as in CallGraph) does,
+// and otherwise carries the summaries of all the latter.
+struct TaintSpec
+{
+  std::vector<std::string> sources;
+  std::vector<std::string> sinks;
+  unsigned threads = 0;  // 0 for one per CPU
+};
+
+// Invoke of callee at a code unit offset of method_idx.
+struct TaintStep
+{
+  uint32_t method_idx;
+  uint32_t offset;
+  uint32_t callee;
+};
+
+// Source data reaching a sink in method_idx. Both witness paths start at
+// an invoke in it and go down through the callees returning the data or
+// passing the argument on, to the invoke of the source or the sink.
+struct TaintLeak
+{
+  uint32_t method_idx;
+  std::vector<TaintStep> source_path;
+  std::vector<TaintStep> sink_path;
+};
+
+// Register taint over the method graphs the options select, one summary
+// per method reused at every call site. Callees are summarised before
+// their callers, the methods of a recursion iterated to a fixed point,
+// and independent ones on spec.threads threads. Honours prune_infeasible;
+// leaks in method_idx order, empty if cancelled.
+std::vector<TaintLeak> taint(Dex const& dex, Options const& options,
+                             TaintSpec const& spec);
+
+struct Node
+{
+  uint64_t addr;
+  OpCodeType type;
+};
+
+struct Edge
+{
+  uint64_t from;
+  uint64_t to;
+};
+
+// Sink keeping the graph in memory, in Edg order.
+class Graph : public Fmt::Edg::Sink
+{
+public:
+  void dump_node(uint64_t addr, OpCodeType opcode_type) override;
+  void dump_edge(uint64_t from_addr, uint64_t to_addr) override;
+  bool finish() override;
+
+  // The graph in Edg layout, as StreamWriter appends it to graph.edg.
+  std::string to_edg() const;
+
+  std::vector<Node> nodes;
+  std::vector<Edge> edges;
+};
+}
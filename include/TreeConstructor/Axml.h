@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace TreeConstructor
+{
+// Reader of the binary XML (AXML) an APK stores AndroidManifest.xml as,
+// reduced to what seeds graph analyses: the package and the components.
+namespace Axml
+{
+enum class ComponentKind
+{
+  APPLICATION,
+  ACTIVITY,
+  SERVICE,
+  RECEIVER,
+  PROVIDER,
+};
+
+char const* component_kind_name(ComponentKind kind);
+
+struct Component
+{
+  ComponentKind kind;
+  std::string name;  // fully qualified, ".Main" and "Main" resolved
+};
+
+struct Manifest
+{
+  std::string package;
+  std::vector<Component> components;  // in document order
+};
+
+// Returns false and sets error on a malformed document. Components named
+// only through a resource reference are left out.
+bool parse_manifest(uint8_t const* data, std::size_t length,
+                    Manifest& manifest, std::string& error);
+
+// "com.example.Main" to "Lcom/example/Main;"
+std::string class_descriptor(std::string const& class_name);
+}
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <TreeConstructor/TCNode.h>
+
+namespace TreeConstructor
+{
+// Gen/kill problems (liveness, reaching definitions, available
+// expressions) over the basic blocks of one method graph.
+namespace Dataflow
+{
+// Maximal straight-line runs of a method graph. first and last index the
+// node vector the blocks were built from.
+struct BasicBlock
+{
+  uint32_t first;
+  uint32_t last;
+  std::vector<uint32_t> succs;
+  std::vector<uint32_t> preds;
+};
+
+struct BlockGraph
+{
+  std::vector<BasicBlock> blocks;  // blocks[0] holds the entry node
+  std::vector<uint32_t> rpo;       // blocks reached from the entry
+  std::vector<uint32_t> block_of;  // node index to block
+};
+
+// Blocks of a node vector as decoded (address order) and linked by
+// construct_node_from_vec(). Links leaving the vector, such as call edges
+// added by process_calls(), are ignored.
+BlockGraph build_blocks(std::vector<NodeSPtr> const& node_vec);
+
+// One fixed-width bitset per row, rows stored back to back in 64-bit
+// words so that the set operations are plain loops the compiler
+// vectorizes.
+class BitMatrix
+{
+public:
+  BitMatrix() {}
+  BitMatrix(std::size_t rows, std::size_t bits);
+
+  std::size_t rows() const { return row_count; }
+  std::size_t bits() const { return bit_count; }
+  std::size_t words() const { return word_count; }
+
+  uint64_t* row(std::size_t r) { return data.data() + r * word_count; }
+  uint64_t const* row(std::size_t r) const
+  {
+    return data.data() + r * word_count;
+  }
+
+  bool test(std::size_t r, std::size_t bit) const
+  {
+    return (row(r)[bit / 64] >> (bit % 64)) & 1;
+  }
+  void set(std::size_t r, std::size_t bit)
+  {
+    row(r)[bit / 64] |= uint64_t(1) << (bit % 64);
+  }
+  void reset(std::size_t r, std::size_t bit)
+  {
+    row(r)[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+  }
+  // Set bits [0, bits()) of row r.
+  void fill(std::size_t r);
+
+  // "{0,3,17}"
+  std::string format(std::size_t r) const;
+
+private:
+  std::size_t row_count = 0;
+  std::size_t bit_count = 0;
+  std::size_t word_count = 0;
+  std::vector<uint64_t> data;
+};
+
+enum class Direction
+{
+  FORWARD,   // out = gen | (in & ~kill), in = meet of the preds' out
+  BACKWARD,  // in = gen | (out & ~kill), out = meet of the succs' in
+};
+
+enum class Meet
+{
+  UNION,         // may problems, sets start empty
+  INTERSECTION,  // must problems, sets start full
+};
+
+// gen and kill hold one row per block of the graph solved. boundary is
+// the value flowing into the entry block (forward) or out of the blocks
+// without successors (backward), empty if not set.
+struct Problem
+{
+  Direction direction;
+  Meet meet;
+  BitMatrix gen;
+  BitMatrix kill;
+  BitMatrix boundary;  // one row, or none
+};
+
+struct Solution
+{
+  BitMatrix in;
+  BitMatrix out;
+  std::size_t visits = 0;  // transfer functions applied
+};
+
+// Worklist iteration to the fixed point, visiting pending blocks in
+// reverse postorder (forward) or postorder (backward). Blocks not reached
+// from the entry keep empty sets.
+Solution solve(BlockGraph const& graph, Problem const& problem);
+}
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include <cstdio>
+#include <fstream>
 #include <string>
 
 #include <TreeConstructor/TCNode.h>
@@ -20,5 +22,62 @@ namespace Edg
       std::vector<TreeConstructor::NodeSPtr> const& nodesptr_vec,
       std::vector<std::pair<TreeConstructor::NodeSPtr,
                             TreeConstructor::NodeSPtr>> const& edges_vec);
+
+  // Receiver of a graph as it is built. Nodes and edges may interleave,
+  // each in Edg order; finish() is called once, after the last of them,
+  // and is false if the graph could not be written.
+  class Sink
+  {
+  public:
+    virtual ~Sink() {}
+
+    void dump_method(
+        std::vector<TreeConstructor::NodeSPtr> const& nodesptr_vec,
+        std::vector<std::pair<TreeConstructor::NodeSPtr,
+                              TreeConstructor::NodeSPtr>> const& edges_vec);
+    virtual void dump_node(uint64_t addr, OpCodeType opcode_type) = 0;
+    virtual void dump_edge(uint64_t from_addr, uint64_t to_addr) = 0;
+    virtual bool finish() = 0;
+  };
+
+  // Static visitor for TreeConstructor::traverse(): each node and its out
+  // edges go straight to the sink, as dump_single_node then dump_method
+  // would emit them.
+  template <typename SinkType>
+  struct Emitter
+  {
+    SinkType& sink;
+
+    void operator()(TreeConstructor::NodeSPtr const& node) const
+    {
+      sink.dump_node(node->baseAddr, node->opcode_type);
+      for (auto const& child : node->next_nodes)
+        sink.dump_edge(node->baseAddr, child->baseAddr);
+    }
+  };
+
+  // Incremental Edg writer: nodes are appended as soon as a method is
+  // dumped, edges are spilled to a temporary file and appended on finish()
+  // (the Edg layout wants the node block first), and the node count is
+  // patched in place once it is known. Any I/O error, including no
+  // temporary file for the edges, fails finish().
+  class StreamWriter : public Sink
+  {
+  public:
+    StreamWriter();
+    ~StreamWriter() override;
+
+    void dump_node(uint64_t addr, OpCodeType opcode_type) override;
+    void dump_edge(uint64_t from_addr, uint64_t to_addr) override;
+    bool finish() override;
+
+  private:
+    std::fstream file;
+    std::streampos count_pos;
+    uint32_t node_count = 0;
+    uint64_t edge_count = 0;
+    FILE* edge_spill = nullptr;
+    bool spill_failed = false;
+  };
 }
 }
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include <libdex/DexFile.h>
+
+namespace TreeConstructor
+{
+// On-disk cache of Edg output, keyed by the dex SHA-1 signature, the
+// options that shape the graph and the cache format version.
+//
+// Each entry is a small header followed by the exact Edg bytes the run
+// appended to graph.edg, so a hit is an mmap plus one write: no parse,
+// no decode, no CFG construction. Entries are published with rename()
+// so concurrent processes never see a partial entry, hits refresh the
+// entry mtime, and eviction (oldest mtime first, under an flock on the
+// cache directory) keeps the directory below a byte budget.
+namespace GraphCache
+{
+auto constexpr cache_version = 1u;
+auto constexpr default_max_bytes = 1024ull * 1024 * 1024;
+
+// Empty key when the data is not a plain (unoptimized) dex.
+std::string make_key(uint8_t const* dex_data,
+                     std::size_t dex_length,
+                     std::string const& options_tag);
+
+// Append the cached Edg bytes for key to edg_filename.
+// Returns false on a miss or an unusable entry.
+bool replay(std::string const& cache_dir,
+            std::string const& key,
+            std::string const& edg_filename);
+
+// Store what was appended to edg_filename since begin_offset under key,
+// then evict down to max_bytes.
+void store(std::string const& cache_dir,
+           std::string const& key,
+           std::string const& edg_filename,
+           uint64_t begin_offset,
+           uint64_t max_bytes);
+
+void evict(std::string const& cache_dir, uint64_t max_bytes);
+
+// Current size of a file, 0 if it doesn't exist.
+uint64_t file_size(std::string const& filename);
+}
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <libdex/InstrUtils.h>
+#include <TreeConstructor/Dataflow.h>
+#include <TreeConstructor/TCNode.h>
+
+namespace TreeConstructor
+{
+// Dalvik register liveness over the blocks of a method graph.
+namespace Liveness
+{
+// Registers read and written by each instruction of a method, recorded
+// while it is decoded (one add() per node, in node vector order) and kept
+// in one arena per method. Wide values count as their two registers.
+class RegisterEffects
+{
+public:
+  RegisterEffects() : use_begin(1, 0), def_begin(1, 0) {}
+
+  void add(DecodedInstruction const& insn, InstructionFormat format);
+  void clear();
+
+  std::size_t size() const { return use_begin.size() - 1; }
+  uint16_t const* uses_begin(std::size_t insn) const
+  {
+    return uses.data() + use_begin[insn];
+  }
+  uint16_t const* uses_end(std::size_t insn) const
+  {
+    return uses.data() + use_begin[insn + 1];
+  }
+  uint16_t const* defs_begin(std::size_t insn) const
+  {
+    return defs.data() + def_begin[insn];
+  }
+  uint16_t const* defs_end(std::size_t insn) const
+  {
+    return defs.data() + def_begin[insn + 1];
+  }
+
+private:
+  std::vector<uint32_t> use_begin;
+  std::vector<uint32_t> def_begin;
+  std::vector<uint16_t> uses;
+  std::vector<uint16_t> defs;
+};
+
+// Live registers (bit n is vn) on entry and exit of each block. Blocks
+// only reached through exception handlers are not linked in the method
+// graph and have empty sets.
+struct Result
+{
+  Dataflow::BlockGraph graph;
+  Dataflow::BitMatrix live_in;
+  Dataflow::BitMatrix live_out;
+};
+
+// Registers past registers_size (malformed code) are ignored.
+Result analyze(std::vector<NodeSPtr> const& node_vec,
+               RegisterEffects const& effects,
+               uint16_t registers_size);
+}
+}
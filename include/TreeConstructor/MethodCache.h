@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <TreeConstructor/TCNode.h>
+
+namespace TreeConstructor
+{
+// Position independent copy of one method graph. Offsets are in code
+// units from the first instruction of the code item, so the same template
+// is relocated onto every identical method, whatever dex it comes from.
+struct MethodTemplate
+{
+  struct TemplateNode
+  {
+    uint32_t intern_offset;
+    uint16_t size;
+    OpCode opcode;
+  };
+
+  // Decoded nodes and their next_nodes links (node indices), as left by
+  // construct_node_from_vec. Used to rebuild the graph in memory.
+  std::vector<TemplateNode> nodes;
+  std::vector<std::pair<uint32_t, uint32_t>> links;
+
+  // What the streaming writer emitted for the method: traversal order,
+  // intra-method edges and the CALL nodes whose edge is resolved per dex.
+  std::vector<std::pair<uint32_t, OpCodeType>> emitted_nodes;
+  std::vector<std::pair<uint32_t, uint32_t>> emitted_edges;
+  std::vector<uint32_t> call_sites;
+};
+typedef std::shared_ptr<MethodTemplate const> MethodTemplateSPtr;
+
+// Method graphs keyed by a content hash of the normalized code item, kept
+// for the whole run so that libraries bundled by several APKs are only
+// built once per batch.
+class MethodCache
+{
+public:
+  static std::size_t constexpr default_max_nodes = 4 * 1024 * 1024;
+
+  struct Stats
+  {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t reused_nodes = 0;
+  };
+
+  explicit MethodCache(std::size_t max_nodes = default_max_nodes);
+
+  // nullptr on a miss. Updates the hit/miss counters either way.
+  MethodTemplateSPtr find(std::string const& hash);
+  // Ignored once max_nodes template nodes are held.
+  void insert(std::string const& hash, MethodTemplateSPtr const& method);
+
+  Stats const& stats() const { return total_stats; }
+  // Counters since the previous call, for per-file reporting.
+  Stats take_file_stats();
+
+private:
+  std::unordered_map<std::string, MethodTemplateSPtr> templates;
+  std::size_t max_nodes;
+  std::size_t held_nodes = 0;
+  Stats total_stats;
+  Stats file_stats;
+};
+
+// Record the decoded, linked node vector of a method (no call edges yet).
+void capture_links(MethodTemplate& method,
+                   std::vector<NodeSPtr> const& node_vec);
+
+// Record the binary_traversal output of a method, as StreamWriter would
+// emit it.
+void capture_traversal(
+    MethodTemplate& method,
+    std::vector<NodeSPtr> const& nodesptr_vec,
+    std::vector<std::pair<NodeSPtr, NodeSPtr>> const& edges_vec);
+
+// Same, one node at a time as traverse() visits them.
+void capture_node(MethodTemplate& method, Node const& node);
+
+// Rebuild the linked node vector of a method at entry_addr. The caller
+// fills called_method_info of the CALL nodes.
+std::vector<NodeSPtr> instantiate(MethodTemplate const& method,
+                                  uint32_t entry_addr);
+}
@@ -15,6 +15,7 @@ enum class OpCodeType
 	THROW,
 	SYSCALL,
 	RET,
+	EXTERN,  // stub for a method outside the graph
 };
 
 std::string OpCodeTypeToStr(OpCodeType const& opcodetype);
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <libdex/InstrUtils.h>
+#include <TreeConstructor/Dataflow.h>
+#include <TreeConstructor/Liveness.h>
+#include <TreeConstructor/TCNode.h>
+
+namespace TreeConstructor
+{
+// Sparse conditional constant propagation over the blocks of a method
+// graph: 32-bit constants are tracked per register along the links that
+// can be taken, so that opaque predicates (const/4 v0, 0; if-eqz v0, ...)
+// resolve to a single successor.
+namespace Sccp
+{
+// Operands of each instruction of a method, recorded while it is decoded
+// (one add() per node, in node vector order), with the case table of each
+// switch.
+class Code
+{
+public:
+  struct Case
+  {
+    int32_t key;
+    uint32_t target;  // code unit offset in the method
+  };
+
+  Code() : case_begin(1, 0) {}
+
+  // insns points to the instruction itself, its switch payload is read
+  // from there.
+  void add(DecodedInstruction const& insn, uint32_t insn_offset,
+           u2 const* insns);
+  void clear();
+
+  std::size_t size() const { return operands.size(); }
+  DecodedInstruction const& operator[](std::size_t insn) const
+  {
+    return operands[insn];
+  }
+  Case const* cases_begin(std::size_t insn) const
+  {
+    return cases.data() + case_begin[insn];
+  }
+  Case const* cases_end(std::size_t insn) const
+  {
+    return cases.data() + case_begin[insn + 1];
+  }
+
+private:
+  std::vector<DecodedInstruction> operands;
+  std::vector<uint32_t> case_begin;
+  std::vector<Case> cases;
+};
+
+struct Result
+{
+  Dataflow::BlockGraph graph;
+  std::vector<bool> executable;  // per block
+  // Links of the node vector (from, to node indices) out of an executable
+  // IF or SWITCH that are never taken.
+  std::vector<std::pair<uint32_t, uint32_t>> infeasible;
+};
+
+// Registers start unknown on entry, so parameters are never assumed
+// constant. handlers are the code unit offsets of the catch handlers,
+// which the graph does not link: they are entered as well, with every
+// register unknown. A branch whose known target is not linked in the
+// graph keeps all its links.
+Result analyze(std::vector<NodeSPtr> const& node_vec, Code const& code,
+               Liveness::RegisterEffects const& effects,
+               uint16_t registers_size,
+               std::vector<uint32_t> const& handlers);
+
+// Drop the infeasible links from next_nodes, returning how many went.
+// Nodes only reached through them are then left out of traversals.
+std::size_t prune(std::vector<NodeSPtr> const& node_vec, Result const& result);
+}
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <time.h>
+
+namespace TreeConstructor
+{
+// Per-file phase timings and counters, reported as one JSON object per
+// input file. Timers only read the clocks when stats are enabled, and
+// phases are coarse (a handful of scopes per file, or per class), so this
+// is cheap enough to leave on. Timings and counters are per thread, so
+// concurrent builds each report their own. Memory is process wide, and
+// heap memory is only counted in executables linking the operator new of
+// CountingAllocator.cpp: embedders of libdexgraph see none.
+namespace Stats
+{
+enum class Phase
+{
+  OPEN,       // map, or extract from a zip
+  VERIFY,     // structural verification (-V)
+  PARSE,      // dexFileParse, checksum included
+  CACHE,      // graph cache lookup and store
+  CLASSES,    // class data, decode and CFG construction
+  CALLS,      // process_calls
+  TRAVERSAL,  // binary_traversal
+  WRITE,      // Edg output
+  TOTAL,
+  COUNT
+};
+
+enum class Counter
+{
+  CLASSES,
+  METHODS,
+  INSTRUCTIONS,
+  NODES,
+  EDGES,
+  BYTES_WRITTEN,
+  METHODS_SKIPPED,   // over the memory budget, emitted as their entry node
+  STREAM_FALLBACKS,  // over the memory budget, redone with -s
+  CLASSES_FILTERED,  // left out by the class filters
+  EDGES_PRUNED,      // never taken, dropped by constant propagation
+  CALLS_SHARPENED,   // retargeted by the inferred receiver type
+  COUNT
+};
+
+// Subsystems live and peak memory is attributed to. Heap memory goes to
+// the MemoryScope of the allocating thread (OTHER outside of any), and is
+// given back to that same subsystem when freed.
+enum class Memory
+{
+  DEX_MAPPING,  // mapped dex file, see track()
+  CLASS_DATA,   // decoded class_data_item, see track()
+  NODES,        // Node objects
+  EDGES,        // next_nodes, call lists, traversal and edge vectors
+  STRINGS,      // MethodInfo descriptors, method_node_map keys
+  OUTPUT,       // Edg writers and graph cache buffers
+  OTHER,
+  COUNT
+};
+
+void enable(bool enabled);
+bool enabled();
+
+// Clear timings and counters before the next file.
+void reset();
+
+void add(Counter counter, uint64_t value);
+
+// Counters of the calling thread since it started or reset(). Worker
+// threads hand theirs to the thread reporting the file with add().
+typedef std::array<uint64_t, static_cast<std::size_t>(Counter::COUNT)> Counts;
+Counts thread_counts();
+void add(Counts const& counts);
+
+class ScopedTimer
+{
+public:
+  explicit ScopedTimer(Phase phase);
+  ~ScopedTimer();
+
+private:
+  Phase phase;
+  bool active;
+  timespec wall_begin;
+  timespec cpu_begin;
+};
+
+class MemoryScope
+{
+public:
+  explicit MemoryScope(Memory memory);
+  ~MemoryScope();
+
+  MemoryScope(MemoryScope const&) = delete;
+  MemoryScope& operator=(MemoryScope const&) = delete;
+
+private:
+  Memory previous;
+};
+
+// Account memory that does not come from operator new (mappings, libdex
+// mallocs): positive when acquired, negative when released.
+void track(Memory memory, int64_t bytes);
+
+// Called by the operator new and delete of CountingAllocator.cpp: the
+// MemoryScope of this thread, and heap bytes acquired or released.
+Memory allocating_memory();
+void allocated(Memory memory, std::size_t bytes);
+void freed(Memory memory, std::size_t bytes);
+
+// Heap bytes live in every subsystem but DEX_MAPPING, which is file
+// backed and can be paged out.
+uint64_t heap_live_bytes();
+
+// Whether heap_live_bytes() + extra_bytes exceeds budget_bytes, 0 being
+// no budget.
+bool over_memory_budget(uint64_t budget_bytes, uint64_t extra_bytes = 0);
+
+// {"file": ..., "result": ..., "phases": {...}, counters..., "memory": {...}}
+std::string to_json(std::string const& file_name, int result);
+}
+}
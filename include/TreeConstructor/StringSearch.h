@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace TreeConstructor
+{
+// Substring search over a string pool (the string_ids of a dex): posting
+// lists of the strings holding each 3-byte sequence, so that a query only
+// checks the strings sharing its rarest trigram.
+namespace StringSearch
+{
+class Index
+{
+public:
+  // strings[i] is the NUL terminated string i, kept alive by the caller.
+  // The trigrams are collected on threads (0 for one per CPU).
+  explicit Index(std::vector<char const*> strings, unsigned threads = 0);
+
+  // Indices of the strings containing needle (bytes, case sensitive), in
+  // ascending order. Needles under 3 bytes scan the whole pool.
+  std::vector<uint32_t> find(std::string const& needle) const;
+
+  std::size_t size() const { return strings.size(); }
+
+private:
+  std::vector<char const*> strings;
+  std::vector<uint32_t> trigrams;  // sorted, unique
+  std::vector<uint32_t> begin;     // trigrams.size() + 1 offsets
+  std::vector<uint32_t> postings;  // string indices, ascending per trigram
+};
+}
+}
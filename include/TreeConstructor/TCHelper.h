@@ -23,6 +23,16 @@ namespace Helper
 {
 auto constexpr classlist_filename = "class_list.txt";
 auto constexpr graph_filename = "graph.dot";
+auto constexpr edg_filename = "graph.edg";
+auto constexpr metrics_filename = "metrics.tsv";
+auto constexpr liveness_filename = "liveness.txt";
+auto constexpr reachable_filename = "reachable.bin";
+auto constexpr components_filename = "components.tsv";
+auto constexpr icfg_filename = "icfg.edg";
+auto constexpr taint_filename = "taint.txt";
+auto constexpr fields_xref_filename = "fields.xref";
+auto constexpr strings_xref_filename = "strings.xref";
+auto constexpr strings_filename = "strings.txt";
 
 void write(std::basic_string<char> const& filename,
            std::basic_string<char> const& content);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
 #include <memory>
 #include <queue>
@@ -29,13 +30,21 @@ struct Node
   Node(uint32_t const& _baseAddr,
        uint16_t const& _size,
 	     OpCode const& _opcode,
-       MethodInfo const& _called_method_info,
+       MethodInfo _called_method_info,
        uint32_t const& _internal_offset,
-       std::vector<uint32_t> const& _opt_arg_offset);
+       std::vector<uint32_t> _opt_arg_offset);
 
   int count_node() const;
 };
 
+// Depth-first walk from node, calling visitor(NodeSPtr const&) once per
+// reached node in the order binary_traversal reports them. The visitor is
+// a type parameter so that emitters (see Fmt::Edg::Emitter) are inlined
+// and nothing is allocated per node.
+template <typename Visitor>
+void traverse(Node const& node, Visitor&& visitor);
+
+// std::function front ends of traverse().
 typedef std::function<std::string(NodeSPtr const&)> FmtLambda;
 typedef std::function<std::pair<NodeSPtr, std::vector<std::pair<NodeSPtr, NodeSPtr>>>(NodeSPtr const&)> BinaryFmtLambda;
 std::string dot_traversal(Node const& node,
@@ -51,4 +60,112 @@ std::vector<NodeSPtr> get_method_call_nodes(
 
 void process_calls(std::map<MethodInfo, NodeSPtr> &map,
                    std::vector<NodeSPtr> &call_node_vec);
+
+// Break the next_nodes cycles (loops, back edges) of a method graph
+// so that its nodes are actually freed once the vector goes away.
+void release_nodes(std::vector<NodeSPtr> const &node_vec);
+
+// Same for every node reachable from the roots, call edges included, when
+// the per-method node vectors are gone (unreachable code is not found).
+void release_graph(std::map<MethodInfo, NodeSPtr> const &method_node_map);
+
+namespace detail
+{
+  inline bool contains(std::vector<NodeSPtr> const& vec, NodeSPtr const& value)
+  {
+    return std::find(vec.begin(), vec.end(), value) != vec.end();
+  }
+
+  inline bool contains_addr(std::vector<NodeSPtr> const& vec, uint32_t addr)
+  {
+    return std::find_if(vec.begin(), vec.end(), [&](NodeSPtr const& node) {
+             return node->baseAddr == addr;
+           }) != vec.end();
+  }
+
+  // Descend from current_node via the leftmost child, stacking every node
+  // not stacked yet.
+  inline void left_traversal_stack(std::vector<NodeSPtr>& visiting_stack,
+                                   std::vector<NodeSPtr> const& visited_vec,
+                                   NodeSPtr& current_node)
+  {
+    while (!current_node->next_nodes.empty())
+    {
+      if (contains(visiting_stack, current_node))
+        break;
+      visiting_stack.push_back(current_node);
+      auto const& left_child = current_node->next_nodes[0];
+      if (!contains(visited_vec, left_child))
+        current_node = left_child;
+    }
+    if (!contains(visiting_stack, current_node))
+      visiting_stack.push_back(current_node);
+  }
+
+  // First child of the top of the stack neither visited nor stacked.
+  inline NodeSPtr next_unvisited_child(std::vector<NodeSPtr> const& visiting_stack,
+                                       std::vector<NodeSPtr> const& visited_vec)
+  {
+    for (auto const& child : visiting_stack.back()->next_nodes)
+    {
+      if (!contains(visited_vec, child) &&
+          !contains_addr(visiting_stack, child->baseAddr))
+        return child;
+    }
+    return nullptr;
+  }
+
+  template <typename Visitor>
+  void destack_and_visit(std::vector<NodeSPtr>& visiting_stack,
+                         std::vector<NodeSPtr>& visited_vec,
+                         Visitor& visitor)
+  {
+    auto const popped_node = visiting_stack.back();
+    visiting_stack.pop_back();
+    if (!contains(visited_vec, popped_node))
+    {
+      visitor(popped_node);
+      visited_vec.push_back(popped_node);
+    }
+  }
+}
+
+template <typename Visitor>
+void traverse(Node const& node, Visitor&& visitor)
+{
+  std::vector<NodeSPtr> visiting_stack;
+  std::vector<NodeSPtr> visited_vec;
+  NodeSPtr current_node = std::make_shared<Node>(node);
+  do
+  {
+    detail::left_traversal_stack(visiting_stack, visited_vec, current_node);
+
+    // Visit the nodes with at most one child on top of the stack
+    while (!visiting_stack.empty() &&
+           visiting_stack.back()->next_nodes.size() < 2)
+    {
+      if (!detail::contains_addr(visited_vec, visiting_stack.back()->baseAddr))
+        detail::destack_and_visit(visiting_stack, visited_vec, visitor);
+      else
+        visiting_stack.pop_back();
+    }
+
+    // Then go down the next child of a branch, or visit it once all are
+    if (!visiting_stack.empty())
+    {
+      auto const next_child =
+          detail::next_unvisited_child(visiting_stack, visited_vec);
+      if (next_child != nullptr)
+      {
+        current_node = next_child;
+      }
+      else
+      {
+        detail::destack_and_visit(visiting_stack, visited_vec, visitor);
+        if (!visiting_stack.empty())
+          current_node = visiting_stack.back();
+      }
+    }
+  } while (!visiting_stack.empty());
+}
 }
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <TreeConstructor/Liveness.h>
+#include <TreeConstructor/Sccp.h>
+#include <TreeConstructor/TCNode.h>
+
+namespace TreeConstructor
+{
+// Source to sink taint over the blocks of a method graph, summarised per
+// method so that callers apply the summary at each call site instead of
+// walking into the callee again. Values carry labels: one bit per
+// incoming argument slot (the ins registers, wide values taking two) and
+// one for data returned by a source.
+namespace Taint
+{
+typedef uint64_t Labels;
+
+auto constexpr SOURCE_LABEL = 63;
+auto constexpr MAX_SLOTS = 63;  // argument slots past these are not tracked
+
+Labels constexpr source_bit() { return Labels(1) << SOURCE_LABEL; }
+
+// An invoke a witness goes through: code unit offset in the caller, and
+// the argument slot a sinking value is passed in.
+struct Site
+{
+  uint32_t offset = 0;
+  uint32_t callee = 0;  // method_idx
+  uint8_t slot = 0;
+};
+
+struct Summary
+{
+  Labels to_return = 0;  // what the result may carry
+  Labels to_sink = 0;    // argument slots that may reach a sink
+  bool leak = false;     // a source reaches a sink in the method itself
+
+  // Witnesses, the first one found for each flow
+  Site return_source;                           // SOURCE into the result
+  std::vector<std::pair<uint8_t, Site>> sinks;  // per to_sink slot
+  Site leak_source;
+  Site leak_sink;
+
+  bool same_flows(Summary const& other) const
+  {
+    return to_return == other.to_return && to_sink == other.to_sink &&
+           leak == other.leak;
+  }
+  Site const* sink_site(uint8_t slot) const;
+  // Take the witnesses of the flows previous already had. Iterating a
+  // recursion, this keeps each witness to the callee summaries it was
+  // found with, so that following them down always ends.
+  void keep_witnesses(Summary const& previous);
+};
+
+// What an invoke of a method does with the values passed. Methods neither
+// analysed nor listed (library code) return the union of their
+// arguments, and taint all of them with it (a receiver collecting them).
+struct Callee
+{
+  bool source = false;
+  bool sink = false;
+  Summary const* summary = nullptr;
+};
+
+typedef std::function<Callee(uint32_t method_idx)> CalleeLookup;
+
+// Fields and statics are not tracked, array and instance stores taint the
+// array or object. Blocks the graph does not link (exception handlers)
+// are analysed from clean registers.
+Summary summarize(std::vector<NodeSPtr> const& node_vec, Sccp::Code const& code,
+                  Liveness::RegisterEffects const& effects,
+                  uint16_t registers_size, uint16_t ins_size,
+                  CalleeLookup const& callee);
+}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace TreeConstructor
+{
+// Chrome / Perfetto trace-event recorder ("X" complete events).
+//
+// Each thread appends to its own fixed-size ring buffer (single writer, no
+// locks once the buffer is registered); the oldest events are overwritten
+// when it wraps. Everything is written out as JSON at exit, after worker
+// threads have been joined. When tracing is off a Span costs one branch.
+namespace Trace
+{
+auto constexpr default_min_span_us = 100u;
+
+// Start recording; the trace is written to filename at exit. Spans marked
+// IF_SLOW that last less than min_span_us are dropped.
+bool start(std::string const& filename, uint64_t min_span_us);
+bool enabled();
+
+class Span
+{
+public:
+  enum Keep
+  {
+    ALWAYS,
+    IF_SLOW,
+  };
+
+  // name must be a literal. detail and sub_detail (joined with "->") must
+  // stay valid until the span ends, e.g. strings of the mapped dex.
+  Span(char const* name,
+       Keep keep,
+       char const* detail = nullptr,
+       char const* sub_detail = nullptr);
+  ~Span();
+
+  // For details only known (or only safe to look up) after the span began.
+  void set_detail(char const* detail, char const* sub_detail = nullptr);
+
+  Span(Span const&) = delete;
+  Span& operator=(Span const&) = delete;
+
+private:
+  char const* name;
+  char const* detail;
+  char const* sub_detail;
+  Keep keep;
+  bool active;
+  uint64_t begin_ns;
+};
+}
+}
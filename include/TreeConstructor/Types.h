@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <TreeConstructor/Liveness.h>
+#include <TreeConstructor/Sccp.h>
+#include <TreeConstructor/TCNode.h>
+
+namespace TreeConstructor
+{
+// Class of the reference in each register over the blocks of a method
+// graph, as far as the instructions fixing it tell, to find the receiver
+// of virtual and interface calls.
+namespace Types
+{
+auto constexpr NO_TYPE = 0xffffffffu;
+
+struct Type
+{
+  uint32_t type_idx = NO_TYPE;
+  bool exact = false;  // allocated by new-instance, not a subclass
+};
+
+// What holds on entry and what the invokes return.
+struct Seeds
+{
+  std::vector<Type> entry;  // per register, the parameters
+  // Declared return class of a method_idx, or NO_TYPE.
+  std::function<uint32_t(uint32_t method_idx)> return_type;
+};
+
+// Receiver type of each invoke-virtual and invoke-interface reached from
+// the entry or a catch handler (node vector order); NO_TYPE for other
+// instructions and where paths disagree. new-instance and check-cast fix
+// a type, moves copy it, anything else writing a register forgets it.
+// handlers are the code unit offsets of the catch handlers, which the
+// graph does not link: every register is unknown there.
+std::vector<Type> receivers(std::vector<NodeSPtr> const& node_vec,
+                            Sccp::Code const& code,
+                            Liveness::RegisterEffects const& effects,
+                            uint16_t registers_size, Seeds const& seeds,
+                            std::vector<uint32_t> const& handlers);
+}
+}
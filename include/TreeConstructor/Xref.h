@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace TreeConstructor
+{
+// Cross-references from the instructions of a dex to the ids they name
+// (field_idx, string_idx), grouped by id so that the sites of one id are
+// found in constant time.
+namespace Xref
+{
+// An instruction: its method and code unit offset.
+struct Site
+{
+  uint32_t method_idx;
+  uint32_t offset;
+};
+
+class Index
+{
+public:
+  // Record a reference, in any id order. Seen by sites() after finish().
+  void add(uint32_t id, Site const& site);
+  // Group what was added by id (CSR), keeping the order sites were added
+  // in. References to ids past id_count are dropped.
+  void finish(uint32_t id_count);
+  // Forget everything, added or finished.
+  void clear();
+
+  // Sites of id, empty past id_count().
+  std::pair<Site const*, Site const*> sites(uint32_t id) const;
+  std::size_t id_count() const { return begin.empty() ? 0 : begin.size() - 1; }
+  std::size_t site_count() const { return grouped.size(); }
+
+  // The CSR arrays: the sites of id are grouped[begin[id]] up to
+  // grouped[begin[id + 1]].
+  std::vector<uint32_t> const& offsets() const { return begin; }
+  std::vector<Site> const& all_sites() const { return grouped; }
+
+private:
+  std::vector<std::pair<uint32_t, Site>> pending;
+  std::vector<uint32_t> begin;
+  std::vector<Site> grouped;
+};
+}
+}
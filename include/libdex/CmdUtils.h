@@ -61,6 +61,14 @@ typedef enum UnzipToFileResult {
 UnzipToFileResult dexOpenAndMap(const char* fileName, const char* tempFileName,
     MemMapping* pMap, bool quiet);
 
+/*
+ * Same as dexOpenAndMap(), but the file is mapped private and
+ * copy-on-write (initially read-only), so the caller can flip it to
+ * read-write with sysChangeMapAccess() and byte-swap it in place.
+ */
+UnzipToFileResult dexOpenAndMapWritable(const char* fileName,
+    const char* tempFileName, MemMapping* pMap, bool quiet);
+
 /*
  * Utility function to open a Zip archive, find "classes.dex", and extract
  * it to a file.
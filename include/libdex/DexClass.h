@@ -106,6 +106,20 @@ bool dexReadAndVerifyClassDataMethod(const u1** pData, const u1* pLimit,
  * are valid. */
 DexClassData* dexReadAndVerifyClassData(const u1** pData, const u1* pLimit);
 
+/* Verify class_def "idx" the first time it is touched, when the DexFile
+ * was parsed with kDexParseVerifyLazy: its class_data_item and every code
+ * item it references are checked against the file bounds, and the outcome
+ * is cached in the DexFile bitmaps so later calls are a bit test. Always
+ * returns true (without checking anything) for eagerly parsed files. */
+bool dexVerifyClassDef(const DexFile* pDexFile, u4 idx);
+
+/* The class data of class_def "idx", as dexReadAndVerifyClassData() reads
+ * it, after dexVerifyClassDef(): the first time a lazily parsed class is
+ * touched, it is verified from the same decode. Returns NULL if the class
+ * failed verification or its data could not be read; the result must
+ * subsequently be free()d. */
+DexClassData* dexReadVerifiedClassData(const DexFile* pDexFile, u4 idx);
+
 /*
  * Get the DexCode for a DexMethod.  Returns NULL if the class is native
  * or abstract.
@@ -538,6 +538,13 @@ typedef struct DexFile {
     /* track memory overhead for auxillary structures */
     int                 overhead;
 
+    /*
+     * Per-class_def verification bitmaps, only allocated when parsing with
+     * kDexParseVerifyLazy (see dexVerifyClassDef).
+     */
+    u4*                 pClassVerifiedBits;
+    u4*                 pClassFailedBits;
+
     /* additional app-specific data structures associated with the DEX */
     //void*               auxData;
 } DexFile;
@@ -559,15 +566,18 @@ enum {
     kDexParseDefault            = 0,
     kDexParseVerifyChecksum     = 1,
     kDexParseContinueOnError    = (1 << 1),
+    kDexParseVerifyLazy         = (1 << 2),     /* see dexVerifyClassDef */
 };
 
 /*
  * Correct the byte ordering in a memory-mapped DEX file.  This is only
  * required for code that opens "raw" DEX files, such as the DEX optimizer.
+ * The "Parallel" flavor splits large sections across "numThreads" threads.
  *
  * Return 0 on success.
  */
 int dexFixByteOrdering(u1* addr, int len);
+int dexFixByteOrderingParallel(u1* addr, int len, int numThreads);
 
 /*
  * Compute DEX checksum.
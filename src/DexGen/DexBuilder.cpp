@@ -0,0 +1,573 @@
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <tuple>
+
+#include <zlib.h>
+
+#include <DexGen/DexBuilder.h>
+#include <libdex/DexFile.h>
+#include <libdex/OpCode.h>
+#include <libdex/sha1.h>
+
+namespace DexGen
+{
+CodeBuilder& CodeBuilder::unit(uint16_t code_unit)
+{
+  insns.push_back(code_unit);
+  return *this;
+}
+
+CodeBuilder& CodeBuilder::units(std::vector<uint16_t> const& code_units)
+{
+  insns.insert(insns.end(), code_units.begin(), code_units.end());
+  return *this;
+}
+
+CodeBuilder& CodeBuilder::append(CodeBuilder const& other)
+{
+  auto const base = size();
+  for (auto const& fixup : other.method_fixups)
+    method_fixups.push_back(std::make_pair(base + fixup.first, fixup.second));
+  for (auto const& fixup : other.field_fixups)
+    field_fixups.push_back(std::make_pair(base + fixup.first, fixup.second));
+  for (auto const& fixup : other.type_fixups)
+    type_fixups.push_back(std::make_pair(base + fixup.first, fixup.second));
+  for (auto const& fixup : other.string_fixups)
+    string_fixups.push_back(std::make_pair(base + fixup.first, fixup.second));
+  for (auto const& payload : other.switch_payloads)
+    switch_payloads.push_back(std::make_pair(base + payload.first, payload.second));
+  return units(other.insns);
+}
+
+CodeBuilder& CodeBuilder::const4(uint8_t reg, int8_t value)
+{
+  return unit(0x12 | (reg & 0xf) << 8 | (value & 0xf) << 12);
+}
+
+CodeBuilder& CodeBuilder::if_eqz(uint8_t reg, int16_t offset)
+{
+  return unit(0x38 | reg << 8).unit((uint16_t)offset);
+}
+
+CodeBuilder& CodeBuilder::goto16(int16_t offset)
+{
+  return unit(0x29).unit((uint16_t)offset);
+}
+
+CodeBuilder& CodeBuilder::invoke(uint8_t opcode, MethodRef const& method,
+                                 std::vector<uint8_t> const& args)
+{
+  if (args.size() > 5)
+    throw std::invalid_argument("more than 5 invoke arguments");
+  uint16_t regs[5] = {};
+  std::copy(args.begin(), args.end(), regs);
+  method_fixups.push_back(std::make_pair(size() + 1, method));
+  return unit((uint16_t)(opcode | (regs[4] & 0xf) << 8 | args.size() << 12))
+      .unit(0)
+      .unit((uint16_t)((regs[0] & 0xf) | (regs[1] & 0xf) << 4 |
+                       (regs[2] & 0xf) << 8 | (regs[3] & 0xf) << 12));
+}
+
+CodeBuilder& CodeBuilder::invoke_static(MethodRef const& method)
+{
+  return invoke(0x71, method, {});
+}
+
+CodeBuilder& CodeBuilder::invoke_virtual(MethodRef const& method, uint8_t reg)
+{
+  return invoke(0x6e, method, { reg });
+}
+
+CodeBuilder& CodeBuilder::invoke_interface(MethodRef const& method, uint8_t reg)
+{
+  return invoke(0x72, method, { reg });
+}
+
+CodeBuilder& CodeBuilder::new_instance(uint8_t reg, std::string const& descriptor)
+{
+  type_fixups.push_back(std::make_pair(size() + 1, descriptor));
+  return unit(0x22 | reg << 8).unit(0);
+}
+
+CodeBuilder& CodeBuilder::check_cast(uint8_t reg, std::string const& descriptor)
+{
+  type_fixups.push_back(std::make_pair(size() + 1, descriptor));
+  return unit(0x1f | reg << 8).unit(0);
+}
+
+CodeBuilder& CodeBuilder::const_string(uint8_t reg, std::string const& value)
+{
+  string_fixups.push_back(std::make_pair(size() + 1, value));
+  return unit(0x1a | reg << 8).unit(0);
+}
+
+CodeBuilder& CodeBuilder::static_field(uint8_t opcode, uint8_t reg,
+                                       FieldRef const& field)
+{
+  field_fixups.push_back(std::make_pair(size() + 1, field));
+  return unit(opcode | reg << 8).unit(0);
+}
+
+CodeBuilder& CodeBuilder::instance_field(uint8_t opcode, uint8_t reg,
+                                         uint8_t object, FieldRef const& field)
+{
+  field_fixups.push_back(std::make_pair(size() + 1, field));
+  return unit((uint16_t)(opcode | (reg & 0xf) << 8 | (object & 0xf) << 12))
+      .unit(0);
+}
+
+CodeBuilder& CodeBuilder::packed_switch(uint8_t reg,
+                                        std::vector<int32_t> const& targets)
+{
+  switch_payloads.push_back(std::make_pair(size(), targets));
+  return unit(0x2b | reg << 8).unit(0).unit(0);
+}
+
+CodeBuilder& CodeBuilder::move_result(uint8_t reg)
+{
+  return unit(0x0a | reg << 8);
+}
+
+CodeBuilder& CodeBuilder::return_value(uint8_t reg)
+{
+  return unit(0x0f | reg << 8);
+}
+
+CodeBuilder& CodeBuilder::return_void()
+{
+  return unit(0x0e);
+}
+
+CodeBuilder& CodeBuilder::nop()
+{
+  return unit(0x00);
+}
+
+namespace
+{
+  auto constexpr object_descriptor = "Ljava/lang/Object;";
+  auto constexpr void_descriptor = "V";
+  auto constexpr header_size = 0x70u;
+  auto constexpr method_access_flags = ACC_PUBLIC | ACC_STATIC;
+
+  class ByteWriter
+  {
+  public:
+    std::vector<uint8_t> bytes;
+
+    uint32_t pos() const { return (uint32_t)bytes.size(); }
+
+    void u1(uint8_t value) { bytes.push_back(value); }
+    void u2(uint16_t value)
+    {
+      u1(value & 0xff);
+      u1(value >> 8);
+    }
+    void u4(uint32_t value)
+    {
+      u2(value & 0xffff);
+      u2(value >> 16);
+    }
+    void uleb128(uint32_t value)
+    {
+      do
+      {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        u1(value != 0 ? byte | 0x80 : byte);
+      } while (value != 0);
+    }
+    void align4()
+    {
+      while (pos() % 4 != 0)
+        u1(0);
+    }
+    void patch_u4(uint32_t at, uint32_t value)
+    {
+      for (auto i = 0; i < 4; i++)
+        bytes[at + i] = (value >> (8 * i)) & 0xff;
+    }
+  };
+
+  typedef std::tuple<std::string, std::string, std::string> FieldKey;
+
+  FieldKey field_key(FieldRef const& field)
+  {
+    return FieldKey(field.class_descriptor, field.name, field.type_descriptor);
+  }
+
+  // Code units with method, field, type and string references resolved
+  // and switch payloads laid out after the last instruction.
+  std::vector<uint16_t> finish_code(CodeBuilder const& code,
+                                    std::map<std::pair<std::string, std::string>,
+                                             uint32_t> const& method_index,
+                                    std::map<FieldKey, uint32_t> const& field_index,
+                                    std::map<std::string, uint32_t> const& type_index,
+                                    std::map<std::string, uint32_t> const& string_index)
+  {
+    auto insns = code.insns;
+    for (auto const& fixup : code.method_fixups)
+    {
+      auto const idx = method_index.at(std::make_pair(
+          fixup.second.class_descriptor, fixup.second.name));
+      insns[fixup.first] = (uint16_t)idx;
+    }
+    for (auto const& fixup : code.field_fixups)
+      insns[fixup.first] = (uint16_t)field_index.at(field_key(fixup.second));
+    for (auto const& fixup : code.type_fixups)
+      insns[fixup.first] = (uint16_t)type_index.at(fixup.second);
+    for (auto const& fixup : code.string_fixups)
+    {
+      auto const idx = string_index.at(fixup.second);
+      if (idx > 0xffff)
+        throw std::length_error("const-string index past 16 bits");
+      insns[fixup.first] = (uint16_t)idx;
+    }
+
+    for (auto const& payload : code.switch_payloads)
+    {
+      // Payloads must be 4-byte aligned, insns start 4-byte aligned
+      if (insns.size() % 2 != 0)
+        insns.push_back(0x00);
+      auto const payload_offset = (int32_t)(insns.size() - payload.first);
+      insns[payload.first + 1] = payload_offset & 0xffff;
+      insns[payload.first + 2] = (uint32_t)payload_offset >> 16;
+
+      insns.push_back(kPackedSwitchSignature);
+      insns.push_back((uint16_t)payload.second.size());
+      insns.push_back(0);   // first_key
+      insns.push_back(0);
+      for (auto const target : payload.second)
+      {
+        insns.push_back(target & 0xffff);
+        insns.push_back((uint32_t)target >> 16);
+      }
+    }
+    return insns;
+  }
+}
+
+std::vector<uint8_t> build(std::vector<ClassDef> const& classes)
+{
+  // Strings, types, field and method ids, all in the order the format
+  // mandates
+  std::set<std::string> string_set = { object_descriptor, void_descriptor };
+  std::set<std::string> type_set = { object_descriptor, void_descriptor };
+  std::set<FieldKey> field_set;
+  std::set<std::pair<std::string, std::string>> method_set;
+  std::set<std::pair<std::string, std::string>> defined_methods;
+  for (auto const& class_def : classes)
+  {
+    string_set.insert(class_def.descriptor);
+    type_set.insert(class_def.descriptor);
+    string_set.insert(class_def.superclass);
+    type_set.insert(class_def.superclass);
+    string_set.insert(class_def.interfaces.begin(), class_def.interfaces.end());
+    type_set.insert(class_def.interfaces.begin(), class_def.interfaces.end());
+    for (auto const& method : class_def.methods)
+    {
+      string_set.insert(method.name);
+      method_set.emplace(class_def.descriptor, method.name);
+      if (!defined_methods.emplace(class_def.descriptor, method.name).second)
+        throw std::invalid_argument("duplicate method " + class_def.descriptor +
+                                    "->" + method.name);
+      for (auto const& fixup : method.code.method_fixups)
+      {
+        string_set.insert(fixup.second.class_descriptor);
+        string_set.insert(fixup.second.name);
+        type_set.insert(fixup.second.class_descriptor);
+        method_set.emplace(fixup.second.class_descriptor, fixup.second.name);
+      }
+      for (auto const& fixup : method.code.field_fixups)
+      {
+        string_set.insert(fixup.second.class_descriptor);
+        string_set.insert(fixup.second.name);
+        string_set.insert(fixup.second.type_descriptor);
+        type_set.insert(fixup.second.class_descriptor);
+        type_set.insert(fixup.second.type_descriptor);
+        field_set.insert(field_key(fixup.second));
+      }
+      for (auto const& fixup : method.code.type_fixups)
+      {
+        string_set.insert(fixup.second);
+        type_set.insert(fixup.second);
+      }
+      for (auto const& fixup : method.code.string_fixups)
+        string_set.insert(fixup.second);
+    }
+  }
+
+  std::vector<std::string> const strings(string_set.begin(), string_set.end());
+  std::map<std::string, uint32_t> string_index;
+  for (auto const& str : strings)
+    string_index.emplace(str, (uint32_t)string_index.size());
+
+  // Sorted by string index, which is the string order
+  std::vector<std::string> const types(type_set.begin(), type_set.end());
+  std::map<std::string, uint32_t> type_index;
+  for (auto const& type : types)
+    type_index.emplace(type, (uint32_t)type_index.size());
+
+  // Sorted by class type index, then name string index, then type index
+  std::vector<FieldKey> fields(field_set.begin(), field_set.end());
+  std::sort(fields.begin(), fields.end(),
+            [&](auto const& lhs, auto const& rhs) {
+              return std::make_tuple(type_index[std::get<0>(lhs)],
+                                     string_index[std::get<1>(lhs)],
+                                     type_index[std::get<2>(lhs)]) <
+                     std::make_tuple(type_index[std::get<0>(rhs)],
+                                     string_index[std::get<1>(rhs)],
+                                     type_index[std::get<2>(rhs)]);
+            });
+  std::map<FieldKey, uint32_t> field_index;
+  for (auto const& field : fields)
+    field_index.emplace(field, (uint32_t)field_index.size());
+
+  // Sorted by class type index, then name string index
+  std::vector<std::pair<std::string, std::string>> methods(method_set.begin(),
+                                                           method_set.end());
+  std::sort(methods.begin(), methods.end(),
+            [&](auto const& lhs, auto const& rhs) {
+              return std::make_pair(type_index[lhs.first], string_index[lhs.second]) <
+                     std::make_pair(type_index[rhs.first], string_index[rhs.second]);
+            });
+  std::map<std::pair<std::string, std::string>, uint32_t> method_index;
+  for (auto const& method : methods)
+    method_index.emplace(method, (uint32_t)method_index.size());
+
+  if (types.size() > 0x10000 || fields.size() > 0x10000 ||
+      methods.size() > 0x10000)
+    throw std::length_error("too many types, fields or methods for one dex");
+
+  // Fixed-size sections
+  auto const string_ids_off = header_size;
+  auto const type_ids_off = string_ids_off + 4 * (uint32_t)strings.size();
+  auto const proto_ids_off = type_ids_off + 4 * (uint32_t)types.size();
+  auto const field_ids_off = proto_ids_off + 12;
+  auto const method_ids_off = field_ids_off + 8 * (uint32_t)fields.size();
+  auto const class_defs_off = method_ids_off + 8 * (uint32_t)methods.size();
+  auto const data_off = class_defs_off + 32 * (uint32_t)classes.size();
+
+  ByteWriter dex;
+  dex.bytes.resize(data_off, 0);
+
+  // Interface type lists
+  std::vector<uint32_t> interfaces_offsets;
+  uint32_t type_list_count = 0;
+  uint32_t first_type_list_off = 0;
+  for (auto const& class_def : classes)
+  {
+    if (class_def.interfaces.empty())
+    {
+      interfaces_offsets.push_back(0);
+      continue;
+    }
+    dex.align4();
+    if (type_list_count++ == 0)
+      first_type_list_off = dex.pos();
+    interfaces_offsets.push_back(dex.pos());
+    dex.u4((uint32_t)class_def.interfaces.size());
+    for (auto const& type : class_def.interfaces)
+      dex.u2((uint16_t)type_index[type]);
+  }
+
+  // Code items
+  std::map<std::pair<std::string, std::string>, uint32_t> code_offsets;
+  uint32_t code_count = 0;
+  uint32_t first_code_off = 0;
+  for (auto const& class_def : classes)
+  {
+    for (auto const& method : class_def.methods)
+    {
+      dex.align4();
+      if (code_count++ == 0)
+        first_code_off = dex.pos();
+      code_offsets[std::make_pair(class_def.descriptor, method.name)] = dex.pos();
+
+      auto const insns = finish_code(method.code, method_index, field_index,
+                                      type_index, string_index);
+      dex.u2(method.registers);
+      dex.u2(method.ins);
+      dex.u2(0);  // outs
+      dex.u2((uint16_t)method.tries.size());
+      dex.u4(0);  // debug info
+      dex.u4((uint32_t)insns.size());
+      for (auto const code_unit : insns)
+        dex.u2(code_unit);
+      if (method.tries.empty())
+        continue;
+
+      // try_items, then one catch-all encoded_catch_handler per try
+      if (insns.size() % 2 != 0)
+        dex.u2(0);
+      ByteWriter handlers;
+      handlers.uleb128((uint32_t)method.tries.size());
+      for (auto const& block : method.tries)
+      {
+        dex.u4(block.start);
+        dex.u2(block.count);
+        dex.u2((uint16_t)handlers.pos());
+        handlers.u1(0);  // sleb128 0: no typed handlers, a catch-all
+        handlers.uleb128(block.handler);
+      }
+      dex.bytes.insert(dex.bytes.end(), handlers.bytes.begin(),
+                       handlers.bytes.end());
+    }
+  }
+
+  // Class data
+  std::vector<uint32_t> class_data_offsets;
+  uint32_t class_data_count = 0;
+  uint32_t first_class_data_off = dex.pos();
+  for (auto const& class_def : classes)
+  {
+    if (class_def.methods.empty())
+    {
+      class_data_offsets.push_back(0);
+      continue;
+    }
+    class_data_count++;
+    class_data_offsets.push_back(dex.pos());
+
+    std::vector<std::pair<uint32_t, uint32_t>> direct_methods;
+    for (auto const& method : class_def.methods)
+    {
+      auto const key = std::make_pair(class_def.descriptor, method.name);
+      direct_methods.push_back(std::make_pair(method_index[key], code_offsets[key]));
+    }
+    std::sort(direct_methods.begin(), direct_methods.end());
+
+    dex.uleb128(0);   // static fields
+    dex.uleb128(0);   // instance fields
+    dex.uleb128((uint32_t)direct_methods.size());
+    dex.uleb128(0);   // virtual methods
+    uint32_t last_idx = 0;
+    for (auto const& method : direct_methods)
+    {
+      dex.uleb128(method.first - last_idx);
+      dex.uleb128(method_access_flags);
+      dex.uleb128(method.second);
+      last_idx = method.first;
+    }
+  }
+
+  // String data
+  auto const string_data_off = dex.pos();
+  std::vector<uint32_t> string_data_offsets;
+  for (auto const& str : strings)
+  {
+    string_data_offsets.push_back(dex.pos());
+    dex.uleb128((uint32_t)str.size());
+    for (auto const c : str)
+      dex.u1((uint8_t)c);
+    dex.u1(0);
+  }
+
+  // Map list
+  dex.align4();
+  auto const map_off = dex.pos();
+  std::vector<std::vector<uint32_t>> map_items = {
+    { kDexTypeHeaderItem, 1, 0 },
+    { kDexTypeStringIdItem, (uint32_t)strings.size(), string_ids_off },
+    { kDexTypeTypeIdItem, (uint32_t)types.size(), type_ids_off },
+    { kDexTypeProtoIdItem, 1, proto_ids_off },
+    { kDexTypeFieldIdItem, (uint32_t)fields.size(), field_ids_off },
+    { kDexTypeMethodIdItem, (uint32_t)methods.size(), method_ids_off },
+    { kDexTypeClassDefItem, (uint32_t)classes.size(), class_defs_off },
+  };
+  if (type_list_count != 0)
+    map_items.push_back({ kDexTypeTypeList, type_list_count,
+                          first_type_list_off });
+  if (code_count != 0)
+    map_items.push_back({ kDexTypeCodeItem, code_count, first_code_off });
+  if (class_data_count != 0)
+    map_items.push_back({ kDexTypeClassDataItem, class_data_count,
+                          first_class_data_off });
+  map_items.push_back({ kDexTypeStringDataItem, (uint32_t)strings.size(),
+                        string_data_off });
+  map_items.push_back({ kDexTypeMapList, 1, map_off });
+  // Empty sections are left out of the map
+  map_items.erase(std::remove_if(map_items.begin(), map_items.end(),
+                                 [](auto const& item) { return item[1] == 0; }),
+                  map_items.end());
+  dex.u4((uint32_t)map_items.size());
+  for (auto const& item : map_items)
+  {
+    dex.u2((uint16_t)item[0]);
+    dex.u2(0);
+    dex.u4(item[1]);
+    dex.u4(item[2]);
+  }
+
+  // Id sections and class defs
+  ByteWriter ids;
+  for (auto const offset : string_data_offsets)
+    ids.u4(offset);
+  for (auto const& type : types)
+    ids.u4(string_index[type]);
+  ids.u4(string_index[void_descriptor]);   // shorty "V"
+  ids.u4(type_index[void_descriptor]);
+  ids.u4(0);                               // no parameters
+  for (auto const& field : fields)
+  {
+    ids.u2((uint16_t)type_index[std::get<0>(field)]);
+    ids.u2((uint16_t)type_index[std::get<2>(field)]);
+    ids.u4(string_index[std::get<1>(field)]);
+  }
+  for (auto const& method : methods)
+  {
+    ids.u2((uint16_t)type_index[method.first]);
+    ids.u2(0);
+    ids.u4(string_index[method.second]);
+  }
+  for (std::size_t i = 0; i < classes.size(); i++)
+  {
+    ids.u4(type_index[classes[i].descriptor]);
+    ids.u4(ACC_PUBLIC);
+    ids.u4(type_index[classes[i].superclass]);
+    ids.u4(interfaces_offsets[i]);
+    ids.u4(kDexNoIndex);  // source file
+    ids.u4(0);            // annotations
+    ids.u4(class_data_offsets[i]);
+    ids.u4(0);            // static values
+  }
+  std::copy(ids.bytes.begin(), ids.bytes.end(), dex.bytes.begin() + header_size);
+
+  // Header
+  auto const file_size = dex.pos();
+  std::vector<uint32_t> const header_words = {
+    file_size, header_size, kDexEndianConstant, 0, 0, map_off,
+    (uint32_t)strings.size(), string_ids_off,
+    (uint32_t)types.size(), type_ids_off,
+    1, proto_ids_off,
+    (uint32_t)fields.size(), fields.empty() ? 0 : field_ids_off,
+    (uint32_t)methods.size(), method_ids_off,
+    (uint32_t)classes.size(), class_defs_off,
+    file_size - data_off, data_off,
+  };
+  std::copy(DEX_MAGIC, DEX_MAGIC + 4, dex.bytes.begin());
+  std::copy(DEX_MAGIC_VERS, DEX_MAGIC_VERS + 4, dex.bytes.begin() + 4);
+  for (std::size_t i = 0; i < header_words.size(); i++)
+    dex.patch_u4(32 + 4 * (uint32_t)i, header_words[i]);
+
+  SHA1_CTX sha1;
+  SHA1Init(&sha1);
+  SHA1Update(&sha1, dex.bytes.data() + 32, file_size - 32);
+  SHA1Final(dex.bytes.data() + 12, &sha1);
+  dex.patch_u4(8, adler32(adler32(0L, Z_NULL, 0), dex.bytes.data() + 12,
+                          file_size - 12));
+  return dex.bytes;
+}
+
+bool write_file(std::string const& filename, std::vector<uint8_t> const& dex)
+{
+  auto file = fopen(filename.c_str(), "wb");
+  if (file == nullptr)
+    return false;
+  auto const okay = fwrite(dex.data(), 1, dex.size(), file) == dex.size();
+  return (fclose(file) == 0) && okay;
+}
+}
@@ -0,0 +1,144 @@
+/*
+ * dexgen: write synthetic dex files of a given shape for scale testing.
+ *
+ * Output is classes.dex, classes2.dex, ... as in a multidex APK; a new dex
+ * is started whenever the next class would push the method or type ids
+ * past the 65536 limit (or -x).
+ */
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include <DexGen/DexBuilder.h>
+#include <DexGen/Shapes.h>
+
+static const char* gProgName = "dexgen";
+
+struct Options {
+    DexGen::Shape shape;
+    uint32_t maxIds;
+    const char* outputDir;
+};
+
+static Options gOptions;
+
+/*
+ * Parse a count argument; returns false if it is not a number.
+ */
+static bool parseCount(const char* arg, uint32_t* pValue)
+{
+    char* end;
+    errno = 0;
+    unsigned long value = strtoul(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || errno != 0 || value > 0xffffffffUL)
+        return false;
+    *pValue = (uint32_t) value;
+    return true;
+}
+
+void usage(void)
+{
+    fprintf(stderr,
+        "%s: [-b branches] [-c classes] [-k calls] [-l loopdepth] [-m methods] [-o outdir] [-r seed] [-w cases] [-x maxids]\n",
+        gProgName);
+    fprintf(stderr, "\n");
+    fprintf(stderr, " -b : if/else diamonds per method (default 1)\n");
+    fprintf(stderr, " -c : number of classes (default 100)\n");
+    fprintf(stderr, " -k : static calls per method to random methods (default 1)\n");
+    fprintf(stderr, " -l : loop nesting depth around the method body (default 0)\n");
+    fprintf(stderr, " -m : methods per class (default 4)\n");
+    fprintf(stderr, " -o : output directory (default .)\n");
+    fprintf(stderr, " -r : random seed for call targets (default 1)\n");
+    fprintf(stderr, " -w : packed-switch cases per method, up to 65535 (default 0)\n");
+    fprintf(stderr, " -x : method and type ids per dex (default 65536)\n");
+}
+
+int main(int argc, char* const argv[])
+{
+    bool wantUsage = false;
+    int ic;
+
+    gOptions.maxIds = 0x10000;
+    gOptions.outputDir = ".";
+
+    while (1) {
+        ic = getopt(argc, argv, "b:c:k:l:m:o:r:w:x:");
+        if (ic < 0)
+            break;
+
+        bool okay = true;
+        switch (ic) {
+        case 'b':
+            okay = parseCount(optarg, &gOptions.shape.branches_per_method);
+            break;
+        case 'c':
+            okay = parseCount(optarg, &gOptions.shape.classes);
+            break;
+        case 'k':
+            okay = parseCount(optarg, &gOptions.shape.calls_per_method);
+            break;
+        case 'l':
+            okay = parseCount(optarg, &gOptions.shape.loop_depth);
+            break;
+        case 'm':
+            okay = parseCount(optarg, &gOptions.shape.methods_per_class);
+            break;
+        case 'o':
+            gOptions.outputDir = optarg;
+            break;
+        case 'r':
+            okay = parseCount(optarg, &gOptions.shape.seed);
+            break;
+        case 'w':
+            okay = parseCount(optarg, &gOptions.shape.switch_cases);
+            break;
+        case 'x':
+            okay = parseCount(optarg, &gOptions.maxIds) &&
+                gOptions.maxIds >= 3 && gOptions.maxIds <= 0x10000;
+            break;
+        default:
+            okay = false;
+            break;
+        }
+        if (!okay)
+            wantUsage = true;
+    }
+
+    if (optind != argc)
+        wantUsage = true;
+
+    if (wantUsage) {
+        usage();
+        return 2;
+    }
+
+    try {
+        auto const dexFiles = DexGen::split_multidex(
+            DexGen::generate(gOptions.shape), gOptions.maxIds);
+        for (size_t i = 0; i < dexFiles.size(); i++) {
+            std::string fileName = std::string(gOptions.outputDir) + "/classes";
+            if (i != 0)
+                fileName += std::to_string(i + 1);
+            fileName += ".dex";
+
+            auto const dex = DexGen::build(dexFiles[i]);
+            if (!DexGen::write_file(fileName, dex)) {
+                fprintf(stderr, "%s: can't write '%s'\n", gProgName,
+                    fileName.c_str());
+                return 1;
+            }
+            printf("%s: %zu classes, %zu bytes\n", fileName.c_str(),
+                dexFiles[i].size(), dex.size());
+        }
+    } catch (std::exception const& e) {
+        fprintf(stderr, "%s: %s\n", gProgName, e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include <DexGen/Shapes.h>
+
+namespace DexGen
+{
+namespace
+{
+  auto constexpr max_branch_offset = 0x7fff;
+
+  std::string class_descriptor(uint32_t class_idx)
+  {
+    char buff[32];
+    snprintf(buff, sizeof(buff), "Lgen/C%06u;", class_idx);
+    return buff;
+  }
+
+  std::string method_name(uint32_t method_idx)
+  {
+    return "m" + std::to_string(method_idx);
+  }
+
+  // xorshift32, never seeded with 0
+  uint32_t next_random(uint32_t& state)
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+
+  CodeBuilder loop_body(Shape const& shape, uint32_t& random)
+  {
+    auto const method_count = shape.classes * shape.methods_per_class;
+    CodeBuilder body;
+    for (uint32_t i = 0; i < shape.branches_per_method; i++)
+    {
+      // if (v0 == 0) v1 = 0; else v1 = 1;
+      body.if_eqz(0, 5).const4(1, 1).goto16(3).const4(1, 0);
+    }
+    for (uint32_t i = 0; i < shape.calls_per_method && method_count != 0; i++)
+    {
+      auto const callee = next_random(random) % method_count;
+      body.invoke_static(
+          MethodRef{ class_descriptor(callee / shape.methods_per_class),
+                     method_name(callee % shape.methods_per_class) });
+    }
+    return body;
+  }
+
+  // while (v0 != 0) { inner } around the body, depth times.
+  CodeBuilder loop_nest(CodeBuilder const& body, uint32_t depth)
+  {
+    if (depth == 0)
+      return body;
+    auto const inner = loop_nest(body, depth - 1);
+    if (inner.size() + 4 > max_branch_offset)
+      throw std::length_error("loop body exceeds 16-bit branch offsets");
+    CodeBuilder loop;
+    loop.if_eqz(0, (int16_t)(inner.size() + 4));
+    loop.append(inner);
+    loop.goto16((int16_t)-(int32_t)(inner.size() + 2));
+    return loop;
+  }
+}
+
+std::vector<ClassDef> generate(Shape const& shape)
+{
+  if (shape.switch_cases > 0xffff)
+    throw std::length_error("packed-switch holds at most 65535 cases");
+
+  uint32_t random = shape.seed == 0 ? 1 : shape.seed;
+  std::vector<ClassDef> classes;
+  classes.reserve(shape.classes);
+  for (uint32_t class_idx = 0; class_idx < shape.classes; class_idx++)
+  {
+    ClassDef class_def{ class_descriptor(class_idx), {} };
+    for (uint32_t method_idx = 0; method_idx < shape.methods_per_class;
+         method_idx++)
+    {
+      MethodDef method;
+      method.name = method_name(method_idx);
+      method.code.const4(0, 0);
+      if (shape.switch_cases != 0)
+      {
+        // Case i is the nop i units after the 3-unit switch
+        std::vector<int32_t> targets(shape.switch_cases);
+        for (uint32_t i = 0; i < shape.switch_cases; i++)
+          targets[i] = 3 + i;
+        method.code.packed_switch(0, targets);
+        for (uint32_t i = 0; i < shape.switch_cases; i++)
+          method.code.nop();
+      }
+      method.code.append(loop_nest(loop_body(shape, random), shape.loop_depth));
+      method.code.return_void();
+      class_def.methods.push_back(method);
+    }
+    classes.push_back(class_def);
+  }
+  return classes;
+}
+
+std::vector<std::vector<ClassDef>> split_multidex(
+    std::vector<ClassDef> const& classes,
+    uint32_t max_ids)
+{
+  typedef std::pair<std::string, std::string> MethodKey;
+  std::vector<std::vector<ClassDef>> dex_files;
+  std::set<MethodKey> methods;
+  // java.lang.Object and V are in every dex
+  std::set<std::string> types;
+  auto const base_types = 2u;
+
+  for (auto const& class_def : classes)
+  {
+    std::set<MethodKey> class_methods;
+    std::set<std::string> class_types = { class_def.descriptor };
+    for (auto const& method : class_def.methods)
+    {
+      class_methods.emplace(class_def.descriptor, method.name);
+      for (auto const& fixup : method.code.method_fixups)
+      {
+        class_methods.emplace(fixup.second.class_descriptor, fixup.second.name);
+        class_types.insert(fixup.second.class_descriptor);
+      }
+    }
+    if (class_methods.size() > max_ids ||
+        class_types.size() + base_types > max_ids)
+      throw std::length_error("class " + class_def.descriptor +
+                              " does not fit in one dex");
+
+    auto new_methods = methods.size();
+    for (auto const& method : class_methods)
+      new_methods += methods.count(method) == 0;
+    auto new_types = types.size() + base_types;
+    for (auto const& type : class_types)
+      new_types += types.count(type) == 0;
+
+    if (dex_files.empty() || new_methods > max_ids || new_types > max_ids)
+    {
+      dex_files.emplace_back();
+      methods.clear();
+      types.clear();
+    }
+    dex_files.back().push_back(class_def);
+    methods.insert(class_methods.begin(), class_methods.end());
+    types.insert(class_types.begin(), class_types.end());
+  }
+  return dex_files;
+}
+}
@@ -0,0 +1,2903 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Graph construction of the dexgraph tool, as a library.  Decoding started
+ * out as dexdump's; what was global state there (options, VM tables,
+ * method cache) is passed down explicitly so that several files can be
+ * built at once.
+ */
+#include <DexGraph/DexGraph.h>
+
+#include <libdex/DexFile.h>
+#include <libdex/DexCatch.h>
+#include <libdex/DexClass.h>
+#include <libdex/DexProto.h>
+#include <libdex/InstrUtils.h>
+#include <libdex/SysUtil.h>
+#include <libdex/ZipArchive.h>
+#include <libdex/sha1.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <array>
+#include <map>
+#include <string>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <TreeConstructor/FmtEdg.h>
+#include <TreeConstructor/Liveness.h>
+#include <TreeConstructor/MethodCache.h>
+#include <TreeConstructor/Sccp.h>
+#include <TreeConstructor/Stats.h>
+#include <TreeConstructor/Taint.h>
+#include <TreeConstructor/Trace.h>
+#include <TreeConstructor/TCHelper.h>
+#include <TreeConstructor/TCNode.h>
+#include <TreeConstructor/Types.h>
+
+typedef std::pair<TreeConstructor::MethodInfo, TreeConstructor::NodeSPtr>
+    id_node_pair;
+
+/*
+ * Rough heap cost of one decoded instruction: the Node, its shared_ptr
+ * control block, allocation headers and a couple of small vectors.
+ */
+static const size_t kNodeBytesEstimate = sizeof(TreeConstructor::Node) + 96;
+
+/*
+ * VM tables, built on first use and only read afterwards.
+ */
+static InstructionWidth* instrWidthTable()
+{
+    static InstructionWidth* const table = dexCreateInstrWidthTable();
+    return table;
+}
+
+static InstructionFormat* instrFormatTable()
+{
+    static InstructionFormat* const table = dexCreateInstrFormatTable();
+    return table;
+}
+
+/*
+ * Get 2 little-endian bytes. 
+ */ 
+static inline u2 get2LE(unsigned char const* pSrc)
+{
+    return pSrc[0] | (pSrc[1] << 8);
+}   
+
+/*
+ * Size of the block dexReadAndVerifyClassData() allocated.
+ */
+static size_t classDataSize(const DexClassData* pClassData)
+{
+    const DexClassDataHeader& header = pClassData->header;
+    return sizeof(DexClassData) +
+        (header.staticFieldsSize + header.instanceFieldsSize) * sizeof(DexField) +
+        (header.directMethodsSize + header.virtualMethodsSize) * sizeof(DexMethod);
+}
+
+/*
+ * Read the class data of class_def "idx", verifying the class on first use
+ * when the file was parsed lazily.  Returns nullptr if the class is
+ * unusable; the caller frees the result.
+ */
+static DexClassData* readClassData(DexFile* pDexFile, u4 idx)
+{
+    DexClassData* pClassData = dexReadVerifiedClassData(pDexFile, idx);
+    if (pClassData != nullptr)
+        TreeConstructor::Stats::track(TreeConstructor::Stats::Memory::CLASS_DATA,
+            classDataSize(pClassData));
+    return pClassData;
+}
+
+/*
+ * Free the result of readClassData().
+ */
+static void freeClassData(DexClassData* pClassData)
+{
+    if (pClassData == nullptr)
+        return;
+    TreeConstructor::Stats::track(TreeConstructor::Stats::Memory::CLASS_DATA,
+        -(int64_t) classDataSize(pClassData));
+    free(pClassData);
+}
+
+/*
+ * Dump a single instruction.
+ */
+static TreeConstructor::Node dumpInstruction(DexFile* pDexFile,
+	const DexCode* pCode,
+	int insnIdx,
+  int insnWidth,
+	const DecodedInstruction* pDecInsn)
+{
+	// Modified Tool
+  std::vector<uint32_t> arg_offset;
+  uint32_t payload_offset = 0;
+	TreeConstructor::MethodInfo opt_called_method_info;
+
+  u2 const* insns = pCode->insns;
+
+  switch (dexGetInstrFormat(instrFormatTable(), pDecInsn->opCode)) 
+	{
+    case kFmt10t: case kFmt20t:    // op+AAcase  // op +AAAA
+    {
+      s4 targ = (s4)pDecInsn->vA;
+      arg_offset.push_back(insnIdx + targ);
+      break;
+    }
+    case kFmt21t: // op vAA, +BBBB
+    {
+      s4 targ = (s4)pDecInsn->vB;
+      arg_offset.push_back(insnIdx + targ);
+      break;
+    }
+    case kFmt22t: // op vA, vB, +CCCC
+    {
+      s4 targ = (s4)pDecInsn->vC;
+      arg_offset.push_back(insnIdx + targ);
+      break;
+    }
+    case kFmt22s: // op vA, vB, #+CCCC
+    {
+      arg_offset.push_back((s4)pDecInsn->vC);
+      break;
+    }
+    case kFmt22cs: // [opt] op vA, vB, field offset CCCC
+    {
+      arg_offset.push_back(pDecInsn->vC);
+      break;
+    }
+    case kFmt31t: // op vAA, offset +BBBBBBBB
+    {
+      payload_offset = insnIdx + pDecInsn->vB;
+      break;
+    }
+    case kFmt35c: // op vB, {vD, vE, vF, vG, vA}, thing@CCCC
+    {
+      if (pDecInsn->opCode != OP_FILLED_NEW_ARRAY) {
+				try 
+				{
+          TreeConstructor::Stats::MemoryScope memory(
+              TreeConstructor::Stats::Memory::STRINGS);
+					auto const method_idx = pDecInsn->vB;
+					opt_called_method_info =
+            TreeConstructor::get_method_info(*pDexFile, method_idx);
+				}
+				catch (std::range_error const& e) {}
+      }
+      break;
+    }
+    case kFmt3rc: // op {vCCCC .. v(CCCC+AA-1)}, meth@BBBB
+    {
+      if (pDecInsn->opCode != OP_FILLED_NEW_ARRAY_RANGE) {
+				try
+				{
+          TreeConstructor::Stats::MemoryScope memory(
+              TreeConstructor::Stats::Memory::STRINGS);
+					auto const method_idx = pDecInsn->vB;
+          opt_called_method_info =
+            TreeConstructor::get_method_info(*pDexFile, method_idx);
+				}
+				catch(std::range_error const& e) {}
+      }
+      break;
+    } 
+    default: break;
+	}
+   
+	// Get relevant addresses
+	intptr_t const method_base_addr = ((u1*)insns - pDexFile->baseAddr) + insnIdx * 2;
+	// Get Instruction size
+	auto const instr_size = insnWidth;
+	// Get OpCode
+	auto const instr_opcode = pDecInsn->opCode;
+	// Get Offset (relative to method base address)
+	int const internal_offset = insnIdx;
+
+	/// Additional processing for Switch instructions
+	if (instr_opcode == OpCode::OP_PACKED_SWITCH)
+	{
+		intptr_t const payload_addr = (intptr_t const)(insns + payload_offset);
+		auto const packed_switch_payload =
+				TreeConstructor::get_packed_switch_payload(internal_offset,
+																									 payload_addr);
+		for (auto const& offset : packed_switch_payload.targets)
+			arg_offset.push_back(offset);
+	}
+
+	if (instr_opcode == OpCode::OP_SPARSE_SWITCH)
+	{
+		auto const payload_addr = (intptr_t const)(insns + payload_offset);
+		auto const sparse_switch_payload =
+				TreeConstructor::get_sparse_switch_offsets(internal_offset,
+																									 payload_addr);
+		for (auto const& offset : sparse_switch_payload.targets)  
+			arg_offset.push_back(offset);
+	}
+
+	// Construct Tree Node
+	auto method_node =
+			TreeConstructor::Node(method_base_addr,
+														instr_size,
+														instr_opcode,
+														std::move(opt_called_method_info),
+														internal_offset,
+														std::move(arg_offset));
+
+	return method_node;
+}
+
+/*
+ * Width in code units of the instruction or payload at insns, 0 for an
+ * unknown opcode.
+ */
+static int getInsnWidth(const u2* insns)
+{
+  u2 instr = get2LE((const u1*)insns);
+  if (instr == kPackedSwitchSignature) {
+    return 4 + get2LE((const u1*)(insns+1)) * 2;
+  } else if (instr == kSparseSwitchSignature) {
+    return 2 + get2LE((const u1*)(insns+1)) * 4;
+  } else if (instr == kArrayDataSignature) {
+    int width = get2LE((const u1*)(insns+1));
+    int size = get2LE((const u1*)(insns+2)) | 
+                (get2LE((const u1*)(insns+3))<<16);
+    // The plus 1 is to round up for odd size and width 
+    return 4 + ((size * width) + 1) / 2;
+  }
+  return dexGetInstrWidthAbs(instrWidthTable(), (OpCode)(instr & 0xff));
+}
+
+/*
+ * Record the ids an instruction of methodIdx references in pXrefs.
+ */
+static void recordXrefs(DexGraph::Xrefs* pXrefs, u4 methodIdx, int insnIdx,
+    const DecodedInstruction& decInsn)
+{
+  TreeConstructor::Xref::Site const site{ methodIdx, (uint32_t)insnIdx };
+  if (decInsn.opCode >= OP_IGET && decInsn.opCode <= OP_IPUT_SHORT)
+    pXrefs->fields.add(decInsn.vC, site);   // kFmt22c
+  else if (decInsn.opCode >= OP_SGET && decInsn.opCode <= OP_SPUT_SHORT)
+    pXrefs->fields.add(decInsn.vB, site);   // kFmt21c
+  else if (decInsn.opCode == OP_CONST_STRING ||
+           decInsn.opCode == OP_CONST_STRING_JUMBO)
+    pXrefs->strings.add(decInsn.vB, site);  // kFmt21c, kFmt31c
+}
+
+/*
+ * Decode every instruction of a code item into an unlinked node vector,
+ * and record their register operands in pEffects, their decoded form
+ * in pOperands, and the ids they reference in pXrefs if set.
+ */
+static std::vector<TreeConstructor::NodeSPtr>
+decodeMethodNodes(DexFile *pDexFile, const DexCode *pCode,
+    TreeConstructor::Liveness::RegisterEffects* pEffects = nullptr,
+    TreeConstructor::Sccp::Code* pOperands = nullptr,
+    DexGraph::Xrefs* pXrefs = nullptr, u4 methodIdx = 0)
+{
+  const u2* insns;
+  int insnIdx;
+
+  assert(pCode->insnsSize > 0);
+  insns = pCode->insns;
+
+  insnIdx = 0;
+  TreeConstructor::Stats::MemoryScope memory(
+      TreeConstructor::Stats::Memory::NODES);
+  std::vector<TreeConstructor::NodeSPtr> node_vector;
+  while (insnIdx < (int) pCode->insnsSize) {
+    int insnWidth;
+    DecodedInstruction decInsn;
+
+    insnWidth = getInsnWidth(insns);
+    if (insnWidth == 0) {
+      fprintf(stderr,
+          "GLITCH: zero-width instruction at idx=0x%04x\n", insnIdx);
+      break;
+    }
+
+    dexDecodeInstruction(instrFormatTable(), insns, &decInsn);
+    if (pEffects != nullptr)
+      pEffects->add(decInsn,
+          dexGetInstrFormat(instrFormatTable(), decInsn.opCode));
+    if (pOperands != nullptr)
+      pOperands->add(decInsn, insnIdx, insns);
+    if (pXrefs != nullptr)
+      recordXrefs(pXrefs, methodIdx, insnIdx, decInsn);
+
+    auto instr_node =
+        dumpInstruction(pDexFile, pCode, insnIdx, insnWidth, &decInsn);
+
+    insns += insnWidth;
+    insnIdx += insnWidth;
+
+    // Add to node vector
+    node_vector.push_back(
+        std::make_shared<TreeConstructor::Node>(std::move(instr_node)));
+  }
+
+  TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::INSTRUCTIONS,
+                              node_vector.size());
+  return node_vector;
+}
+
+static void hashDescriptor(SHA1_CTX* pCtx, const char* str)
+{
+  SHA1Update(pCtx, (const unsigned char*) str, strlen(str) + 1);
+}
+
+/*
+ * Hash the string, type, field or method an instruction refers to by its
+ * descriptors.  Returns false if the index is out of range.
+ */
+static bool hashReference(SHA1_CTX* pCtx, const DexFile* pDexFile,
+    OpCode opCode, InstructionFormat format, u4 idx)
+{
+  const DexHeader* pHeader = pDexFile->pHeader;
+
+  switch (opCode) {
+  case OP_CONST_STRING:
+  case OP_CONST_STRING_JUMBO:
+    if (idx >= pHeader->stringIdsSize)
+      return false;
+    hashDescriptor(pCtx, dexStringById(pDexFile, idx));
+    return true;
+  case OP_CONST_CLASS:
+  case OP_CHECK_CAST:
+  case OP_NEW_INSTANCE:
+  case OP_INSTANCE_OF:
+  case OP_NEW_ARRAY:
+  case OP_FILLED_NEW_ARRAY:
+  case OP_FILLED_NEW_ARRAY_RANGE:
+    if (idx >= pHeader->typeIdsSize)
+      return false;
+    hashDescriptor(pCtx, dexStringByTypeIdx(pDexFile, idx));
+    return true;
+  default:
+    break;
+  }
+
+  if (format == kFmt35c || format == kFmt3rc) {
+    if (idx >= pHeader->methodIdsSize)
+      return false;
+    const DexMethodId* pMethodId = dexGetMethodId(pDexFile, idx);
+    const DexProtoId* pProtoId = dexGetProtoId(pDexFile, pMethodId->protoIdx);
+    const DexTypeList* pParams = dexGetProtoParameters(pDexFile, pProtoId);
+    hashDescriptor(pCtx, dexStringByTypeIdx(pDexFile, pMethodId->classIdx));
+    hashDescriptor(pCtx, dexStringById(pDexFile, pMethodId->nameIdx));
+    hashDescriptor(pCtx, dexStringByTypeIdx(pDexFile, pProtoId->returnTypeIdx));
+    u4 paramCount = (pParams == nullptr) ? 0 : pParams->size;
+    SHA1Update(pCtx, (const unsigned char*) &paramCount, sizeof(paramCount));
+    for (u4 i = 0; i < paramCount; i++)
+      hashDescriptor(pCtx,
+          dexStringByTypeIdx(pDexFile, dexTypeListGetIdx(pParams, i)));
+    return true;
+  }
+
+  // Remaining 21c/22c instructions are static and instance field accesses
+  if (idx >= pHeader->fieldIdsSize)
+    return false;
+  const DexFieldId* pFieldId = dexGetFieldId(pDexFile, idx);
+  hashDescriptor(pCtx, dexStringByTypeIdx(pDexFile, pFieldId->classIdx));
+  hashDescriptor(pCtx, dexStringById(pDexFile, pFieldId->nameIdx));
+  hashDescriptor(pCtx, dexStringByTypeIdx(pDexFile, pFieldId->typeIdx));
+  return true;
+}
+
+/*
+ * Content hash of a code item, normalized so that the same method bundled
+ * in different dex files hashes the same: string, type, field and method
+ * references are hashed as descriptors instead of indices.  Try/catch
+ * tables do not shape the graph and are left out.
+ */
+static std::string hashMethodCode(const DexFile* pDexFile, const DexCode* pCode)
+{
+  SHA1_CTX ctx;
+  unsigned char digest[HASHSIZE];
+  const u2* insns = pCode->insns;
+  u4 insnIdx = 0;
+
+  SHA1Init(&ctx);
+  SHA1Update(&ctx, (const unsigned char*) &pCode->registersSize,
+      sizeof(pCode->registersSize));
+  SHA1Update(&ctx, (const unsigned char*) &pCode->insnsSize,
+      sizeof(pCode->insnsSize));
+
+  while (insnIdx < pCode->insnsSize) {
+    u4 insnWidth = getInsnWidth(insns);
+    if (insnWidth == 0 || insnWidth > pCode->insnsSize - insnIdx)
+      insnWidth = pCode->insnsSize - insnIdx;
+
+    OpCode opCode = (OpCode)(insns[0] & 0xff);
+    InstructionFormat format = dexGetInstrFormat(instrFormatTable(), opCode);
+    u4 idxWidth = 0;
+    u4 idx = 0;
+    if (insns[0] == kPackedSwitchSignature ||
+        insns[0] == kSparseSwitchSignature ||
+        insns[0] == kArrayDataSignature) {
+      // Payloads are hashed raw
+    } else if (format == kFmt31c) {
+      idxWidth = 2;
+      idx = insns[1] | ((u4) insns[2] << 16);
+    } else if (format == kFmt21c || format == kFmt22c ||
+               format == kFmt35c || format == kFmt3rc) {
+      idxWidth = 1;
+      idx = insns[1];
+    }
+    if (1 + idxWidth > insnWidth)
+      idxWidth = 0;
+
+    SHA1Update(&ctx, (const unsigned char*) insns, sizeof(u2));
+    if (idxWidth != 0 &&
+        !hashReference(&ctx, pDexFile, opCode, format, idx)) {
+      // Dangling reference: keep the raw index so it can't match anything
+      SHA1Update(&ctx, (const unsigned char*) "\xff", 1);
+      SHA1Update(&ctx, (const unsigned char*) &idx, sizeof(idx));
+    }
+    SHA1Update(&ctx, (const unsigned char*) (insns + 1 + idxWidth),
+        (insnWidth - 1 - idxWidth) * sizeof(u2));
+
+    insns += insnWidth;
+    insnIdx += insnWidth;
+  }
+
+  SHA1Final(digest, &ctx);
+  return std::string((const char*) digest, HASHSIZE);
+}
+
+/*
+ * File offset of the first instruction of a code item, i.e. the address
+ * of the method entry node.
+ */
+static u4 methodEntryAddr(const DexFile* pDexFile, const DexCode* pCode)
+{
+  return (u4)((const u1*)pCode->insns - pDexFile->baseAddr);
+}
+
+/*
+ * Method index the CALL node at internOffset resolves to, the way
+ * dumpInstruction() reads it (0 when out of range).
+ */
+static u4 calledMethodIdx(const DexFile* pDexFile, const DexCode* pCode,
+    u4 internOffset)
+{
+  u4 methodIdx = pCode->insns[internOffset + 1];
+  return methodIdx < pDexFile->pHeader->methodIdsSize ? methodIdx : 0;
+}
+
+/*
+ * Label a trace span with the method's class and name.
+ */
+static void setMethodSpanDetail(TreeConstructor::Trace::Span& span,
+    const DexFile* pDexFile, u4 methodIdx)
+{
+  if (!TreeConstructor::Trace::enabled() ||
+      methodIdx >= pDexFile->pHeader->methodIdsSize)
+    return;
+  const DexMethodId* pMethodId = dexGetMethodId(pDexFile, methodIdx);
+  span.set_detail(dexStringByTypeIdx(pDexFile, pMethodId->classIdx),
+      dexStringById(pDexFile, pMethodId->nameIdx));
+}
+
+/*
+ * Method cache of the build: none when liveness, pruning, call
+ * sharpening or xrefs are wanted, since a cache hit skips the decoding
+ * they are computed from.
+ */
+static TreeConstructor::MethodCache* buildMethodCache(
+    const DexGraph::Options& options)
+{
+  if (options.liveness != nullptr || options.prune_infeasible ||
+      options.sharpen_calls || options.xrefs != nullptr)
+    return nullptr;
+  return options.method_cache;
+}
+
+/*
+ * Whether decoding records the register operands of each instruction.
+ */
+static bool recordEffects(const DexGraph::Options& options)
+{
+  return options.liveness != nullptr || options.prune_infeasible ||
+         options.sharpen_calls;
+}
+
+/*
+ * Whether decoding keeps the decoded form of each instruction.
+ */
+static bool recordOperands(const DexGraph::Options& options)
+{
+  return options.prune_infeasible || options.sharpen_calls;
+}
+
+/*
+ * Code unit offsets of the catch handlers of a code item, sorted and
+ * unique.  The method graphs do not link them.
+ */
+static std::vector<uint32_t> handlerOffsets(const DexCode* pCode)
+{
+  std::vector<uint32_t> offsets;
+  const DexTry* pTries = dexGetTries(pCode);
+  for (u4 i = 0; i < pCode->triesSize; i++) {
+    DexCatchIterator iterator;
+    dexCatchIteratorInit(&iterator, pCode, pTries[i].handlerOff);
+    for (DexCatchHandler* pHandler = dexCatchIteratorNext(&iterator);
+         pHandler != nullptr; pHandler = dexCatchIteratorNext(&iterator))
+      offsets.push_back(pHandler->address);
+  }
+  std::sort(offsets.begin(), offsets.end());
+  offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+  return offsets;
+}
+
+/*
+ * Unlink the IF and SWITCH successors of a decoded, linked method that
+ * constant propagation proves are never taken.
+ */
+static void pruneInfeasible(const DexCode* pCode,
+    std::vector<TreeConstructor::NodeSPtr> const& node_vector,
+    TreeConstructor::Sccp::Code const& operands,
+    TreeConstructor::Liveness::RegisterEffects const& effects)
+{
+  TreeConstructor::Stats::MemoryScope memory(
+      TreeConstructor::Stats::Memory::OTHER);
+  auto const result = TreeConstructor::Sccp::analyze(node_vector, operands,
+      effects, pCode->registersSize, handlerOffsets(pCode));
+  TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::EDGES_PRUNED,
+      TreeConstructor::Sccp::prune(node_vector, result));
+}
+
+/*
+ * Hand the register liveness of a decoded, linked method to
+ * Options::liveness.
+ */
+static void reportLiveness(const DexMethod* pDexMethod, const DexCode* pCode,
+    std::vector<TreeConstructor::NodeSPtr> const& node_vector,
+    TreeConstructor::Liveness::RegisterEffects const& effects,
+    const DexGraph::Options& options)
+{
+  TreeConstructor::Stats::MemoryScope memory(
+      TreeConstructor::Stats::Memory::OTHER);
+  auto const result = TreeConstructor::Liveness::analyze(node_vector,
+      effects, pCode->registersSize);
+  options.liveness->method(pDexMethod->methodIdx, node_vector, result);
+}
+
+/*
+ * Virtual dispatch within the dex, for Options::sharpen_calls and the call
+ * graph: the superclass of each class defined in it, the classes
+ * extending or implementing each type, what each method_idx is, and the
+ * classes defining a method of each name and proto.
+ */
+struct CallResolver
+{
+  enum : uint8_t { NOT_DEFINED, NO_CODE, HAS_CODE };
+  std::vector<u4> superclass;     // by type_idx, kDexNoIndex if none here
+  std::unordered_map<u4, std::vector<u4>> subtypes;  // by type_idx
+  std::vector<uint8_t> methods;   // by method_idx
+  std::unordered_map<uint64_t, std::vector<u4>> definers;  // by signatureKey
+};
+
+static uint64_t signatureKey(const DexMethodId* pMethodId)
+{
+  return (uint64_t) pMethodId->nameIdx << 32 | pMethodId->protoIdx;
+}
+
+static CallResolver buildCallResolver(DexFile* pDexFile)
+{
+  CallResolver resolver;
+  resolver.superclass.assign(pDexFile->pHeader->typeIdsSize, kDexNoIndex);
+  resolver.methods.assign(pDexFile->pHeader->methodIdsSize,
+                          CallResolver::NOT_DEFINED);
+  for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++)
+  {
+    const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+    if (pClassDef->classIdx < resolver.superclass.size())
+      resolver.superclass[pClassDef->classIdx] = pClassDef->superclassIdx;
+    if (pClassDef->superclassIdx != kDexNoIndex)
+      resolver.subtypes[pClassDef->superclassIdx].push_back(pClassDef->classIdx);
+    const DexTypeList* pInterfaces = dexGetInterfacesList(pDexFile, pClassDef);
+    for (u4 k = 0; pInterfaces != nullptr && k < pInterfaces->size; k++)
+      resolver.subtypes[dexTypeListGetIdx(pInterfaces, k)].push_back(
+          pClassDef->classIdx);
+    DexClassData* pClassData = readClassData(pDexFile, i);
+    if (pClassData == nullptr)
+      continue;
+    u4 const methods_size = pClassData->header.directMethodsSize +
+                            pClassData->header.virtualMethodsSize;
+    for (u4 j = 0; j < methods_size; j++)
+    {
+      const DexMethod* pDexMethod =
+          j < pClassData->header.directMethodsSize
+              ? &pClassData->directMethods[j]
+              : &pClassData->virtualMethods[j - pClassData->header.directMethodsSize];
+      if (pDexMethod->methodIdx >= resolver.methods.size())
+        continue;
+      resolver.methods[pDexMethod->methodIdx] = pDexMethod->codeOff != 0
+          ? CallResolver::HAS_CODE : CallResolver::NO_CODE;
+      resolver.definers[signatureKey(dexGetMethodId(pDexFile,
+          pDexMethod->methodIdx))].push_back(pClassDef->classIdx);
+    }
+    freeClassData(pClassData);
+  }
+  return resolver;
+}
+
+/*
+ * The first method defined in the dex with the name and proto of methodIdx
+ * up the superclasses of typeIdx, abstract or not.  kDexNoIndex if the
+ * chain leaves the dex first.
+ */
+static u4 findDeclaration(const DexFile* pDexFile,
+    const CallResolver& resolver, u4 typeIdx, u4 methodIdx)
+{
+  const DexMethodId* pCalled = dexGetMethodId(pDexFile, methodIdx);
+  const DexMethodId* pBegin = dexGetMethodId(pDexFile, 0);
+  const DexMethodId* pEnd = pBegin + pDexFile->pHeader->methodIdsSize;
+  for (size_t depth = 0; typeIdx < resolver.superclass.size() &&
+       depth < resolver.superclass.size(); depth++)
+  {
+    // method_ids are sorted by class, name and proto
+    auto const it = std::lower_bound(pBegin, pEnd, typeIdx,
+        [pCalled](const DexMethodId& id, u4 classIdx) {
+          if (id.classIdx != classIdx)
+            return id.classIdx < classIdx;
+          if (id.nameIdx != pCalled->nameIdx)
+            return id.nameIdx < pCalled->nameIdx;
+          return id.protoIdx < pCalled->protoIdx;
+        });
+    if (it != pEnd && it->classIdx == typeIdx &&
+        it->nameIdx == pCalled->nameIdx && it->protoIdx == pCalled->protoIdx)
+    {
+      u4 const m = it - pBegin;
+      if (resolver.methods[m] != CallResolver::NOT_DEFINED)
+        return m;
+    }
+    typeIdx = resolver.superclass[typeIdx];
+  }
+  return kDexNoIndex;
+}
+
+/*
+ * The method with code a call of methodIdx on a receiver of class typeIdx
+ * dispatches to: its declaration up the superclasses defined in the dex.
+ * kDexNoIndex if that one is abstract or the chain leaves the dex first.
+ */
+static u4 resolveCall(const DexFile* pDexFile, const CallResolver& resolver,
+    u4 typeIdx, u4 methodIdx)
+{
+  u4 const m = findDeclaration(pDexFile, resolver, typeIdx, methodIdx);
+  return m != kDexNoIndex && resolver.methods[m] == CallResolver::HAS_CODE
+      ? m : kDexNoIndex;
+}
+
+/*
+ * Append to targets the methods of the dex an invoke of methodIdx may run:
+ * its declaration up the superclasses of the class the method_id names
+ * and, for virtual and interface invokes, the declaration each class
+ * extending or implementing that one reaches (class hierarchy analysis).
+ */
+static void dispatchTargets(const DexFile* pDexFile,
+    const CallResolver& resolver, u4 methodIdx, bool virtualCall,
+    std::vector<u4>& targets)
+{
+  u4 const classIdx = dexGetMethodId(pDexFile, methodIdx)->classIdx;
+  u4 const declared = findDeclaration(pDexFile, resolver, classIdx, methodIdx);
+  if (declared != kDexNoIndex)
+    targets.push_back(declared);
+  if (!virtualCall)
+    return;
+
+  std::vector<u4> pending(1, classIdx);
+  std::unordered_set<u4> seen(pending.begin(), pending.end());
+  while (!pending.empty())
+  {
+    auto const it = resolver.subtypes.find(pending.back());
+    pending.pop_back();
+    if (it == resolver.subtypes.end())
+      continue;
+    for (u4 subtype : it->second)
+    {
+      if (!seen.insert(subtype).second)
+        continue;
+      pending.push_back(subtype);
+      u4 const m = findDeclaration(pDexFile, resolver, subtype, methodIdx);
+      if (m != kDexNoIndex)
+        targets.push_back(m);
+    }
+  }
+}
+
+/*
+ * Whether a class of the dex below typeIdx defines a method with the name
+ * and proto of methodIdx, which a receiver of a subclass would run.
+ */
+static bool overriddenBelow(const DexFile* pDexFile,
+    const CallResolver& resolver, u4 typeIdx, u4 methodIdx)
+{
+  auto const it = resolver.definers.find(
+      signatureKey(dexGetMethodId(pDexFile, methodIdx)));
+  if (it == resolver.definers.end())
+    return false;
+  for (u4 classIdx : it->second)
+  {
+    if (classIdx >= resolver.superclass.size())
+      continue;
+    u4 ancestor = resolver.superclass[classIdx];
+    for (size_t depth = 0; ancestor < resolver.superclass.size() &&
+         depth < resolver.superclass.size(); depth++)
+    {
+      if (ancestor == typeIdx)
+        return true;
+      ancestor = resolver.superclass[ancestor];
+    }
+  }
+  return false;
+}
+
+/*
+ * Retarget the virtual and interface calls of a decoded, linked method to
+ * the method their inferred receiver type dispatches to.  Registers are
+ * seeded with "this" and the parameters of its proto, invokes return
+ * their declared class.  Those may hold a subclass, so their calls are
+ * only retargeted when no subclass in the dex overrides the target;
+ * allocations are exact.
+ */
+static void sharpenCalls(DexFile* pDexFile, const DexMethod* pDexMethod,
+    const DexCode* pCode,
+    std::vector<TreeConstructor::NodeSPtr> const& node_vector,
+    TreeConstructor::Sccp::Code const& operands,
+    TreeConstructor::Liveness::RegisterEffects const& effects,
+    const CallResolver& resolver)
+{
+  using TreeConstructor::Types::NO_TYPE;
+  TreeConstructor::Stats::MemoryScope memory(
+      TreeConstructor::Stats::Memory::OTHER);
+
+  TreeConstructor::Types::Seeds seeds;
+  u2 const registersSize = pCode->registersSize;
+  seeds.entry.resize(registersSize);
+  const DexMethodId* pMethodId = dexGetMethodId(pDexFile,
+      pDexMethod->methodIdx);
+  u4 reg = registersSize - std::min(pCode->insSize, registersSize);
+  if ((pDexMethod->accessFlags & ACC_STATIC) == 0 && reg < registersSize)
+    seeds.entry[reg++].type_idx = pMethodId->classIdx;
+  DexProto proto;
+  dexProtoSetFromMethodId(&proto, pDexFile, pMethodId);
+  DexParameterIterator params;
+  dexParameterIteratorInit(&params, &proto);
+  for (u4 typeIdx = dexParameterIteratorNextIndex(&params);
+       typeIdx != kDexNoIndex && reg < registersSize;
+       typeIdx = dexParameterIteratorNextIndex(&params))
+  {
+    char const kind = dexStringByTypeIdx(pDexFile, typeIdx)[0];
+    if (kind == 'L')
+      seeds.entry[reg].type_idx = typeIdx;
+    reg += kind == 'J' || kind == 'D' ? 2 : 1;
+  }
+  seeds.return_type = [pDexFile](uint32_t methodIdx) -> uint32_t {
+    if (methodIdx >= pDexFile->pHeader->methodIdsSize)
+      return NO_TYPE;
+    DexProto callee;
+    dexProtoSetFromMethodId(&callee, pDexFile,
+        dexGetMethodId(pDexFile, methodIdx));
+    if (dexProtoGetReturnType(&callee)[0] != 'L')
+      return NO_TYPE;
+    return dexGetProtoId(pDexFile, callee.protoIdx)->returnTypeIdx;
+  };
+
+  auto const receivers = TreeConstructor::Types::receivers(node_vector,
+      operands, effects, registersSize, seeds, handlerOffsets(pCode));
+  for (size_t i = 0; i < node_vector.size(); i++)
+  {
+    auto& node = *node_vector[i];
+    // No method_info when the invoke's method_idx is out of range
+    if (receivers[i].type_idx == NO_TYPE ||
+        node.opcode_type != OpCodeType::CALL ||
+        node.called_method_info.class_descriptor.empty())
+      continue;
+    u4 const target = resolveCall(pDexFile, resolver, receivers[i].type_idx,
+        node.called_method_info.method_idx);
+    if (target == kDexNoIndex || target == node.called_method_info.method_idx ||
+        (!receivers[i].exact && overriddenBelow(pDexFile, resolver,
+             receivers[i].type_idx, target)))
+      continue;
+    {
+      TreeConstructor::Stats::MemoryScope strings(
+          TreeConstructor::Stats::Memory::STRINGS);
+      node.called_method_info = TreeConstructor::get_method_info(*pDexFile,
+          target);
+    }
+    TreeConstructor::Stats::add(
+        TreeConstructor::Stats::Counter::CALLS_SHARPENED, 1);
+  }
+}
+
+/*
+ * Dump a bytecode disassembly.
+ */
+static std::pair<id_node_pair, std::vector<TreeConstructor::NodeSPtr>>
+dumpBytecodes(DexFile *pDexFile, const DexMethod *pDexMethod,
+    const DexGraph::Options& options, const CallResolver* pResolver)
+{
+  TreeConstructor::Trace::Span span("dumpBytecodes",
+      TreeConstructor::Trace::Span::IF_SLOW);
+  setMethodSpanDetail(span, pDexFile, pDexMethod->methodIdx);
+
+  using TreeConstructor::Stats::MemoryScope;
+  using TreeConstructor::Stats::Memory;
+
+  const DexCode* pCode = dexGetCode(pDexFile, pDexMethod);
+  TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::METHODS, 1);
+
+  TreeConstructor::MethodCache* pMethodCache = buildMethodCache(options);
+  TreeConstructor::Liveness::RegisterEffects effects;
+  TreeConstructor::Sccp::Code operands;
+  std::string hash;
+  TreeConstructor::MethodTemplateSPtr cached;
+  if (pMethodCache != nullptr) {
+    hash = hashMethodCode(pDexFile, pCode);
+    cached = pMethodCache->find(hash);
+  }
+
+  std::vector<TreeConstructor::NodeSPtr> node_vector;
+  if (cached != nullptr) {
+    // Relocate the cached graph, only the call targets are per dex
+    {
+      MemoryScope memory(Memory::NODES);
+      node_vector = TreeConstructor::instantiate(*cached,
+                                                 methodEntryAddr(pDexFile, pCode));
+    }
+    MemoryScope memory(Memory::STRINGS);
+    for (auto const& node : node_vector) {
+      if (node->opcode_type != OpCodeType::CALL)
+        continue;
+      u4 methodIdx = pCode->insns[node->intern_offset + 1];
+      if (methodIdx < pDexFile->pHeader->methodIdsSize)
+        node->called_method_info =
+            TreeConstructor::get_method_info(*pDexFile, methodIdx);
+    }
+  } else {
+    node_vector = decodeMethodNodes(pDexFile, pCode,
+        recordEffects(options) ? &effects : nullptr,
+        recordOperands(options) ? &operands : nullptr,
+        options.xrefs, pDexMethod->methodIdx);
+  }
+
+  TreeConstructor::MethodInfo method_info;
+  {
+    MemoryScope memory(Memory::STRINGS);
+    method_info =
+        TreeConstructor::get_method_info(*pDexFile, pDexMethod->methodIdx);
+  }
+  MemoryScope memory(Memory::EDGES);
+	auto const call_nodes = TreeConstructor::get_method_call_nodes(node_vector);
+
+  TreeConstructor::NodeSPtr nodeptr;
+  if (cached != nullptr) {
+    nodeptr = node_vector.front();
+  } else {
+    nodeptr = TreeConstructor::construct_node_from_vec(node_vector);
+    if (options.prune_infeasible)
+      pruneInfeasible(pCode, node_vector, operands, effects);
+    if (pResolver != nullptr)
+      sharpenCalls(pDexFile, pDexMethod, pCode, node_vector, operands,
+                   effects, *pResolver);
+    if (options.liveness != nullptr)
+      reportLiveness(pDexMethod, pCode, node_vector, effects, options);
+    if (pMethodCache != nullptr) {
+      MemoryScope memory(Memory::OTHER);
+      auto method = std::make_shared<TreeConstructor::MethodTemplate>();
+      TreeConstructor::capture_links(*method, node_vector);
+      pMethodCache->insert(hash, method);
+    }
+  }
+
+	auto methodid_node_pair = std::make_pair(std::move(method_info), nodeptr);
+	return std::make_pair(std::move(methodid_node_pair), call_nodes);
+}
+
+/*
+ * Dump a "code" struct.
+ */
+static std::pair<id_node_pair, std::vector<TreeConstructor::NodeSPtr>>
+dumpCode(DexFile *pDexFile, const DexMethod *pDexMethod,
+    const DexGraph::Options& options, const CallResolver* pResolver)
+{
+  if (options.disassemble)
+    return dumpBytecodes(pDexFile, pDexMethod, options, pResolver);
+  else
+    throw std::runtime_error("Could not dump byte_code for method_id " +
+                             std::to_string(pDexMethod->methodIdx));
+}
+
+/*
+ * Dump a method.
+ */
+static std::pair<id_node_pair, std::vector<TreeConstructor::NodeSPtr>>
+dumpMethod(DexFile *pDexFile, const DexMethod *pDexMethod,
+    const DexGraph::Options& options, const CallResolver* pResolver)
+{
+  if (options.exports_only &&
+      (pDexMethod->accessFlags & (ACC_PUBLIC | ACC_PROTECTED)) == 0) {
+    throw std::runtime_error("Could not access method with method_idx: " +
+                             std::to_string(pDexMethod->methodIdx));
+  }
+
+  if (pDexMethod->codeOff != 0)
+    return dumpCode(pDexFile, pDexMethod, options, pResolver);
+  else
+    throw std::runtime_error("codeOff for method_idx " +
+                             std::to_string(pDexMethod->methodIdx) +
+                             " equals 0.");
+}
+
+/*
+ * Add one method graph of dumpMethod() to the graphs of its class.
+ */
+static void addMethodGraph(
+    std::pair<id_node_pair, std::vector<TreeConstructor::NodeSPtr>> const& pair,
+    std::map<TreeConstructor::MethodInfo, TreeConstructor::NodeSPtr>& method_map,
+    std::vector<TreeConstructor::NodeSPtr>& call_node_vec)
+{
+  {
+    TreeConstructor::Stats::MemoryScope memory(
+        TreeConstructor::Stats::Memory::STRINGS);
+    method_map.emplace(pair.first.first, pair.first.second);
+  }
+  TreeConstructor::Stats::MemoryScope memory(
+      TreeConstructor::Stats::Memory::EDGES);
+  call_node_vec.insert(call_node_vec.end(), pair.second.begin(),
+                       pair.second.end());
+}
+
+/*
+ * Whether any class filter is set.
+ */
+static bool hasClassFilter(const DexGraph::Options& options)
+{
+  return !options.include_classes.empty() || !options.exclude_classes.empty();
+}
+
+/*
+ * Whether class_def "idx" passes the class filters.  Only its descriptor
+ * is read, so a left out class is neither verified nor decoded.
+ */
+static bool classDefSelected(const DexFile* pDexFile, u4 idx,
+    const DexGraph::Options& options)
+{
+  if (!hasClassFilter(options))
+    return true;
+  const DexClassDef* pClassDef = dexGetClassDef(pDexFile, idx);
+  /* a bad type index is left to readClassData() to reject */
+  if (pClassDef->classIdx >= pDexFile->pHeader->typeIdsSize)
+    return true;
+  return DexGraph::class_selected(options,
+      dexStringByTypeIdx(pDexFile, pClassDef->classIdx));
+}
+
+/*
+ * Address of the EXTERN stub node of a method whose class is filtered out:
+ * the file offset of its method_id_item, which no instruction shares.
+ */
+static u4 methodStubAddr(const DexFile* pDexFile, u4 methodIdx)
+{
+  return pDexFile->pHeader->methodIdsOff + methodIdx * sizeof(DexMethodId);
+}
+
+/*
+ * Give the calls into filtered out classes a stub callee in
+ * method_node_map, so that process_calls() keeps their edge.
+ */
+static void addStubMethods(const DexFile* pDexFile,
+    const DexGraph::Options& options,
+    std::map<TreeConstructor::MethodInfo, TreeConstructor::NodeSPtr>& method_node_map,
+    std::vector<TreeConstructor::NodeSPtr> const& call_node_vec)
+{
+  if (!hasClassFilter(options))
+    return;
+  for (auto const& node : call_node_vec)
+  {
+    auto const& callee = node->called_method_info;
+    if (callee.class_descriptor.empty() ||
+        method_node_map.count(callee) != 0 ||
+        DexGraph::class_selected(options, callee.class_descriptor.c_str()))
+      continue;
+    TreeConstructor::Stats::MemoryScope memory(
+        TreeConstructor::Stats::Memory::NODES);
+    auto stub = std::make_shared<TreeConstructor::Node>(
+        methodStubAddr(pDexFile, callee.method_idx), 0, OP_NOP, callee, 0,
+        std::vector<uint32_t>());
+    stub->opcode_type = OpCodeType::EXTERN;
+    method_node_map.emplace(callee, stub);
+  }
+}
+
+/*
+ * Build the method graphs of a class.
+ *
+ * Note "idx" is a DexClassDef index, not a DexTypeId index.
+ */
+static std::pair<std::map<TreeConstructor::MethodInfo, TreeConstructor::NodeSPtr>,
+          std::vector<TreeConstructor::NodeSPtr>>
+dumpClass(DexFile *pDexFile, int idx, const DexGraph::Options& options,
+    const CallResolver* pResolver)
+{
+  const DexClassDef *pClassDef;
+  DexClassData *pClassData = nullptr;
+  const char *classDescriptor;
+  int i;
+
+  std::map<TreeConstructor::MethodInfo, TreeConstructor::NodeSPtr> ret;
+	std::vector<TreeConstructor::NodeSPtr> call_node_vec;
+  TreeConstructor::Trace::Span span("dumpClass",
+      TreeConstructor::Trace::Span::IF_SLOW);
+
+  pClassDef = dexGetClassDef(pDexFile, idx);
+
+  pClassData = readClassData(pDexFile, idx);
+
+  if (pClassData == nullptr)
+    return std::make_pair(ret, call_node_vec);
+
+  classDescriptor = dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
+  span.set_detail(classDescriptor);
+
+  if (!(classDescriptor[0] == 'L' &&
+        classDescriptor[strlen(classDescriptor) - 1] == ';')) {
+    /* arrays and primitives should not be defined explicitly */
+    fprintf(stderr, "Malformed class name '%s'\n", classDescriptor);
+    /* keep going? */
+  }
+
+  for (i = 0; i < (int)pClassData->header.directMethodsSize; i++) 
+	{
+    try 
+		{
+      auto const pair =
+          dumpMethod(pDexFile, &pClassData->directMethods[i], options,
+                     pResolver);
+      addMethodGraph(pair, ret, call_node_vec);
+    } catch (std::runtime_error const &e) {}
+  }
+
+  for (i = 0; i < (int)pClassData->header.virtualMethodsSize; i++) 
+	{
+    try 
+		{
+      auto const pair =
+          dumpMethod(pDexFile, &pClassData->virtualMethods[i], options,
+                     pResolver);
+      addMethodGraph(pair, ret, call_node_vec);
+    } catch (std::runtime_error const &e) {}
+  }
+
+  freeClassData(pClassData);
+  return std::make_pair(ret, call_node_vec);
+}
+
+/*
+ * Tell whether dumpMethod() builds a graph for this method.
+ */
+static bool methodHasGraph(const DexMethod* pDexMethod,
+    const DexGraph::Options& options)
+{
+  if (options.exports_only &&
+      (pDexMethod->accessFlags & (ACC_PUBLIC | ACC_PROTECTED)) == 0)
+    return false;
+  return options.disassemble && pDexMethod->codeOff != 0;
+}
+
+/*
+ * Where the calls of streaming pass 2 land, by method_idx: the address of
+ * the callee entry node, kDexNoIndex if it gets no graph, or the address
+ * of its EXTERN stub if its class is filtered out.  Stubs are emitted on
+ * their first call.
+ */
+struct CallTargets
+{
+  std::vector<u4> entry_index;
+  std::vector<bool> stub_pending;
+};
+
+/*
+ * Point the methods of filtered out classes at their stub.
+ */
+static void addStubTargets(const DexFile* pDexFile,
+    const DexGraph::Options& options, CallTargets& targets)
+{
+  enum { UNKNOWN, SELECTED, LEFT_OUT };
+  std::vector<char> type_state(pDexFile->pHeader->typeIdsSize, UNKNOWN);
+
+  targets.stub_pending.assign(targets.entry_index.size(), false);
+  for (u4 i = 0; i < targets.entry_index.size(); i++)
+  {
+    u4 const classIdx = dexGetMethodId(pDexFile, i)->classIdx;
+    if (classIdx >= type_state.size())
+      continue;
+    if (type_state[classIdx] == UNKNOWN)
+      type_state[classIdx] = DexGraph::class_selected(options,
+          dexStringByTypeIdx(pDexFile, classIdx)) ? SELECTED : LEFT_OUT;
+    if (type_state[classIdx] == LEFT_OUT)
+    {
+      targets.entry_index[i] = methodStubAddr(pDexFile, i);
+      targets.stub_pending[i] = true;
+    }
+  }
+}
+
+/*
+ * Streaming pass 1: the call targets of every method_idx.  Only class data
+ * is read, nothing is decoded.
+ */
+static CallTargets buildCallTargets(DexFile* pDexFile,
+    const DexGraph::Options& options)
+{
+  CallTargets targets;
+  std::vector<u4>& entry_index = targets.entry_index;
+  entry_index.assign(pDexFile->pHeader->methodIdsSize, kDexNoIndex);
+
+  for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++)
+  {
+    if (!classDefSelected(pDexFile, i, options))
+      continue;
+    DexClassData* pClassData = readClassData(pDexFile, i);
+    if (pClassData == nullptr)
+      continue;
+
+    u4 const methods_size = pClassData->header.directMethodsSize +
+                            pClassData->header.virtualMethodsSize;
+    for (u4 j = 0; j < methods_size; j++)
+    {
+      const DexMethod* pDexMethod =
+          j < pClassData->header.directMethodsSize
+              ? &pClassData->directMethods[j]
+              : &pClassData->virtualMethods[j - pClassData->header.directMethodsSize];
+      if (!methodHasGraph(pDexMethod, options) ||
+          pDexMethod->methodIdx >= entry_index.size())
+        continue;
+      entry_index[pDexMethod->methodIdx] =
+          methodEntryAddr(pDexFile, dexGetCode(pDexFile, pDexMethod));
+    }
+    freeClassData(pClassData);
+  }
+
+  if (hasClassFilter(options))
+    addStubTargets(pDexFile, options, targets);
+  return targets;
+}
+
+/*
+ * Emit the edge of a call to methodIdx, and the callee stub on its first
+ * call.
+ */
+static void dumpCallEdge(u4 fromAddr, u4 methodIdx, CallTargets& targets,
+                         Fmt::Edg::Sink& writer)
+{
+  if (methodIdx >= targets.entry_index.size() ||
+      targets.entry_index[methodIdx] == kDexNoIndex)
+    return;
+  if (!targets.stub_pending.empty() && targets.stub_pending[methodIdx])
+  {
+    writer.dump_node(targets.entry_index[methodIdx], OpCodeType::EXTERN);
+    targets.stub_pending[methodIdx] = false;
+  }
+  writer.dump_edge(fromAddr, targets.entry_index[methodIdx]);
+}
+
+/*
+ * Streaming pass 2, method cache hit: emit the cached traversal relocated
+ * to this code item, in the order streamMethod() would have.
+ */
+static void streamMethodTemplate(DexFile* pDexFile, const DexCode* pCode,
+                                 TreeConstructor::MethodTemplate const& method,
+                                 CallTargets& targets,
+                                 Fmt::Edg::Sink& writer)
+{
+  u4 const entry_addr = methodEntryAddr(pDexFile, pCode);
+
+  for (auto const& node : method.emitted_nodes)
+    writer.dump_node(entry_addr + node.first * 2, node.second);
+  for (auto const& edge : method.emitted_edges)
+    writer.dump_edge(entry_addr + edge.first * 2, entry_addr + edge.second * 2);
+
+  for (auto const& offset : method.call_sites)
+    dumpCallEdge(entry_addr + offset * 2,
+                 calledMethodIdx(pDexFile, pCode, offset), targets, writer);
+}
+
+/*
+ * Poll Options::cancel, and remember in the report that it was set.
+ */
+static bool checkCancelled(const DexGraph::Options& options,
+                           DexGraph::BuildReport& report)
+{
+  if (options.cancel != nullptr &&
+      options.cancel->load(std::memory_order_relaxed))
+    report.cancelled = true;
+  return report.cancelled;
+}
+
+/*
+ * Streaming pass 2: build one method graph, resolve its calls against the
+ * entry index, emit it and free it.
+ */
+static void streamMethod(DexFile* pDexFile, const DexMethod* pDexMethod,
+                         CallTargets& targets, const CallResolver* pResolver,
+                         const DexGraph::Options& options,
+                         DexGraph::BuildReport& report,
+                         Fmt::Edg::Sink& writer)
+{
+  if (checkCancelled(options, report))
+    return;
+  TreeConstructor::Trace::Span span("streamMethod",
+      TreeConstructor::Trace::Span::IF_SLOW);
+  setMethodSpanDetail(span, pDexFile, pDexMethod->methodIdx);
+
+  const DexCode* pCode = dexGetCode(pDexFile, pDexMethod);
+  TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::METHODS, 1);
+
+  TreeConstructor::MethodCache* pMethodCache = buildMethodCache(options);
+  std::string hash;
+  if (pMethodCache != nullptr)
+  {
+    hash = hashMethodCode(pDexFile, pCode);
+    auto const cached = pMethodCache->find(hash);
+    if (cached != nullptr)
+    {
+      streamMethodTemplate(pDexFile, pCode, *cached, targets, writer);
+      return;
+    }
+  }
+
+  // Over the memory budget: keep the entry node so call edges still land
+  if (TreeConstructor::Stats::over_memory_budget(options.memory_budget,
+          pCode->insnsSize * kNodeBytesEstimate))
+  {
+    writer.dump_node(methodEntryAddr(pDexFile, pCode),
+        OpCodeClassifier::get_opcode_type((OpCode)(pCode->insns[0] & 0xff)));
+    TreeConstructor::Stats::add(
+        TreeConstructor::Stats::Counter::METHODS_SKIPPED, 1);
+    report.skipped_methods++;
+    return;
+  }
+
+  TreeConstructor::Liveness::RegisterEffects effects;
+  TreeConstructor::Sccp::Code operands;
+  auto const node_vector = decodeMethodNodes(pDexFile, pCode,
+      recordEffects(options) ? &effects : nullptr,
+      recordOperands(options) ? &operands : nullptr,
+      options.xrefs, pDexMethod->methodIdx);
+  if (node_vector.empty())
+    return;
+  TreeConstructor::Stats::MemoryScope memory(
+      TreeConstructor::Stats::Memory::EDGES);
+  auto const nodeptr = TreeConstructor::construct_node_from_vec(node_vector);
+  if (options.prune_infeasible)
+    pruneInfeasible(pCode, node_vector, operands, effects);
+  if (pResolver != nullptr)
+    sharpenCalls(pDexFile, pDexMethod, pCode, node_vector, operands, effects,
+                 *pResolver);
+  if (options.liveness != nullptr)
+    reportLiveness(pDexMethod, pCode, node_vector, effects, options);
+
+  // Nodes and intra-method edges go to the writer as they are visited
+  std::shared_ptr<TreeConstructor::MethodTemplate> method;
+  if (pMethodCache != nullptr)
+  {
+    TreeConstructor::Stats::MemoryScope memory(
+        TreeConstructor::Stats::Memory::OTHER);
+    method = std::make_shared<TreeConstructor::MethodTemplate>();
+  }
+  std::vector<TreeConstructor::NodeSPtr> call_nodes;
+  Fmt::Edg::Emitter<Fmt::Edg::Sink> const emit{ writer };
+  TreeConstructor::traverse(*nodeptr,
+      [&](TreeConstructor::NodeSPtr const& node) {
+        emit(node);
+        if (node->opcode_type == OpCodeType::CALL)
+          call_nodes.push_back(node);
+        if (method != nullptr) {
+          TreeConstructor::Stats::MemoryScope memory(
+              TreeConstructor::Stats::Memory::OTHER);
+          TreeConstructor::capture_node(*method, *node);
+        }
+      });
+
+  // Call edges go straight to the callee entry address
+  for (auto const& node : call_nodes)
+    dumpCallEdge(node->baseAddr, node->called_method_info.method_idx, targets,
+                 writer);
+
+  if (method != nullptr)
+    pMethodCache->insert(hash, method);
+
+  TreeConstructor::release_nodes(node_vector);
+}
+
+/*
+ * Two-pass variant of processDexFile: peak memory is bounded by the largest
+ * method instead of the whole method_node_map.
+ */
+static void streamDexFile(DexFile *pDexFile, const DexGraph::Options& options,
+                          DexGraph::BuildReport& report, Fmt::Edg::Sink& writer)
+{
+  using TreeConstructor::Stats::ScopedTimer;
+  using TreeConstructor::Stats::Phase;
+
+  // Traversal and Edg writing are interleaved with decoding here and
+  // accounted to the classes phase, except for the final edge copy.
+  {
+    ScopedTimer timer(Phase::CLASSES);
+    auto targets = buildCallTargets(pDexFile, options);
+    CallResolver resolver;
+    if (options.sharpen_calls)
+      resolver = buildCallResolver(pDexFile);
+    const CallResolver* pResolver = options.sharpen_calls ? &resolver : nullptr;
+
+    for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++)
+    {
+      if (checkCancelled(options, report))
+        return;
+      if (!classDefSelected(pDexFile, i, options))
+      {
+        TreeConstructor::Stats::add(
+            TreeConstructor::Stats::Counter::CLASSES_FILTERED, 1);
+        continue;
+      }
+      TreeConstructor::Trace::Span span("streamClass",
+          TreeConstructor::Trace::Span::IF_SLOW);
+      DexClassData* pClassData = readClassData(pDexFile, i);
+      if (pClassData == nullptr)
+        continue;
+      TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::CLASSES, 1);
+      span.set_detail(dexStringByTypeIdx(pDexFile,
+          dexGetClassDef(pDexFile, i)->classIdx));
+
+      for (u4 j = 0; j < pClassData->header.directMethodsSize; j++)
+        if (methodHasGraph(&pClassData->directMethods[j], options))
+          streamMethod(pDexFile, &pClassData->directMethods[j], targets,
+                       pResolver, options, report, writer);
+      for (u4 j = 0; j < pClassData->header.virtualMethodsSize; j++)
+        if (methodHasGraph(&pClassData->virtualMethods[j], options))
+          streamMethod(pDexFile, &pClassData->virtualMethods[j], targets,
+                       pResolver, options, report, writer);
+      freeClassData(pClassData);
+    }
+  }
+  if (report.cancelled)
+    return;
+
+  ScopedTimer timer(Phase::WRITE);
+  TreeConstructor::Trace::Span span("writeEdg",
+      TreeConstructor::Trace::Span::ALWAYS);
+  report.write_failed = !writer.finish();
+}
+
+/*
+ * Build every method graph of the file, resolve the calls, then emit the
+ * traversal of the whole program.
+ */
+static void processDexFile(DexFile *pDexFile, const DexGraph::Options& options,
+                           DexGraph::BuildReport& report, Fmt::Edg::Sink& sink)
+{
+  int i;
+  TreeConstructor::Trace::Span span("processDexFile",
+      TreeConstructor::Trace::Span::ALWAYS);
+
+  if (options.stream) {
+    streamDexFile(pDexFile, options, report, sink);
+    return;
+  }
+
+  using TreeConstructor::Stats::ScopedTimer;
+  using TreeConstructor::Stats::Phase;
+
+	// Construct {method, node} map for each method in the program.
+  std::map<TreeConstructor::MethodInfo, TreeConstructor::NodeSPtr>
+      method_node_map;
+  std::vector<TreeConstructor::NodeSPtr> call_node_vec;
+  bool overBudget = false;
+  {
+    ScopedTimer timer(Phase::CLASSES);
+    CallResolver resolver;
+    if (options.sharpen_calls)
+      resolver = buildCallResolver(pDexFile);
+    for (i = 0; i < (int)pDexFile->pHeader->classDefsSize && !overBudget; i++)
+    {
+      if (checkCancelled(options, report))
+        break;
+      if (!classDefSelected(pDexFile, i, options)) {
+        TreeConstructor::Stats::add(
+            TreeConstructor::Stats::Counter::CLASSES_FILTERED, 1);
+        continue;
+      }
+      auto const pair = dumpClass(pDexFile, i, options,
+          options.sharpen_calls ? &resolver : nullptr);
+      auto const& class_map = pair.first;
+      auto const& node_vec = pair.second;
+      TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::CLASSES, 1);
+      
+      {
+        TreeConstructor::Stats::MemoryScope memory(
+            TreeConstructor::Stats::Memory::STRINGS);
+        method_node_map.insert(class_map.begin(), class_map.end());
+      }
+      TreeConstructor::Stats::MemoryScope memory(
+          TreeConstructor::Stats::Memory::EDGES);
+      call_node_vec.insert(call_node_vec.end(), node_vec.begin(), node_vec.end());
+      overBudget =
+          TreeConstructor::Stats::over_memory_budget(options.memory_budget);
+    }
+  }
+
+  /*
+   * Nothing is emitted before the traversal, so a file that does not fit
+   * the memory budget can start over in streaming mode.
+   */
+  if (overBudget || report.cancelled) {
+    TreeConstructor::release_graph(method_node_map);
+    method_node_map.clear();
+    call_node_vec.clear();
+    if (report.cancelled)
+      return;
+    if (options.xrefs != nullptr) {
+      options.xrefs->fields.clear();
+      options.xrefs->strings.clear();
+    }
+    TreeConstructor::Stats::add(
+        TreeConstructor::Stats::Counter::STREAM_FALLBACKS, 1);
+    report.stream_fallback = true;
+    streamDexFile(pDexFile, options, report, sink);
+    return;
+  }
+
+  // Graph memory from here on is edges, traversal and output
+  TreeConstructor::Stats::MemoryScope memory(
+      TreeConstructor::Stats::Memory::EDGES);
+
+  // Now that we have all the methods, we can resolve CALL instructions.
+  {
+    ScopedTimer timer(Phase::CALLS);
+    TreeConstructor::Trace::Span span("processCalls",
+        TreeConstructor::Trace::Span::ALWAYS);
+    addStubMethods(pDexFile, options, method_node_map, call_node_vec);
+    TreeConstructor::process_calls(method_node_map, call_node_vec);
+  }
+  
+  std::vector<TreeConstructor::NodeSPtr> nodesptr_vec;
+  std::vector<std::pair<TreeConstructor::NodeSPtr,
+                        TreeConstructor::NodeSPtr>> edges_vec;
+  {
+    ScopedTimer timer(Phase::TRAVERSAL);
+    TreeConstructor::Trace::Span span("traversal",
+        TreeConstructor::Trace::Span::ALWAYS);
+    for (auto const& pair: method_node_map)
+    {
+      if (checkCancelled(options, report))
+        break;
+      std::vector<TreeConstructor::NodeSPtr> current_nodesptr_vec;
+      std::vector<std::pair<TreeConstructor::NodeSPtr,
+                            TreeConstructor::NodeSPtr>> current_edges_vec;
+      TreeConstructor::traverse(*pair.second,
+          [&](TreeConstructor::NodeSPtr const& node) {
+            current_nodesptr_vec.push_back(node);
+            for (auto const& child : node->next_nodes)
+              current_edges_vec.emplace_back(node, child);
+          });
+      // Update global vecs
+  		for (auto const& node : current_nodesptr_vec)
+  		{
+  			auto const it = std::find_if(nodesptr_vec.begin(),
+                                     nodesptr_vec.end(),
+                                     [&](TreeConstructor::NodeSPtr current_node) -> bool {
+                                       return current_node->baseAddr == node->baseAddr;
+                                     });
+  			if (it == std::end(nodesptr_vec))
+  				nodesptr_vec.push_back(node);
+  		}
+															
+      edges_vec.insert(edges_vec.begin(),
+                       current_edges_vec.begin(),
+                       current_edges_vec.end());
+    }
+  }
+  // Emit in Edg order
+  if (!report.cancelled) {
+    ScopedTimer timer(Phase::WRITE);
+    TreeConstructor::Trace::Span span("writeEdg",
+        TreeConstructor::Trace::Span::ALWAYS);
+    sink.dump_method(nodesptr_vec, edges_vec);
+    report.write_failed = !sink.finish();
+  }
+
+  // Graphs are cyclic (loops, recursive calls): unlink them to free them
+  TreeConstructor::release_graph(method_node_map);
+}
+
+/*
+ * Read AndroidManifest.xml of an open archive into manifest, if there is
+ * one.  Leaves manifest empty on any failure.
+ */
+static void readManifest(ZipArchive* pArchive, std::vector<uint8_t>& manifest)
+{
+    static const char* kManifest = "AndroidManifest.xml";
+    manifest.clear();
+
+    ZipEntry entry = dexZipFindEntry(pArchive, kManifest);
+    if (entry == nullptr)
+        return;
+    long const length = dexGetZipEntryUncompLen(pArchive, entry);
+    if (length <= 0)
+        return;
+
+    int fd = memfd_create(kManifest, MFD_CLOEXEC);
+    if (fd < 0)
+        return;
+    manifest.resize(length);
+    if (!dexZipExtractEntryToFile(pArchive, entry, fd) ||
+            pread(fd, manifest.data(), length, 0) != length)
+        manifest.clear();
+    close(fd);
+}
+
+/*
+ * Extract classes.dex of an open archive to an anonymous memory file and
+ * map it privately, and read its manifest.  Closes the archive.
+ */
+static bool mapClassesDex(ZipArchive* pArchive, MemMapping* pMap,
+    std::vector<uint8_t>& manifest, std::string& error)
+{
+    static const char* kFileToExtract = "classes.dex";
+    bool result = false;
+    int fd = -1;
+
+    ZipEntry entry = dexZipFindEntry(pArchive, kFileToExtract);
+    if (entry == nullptr) {
+        error = "Zip has no classes.dex";
+        goto bail;
+    }
+
+    fd = memfd_create(kFileToExtract, MFD_CLOEXEC);
+    if (fd < 0) {
+        error = std::string("Unable to create memory file: ") + strerror(errno);
+        goto bail;
+    }
+
+    if (!dexZipExtractEntryToFile(pArchive, entry, fd) ||
+            lseek(fd, 0, SEEK_SET) != 0) {
+        error = "Extract of classes.dex failed";
+        goto bail;
+    }
+
+    if (sysMapFileInShmemWritableReadOnly(fd, pMap) != 0) {
+        error = "Unable to map classes.dex";
+        goto bail;
+    }
+    readManifest(pArchive, manifest);
+    result = true;
+
+bail:
+    if (fd >= 0)
+        close(fd);
+    dexZipCloseArchive(pArchive);
+    return result;
+}
+
+namespace DexGraph
+{
+Dex::Dex()
+{
+  memset(&mapping, 0, sizeof(mapping));
+}
+
+Dex::~Dex()
+{
+  if (dex != nullptr)
+    dexFileFree(dex);
+  if (mapping.addr != nullptr)
+  {
+    TreeConstructor::Stats::track(TreeConstructor::Stats::Memory::DEX_MAPPING,
+                                  -(int64_t)mapping.length);
+    sysReleaseShmem(&mapping);
+  }
+}
+
+std::unique_ptr<Dex> Dex::map(std::string const& path, std::string& error)
+{
+  TreeConstructor::Stats::ScopedTimer timer(
+      TreeConstructor::Stats::Phase::OPEN);
+  std::unique_ptr<Dex> ret(new Dex());
+
+  // Anything but .dex may be a zip with classes.dex inside
+  auto const is_dex = path.size() >= 3 &&
+      strcasecmp(path.c_str() + path.size() - 3, "dex") == 0;
+  bool mapped = false;
+  if (!is_dex)
+  {
+    ZipArchive archive;
+    if (dexZipOpenArchive(path.c_str(), &archive) == 0)
+    {
+      if (!mapClassesDex(&archive, &ret->mapping, ret->manifest_data, error))
+        return nullptr;
+      mapped = true;
+    }
+  }
+
+  if (!mapped)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      error = "unable to open '" + path + "': " + strerror(errno);
+      return nullptr;
+    }
+    auto const failed = sysMapFileInShmemWritableReadOnly(fd, &ret->mapping);
+    close(fd);
+    if (failed != 0)
+    {
+      error = "Unable to map " + path;
+      return nullptr;
+    }
+  }
+
+  TreeConstructor::Stats::track(TreeConstructor::Stats::Memory::DEX_MAPPING,
+                                ret->mapping.length);
+  return ret;
+}
+
+std::unique_ptr<Dex> Dex::map_memory(void const* data, std::size_t length,
+                                     std::string& error)
+{
+  TreeConstructor::Stats::ScopedTimer timer(
+      TreeConstructor::Stats::Phase::OPEN);
+  std::unique_ptr<Dex> ret(new Dex());
+
+  // Both the zip reader and the mapping helpers want a file descriptor
+  int fd = memfd_create("dex", MFD_CLOEXEC);
+  if (fd < 0)
+  {
+    error = std::string("Unable to create memory file: ") + strerror(errno);
+    return nullptr;
+  }
+  if (length == 0 || write(fd, data, length) != (ssize_t)length ||
+      lseek(fd, 0, SEEK_SET) != 0)
+  {
+    close(fd);
+    error = "Unable to copy " + std::to_string(length) + " bytes to memory file";
+    return nullptr;
+  }
+
+  if (length >= 4 && memcmp(data, "PK\3\4", 4) == 0)
+  {
+    // The archive owns fd from here, even on failure
+    ZipArchive archive;
+    if (dexZipPrepArchive(fd, "<memory>", &archive) != 0)
+    {
+      error = "Unable to open buffer as zip archive";
+      return nullptr;
+    }
+    if (!mapClassesDex(&archive, &ret->mapping, ret->manifest_data, error))
+      return nullptr;
+  }
+  else
+  {
+    auto const failed = sysMapFileInShmemWritableReadOnly(fd, &ret->mapping);
+    close(fd);
+    if (failed != 0)
+    {
+      error = "Unable to map buffer";
+      return nullptr;
+    }
+  }
+
+  TreeConstructor::Stats::track(TreeConstructor::Stats::Memory::DEX_MAPPING,
+                                ret->mapping.length);
+  return ret;
+}
+
+std::unique_ptr<Dex> Dex::open(std::string const& path,
+                               Options const& options,
+                               std::string& error)
+{
+  auto ret = map(path, error);
+  if (ret == nullptr || !ret->parse(options, error))
+    return nullptr;
+  return ret;
+}
+
+std::unique_ptr<Dex> Dex::open_memory(void const* data, std::size_t length,
+                                      Options const& options,
+                                      std::string& error)
+{
+  auto ret = map_memory(data, length, error);
+  if (ret == nullptr || !ret->parse(options, error))
+    return nullptr;
+  return ret;
+}
+
+bool Dex::parse(Options const& options, std::string& error)
+{
+  using TreeConstructor::Stats::ScopedTimer;
+  using TreeConstructor::Stats::Phase;
+
+  if (dex != nullptr)
+    return true;
+
+  // Full structural verification (and byte swap) of the private mapping
+  if (options.verify_threads > 0)
+  {
+    ScopedTimer timer(Phase::VERIFY);
+    int failed = -1;
+    if (sysChangeMapAccess(mapping.addr, mapping.length, true, &mapping) == 0)
+    {
+      failed = dexFixByteOrderingParallel((u1*)mapping.addr, mapping.length,
+                                          options.verify_threads);
+      sysChangeMapAccess(mapping.addr, mapping.length, false, &mapping);
+    }
+    if (failed != 0)
+    {
+      error = "structural verification failed";
+      return false;
+    }
+  }
+
+  int flags = kDexParseVerifyChecksum;
+  if (options.ignore_bad_checksum)
+    flags |= kDexParseContinueOnError;
+  if (options.lazy_verify)
+    flags |= kDexParseVerifyLazy;
+
+  ScopedTimer timer(Phase::PARSE);
+  dex = dexFileParse((const u1*)mapping.addr, mapping.length, flags);
+  if (dex == nullptr)
+  {
+    error = "DEX parse failed";
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Opcode classes the metrics scan counts, from the same classifier as the
+ * graph nodes, looked up once per opcode.
+ */
+enum MetricsClass : u1 { METRICS_OTHER, METRICS_BRANCH, METRICS_INVOKE,
+    METRICS_SWITCH };
+
+static const u1* metricsClassTable()
+{
+  static const std::array<u1, kNumDalvikInstructions> table = []() {
+    std::array<u1, kNumDalvikInstructions> ret;
+    for (int i = 0; i < kNumDalvikInstructions; i++)
+    {
+      switch (OpCodeClassifier::get_opcode_type((OpCode) i))
+      {
+      case OpCodeType::IF:     ret[i] = METRICS_BRANCH; break;
+      case OpCodeType::CALL:   ret[i] = METRICS_INVOKE; break;
+      case OpCodeType::SWITCH: ret[i] = METRICS_SWITCH; break;
+      default:                 ret[i] = METRICS_OTHER;  break;
+      }
+    }
+    return ret;
+  }();
+  return table.data();
+}
+
+/*
+ * One pass over a code item: widths come from the VM table, switch sizes
+ * from the payload headers, nothing is decoded or allocated.
+ */
+static void scanMethodMetrics(const DexCode* pCode,
+    DexGraph::MethodMetrics& metrics)
+{
+  const u2* insns = pCode->insns;
+  const u4 insnsSize = pCode->insnsSize;
+  const u1* classes = metricsClassTable();
+
+  u4 insnIdx = 0;
+  while (insnIdx < insnsSize) {
+    u2 const instr = insns[insnIdx];
+    int const insnWidth = getInsnWidth(insns + insnIdx);
+    if (insnWidth == 0)
+      break;
+
+    bool const payload = instr == kPackedSwitchSignature ||
+        instr == kSparseSwitchSignature || instr == kArrayDataSignature;
+    if (!payload) {
+      metrics.instructions++;
+      switch (classes[instr & 0xff]) {
+      case METRICS_BRANCH:
+        metrics.branches++;
+        break;
+      case METRICS_INVOKE:
+        metrics.invokes++;
+        break;
+      case METRICS_SWITCH:
+        metrics.switches++;
+        if (insnIdx + 2 < insnsSize) {
+          s4 const offset = (s4)(insns[insnIdx + 1] | (insns[insnIdx + 2] << 16));
+          s8 const payloadIdx = (s8) insnIdx + offset;
+          if (payloadIdx >= 0 && payloadIdx + 1 < (s8) insnsSize &&
+              (insns[payloadIdx] == kPackedSwitchSignature ||
+               insns[payloadIdx] == kSparseSwitchSignature))
+            metrics.switch_cases += insns[payloadIdx + 1];
+        }
+        break;
+      }
+    }
+    insnIdx += insnWidth;
+  }
+  metrics.cyclomatic = 1 + metrics.branches + metrics.switch_cases;
+  TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::INSTRUCTIONS,
+                              metrics.instructions);
+}
+
+/*
+ * Patterns with glob characters are matched whole, the others as prefixes.
+ */
+static bool matchesClassPattern(std::string const& pattern,
+                                char const* descriptor)
+{
+  if (pattern.find_first_of("*?[") != std::string::npos)
+    return fnmatch(pattern.c_str(), descriptor, 0) == 0;
+  return strncmp(descriptor, pattern.c_str(), pattern.size()) == 0;
+}
+
+/*
+ * Call visit(pDexMethod) for every method with code of the classes the
+ * options select, in class_def order, counting classes and methods. False
+ * if cancelled.
+ */
+template <typename Visitor>
+static bool forEachSelectedMethod(DexFile* pDexFile, const Options& options,
+                                  Visitor&& visit)
+{
+  BuildReport report;
+  for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++)
+  {
+    if (checkCancelled(options, report))
+      return false;
+    if (!classDefSelected(pDexFile, i, options))
+    {
+      TreeConstructor::Stats::add(
+          TreeConstructor::Stats::Counter::CLASSES_FILTERED, 1);
+      continue;
+    }
+    DexClassData* pClassData = readClassData(pDexFile, i);
+    if (pClassData == nullptr)
+      continue;
+    TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::CLASSES, 1);
+
+    u4 const methods_size = pClassData->header.directMethodsSize +
+                            pClassData->header.virtualMethodsSize;
+    u4 scanned = 0;
+    for (u4 j = 0; j < methods_size; j++)
+    {
+      const DexMethod* pDexMethod =
+          j < pClassData->header.directMethodsSize
+              ? &pClassData->directMethods[j]
+              : &pClassData->virtualMethods[j - pClassData->header.directMethodsSize];
+      if (pDexMethod->codeOff == 0 || (options.exports_only &&
+          (pDexMethod->accessFlags & (ACC_PUBLIC | ACC_PROTECTED)) == 0))
+        continue;
+      visit(pDexMethod);
+      scanned++;
+    }
+    TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::METHODS,
+                                scanned);
+    freeClassData(pClassData);
+  }
+  return true;
+}
+
+std::vector<MethodMetrics> metrics(Dex const& dex, Options const& options)
+{
+  using TreeConstructor::Stats::ScopedTimer;
+  using TreeConstructor::Stats::Phase;
+
+  ScopedTimer timer(Phase::CLASSES);
+  DexFile* pDexFile = dex.dex_file();
+  assert(pDexFile != nullptr);
+  std::vector<MethodMetrics> ret;
+
+  bool const done = forEachSelectedMethod(pDexFile, options,
+      [&](const DexMethod* pDexMethod) {
+        MethodMetrics method;
+        method.method_idx = pDexMethod->methodIdx;
+        scanMethodMetrics(dexGetCode(pDexFile, pDexMethod), method);
+        ret.push_back(method);
+      });
+  return done ? ret : std::vector<MethodMetrics>();
+}
+
+/*
+ * Append every invoke of a code item to callees, as its method_idx << 1,
+ * plus 1 for a virtual or interface invoke.
+ */
+static void scanMethodCallees(const DexCode* pCode,
+    std::vector<uint32_t>& callees)
+{
+  const u2* insns = pCode->insns;
+  const u4 insnsSize = pCode->insnsSize;
+
+  u4 insnIdx = 0;
+  while (insnIdx < insnsSize) {
+    int const insnWidth = getInsnWidth(insns + insnIdx);
+    if (insnWidth == 0)
+      break;
+    u1 const opcode = insns[insnIdx] & 0xff;
+    bool const invoke =
+        (opcode >= OP_INVOKE_VIRTUAL && opcode <= OP_INVOKE_INTERFACE) ||
+        (opcode >= OP_INVOKE_VIRTUAL_RANGE && opcode <= OP_INVOKE_INTERFACE_RANGE);
+    bool const virtualCall =
+        opcode == OP_INVOKE_VIRTUAL || opcode == OP_INVOKE_INTERFACE ||
+        opcode == OP_INVOKE_VIRTUAL_RANGE || opcode == OP_INVOKE_INTERFACE_RANGE;
+    if (invoke && insnIdx + 1 < insnsSize)
+      callees.push_back((u4)insns[insnIdx + 1] << 1 | (virtualCall ? 1 : 0));
+    insnIdx += insnWidth;
+  }
+}
+
+/*
+ * Methods of the dex each method_id invoked may run, over all the kinds
+ * of invokes naming it (see dispatchTargets).
+ */
+struct Dispatch
+{
+  std::vector<uint32_t> target_begin;  // method_count + 1 offsets
+  std::vector<uint32_t> targets;       // sorted, unique per method_id
+};
+
+/*
+ * Call graph of the selected methods, and their code items by method_idx
+ * in pCode and the dispatch of the method_ids they invoke in pDispatch if
+ * set.  An invoke calls the method_id it names and each method it
+ * dispatches to.
+ */
+static CallGraph scanCallGraph(DexFile* pDexFile, const Options& options,
+    std::vector<const DexCode*>* pCode, Dispatch* pDispatch = nullptr)
+{
+  using TreeConstructor::Stats::ScopedTimer;
+  using TreeConstructor::Stats::Phase;
+
+  ScopedTimer timer(Phase::CLASSES);
+  assert(pDexFile != nullptr);
+  TreeConstructor::Stats::MemoryScope memory(
+      TreeConstructor::Stats::Memory::EDGES);
+
+  CallGraph graph;
+  graph.method_count = pDexFile->pHeader->methodIdsSize;
+  graph.defined.assign((graph.method_count + 63) / 64, 0);
+  if (pCode != nullptr)
+    pCode->assign(graph.method_count, nullptr);
+
+  // Callees of each method, sorted and deduplicated, in class_def order
+  std::vector<uint32_t> callers;
+  std::vector<uint32_t> caller_begin(1, 0);
+  std::vector<uint32_t> flat;
+  std::vector<uint32_t> scratch;
+  bool const done = forEachSelectedMethod(pDexFile, options,
+      [&](const DexMethod* pDexMethod) {
+        u4 const methodIdx = pDexMethod->methodIdx;
+        if (methodIdx >= graph.method_count)
+          return;
+        const DexCode* pMethodCode = dexGetCode(pDexFile, pDexMethod);
+        if (pCode != nullptr)
+          (*pCode)[methodIdx] = pMethodCode;
+        scratch.clear();
+        scanMethodCallees(pMethodCode, scratch);
+        std::sort(scratch.begin(), scratch.end());
+        scratch.erase(std::unique(scratch.begin(), scratch.end()),
+                      scratch.end());
+        while (!scratch.empty() && (scratch.back() >> 1) >= graph.method_count)
+          scratch.pop_back();
+        graph.defined[methodIdx / 64] |= uint64_t(1) << (methodIdx % 64);
+        callers.push_back(methodIdx);
+        flat.insert(flat.end(), scratch.begin(), scratch.end());
+        caller_begin.push_back(flat.size());
+      });
+  if (!done)
+    return CallGraph();
+
+  // The targets of each distinct invoke, then the callees of each method:
+  // the method_ids invoked and their targets
+  std::vector<uint32_t> invoked(flat);
+  std::sort(invoked.begin(), invoked.end());
+  invoked.erase(std::unique(invoked.begin(), invoked.end()), invoked.end());
+  std::vector<uint32_t> target_begin(1, 0);
+  std::vector<uint32_t> targets;
+  {
+    auto const resolver = buildCallResolver(pDexFile);
+    for (auto const callee : invoked)
+    {
+      dispatchTargets(pDexFile, resolver, callee >> 1, callee & 1, targets);
+      target_begin.push_back(targets.size());
+    }
+  }
+  std::vector<uint32_t> expanded;
+  std::vector<uint32_t> expanded_begin(1, 0);
+  for (std::size_t i = 0; i + 1 < caller_begin.size(); i++)
+  {
+    scratch.clear();
+    for (auto c = caller_begin[i]; c < caller_begin[i + 1]; c++)
+    {
+      auto const k = std::lower_bound(invoked.begin(), invoked.end(), flat[c]) -
+                     invoked.begin();
+      scratch.push_back(flat[c] >> 1);
+      scratch.insert(scratch.end(), targets.begin() + target_begin[k],
+                     targets.begin() + target_begin[k + 1]);
+    }
+    std::sort(scratch.begin(), scratch.end());
+    scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+    expanded.insert(expanded.end(), scratch.begin(), scratch.end());
+    expanded_begin.push_back(expanded.size());
+  }
+  flat.swap(expanded);
+  caller_begin.swap(expanded_begin);
+
+  if (pDispatch != nullptr)
+  {
+    // invoked is sorted, so the kinds naming one method_id are adjacent
+    pDispatch->target_begin.assign(graph.method_count + 1, 0);
+    pDispatch->targets.clear();
+    std::size_t k = 0;
+    for (u4 m = 0; m < graph.method_count; m++)
+    {
+      auto const first = pDispatch->targets.size();
+      for (; k < invoked.size() && (invoked[k] >> 1) == m; k++)
+        pDispatch->targets.insert(pDispatch->targets.end(),
+                                  targets.begin() + target_begin[k],
+                                  targets.begin() + target_begin[k + 1]);
+      std::sort(pDispatch->targets.begin() + first, pDispatch->targets.end());
+      pDispatch->targets.erase(std::unique(pDispatch->targets.begin() + first,
+                                           pDispatch->targets.end()),
+                               pDispatch->targets.end());
+      pDispatch->target_begin[m + 1] = pDispatch->targets.size();
+    }
+  }
+
+  // Reindex by method_idx
+  graph.callee_begin.assign(graph.method_count + 1, 0);
+  for (std::size_t i = 0; i < callers.size(); i++)
+    graph.callee_begin[callers[i] + 1] = caller_begin[i + 1] - caller_begin[i];
+  for (u4 m = 0; m < graph.method_count; m++)
+    graph.callee_begin[m + 1] += graph.callee_begin[m];
+  graph.callees.resize(flat.size());
+  for (std::size_t i = 0; i < callers.size(); i++)
+    std::copy(flat.begin() + caller_begin[i], flat.begin() + caller_begin[i + 1],
+              graph.callees.begin() + graph.callee_begin[callers[i]]);
+  return graph;
+}
+
+CallGraph call_graph(Dex const& dex, Options const& options)
+{
+  return scanCallGraph(dex.dex_file(), options, nullptr);
+}
+
+std::vector<uint32_t> entry_points(Dex const& dex,
+                                   std::vector<std::string> const& specs)
+{
+  DexFile* pDexFile = dex.dex_file();
+  assert(pDexFile != nullptr);
+  std::vector<uint32_t> ret;
+  if (specs.empty())
+    return ret;
+
+  for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++)
+  {
+    const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+    const char* descriptor = dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
+    std::vector<std::string> names;
+    bool all_methods = false;
+    for (auto const& spec : specs)
+    {
+      auto const arrow = spec.find("->");
+      if (!matchesClassPattern(spec.substr(0, arrow), descriptor))
+        continue;
+      if (arrow == std::string::npos)
+        all_methods = true;
+      else
+        names.push_back(spec.substr(arrow + 2));
+    }
+    if (!all_methods && names.empty())
+      continue;
+
+    DexClassData* pClassData = readClassData(pDexFile, i);
+    if (pClassData == nullptr)
+      continue;
+    u4 const methods_size = pClassData->header.directMethodsSize +
+                            pClassData->header.virtualMethodsSize;
+    for (u4 j = 0; j < methods_size; j++)
+    {
+      const DexMethod* pDexMethod =
+          j < pClassData->header.directMethodsSize
+              ? &pClassData->directMethods[j]
+              : &pClassData->virtualMethods[j - pClassData->header.directMethodsSize];
+      if (pDexMethod->codeOff == 0)
+        continue;
+      const char* name = dexStringById(pDexFile,
+          dexGetMethodId(pDexFile, pDexMethod->methodIdx)->nameIdx);
+      if (all_methods ||
+          std::any_of(names.begin(), names.end(), [name](std::string const& glob) {
+            return fnmatch(glob.c_str(), name, 0) == 0;
+          }))
+        ret.push_back(pDexMethod->methodIdx);
+    }
+    freeClassData(pClassData);
+  }
+  return ret;
+}
+
+/*
+ * Index of the node at offset in a decoded node vector (address order),
+ * or -1.
+ */
+static int64_t nodeIndexAt(std::vector<TreeConstructor::NodeSPtr> const& nodes,
+                           uint32_t offset)
+{
+  auto const it = std::lower_bound(nodes.begin(), nodes.end(), offset,
+      [](TreeConstructor::NodeSPtr const& node, uint32_t value) {
+        return node->intern_offset < value;
+      });
+  if (it == nodes.end() || (*it)->intern_offset != offset)
+    return -1;
+  return it - nodes.begin();
+}
+
+Icfg icfg(Dex const& dex, Options const& options)
+{
+  using TreeConstructor::Stats::ScopedTimer;
+  using TreeConstructor::Stats::Phase;
+
+  ScopedTimer timer(Phase::CLASSES);
+  DexFile* pDexFile = dex.dex_file();
+  assert(pDexFile != nullptr);
+  TreeConstructor::Stats::MemoryScope memory(
+      TreeConstructor::Stats::Memory::EDGES);
+
+  struct CallSite
+  {
+    uint32_t site;
+    uint32_t callee;       // method_idx
+    int64_t return_site;   // -1 if the call ends the method
+  };
+  struct RawEdge
+  {
+    uint32_t from;
+    uint32_t to;
+    EdgeKind kind;
+  };
+
+  Icfg graph;
+  std::vector<RawEdge> edges;
+  std::vector<CallSite> calls;
+  std::vector<uint32_t> returns;       // RET nodes, grouped by method
+  std::vector<uint32_t> return_begin(1, 0);
+  std::vector<int64_t> built(pDexFile->pHeader->methodIdsSize, -1);
+  CallResolver resolver;
+  if (options.sharpen_calls)
+    resolver = buildCallResolver(pDexFile);
+
+  bool const done = forEachSelectedMethod(pDexFile, options,
+      [&](const DexMethod* pDexMethod) {
+        const DexCode* pCode = dexGetCode(pDexFile, pDexMethod);
+        TreeConstructor::Liveness::RegisterEffects effects;
+        TreeConstructor::Sccp::Code operands;
+        auto const nodes = decodeMethodNodes(pDexFile, pCode,
+            recordEffects(options) ? &effects : nullptr,
+            recordOperands(options) ? &operands : nullptr);
+        if (nodes.empty() || pDexMethod->methodIdx >= built.size())
+          return;
+        TreeConstructor::construct_node_from_vec(nodes);
+        if (options.prune_infeasible)
+          pruneInfeasible(pCode, nodes, operands, effects);
+        if (options.sharpen_calls)
+          sharpenCalls(pDexFile, pDexMethod, pCode, nodes, operands, effects,
+              resolver);
+
+        // Number the nodes reached from the entry, as build() emits them
+        std::vector<int64_t> local(nodes.size(), -1);
+        std::vector<uint32_t> order{ 0 };
+        auto const base = (uint32_t)graph.addrs.size();
+        local[0] = base;
+        for (std::size_t i = 0; i < order.size(); i++)
+        {
+          for (auto const& child : nodes[order[i]]->next_nodes)
+          {
+            auto const c = nodeIndexAt(nodes, child->intern_offset);
+            if (c >= 0 && nodes[c] == child && local[c] < 0)
+            {
+              local[c] = base + order.size();
+              order.push_back(c);
+            }
+          }
+        }
+        std::sort(order.begin(), order.end());
+        for (std::size_t i = 0; i < order.size(); i++)
+          local[order[i]] = base + i;
+
+        built[pDexMethod->methodIdx] = graph.method_idx.size();
+        graph.method_idx.push_back(pDexMethod->methodIdx);
+        graph.method_begin.push_back(base);
+        for (auto const n : order)
+        {
+          auto const& node = *nodes[n];
+          auto const id = (uint32_t)local[n];
+          graph.addrs.push_back(node.baseAddr);
+          graph.types.push_back(node.opcode_type);
+          if (node.opcode_type == OpCodeType::RET)
+            returns.push_back(id);
+
+          int64_t return_site = -1;
+          bool const call = node.opcode_type == OpCodeType::CALL;
+          for (auto const& child : node.next_nodes)
+          {
+            auto const c = nodeIndexAt(nodes, child->intern_offset);
+            if (c < 0 || nodes[c] != child)
+              continue;
+            bool const fallthrough =
+                child->intern_offset == node.intern_offset + node.size;
+            if (call && fallthrough)
+              return_site = local[c];
+            edges.push_back(RawEdge{ id, (uint32_t)local[c],
+                call && fallthrough ? EdgeKind::CALL_TO_RETURN
+                                    : EdgeKind::INTRA });
+          }
+          // No method_info when the invoke's method_idx is out of range
+          if (call && !node.called_method_info.class_descriptor.empty())
+            calls.push_back(CallSite{ id,
+                node.called_method_info.method_idx, return_site });
+        }
+        return_begin.push_back(returns.size());
+        TreeConstructor::release_nodes(nodes);
+      });
+  if (!done)
+    return Icfg();
+  graph.method_begin.push_back(graph.addrs.size());
+
+  // Calls into built methods, and their returns
+  for (auto const& call : calls)
+  {
+    if (call.callee >= built.size() || built[call.callee] < 0)
+      continue;
+    auto const m = built[call.callee];
+    edges.push_back(RawEdge{ call.site, graph.method_begin[m], EdgeKind::CALL });
+    if (call.return_site < 0)
+      continue;
+    for (auto r = return_begin[m]; r < return_begin[m + 1]; r++)
+      edges.push_back(RawEdge{ returns[r], (uint32_t)call.return_site,
+                               EdgeKind::RETURN });
+  }
+
+  // Compressed rows, edges of a node in the order found
+  auto const node_count = graph.addrs.size();
+  graph.succ_begin.assign(node_count + 1, 0);
+  for (auto const& edge : edges)
+    graph.succ_begin[edge.from + 1]++;
+  for (std::size_t n = 0; n < node_count; n++)
+    graph.succ_begin[n + 1] += graph.succ_begin[n];
+  graph.succs.resize(edges.size());
+  graph.kinds.resize(edges.size());
+  std::vector<uint32_t> fill(graph.succ_begin.begin(), graph.succ_begin.end() - 1);
+  for (auto const& edge : edges)
+  {
+    auto const slot = fill[edge.from]++;
+    graph.succs[slot] = edge.to;
+    graph.kinds[slot] = edge.kind;
+  }
+
+  graph.by_addr.resize(node_count);
+  for (std::size_t n = 0; n < node_count; n++)
+    graph.by_addr[n] = n;
+  std::sort(graph.by_addr.begin(), graph.by_addr.end(),
+            [&graph](uint32_t lhs, uint32_t rhs) {
+              return graph.addrs[lhs] < graph.addrs[rhs];
+            });
+  return graph;
+}
+
+int64_t Icfg::find(uint64_t addr) const
+{
+  auto const it = std::lower_bound(by_addr.begin(), by_addr.end(), addr,
+      [this](uint32_t node, uint64_t value) { return addrs[node] < value; });
+  if (it == by_addr.end() || addrs[*it] != addr)
+    return -1;
+  return *it;
+}
+
+bool components(Dex const& dex, std::vector<Component>& components,
+                std::string& error)
+{
+  DexFile* pDexFile = dex.dex_file();
+  assert(pDexFile != nullptr);
+  components.clear();
+  if (dex.manifest().empty())
+  {
+    error = "no AndroidManifest.xml";
+    return false;
+  }
+  TreeConstructor::Axml::Manifest manifest;
+  if (!TreeConstructor::Axml::parse_manifest(dex.manifest().data(),
+          dex.manifest().size(), manifest, error))
+    return false;
+
+  // Plain dex files carry no lookup table, build one for this call
+  DexFile lookupFile = *pDexFile;
+  DexClassLookup* pLookup = nullptr;
+  if (lookupFile.pClassLookup == nullptr)
+  {
+    pLookup = dexCreateClassLookup(pDexFile);
+    if (pLookup == nullptr)
+    {
+      error = "out of memory";
+      return false;
+    }
+    lookupFile.pClassLookup = pLookup;
+  }
+
+  for (auto const& entry : manifest.components)
+  {
+    Component component;
+    component.kind = entry.kind;
+    component.name = entry.name;
+    component.descriptor =
+        TreeConstructor::Axml::class_descriptor(entry.name);
+    const DexClassDef* pClassDef =
+        dexFindClass(&lookupFile, component.descriptor.c_str());
+    if (pClassDef != nullptr)
+      component.class_def_idx = pClassDef - dexGetClassDef(pDexFile, 0);
+    components.push_back(std::move(component));
+  }
+  free(pLookup);
+  return true;
+}
+
+std::vector<std::string> lifecycle_entry_specs(
+    std::vector<Component> const& components)
+{
+  using TreeConstructor::Axml::ComponentKind;
+  std::vector<std::string> ret;
+  for (auto const& component : components)
+  {
+    if (component.class_def_idx < 0)
+      continue;
+    std::vector<char const*> names = { "<init>", "<clinit>", "on*" };
+    if (component.kind == ComponentKind::APPLICATION)
+      names.push_back("attachBaseContext");
+    if (component.kind == ComponentKind::PROVIDER)
+      names.insert(names.end(), { "query", "insert", "bulkInsert", "update",
+                                  "delete", "getType", "call", "openFile",
+                                  "applyBatch" });
+    for (auto const name : names)
+      ret.push_back(component.descriptor + "->" + name);
+  }
+  return ret;
+}
+
+std::vector<uint64_t> reachable(CallGraph const& graph,
+                                std::vector<uint32_t> const& entries)
+{
+  auto const words = (graph.method_count + 63) / 64;
+  std::vector<uint64_t> visited(words, 0);
+  std::vector<uint64_t> frontier(words, 0);
+  std::vector<uint64_t> next(words, 0);
+  if (graph.callee_begin.size() != graph.method_count + 1)
+    return visited;
+
+  for (auto const entry : entries)
+  {
+    if (entry >= graph.method_count)
+      continue;
+    visited[entry / 64] |= uint64_t(1) << (entry % 64);
+    frontier[entry / 64] |= uint64_t(1) << (entry % 64);
+  }
+
+  // One level of the breadth-first search per pass over the frontier
+  bool pending = !entries.empty();
+  while (pending)
+  {
+    pending = false;
+    for (uint32_t w = 0; w < words; w++)
+    {
+      for (auto bits = frontier[w]; bits != 0; bits &= bits - 1)
+      {
+        auto const caller = w * 64 + (uint32_t)__builtin_ctzll(bits);
+        for (auto c = graph.callee_begin[caller];
+             c < graph.callee_begin[caller + 1]; c++)
+        {
+          auto const callee = graph.callees[c];
+          auto const bit = uint64_t(1) << (callee % 64);
+          if (visited[callee / 64] & bit)
+            continue;
+          visited[callee / 64] |= bit;
+          next[callee / 64] |= bit;
+          pending = true;
+        }
+      }
+    }
+    frontier.swap(next);
+    std::fill(next.begin(), next.end(), 0);
+  }
+  return visited;
+}
+
+/*
+ * Flags of the method_ids a TaintSpec names.
+ */
+enum : uint8_t {
+  kTaintSource = 1,
+  kTaintSink = 2,
+};
+
+static std::vector<uint8_t> taintFlags(const DexFile* pDexFile,
+    const TaintSpec& spec)
+{
+  struct Pattern
+  {
+    std::string descriptor;
+    std::string name;
+    std::string proto;  // empty for any overload
+    uint8_t flag;
+  };
+  std::vector<Pattern> patterns;
+  for (int s = 0; s < 2; s++)
+  {
+    for (auto const& method : s == 0 ? spec.sources : spec.sinks)
+    {
+      auto const arrow = method.find("->");
+      if (arrow == std::string::npos)
+        continue;
+      auto const paren = method.find('(', arrow);
+      Pattern pattern;
+      pattern.descriptor = method.substr(0, arrow);
+      pattern.name = method.substr(arrow + 2,
+          paren == std::string::npos ? std::string::npos : paren - arrow - 2);
+      if (paren != std::string::npos)
+        pattern.proto = method.substr(paren);
+      pattern.flag = s == 0 ? kTaintSource : kTaintSink;
+      patterns.push_back(std::move(pattern));
+    }
+  }
+
+  std::vector<uint8_t> flags(pDexFile->pHeader->methodIdsSize, 0);
+  if (patterns.empty())
+    return flags;
+  DexStringCache cache;
+  dexStringCacheInit(&cache);
+  for (u4 m = 0; m < flags.size(); m++)
+  {
+    const DexMethodId* pMethodId = dexGetMethodId(pDexFile, m);
+    const char* descriptor = dexStringByTypeIdx(pDexFile, pMethodId->classIdx);
+    const char* name = dexStringById(pDexFile, pMethodId->nameIdx);
+    for (auto const& pattern : patterns)
+    {
+      if (pattern.descriptor != descriptor || pattern.name != name)
+        continue;
+      if (!pattern.proto.empty() && pattern.proto !=
+          dexGetDescriptorFromMethodId(pDexFile, pMethodId, &cache))
+        continue;
+      flags[m] |= pattern.flag;
+    }
+  }
+  dexStringCacheRelease(&cache);
+  return flags;
+}
+
+/*
+ * Strongly connected components of graph over the methods it defines, as
+ * runs of members, callees before callers (Tarjan, iterative).
+ */
+static void callGraphSccs(const CallGraph& graph,
+    std::vector<uint32_t>& members, std::vector<uint32_t>& scc_begin)
+{
+  auto const defined = [&graph](uint32_t m) {
+    return (graph.defined[m / 64] >> (m % 64)) & 1;
+  };
+  struct Frame
+  {
+    uint32_t method;
+    uint32_t next;  // callee to visit
+  };
+
+  std::vector<int64_t> index(graph.method_count, -1);
+  std::vector<uint32_t> low(graph.method_count, 0);
+  std::vector<bool> on_stack(graph.method_count, false);
+  std::vector<uint32_t> stack;
+  std::vector<Frame> frames;
+  uint32_t counter = 0;
+  auto const visit = [&](uint32_t m) {
+    index[m] = low[m] = counter++;
+    stack.push_back(m);
+    on_stack[m] = true;
+    frames.push_back(Frame{ m, graph.callee_begin[m] });
+  };
+
+  members.clear();
+  scc_begin.assign(1, 0);
+  for (uint32_t root = 0; root < graph.method_count; root++)
+  {
+    if (!defined(root) || index[root] >= 0)
+      continue;
+    visit(root);
+    while (!frames.empty())
+    {
+      auto const m = frames.back().method;
+      if (frames.back().next < graph.callee_begin[m + 1])
+      {
+        auto const callee = graph.callees[frames.back().next++];
+        if (!defined(callee))
+          continue;
+        if (index[callee] < 0)
+          visit(callee);
+        else if (on_stack[callee])
+          low[m] = std::min<uint32_t>(low[m], index[callee]);
+        continue;
+      }
+      frames.pop_back();
+      if (!frames.empty())
+      {
+        auto& caller_low = low[frames.back().method];
+        caller_low = std::min(caller_low, low[m]);
+      }
+      if (low[m] != index[m])
+        continue;
+      uint32_t member;
+      do
+      {
+        member = stack.back();
+        stack.pop_back();
+        on_stack[member] = false;
+        members.push_back(member);
+      } while (member != m);
+      scc_begin.push_back(members.size());
+    }
+  }
+}
+
+/*
+ * Taint summary of one method, its callees looked up in lookup.
+ */
+static TreeConstructor::Taint::Summary summarizeTaint(DexFile* pDexFile,
+    const DexCode* pCode, const Options& options,
+    const TreeConstructor::Taint::CalleeLookup& lookup)
+{
+  TreeConstructor::Liveness::RegisterEffects effects;
+  TreeConstructor::Sccp::Code operands;
+  auto const nodes = decodeMethodNodes(pDexFile, pCode, &effects, &operands);
+  if (nodes.empty())
+    return TreeConstructor::Taint::Summary();
+  TreeConstructor::construct_node_from_vec(nodes);
+  if (options.prune_infeasible)
+    pruneInfeasible(pCode, nodes, operands, effects);
+
+  TreeConstructor::Stats::MemoryScope memory(
+      TreeConstructor::Stats::Memory::OTHER);
+  auto summary = TreeConstructor::Taint::summarize(nodes, operands, effects,
+      pCode->registersSize, pCode->insSize, lookup);
+  TreeConstructor::release_nodes(nodes);
+  return summary;
+}
+
+std::vector<TaintLeak> taint(Dex const& dex, Options const& options,
+                             TaintSpec const& spec)
+{
+  using TreeConstructor::Taint::Site;
+  using TreeConstructor::Taint::Summary;
+
+  DexFile* pDexFile = dex.dex_file();
+  assert(pDexFile != nullptr);
+  std::vector<const DexCode*> code;
+  Dispatch dispatch;
+  auto const graph = scanCallGraph(pDexFile, options, &code, &dispatch);
+  if (graph.callee_begin.size() != graph.method_count + 1)
+    return std::vector<TaintLeak>();
+
+  using TreeConstructor::Stats::ScopedTimer;
+  using TreeConstructor::Stats::Phase;
+  ScopedTimer timer(Phase::CLASSES);
+
+  auto const flags = taintFlags(pDexFile, spec);
+  std::vector<uint32_t> members;
+  std::vector<uint32_t> scc_begin;
+  callGraphSccs(graph, members, scc_begin);
+  auto const scc_count = scc_begin.size() - 1;
+
+  // Depth of each SCC above the ones it calls: SCCs of one level are
+  // independent, and only read summaries of lower levels
+  std::vector<uint32_t> scc_of(graph.method_count, 0);
+  for (std::size_t s = 0; s < scc_count; s++)
+  {
+    for (auto i = scc_begin[s]; i < scc_begin[s + 1]; i++)
+      scc_of[members[i]] = s;
+  }
+  std::vector<uint32_t> level(scc_count, 0);
+  std::vector<bool> recursive(scc_count, false);
+  uint32_t level_count = 0;
+  for (std::size_t s = 0; s < scc_count; s++)
+  {
+    recursive[s] = scc_begin[s + 1] - scc_begin[s] > 1;
+    for (auto i = scc_begin[s]; i < scc_begin[s + 1]; i++)
+    {
+      auto const m = members[i];
+      for (auto c = graph.callee_begin[m]; c < graph.callee_begin[m + 1]; c++)
+      {
+        auto const callee = graph.callees[c];
+        if (code[callee] == nullptr)
+          continue;
+        if (scc_of[callee] == s)
+          recursive[s] = true;
+        else
+          level[s] = std::max(level[s], level[scc_of[callee]] + 1);
+      }
+    }
+    level_count = std::max(level_count, level[s] + 1);
+  }
+  std::vector<uint32_t> by_level(scc_count);
+  for (std::size_t s = 0; s < scc_count; s++)
+    by_level[s] = s;
+  std::stable_sort(by_level.begin(), by_level.end(),
+                   [&level](uint32_t lhs, uint32_t rhs) {
+                     return level[lhs] < level[rhs];
+                   });
+
+  // An invoke of a method_id runs one of the methods it dispatches to: it
+  // is a source or sink if any of them is, and otherwise carries the flows
+  // of all those with code
+  std::vector<Summary> summaries(graph.method_count);
+  auto const invokeFlags = [&](uint32_t m) {
+    uint8_t ret = flags[m];
+    for (auto t = dispatch.target_begin[m]; t < dispatch.target_begin[m + 1]; t++)
+      ret |= flags[dispatch.targets[t]];
+    return ret;
+  };
+  TreeConstructor::Taint::CalleeLookup const lookup = [&](uint32_t m) {
+    TreeConstructor::Taint::Callee callee;
+    if (m >= graph.method_count)
+      return callee;
+    auto const callee_flags = invokeFlags(m);
+    callee.source = (callee_flags & kTaintSource) != 0;
+    callee.sink = (callee_flags & kTaintSink) != 0;
+    // Only read until the next lookup of this thread
+    thread_local Summary merged;
+    for (auto t = dispatch.target_begin[m]; t < dispatch.target_begin[m + 1]; t++)
+    {
+      auto const target = dispatch.targets[t];
+      if (code[target] == nullptr)
+        continue;
+      if (callee.summary == nullptr)
+      {
+        callee.summary = &summaries[target];
+        continue;
+      }
+      if (callee.summary != &merged)
+      {
+        merged = Summary();
+        merged.to_return = callee.summary->to_return;
+        merged.to_sink = callee.summary->to_sink;
+        callee.summary = &merged;
+      }
+      merged.to_return |= summaries[target].to_return;
+      merged.to_sink |= summaries[target].to_sink;
+    }
+    return callee;
+  };
+  auto const solve = [&](uint32_t s) {
+    bool changed;
+    do
+    {
+      changed = false;
+      for (auto i = scc_begin[s]; i < scc_begin[s + 1]; i++)
+      {
+        auto const m = members[i];
+        auto summary = summarizeTaint(pDexFile, code[m], options, lookup);
+        changed |= !summary.same_flows(summaries[m]);
+        summary.keep_witnesses(summaries[m]);
+        summaries[m] = std::move(summary);
+      }
+    } while (recursive[s] && changed);
+  };
+
+  unsigned threads = spec.threads;
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  BuildReport report;
+  std::size_t first = 0;
+  for (uint32_t l = 0; l < level_count; l++)
+  {
+    if (checkCancelled(options, report))
+      return std::vector<TaintLeak>();
+    auto last = first;
+    while (last < scc_count && level[by_level[last]] == l)
+      last++;
+    std::atomic<std::size_t> next(first);
+    auto const work = [&]() {
+      for (auto i = next++; i < last; i = next++)
+        solve(by_level[i]);
+    };
+    // Counters are per thread: the workers hand theirs over when done
+    std::vector<TreeConstructor::Stats::Counts> counts(
+        std::min<std::size_t>(threads, last - first));
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < counts.size(); t++)
+    {
+      workers.emplace_back([&work, &counts, t]() {
+        work();
+        counts[t] = TreeConstructor::Stats::thread_counts();
+      });
+    }
+    work();
+    for (auto& worker : workers)
+      worker.join();
+    for (unsigned t = 1; t < counts.size(); t++)
+      TreeConstructor::Stats::add(counts[t]);
+    first = last;
+  }
+
+  // Witnesses, following the summaries down to the source and sink calls,
+  // through a method an invoke dispatches to whose summary has the flow
+  auto const dispatchedTo = [&](uint32_t callee,
+                                auto const& has_flow) -> uint32_t {
+    if (callee >= graph.method_count || invokeFlags(callee) != 0)
+      return kDexNoIndex;
+    for (auto t = dispatch.target_begin[callee];
+         t < dispatch.target_begin[callee + 1]; t++)
+    {
+      auto const target = dispatch.targets[t];
+      if (code[target] != nullptr && has_flow(summaries[target]))
+        return target;
+    }
+    return kDexNoIndex;
+  };
+  std::vector<TaintLeak> leaks;
+  for (uint32_t m = 0; m < graph.method_count; m++)
+  {
+    if (!summaries[m].leak)
+      continue;
+    TaintLeak leak;
+    leak.method_idx = m;
+    uint32_t method = m;
+    Site site = summaries[m].leak_source;
+    while (true)
+    {
+      leak.source_path.push_back(TaintStep{ method, site.offset, site.callee });
+      auto const target = dispatchedTo(site.callee, [](Summary const& callee) {
+        return (callee.to_return & TreeConstructor::Taint::source_bit()) != 0;
+      });
+      if (target == kDexNoIndex)
+        break;
+      method = target;
+      site = summaries[target].return_source;
+    }
+    method = m;
+    site = summaries[m].leak_sink;
+    while (true)
+    {
+      leak.sink_path.push_back(TaintStep{ method, site.offset, site.callee });
+      auto const slot = site.slot;
+      auto const target = dispatchedTo(site.callee, [slot](Summary const& callee) {
+        return callee.sink_site(slot) != nullptr;
+      });
+      if (target == kDexNoIndex)
+        break;
+      method = target;
+      site = *summaries[target].sink_site(slot);
+    }
+    leaks.push_back(std::move(leak));
+  }
+  return leaks;
+}
+
+bool class_selected(Options const& options, char const* descriptor)
+{
+  auto const matches = [descriptor](std::string const& pattern) {
+    return matchesClassPattern(pattern, descriptor);
+  };
+  if (!options.include_classes.empty() &&
+      std::none_of(options.include_classes.begin(),
+                   options.include_classes.end(), matches))
+    return false;
+  return std::none_of(options.exclude_classes.begin(),
+                      options.exclude_classes.end(), matches);
+}
+
+BuildReport build(Dex const& dex, Options const& options,
+                  Fmt::Edg::Sink& sink)
+{
+  BuildReport report;
+  assert(dex.dex_file() != nullptr);
+  processDexFile(dex.dex_file(), options, report, sink);
+  if (options.xrefs != nullptr)
+  {
+    options.xrefs->fields.finish(dex.dex_file()->pHeader->fieldIdsSize);
+    options.xrefs->strings.finish(dex.dex_file()->pHeader->stringIdsSize);
+  }
+  return report;
+}
+
+TreeConstructor::StringSearch::Index string_search(Dex const& dex,
+                                                   unsigned threads)
+{
+  DexFile* pDexFile = dex.dex_file();
+  assert(pDexFile != nullptr);
+  TreeConstructor::Stats::MemoryScope memory(
+      TreeConstructor::Stats::Memory::STRINGS);
+  std::vector<char const*> strings(pDexFile->pHeader->stringIdsSize);
+  for (u4 i = 0; i < strings.size(); i++)
+    strings[i] = dexStringById(pDexFile, i);
+  return TreeConstructor::StringSearch::Index(std::move(strings), threads);
+}
+
+void Graph::dump_node(uint64_t addr, OpCodeType opcode_type)
+{
+  nodes.push_back(Node{ addr, opcode_type });
+}
+
+void Graph::dump_edge(uint64_t from_addr, uint64_t to_addr)
+{
+  edges.push_back(Edge{ from_addr, to_addr });
+}
+
+std::string Graph::to_edg() const
+{
+  std::string edg = "GRAPHBIN";
+  edg.reserve(edg.size() + sizeof(uint32_t) + nodes.size() * 13 +
+              edges.size() * 17);
+  auto const append = [&edg](void const* data, std::size_t size) {
+    edg.append((char const*)data, size);
+  };
+  auto const node_count = (uint32_t)nodes.size();
+  append(&node_count, sizeof(node_count));
+  for (auto const& node : nodes)
+  {
+    auto const type = static_cast<uint32_t>(node.type);
+    edg += 'n';
+    append(&node.addr, sizeof(node.addr));
+    append(&type, sizeof(type));
+  }
+  for (auto const& edge : edges)
+  {
+    edg += 'e';
+    append(&edge.from, sizeof(edge.from));
+    append(&edge.to, sizeof(edge.to));
+  }
+  return edg;
+}
+
+bool Graph::finish()
+{
+  TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::NODES,
+                              nodes.size());
+  TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::EDGES,
+                              edges.size());
+  return true;
+}
+}
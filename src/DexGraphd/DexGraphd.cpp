@@ -0,0 +1,702 @@
+/*
+ * dexgraphd: keeps dexgraph warm behind a Unix domain socket, so that
+ * opening one APK after another pays neither process startup nor VM table
+ * setup, and reopening one is answered from memory.
+ *
+ * Requests are lines of "<id> <command> [options] <path>"; the path is the
+ * rest of the line and should be absolute.
+ *
+ *   analyze [-e] [-i] [-p] [-R] [-s] [-z] [-I class] [-V threads]
+ *           [-X class] [-o file] path
+ *       Build the graph of a dex or APK, or take it from the cache.
+ *       Replies "<id> edg <length>\n" followed by the Edg bytes, or with
+ *       -o writes them to file and replies "<id> file <file>\n".
+ *   query [analyze options] [-a addr] path
+ *       Replies "<id> ok nodes <count> edges <count>\n", each edge counted
+ *       once although the whole-file build repeats some, or for the node
+ *       at addr "<id> ok node <addr> type <type> next <addr,...>
+ *       prev <addr,...>\n". The graph is built first if not cached.
+ *   cancel <request id>
+ *       Stops a request of this connection still in flight, which then
+ *       replies "<request id> cancelled\n". Replies "<id> ok\n".
+ *
+ * Failures reply "<id> error <message>\n". The requests of a connection
+ * run concurrently (up to -j over all connections), so replies come in
+ * completion order. There is no -B: the heap budget of dexgraph is
+ * counted for the whole process, which here holds every cached graph and
+ * the concurrent builds.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <DexGraph/DexGraph.h>
+
+static const char* gProgName = "dexgraphd";
+
+struct Options {
+    const char* socketPath;
+    unsigned jobs;
+    unsigned cacheEntries;
+};
+
+static Options gOptions;
+
+namespace
+{
+  std::atomic<bool> stopping(false);
+
+  auto constexpr max_line_size = 64 * 1024;
+
+  // Least recently used entries are dropped once capacity is reached.
+  template <typename Value>
+  class LruCache
+  {
+  public:
+    explicit LruCache(std::size_t _capacity) : capacity(_capacity) {}
+
+    std::shared_ptr<Value> find(std::string const& key)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto const it = index.find(key);
+      if (it == index.end())
+        return nullptr;
+      entries.splice(entries.begin(), entries, it->second);
+      return it->second->second;
+    }
+
+    void insert(std::string const& key, std::shared_ptr<Value> const& value)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto const it = index.find(key);
+      if (it != index.end())
+      {
+        entries.erase(it->second);
+        index.erase(it);
+      }
+      entries.emplace_front(key, value);
+      index[key] = entries.begin();
+      while (entries.size() > capacity)
+      {
+        index.erase(entries.back().first);
+        entries.pop_back();
+      }
+    }
+
+  private:
+    typedef std::list<std::pair<std::string, std::shared_ptr<Value>>> Entries;
+
+    std::mutex mutex;
+    std::size_t capacity;
+    Entries entries;
+    std::unordered_map<std::string, typename Entries::iterator> index;
+  };
+
+  // A parsed dex. Builds take the lock: lazy verification writes to the
+  // DexFile.
+  struct DexEntry
+  {
+    std::unique_ptr<DexGraph::Dex> dex;
+    std::mutex build_mutex;
+  };
+
+  std::unique_ptr<LruCache<DexEntry>> dex_cache;
+  std::unique_ptr<LruCache<DexGraph::Graph const>> graph_cache;
+
+  // Bounds the builds running at once over all connections.
+  class JobSlots
+  {
+  public:
+    explicit JobSlots(unsigned count) : free(count) {}
+
+    // False if cancel was set while waiting.
+    bool acquire(std::atomic<bool> const& cancel)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (free == 0)
+      {
+        if (cancel.load())
+          return false;
+        released.wait_for(lock, std::chrono::milliseconds(50));
+      }
+      free--;
+      return true;
+    }
+
+    void release()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      free++;
+      released.notify_one();
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable released;
+    unsigned free;
+  };
+
+  std::unique_ptr<JobSlots> job_slots;
+
+  struct Request
+  {
+    std::string id;
+    std::string command;
+    DexGraph::Options options;
+    std::string output_path;
+    bool has_addr = false;
+    uint64_t addr = 0;
+    std::string path;
+  };
+
+  bool parse_number(std::string const& str, uint64_t& value)
+  {
+    char* end;
+    errno = 0;
+    value = strtoull(str.c_str(), &end, 0);
+    return !str.empty() && *end == '\0' && errno == 0;
+  }
+
+  // Split "<id> <command> [options] <path>"; false with error set if the
+  // line is malformed.
+  bool parse_request(std::string const& line, Request& request,
+                     std::string& error)
+  {
+    std::size_t pos = 0;
+    auto const next_token = [&line, &pos]() {
+      while (pos < line.size() && line[pos] == ' ')
+        pos++;
+      auto const begin = pos;
+      while (pos < line.size() && line[pos] != ' ')
+        pos++;
+      return line.substr(begin, pos - begin);
+    };
+
+    request.id = next_token();
+    request.command = next_token();
+    if (request.id.empty() || request.command.empty())
+    {
+      error = "expected <id> <command>";
+      return false;
+    }
+    if (request.command != "analyze" && request.command != "query" &&
+        request.command != "cancel")
+    {
+      error = "unknown command '" + request.command + "'";
+      return false;
+    }
+
+    for (;;)
+    {
+      while (pos < line.size() && line[pos] == ' ')
+        pos++;
+      if (request.command == "cancel" || pos + 1 >= line.size() ||
+          line[pos] != '-' || (pos + 2 < line.size() && line[pos + 2] != ' '))
+        break;
+      auto const flag = next_token()[1];
+      uint64_t value = 0;
+      switch (flag)
+      {
+      case 'e':
+        request.options.exports_only = true;
+        break;
+      case 'i':
+        request.options.ignore_bad_checksum = true;
+        break;
+      case 'p':
+        request.options.prune_infeasible = true;
+        break;
+      case 'R':
+        request.options.sharpen_calls = true;
+        break;
+      case 's':
+        request.options.stream = true;
+        break;
+      case 'z':
+        request.options.lazy_verify = true;
+        break;
+      case 'B':
+        error = "-B is not supported: the heap budget is process wide";
+        return false;
+      case 'V':
+        if (!parse_number(next_token(), value) || value == 0 || value > 256)
+        {
+          error = "-V wants a thread count";
+          return false;
+        }
+        request.options.verify_threads = (int)value;
+        break;
+      case 'I':
+        request.options.include_classes.push_back(next_token());
+        break;
+      case 'X':
+        request.options.exclude_classes.push_back(next_token());
+        break;
+      case 'o':
+        request.output_path = next_token();
+        break;
+      case 'a':
+        if (!parse_number(next_token(), request.addr))
+        {
+          error = "-a wants an address";
+          return false;
+        }
+        request.has_addr = true;
+        break;
+      default:
+        error = std::string("unknown option -") + flag;
+        return false;
+      }
+    }
+
+    request.path = line.substr(pos);
+    if (request.path.empty())
+    {
+      error = request.command == "cancel" ? "expected a request id"
+                                          : "expected a path";
+      return false;
+    }
+    return true;
+  }
+
+  // The file contents (path, size, mtime) and the options that change the
+  // parse.
+  bool dex_key(Request const& request, std::string& key, std::string& error)
+  {
+    struct stat st;
+    if (stat(request.path.c_str(), &st) != 0)
+    {
+      error = "can't stat '" + request.path + "': " + strerror(errno);
+      return false;
+    }
+    auto const& options = request.options;
+    key = request.path + '\0' + std::to_string(st.st_size) + ':' +
+          std::to_string(st.st_mtim.tv_sec) + '.' +
+          std::to_string(st.st_mtim.tv_nsec) + ':' +
+          (options.lazy_verify ? 'z' : '-') +
+          (options.ignore_bad_checksum ? 'i' : '-') +
+          (options.verify_threads > 0 ? 'V' : '-');
+    return true;
+  }
+
+  // Graph of the request, from the cache or built. nullptr with error set
+  // on failure, or with cancelled set.
+  std::shared_ptr<DexGraph::Graph const> get_graph(Request const& request,
+                                                   std::string& error,
+                                                   bool& cancelled)
+  {
+    std::string key;
+    if (!dex_key(request, key, error))
+      return nullptr;
+    auto const& options = request.options;
+    auto graph_key = key + ':' + (options.exports_only ? 'e' : '-') +
+                     (options.stream ? 's' : '-') +
+                     (options.prune_infeasible ? 'p' : '-') +
+                     (options.sharpen_calls ? 'R' : '-');
+    for (auto const& pattern : options.include_classes)
+      graph_key += std::string(1, '\0') + 'I' + pattern;
+    for (auto const& pattern : options.exclude_classes)
+      graph_key += std::string(1, '\0') + 'X' + pattern;
+
+    auto graph = graph_cache->find(graph_key);
+    if (graph != nullptr)
+      return graph;
+
+    auto entry = dex_cache->find(key);
+    if (entry == nullptr)
+    {
+      entry = std::make_shared<DexEntry>();
+      entry->dex = DexGraph::Dex::open(request.path, options, error);
+      if (entry->dex == nullptr)
+        return nullptr;
+      dex_cache->insert(key, entry);
+    }
+
+    auto built = std::make_shared<DexGraph::Graph>();
+    DexGraph::BuildReport report;
+    {
+      std::lock_guard<std::mutex> lock(entry->build_mutex);
+      report = DexGraph::build(*entry->dex, options, *built);
+    }
+    if (report.cancelled)
+    {
+      cancelled = true;
+      return nullptr;
+    }
+    graph_cache->insert(graph_key, built);
+    return built;
+  }
+
+  std::string hex(uint64_t value)
+  {
+    char buff[24];
+    snprintf(buff, sizeof(buff), "0x%llx", (unsigned long long)value);
+    return buff;
+  }
+
+  // "a,b,c", or "-" if empty.
+  std::string hex_list(std::set<uint64_t> const& values)
+  {
+    std::string list;
+    for (auto const value : values)
+      list += (list.empty() ? "" : ",") + hex(value);
+    return list.empty() ? "-" : list;
+  }
+
+  // Edges of graph, those the whole-file build emits more than once
+  // counted once, as a streamed build would emit them.
+  std::size_t unique_edge_count(DexGraph::Graph const& graph)
+  {
+    std::vector<std::pair<uint64_t, uint64_t>> edges;
+    edges.reserve(graph.edges.size());
+    for (auto const& edge : graph.edges)
+      edges.emplace_back(edge.from, edge.to);
+    std::sort(edges.begin(), edges.end());
+    return std::unique(edges.begin(), edges.end()) - edges.begin();
+  }
+
+  // "ok ..." text of a query.
+  std::string query_reply(Request const& request,
+                          DexGraph::Graph const& graph, std::string& error)
+  {
+    if (!request.has_addr)
+      return "ok nodes " + std::to_string(graph.nodes.size()) + " edges " +
+             std::to_string(unique_edge_count(graph));
+
+    DexGraph::Node const* found = nullptr;
+    for (auto const& node : graph.nodes)
+    {
+      if (node.addr == request.addr)
+      {
+        found = &node;
+        break;
+      }
+    }
+    if (found == nullptr)
+    {
+      error = "no node at " + hex(request.addr);
+      return "";
+    }
+
+    // Edges may repeat across the methods sharing a node
+    std::set<uint64_t> next;
+    std::set<uint64_t> prev;
+    for (auto const& edge : graph.edges)
+    {
+      if (edge.from == request.addr)
+        next.insert(edge.to);
+      if (edge.to == request.addr)
+        prev.insert(edge.from);
+    }
+    return "ok node " + hex(found->addr) + " type " +
+           std::to_string(static_cast<uint32_t>(found->type)) + " next " +
+           hex_list(next) + " prev " + hex_list(prev);
+  }
+
+  class Connection : public std::enable_shared_from_this<Connection>
+  {
+  public:
+    explicit Connection(int _fd) : fd(_fd) {}
+    ~Connection() { close(fd); }
+
+    // Read requests until the peer hangs up, then cancel what is still in
+    // flight and wait for it.
+    void serve()
+    {
+      std::string buffer;
+      char chunk[4096];
+      for (;;)
+      {
+        auto const got = recv(fd, chunk, sizeof(chunk), 0);
+        if (got < 0 && errno == EINTR)
+          continue;
+        if (got <= 0)
+          break;
+        buffer.append(chunk, got);
+
+        std::size_t newline;
+        while ((newline = buffer.find('\n')) != std::string::npos)
+        {
+          auto line = buffer.substr(0, newline);
+          buffer.erase(0, newline + 1);
+          if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+          if (!line.empty())
+            dispatch(line);
+        }
+        if (buffer.size() > max_line_size)
+        {
+          reply("- error request line too long");
+          break;
+        }
+      }
+
+      std::unique_lock<std::mutex> lock(inflight_mutex);
+      for (auto const& request : inflight)
+        request.second->store(true);
+      inflight_done.wait(lock, [this]() { return inflight.empty(); });
+    }
+
+  private:
+    void dispatch(std::string const& line)
+    {
+      Request request;
+      std::string error;
+      if (!parse_request(line, request, error))
+      {
+        auto const id = request.id.empty() ? std::string("-") : request.id;
+        reply(id + " error " + error);
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(inflight_mutex);
+      if (request.command == "cancel")
+      {
+        auto const it = inflight.find(request.path);
+        if (it == inflight.end())
+        {
+          reply(request.id + " error no request '" + request.path +
+                "' in flight");
+          return;
+        }
+        it->second->store(true);
+        reply(request.id + " ok");
+        return;
+      }
+
+      if (inflight.count(request.id) != 0)
+      {
+        reply(request.id + " error request '" + request.id +
+              "' already in flight");
+        return;
+      }
+      auto cancel = std::make_shared<std::atomic<bool>>(false);
+      inflight[request.id] = cancel;
+      auto self = shared_from_this();
+      std::thread([self, request, cancel]() {
+        self->run(request, *cancel);
+        std::lock_guard<std::mutex> lock(self->inflight_mutex);
+        self->inflight.erase(request.id);
+        self->inflight_done.notify_all();
+      }).detach();
+    }
+
+    void run(Request request, std::atomic<bool> const& cancel)
+    {
+      if (!job_slots->acquire(cancel))
+      {
+        reply(request.id + " cancelled");
+        return;
+      }
+      request.options.cancel = &cancel;
+      std::string error;
+      bool cancelled = false;
+      auto const graph = get_graph(request, error, cancelled);
+      job_slots->release();
+
+      if (cancelled)
+      {
+        reply(request.id + " cancelled");
+        return;
+      }
+      if (graph == nullptr)
+      {
+        reply(request.id + " error " + error);
+        return;
+      }
+
+      if (request.command == "query")
+      {
+        auto const text = query_reply(request, *graph, error);
+        reply(request.id + " " + (text.empty() ? "error " + error : text));
+        return;
+      }
+
+      auto const edg = graph->to_edg();
+      if (request.output_path.empty())
+      {
+        reply(request.id + " edg " + std::to_string(edg.size()), edg);
+        return;
+      }
+      std::ofstream file(request.output_path,
+                         std::ios::binary | std::ios::trunc);
+      file.write(edg.data(), edg.size());
+      file.close();
+      if (!file)
+        reply(request.id + " error can't write '" + request.output_path + "'");
+      else
+        reply(request.id + " file " + request.output_path);
+    }
+
+    // One reply line, and its payload, at a time.
+    void reply(std::string const& line, std::string const& payload = "")
+    {
+      std::lock_guard<std::mutex> lock(write_mutex);
+      send_all(line + "\n");
+      send_all(payload);
+    }
+
+    void send_all(std::string const& data)
+    {
+      std::size_t sent = 0;
+      while (sent < data.size())
+      {
+        auto const count = send(fd, data.data() + sent, data.size() - sent,
+                                MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+          continue;
+        if (count <= 0)
+          return;
+        sent += count;
+      }
+    }
+
+    int fd;
+    std::mutex write_mutex;
+    std::mutex inflight_mutex;
+    std::condition_variable inflight_done;
+    std::map<std::string, std::shared_ptr<std::atomic<bool>>> inflight;
+  };
+
+  void on_signal(int)
+  {
+    stopping = true;
+  }
+}
+
+/*
+ * Parse a count argument; returns false if it is not a positive number.
+ */
+static bool parseCount(const char* arg, unsigned* pValue)
+{
+    char* end;
+    errno = 0;
+    unsigned long value = strtoul(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || errno != 0 || value == 0 ||
+            value > 0xffffUL)
+        return false;
+    *pValue = (unsigned) value;
+    return true;
+}
+
+void usage(void)
+{
+    fprintf(stderr, "%s: [-j jobs] [-n entries] socket\n", gProgName);
+    fprintf(stderr, "\n");
+    fprintf(stderr, " -j : graphs built at once (default one per CPU)\n");
+    fprintf(stderr, " -n : parsed dex files and graphs kept in memory (default 8 each)\n");
+}
+
+int main(int argc, char* const argv[])
+{
+    bool wantUsage = false;
+    int ic;
+
+    gOptions.jobs = (unsigned) sysconf(_SC_NPROCESSORS_ONLN);
+    if (gOptions.jobs == 0)
+        gOptions.jobs = 1;
+    gOptions.cacheEntries = 8;
+
+    while (1) {
+        ic = getopt(argc, argv, "j:n:");
+        if (ic < 0)
+            break;
+
+        switch (ic) {
+        case 'j':       // concurrent builds
+            wantUsage |= !parseCount(optarg, &gOptions.jobs);
+            break;
+        case 'n':       // cache entries
+            wantUsage |= !parseCount(optarg, &gOptions.cacheEntries);
+            break;
+        default:
+            wantUsage = true;
+            break;
+        }
+    }
+
+    if (optind + 1 != argc)
+        wantUsage = true;
+
+    if (wantUsage) {
+        usage();
+        return 2;
+    }
+    gOptions.socketPath = argv[optind];
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(gOptions.socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", gProgName);
+        return 1;
+    }
+    strcpy(addr.sun_path, gOptions.socketPath);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        fprintf(stderr, "%s: socket: %s\n", gProgName, strerror(errno));
+        return 1;
+    }
+    /* a socket left by a previous run */
+    struct stat st;
+    if (stat(gOptions.socketPath, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(gOptions.socketPath);
+    if (bind(listenFd, (sockaddr*) &addr, sizeof(addr)) != 0 ||
+            listen(listenFd, 16) != 0) {
+        fprintf(stderr, "%s: can't listen on '%s': %s\n", gProgName,
+            gOptions.socketPath, strerror(errno));
+        close(listenFd);
+        return 1;
+    }
+
+    dex_cache.reset(new LruCache<DexEntry>(gOptions.cacheEntries));
+    graph_cache.reset(
+        new LruCache<DexGraph::Graph const>(gOptions.cacheEntries));
+    job_slots.reset(new JobSlots(gOptions.jobs));
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    fprintf(stderr, "%s: listening on %s\n", gProgName, gOptions.socketPath);
+    while (!stopping) {
+        pollfd pfd = { listenFd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        auto connection = std::make_shared<Connection>(fd);
+        std::thread([connection]() { connection->serve(); }).detach();
+    }
+
+    /* in-flight requests die with the process */
+    close(listenFd);
+    unlink(gOptions.socketPath);
+    return 0;
+}
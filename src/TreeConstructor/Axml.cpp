@@ -0,0 +1,256 @@
+#include <algorithm>
+
+#include <TreeConstructor/Axml.h>
+
+namespace TreeConstructor
+{
+namespace Axml
+{
+namespace
+{
+  // ResChunk_header types
+  auto constexpr RES_STRING_POOL_TYPE = 0x0001;
+  auto constexpr RES_XML_TYPE = 0x0003;
+  auto constexpr RES_XML_START_ELEMENT_TYPE = 0x0102;
+  auto constexpr RES_XML_RESOURCE_MAP_TYPE = 0x0180;
+
+  auto constexpr UTF8_FLAG = 1u << 8;
+  auto constexpr NO_INDEX = 0xffffffffu;
+  auto constexpr TYPE_STRING = 0x03;
+  auto constexpr ANDROID_NAME_ATTR = 0x01010003u;  // android:name
+
+  uint16_t get16(uint8_t const* p) { return (uint16_t)(p[0] | p[1] << 8); }
+  uint32_t get32(uint8_t const* p)
+  {
+    return (uint32_t)get16(p) | (uint32_t)get16(p + 2) << 16;
+  }
+
+  class StringPool
+  {
+  public:
+    bool load(uint8_t const* chunk, std::size_t size)
+    {
+      if (size < 28)
+        return false;
+      count = get32(chunk + 8);
+      utf8 = (get32(chunk + 16) & UTF8_FLAG) != 0;
+      auto const strings_start = get32(chunk + 20);
+      auto const header_size = get16(chunk + 2);
+      if (header_size > size || count > (size - header_size) / 4 ||
+          strings_start > size)
+        return false;
+      offsets = chunk + header_size;
+      data = chunk + strings_start;
+      data_size = size - strings_start;
+      return true;
+    }
+
+    std::string get(uint32_t idx) const
+    {
+      if (idx >= count)
+        return std::string();
+      auto const offset = get32(offsets + 4 * idx);
+      if (offset >= data_size)
+        return std::string();
+      auto p = data + offset;
+      auto const end = data + data_size;
+      std::string ret;
+      if (utf8)
+      {
+        // UTF-16 length, then UTF-8 length, each one or two bytes
+        std::size_t length = 0;
+        for (int field = 0; field < 2; field++)
+        {
+          if (p >= end)
+            return ret;
+          length = *p++;
+          if (length & 0x80)
+          {
+            if (p >= end)
+              return ret;
+            length = (length & 0x7f) << 8 | *p++;
+          }
+        }
+        length = std::min<std::size_t>(length, end - p);
+        ret.assign((char const*)p, length);
+        return ret;
+      }
+      if (end - p < 2)
+        return ret;
+      std::size_t length = get16(p);
+      p += 2;
+      if (length & 0x8000)
+      {
+        if (end - p < 2)
+          return ret;
+        length = (length & 0x7fff) << 16 | get16(p);
+        p += 2;
+      }
+      length = std::min<std::size_t>(length, (end - p) / 2);
+      for (std::size_t i = 0; i < length; i++)
+      {
+        auto const c = get16(p + 2 * i);
+        // Class and package names are ASCII
+        ret += c < 0x80 ? (char)c : '?';
+      }
+      return ret;
+    }
+
+  private:
+    uint8_t const* offsets = nullptr;
+    uint8_t const* data = nullptr;
+    std::size_t data_size = 0;
+    uint32_t count = 0;
+    bool utf8 = false;
+  };
+
+  bool component_kind(std::string const& element, ComponentKind& kind)
+  {
+    if (element == "application")
+      kind = ComponentKind::APPLICATION;
+    else if (element == "activity")
+      kind = ComponentKind::ACTIVITY;
+    else if (element == "service")
+      kind = ComponentKind::SERVICE;
+    else if (element == "receiver")
+      kind = ComponentKind::RECEIVER;
+    else if (element == "provider")
+      kind = ComponentKind::PROVIDER;
+    else
+      return false;
+    return true;
+  }
+
+  std::string qualify(std::string const& package, std::string const& name)
+  {
+    if (!name.empty() && name[0] == '.')
+      return package + name;
+    if (name.find('.') == std::string::npos)
+      return package + '.' + name;
+    return name;
+  }
+}
+
+char const* component_kind_name(ComponentKind kind)
+{
+  switch (kind)
+  {
+  case ComponentKind::APPLICATION: return "application";
+  case ComponentKind::ACTIVITY: return "activity";
+  case ComponentKind::SERVICE: return "service";
+  case ComponentKind::RECEIVER: return "receiver";
+  case ComponentKind::PROVIDER: return "provider";
+  }
+  return "unknown";
+}
+
+bool parse_manifest(uint8_t const* data, std::size_t length,
+                    Manifest& manifest, std::string& error)
+{
+  manifest = Manifest();
+  if (length < 8 || get16(data) != RES_XML_TYPE)
+  {
+    error = "not a binary XML document";
+    return false;
+  }
+  length = std::min<std::size_t>(length, get32(data + 4));
+
+  StringPool strings;
+  bool have_strings = false;
+  uint8_t const* resource_ids = nullptr;
+  uint32_t resource_count = 0;
+
+  // Names are resolved against the package once the whole document is read
+  std::vector<Component> raw;
+  std::size_t pos = get16(data + 2);
+  while (pos + 8 <= length)
+  {
+    auto const chunk = data + pos;
+    auto const type = get16(chunk);
+    auto const header_size = get16(chunk + 2);
+    auto const size = get32(chunk + 4);
+    if (size < 8 || header_size > size || size > length - pos)
+    {
+      error = "truncated chunk at offset " + std::to_string(pos);
+      return false;
+    }
+
+    if (type == RES_STRING_POOL_TYPE && !have_strings)
+    {
+      if (!strings.load(chunk, size))
+      {
+        error = "bad string pool";
+        return false;
+      }
+      have_strings = true;
+    }
+    else if (type == RES_XML_RESOURCE_MAP_TYPE)
+    {
+      resource_ids = chunk + header_size;
+      resource_count = (size - header_size) / 4;
+    }
+    else if (type == RES_XML_START_ELEMENT_TYPE &&
+             (std::size_t)header_size + 20 <= size)
+    {
+      // ResXMLTree_attrExt follows the node header
+      auto const ext = chunk + header_size;
+      auto const element = strings.get(get32(ext + 4));
+      auto const attribute_start = get16(ext + 8);
+      auto const attribute_size = get16(ext + 10);
+      auto const attribute_count = get16(ext + 12);
+      ComponentKind kind = ComponentKind::APPLICATION;
+      bool const is_manifest = element == "manifest";
+      bool const is_component = component_kind(element, kind);
+      if ((is_manifest || is_component) && attribute_size >= 20 &&
+          header_size + attribute_start +
+                  (std::size_t)attribute_size * attribute_count <= size)
+      {
+        for (uint16_t a = 0; a < attribute_count; a++)
+        {
+          auto const attr = ext + attribute_start + a * attribute_size;
+          auto const name_idx = get32(attr + 4);
+          auto const raw_value = get32(attr + 8);
+          auto const data_type = attr[15];
+          auto const value_data = get32(attr + 16);
+
+          // Obfuscators empty the attribute names, the resource id stays
+          auto const attr_name = strings.get(name_idx);
+          bool const android_name =
+              name_idx < resource_count
+                  ? get32(resource_ids + 4 * name_idx) == ANDROID_NAME_ATTR
+                  : attr_name == "name";
+          std::string value;
+          if (raw_value != NO_INDEX)
+            value = strings.get(raw_value);
+          else if (data_type == TYPE_STRING)
+            value = strings.get(value_data);
+
+          if (is_manifest && attr_name == "package")
+            manifest.package = value;
+          else if (is_component && android_name && !value.empty())
+            raw.push_back(Component{ kind, value });
+        }
+      }
+    }
+    pos += size;
+  }
+
+  if (!have_strings)
+  {
+    error = "no string pool";
+    return false;
+  }
+  for (auto& component : raw)
+    component.name = qualify(manifest.package, component.name);
+  manifest.components = std::move(raw);
+  return true;
+}
+
+std::string class_descriptor(std::string const& class_name)
+{
+  std::string ret = "L" + class_name + ";";
+  std::replace(ret.begin(), ret.end(), '.', '/');
+  return ret;
+}
+}
+}
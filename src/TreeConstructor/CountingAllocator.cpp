@@ -0,0 +1,89 @@
+// Replaces the global operator new and delete to feed the Stats memory
+// counters. Not part of libdexgraph: only the executables link it, so a
+// program embedding the library keeps its own allocator.
+#include <cstdlib>
+#include <new>
+
+#include <TreeConstructor/Stats.h>
+
+namespace
+{
+  using TreeConstructor::Stats::Memory;
+
+  // Keeps the malloc alignment, and remembers who to give the bytes back to
+  struct alignas(16) AllocHeader
+  {
+    uint64_t size;
+    uint64_t memory;
+  };
+
+  void* counted_alloc(std::size_t size)
+  {
+    auto const header =
+        static_cast<AllocHeader*>(std::malloc(sizeof(AllocHeader) + size));
+    if (header == nullptr)
+      return nullptr;
+    auto const memory = TreeConstructor::Stats::allocating_memory();
+    header->size = size;
+    header->memory = static_cast<uint64_t>(memory);
+    TreeConstructor::Stats::allocated(memory, size);
+    return header + 1;
+  }
+
+  void counted_free(void* ptr)
+  {
+    if (ptr == nullptr)
+      return;
+    auto const header = static_cast<AllocHeader*>(ptr) - 1;
+    TreeConstructor::Stats::freed(static_cast<Memory>(header->memory),
+                                  header->size);
+    std::free(header);
+  }
+}
+
+void* operator new(std::size_t size)
+{
+  auto const ptr = counted_alloc(size);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+  auto const ptr = counted_alloc(size);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+  return counted_alloc(size);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept
+{
+  return counted_alloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+  counted_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+  counted_free(ptr);
+}
+
+// Sized deallocation (C++14) passes the size back; the header has it
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  counted_free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+  counted_free(ptr);
+}
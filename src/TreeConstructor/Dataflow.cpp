@@ -0,0 +1,245 @@
+#include <algorithm>
+
+#include <TreeConstructor/Dataflow.h>
+
+namespace TreeConstructor
+{
+namespace Dataflow
+{
+namespace
+{
+  // Position of node in node_vec (address order), or -1 if it is not there.
+  int64_t index_of(std::vector<NodeSPtr> const& node_vec, Node const* node)
+  {
+    auto const it = std::lower_bound(
+        node_vec.begin(), node_vec.end(), node->baseAddr,
+        [](NodeSPtr const& lhs, uint32_t addr) { return lhs->baseAddr < addr; });
+    if (it == node_vec.end() || it->get() != node)
+      return -1;
+    return it - node_vec.begin();
+  }
+
+  void push_unique(std::vector<uint32_t>& vec, uint32_t value)
+  {
+    if (std::find(vec.begin(), vec.end(), value) == vec.end())
+      vec.push_back(value);
+  }
+
+  // Depth-first postorder from block 0, reversed.
+  std::vector<uint32_t> reverse_postorder(std::vector<BasicBlock> const& blocks)
+  {
+    std::vector<uint32_t> order;
+    std::vector<bool> visited(blocks.size(), false);
+    std::vector<std::pair<uint32_t, std::size_t>> stack;
+    stack.emplace_back(0, 0);
+    visited[0] = true;
+    while (!stack.empty())
+    {
+      auto& top = stack.back();
+      auto const& succs = blocks[top.first].succs;
+      if (top.second < succs.size())
+      {
+        auto const next = succs[top.second++];
+        if (!visited[next])
+        {
+          visited[next] = true;
+          stack.emplace_back(next, 0);
+        }
+        continue;
+      }
+      order.push_back(top.first);
+      stack.pop_back();
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+  }
+}
+
+BlockGraph build_blocks(std::vector<NodeSPtr> const& node_vec)
+{
+  BlockGraph graph;
+  auto const count = node_vec.size();
+  if (count == 0)
+    return graph;
+
+  // Links within the vector, flattened
+  std::vector<uint32_t> succ_begin(count + 1, 0);
+  std::vector<uint32_t> succ_list;
+  std::vector<uint32_t> pred_count(count, 0);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    succ_begin[i] = succ_list.size();
+    for (auto const& child : node_vec[i]->next_nodes)
+    {
+      auto const idx = index_of(node_vec, child.get());
+      if (idx < 0)
+        continue;
+      succ_list.push_back((uint32_t)idx);
+      pred_count[idx]++;
+    }
+  }
+  succ_begin[count] = succ_list.size();
+
+  // A block starts at the entry, at branch targets, after branches and at
+  // join points
+  std::vector<bool> leader(count, false);
+  leader[0] = true;
+  for (std::size_t i = 0; i < count; i++)
+  {
+    auto const succ_count = succ_begin[i + 1] - succ_begin[i];
+    if (succ_count == 1 && succ_list[succ_begin[i]] == i + 1)
+      continue;
+    for (auto s = succ_begin[i]; s < succ_begin[i + 1]; s++)
+      leader[succ_list[s]] = true;
+    if (i + 1 < count)
+      leader[i + 1] = true;
+  }
+  for (std::size_t i = 1; i < count; i++)
+  {
+    if (pred_count[i] != 1)
+      leader[i] = true;
+  }
+
+  graph.block_of.resize(count);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    if (leader[i])
+      graph.blocks.push_back(BasicBlock{ (uint32_t)i, (uint32_t)i, {}, {} });
+    graph.blocks.back().last = i;
+    graph.block_of[i] = graph.blocks.size() - 1;
+  }
+
+  for (uint32_t b = 0; b < graph.blocks.size(); b++)
+  {
+    auto const last = graph.blocks[b].last;
+    for (auto s = succ_begin[last]; s < succ_begin[last + 1]; s++)
+    {
+      auto const target = graph.block_of[succ_list[s]];
+      push_unique(graph.blocks[b].succs, target);
+      push_unique(graph.blocks[target].preds, b);
+    }
+  }
+
+  graph.rpo = reverse_postorder(graph.blocks);
+  return graph;
+}
+
+BitMatrix::BitMatrix(std::size_t rows, std::size_t bits)
+  : row_count(rows),
+    bit_count(bits),
+    word_count((bits + 63) / 64),
+    data(rows * ((bits + 63) / 64), 0)
+{
+}
+
+void BitMatrix::fill(std::size_t r)
+{
+  auto const words = row(r);
+  std::fill(words, words + word_count, ~uint64_t(0));
+  if (bit_count % 64 != 0)
+    words[word_count - 1] = (uint64_t(1) << (bit_count % 64)) - 1;
+}
+
+std::string BitMatrix::format(std::size_t r) const
+{
+  std::string ret = "{";
+  for (std::size_t bit = 0; bit < bit_count; bit++)
+  {
+    if (!test(r, bit))
+      continue;
+    if (ret.size() > 1)
+      ret += ',';
+    ret += std::to_string(bit);
+  }
+  return ret + "}";
+}
+
+Solution solve(BlockGraph const& graph, Problem const& problem)
+{
+  auto const count = graph.blocks.size();
+  auto const bits = problem.gen.bits();
+  auto const words = problem.gen.words();
+  bool const forward = problem.direction == Direction::FORWARD;
+  bool const must = problem.meet == Meet::INTERSECTION;
+
+  Solution solution;
+  solution.in = BitMatrix(count, bits);
+  solution.out = BitMatrix(count, bits);
+  // Meet side and transfer side of each block
+  auto& meets = forward ? solution.in : solution.out;
+  auto& results = forward ? solution.out : solution.in;
+
+  auto order = graph.rpo;
+  if (!forward)
+    std::reverse(order.begin(), order.end());
+
+  std::vector<bool> reached(count, false);
+  std::vector<bool> pending(count, false);
+  for (auto const b : order)
+  {
+    reached[b] = true;
+    pending[b] = true;
+    if (must)
+      results.fill(b);
+  }
+
+  bool const has_boundary = problem.boundary.rows() != 0;
+  std::vector<uint64_t> next(words);
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (auto const b : order)
+    {
+      if (!pending[b])
+        continue;
+      pending[b] = false;
+      solution.visits++;
+
+      auto const& block = graph.blocks[b];
+      auto const& sources = forward ? block.preds : block.succs;
+      bool const boundary_block = forward ? b == 0 : block.succs.empty();
+
+      // Meet
+      auto const meet = meets.row(b);
+      if (boundary_block && has_boundary)
+        std::copy(problem.boundary.row(0), problem.boundary.row(0) + words, meet);
+      else if (must && !boundary_block)
+        meets.fill(b);
+      else
+        std::fill(meet, meet + words, 0);
+      for (auto const source : sources)
+      {
+        if (!reached[source])
+          continue;
+        auto const other = results.row(source);
+        if (must)
+          for (std::size_t w = 0; w < words; w++)
+            meet[w] &= other[w];
+        else
+          for (std::size_t w = 0; w < words; w++)
+            meet[w] |= other[w];
+      }
+
+      // Transfer
+      auto const gen = problem.gen.row(b);
+      auto const kill = problem.kill.row(b);
+      auto const result = results.row(b);
+      uint64_t diff = 0;
+      for (std::size_t w = 0; w < words; w++)
+      {
+        next[w] = gen[w] | (meet[w] & ~kill[w]);
+        diff |= next[w] ^ result[w];
+      }
+      if (diff == 0)
+        continue;
+      std::copy(next.begin(), next.end(), result);
+      changed = true;
+      for (auto const target : forward ? block.succs : block.preds)
+        pending[target] = true;
+    }
+  }
+  return solution;
+}
+}
+}
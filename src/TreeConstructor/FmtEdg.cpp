@@ -1,16 +1,17 @@
 #include <sstream>
 
 #include <TreeConstructor/FmtEdg.h>
+#include <TreeConstructor/Stats.h>
 #include <TreeConstructor/TCHelper.h>
 
-void tc_binary_print(std::ofstream & file, std::string const& str)
+void tc_binary_print(std::ostream & file, std::string const& str)
 {
   if (file.good())
     file.write(str.c_str(), str.size());
 }
 
 template <typename IntType>
-void tc_int_binary_print(std::ofstream & file, IntType const& enum_int)
+void tc_int_binary_print(std::ostream & file, IntType const& enum_int)
 {
   if (file.good())
   {
@@ -30,8 +31,10 @@ namespace Edg
     std::vector<std::pair<TreeConstructor::NodeSPtr,
                           TreeConstructor::NodeSPtr>> const& edges_vec)
   {
+    TreeConstructor::Stats::MemoryScope memory(
+        TreeConstructor::Stats::Memory::OUTPUT);
     using TreeConstructor::NodeSPtr;
-    std::ofstream file("graph.edg", std::ios::app | std::ios::binary);
+    std::ofstream file(TreeConstructor::Helper::edg_filename, std::ios::app | std::ios::binary);
     tc_binary_print(file, "GRAPHBIN");
     file.close();
     dump_edg_body(nodesptr_vec, edges_vec);
@@ -58,9 +61,10 @@ namespace Edg
   dump_node_vec(std::vector<TreeConstructor::NodeSPtr> const& nodesptr_vec)
   {
     auto const node_count = (uint32_t)nodesptr_vec.size();
-    std::ofstream file("graph.edg", std::ios::app | std::ios::binary);
+    std::ofstream file(TreeConstructor::Helper::edg_filename, std::ios::app | std::ios::binary);
     tc_int_binary_print<uint32_t>(file, node_count);
     
+    uint64_t written = 0;
     for (auto const& nodesptr : nodesptr_vec)
     {
       if (nodesptr == nullptr)
@@ -68,8 +72,10 @@ namespace Edg
       tc_binary_print(file, "n");
       tc_int_binary_print<uint64_t>(file, (uint64_t)nodesptr->baseAddr);
       tc_int_binary_print<uint32_t>(file, static_cast<uint32_t>(nodesptr->opcode_type));
+      written++;
     }
     file.close();
+    TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::NODES, written);
   }
 
   void dump_edge_vec(
@@ -77,7 +83,8 @@ namespace Edg
       std::pair<TreeConstructor::NodeSPtr, TreeConstructor::NodeSPtr>> const&
           edges_vec) 
   {
-    std::ofstream file("graph.edg", std::ios::app | std::ios::binary);
+    std::ofstream file(TreeConstructor::Helper::edg_filename, std::ios::app | std::ios::binary);
+    uint64_t written = 0;
     for (auto const& pair : edges_vec)
     {
       if (pair.first == nullptr || pair.second == nullptr)
@@ -86,8 +93,10 @@ namespace Edg
       tc_binary_print(file, "e");
       tc_int_binary_print<uint64_t>(file, (uint64_t)pair.first->baseAddr);
       tc_int_binary_print<uint64_t>(file, (uint64_t)pair.second->baseAddr);
+      written++;
     }
     file.close();
+    TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::EDGES, written);
   }
 
   void dump_edg_body(
@@ -113,5 +122,97 @@ namespace Edg
     dump_node_vec(nodesptr_vec);
     dump_edge_vec(edges_vec);
   }
+
+  void Sink::dump_method(
+      std::vector<TreeConstructor::NodeSPtr> const& nodesptr_vec,
+      std::vector<std::pair<TreeConstructor::NodeSPtr,
+                            TreeConstructor::NodeSPtr>> const& edges_vec)
+  {
+    for (auto const& nodesptr : nodesptr_vec)
+    {
+      if (nodesptr == nullptr)
+        break;
+      dump_node(nodesptr->baseAddr, nodesptr->opcode_type);
+    }
+
+    for (auto const& pair : edges_vec)
+    {
+      if (pair.first == nullptr || pair.second == nullptr)
+        break;
+      dump_edge(pair.first->baseAddr, pair.second->baseAddr);
+    }
+  }
+
+  StreamWriter::StreamWriter()
+  {
+    TreeConstructor::Stats::MemoryScope memory(
+        TreeConstructor::Stats::Memory::OUTPUT);
+    // Make sure graph.edg exists, then reopen it read/write so the node
+    // count can be patched once every method has been emitted.
+    std::ofstream(TreeConstructor::Helper::edg_filename, std::ios::app | std::ios::binary).close();
+    file.open(TreeConstructor::Helper::edg_filename, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(0, std::ios::end);
+    tc_binary_print(file, edg_header);
+    count_pos = file.tellp();
+    tc_int_binary_print<uint32_t>(file, node_count);
+    edge_spill = std::tmpfile();
+  }
+
+  StreamWriter::~StreamWriter()
+  {
+    if (edge_spill != nullptr)
+      std::fclose(edge_spill);
+  }
+
+  void StreamWriter::dump_node(uint64_t addr, OpCodeType opcode_type)
+  {
+    tc_binary_print(file, "n");
+    tc_int_binary_print<uint64_t>(file, addr);
+    tc_int_binary_print<uint32_t>(file, static_cast<uint32_t>(opcode_type));
+    node_count++;
+  }
+
+  void StreamWriter::dump_edge(uint64_t from_addr, uint64_t to_addr)
+  {
+    edge_count++;
+    if (edge_spill == nullptr || spill_failed)
+      return;
+    if (std::fputc('e', edge_spill) == EOF ||
+        std::fwrite(&from_addr, sizeof(uint64_t), 1, edge_spill) != 1 ||
+        std::fwrite(&to_addr, sizeof(uint64_t), 1, edge_spill) != 1)
+      spill_failed = true;
+  }
+
+  bool StreamWriter::finish()
+  {
+    TreeConstructor::Stats::MemoryScope memory(
+        TreeConstructor::Stats::Memory::OUTPUT);
+    // Patch node count
+    auto const end_pos = file.tellp();
+    file.seekp(count_pos);
+    tc_int_binary_print<uint32_t>(file, node_count);
+    file.seekp(end_pos);
+
+    // Append spilled edges
+    bool ok = edge_spill != nullptr && !spill_failed;
+    if (edge_spill != nullptr)
+    {
+      char buff[1 << 16];
+      std::rewind(edge_spill);
+      std::size_t read_size;
+      while (ok && (read_size = std::fread(buff, 1, sizeof(buff), edge_spill)) > 0)
+        ok = static_cast<bool>(file.write(buff, read_size));
+      ok = ok && !std::ferror(edge_spill);
+      std::fclose(edge_spill);
+      edge_spill = nullptr;
+    }
+    ok = ok && !file.fail();
+    file.close();
+    ok = ok && !file.fail();
+
+    TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::NODES, node_count);
+    TreeConstructor::Stats::add(TreeConstructor::Stats::Counter::EDGES, edge_count);
+    return ok;
+  }
 }
 }
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <TreeConstructor/GraphCache.h>
+#include <libdex/SysUtil.h>
+
+namespace TreeConstructor
+{
+namespace GraphCache
+{
+namespace
+{
+  auto constexpr entry_magic = "DXGCACHE";
+  auto constexpr entry_suffix = ".edgc";
+  auto constexpr tmp_prefix = ".tmp-";
+  auto constexpr lock_filename = ".lock";
+  // Temp files older than this belong to a crashed writer
+  auto constexpr stale_tmp_seconds = 3600;
+
+  struct EntryHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t payload_size;
+  };
+
+  std::string entry_path(std::string const& cache_dir, std::string const& key)
+  {
+    return cache_dir + "/" + key + entry_suffix;
+  }
+
+  bool ends_with(std::string const& str, std::string const& suffix)
+  {
+    return str.size() >= suffix.size() &&
+           str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  bool write_all(int fd, void const* buff, std::size_t size)
+  {
+    auto ptr = static_cast<char const*>(buff);
+    while (size > 0)
+    {
+      auto const written = write(fd, ptr, size);
+      if (written <= 0)
+        return false;
+      ptr += written;
+      size -= written;
+    }
+    return true;
+  }
+}
+
+std::string make_key(uint8_t const* dex_data,
+                     std::size_t dex_length,
+                     std::string const& options_tag)
+{
+  if (dex_length < sizeof(DexHeader) ||
+      memcmp(dex_data, DEX_MAGIC, 4) != 0)
+    return std::string();
+
+  auto const header = reinterpret_cast<DexHeader const*>(dex_data);
+  char sig_hex[kSHA1DigestOutputLen];
+  for (auto i = 0; i < kSHA1DigestLen; i++)
+    snprintf(sig_hex + i * 2, 3, "%02x", header->signature[i]);
+
+  return std::string(sig_hex) + "-" + options_tag + "-v" +
+         std::to_string(cache_version);
+}
+
+bool replay(std::string const& cache_dir,
+            std::string const& key,
+            std::string const& edg_filename)
+{
+  auto const path = entry_path(cache_dir, key);
+  auto const fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  MemMapping map;
+  if (sysMapFileInShmemReadOnly(fd, &map) != 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  auto okay = false;
+  auto const header = static_cast<EntryHeader const*>(map.addr);
+  if (map.length >= sizeof(EntryHeader) &&
+      memcmp(header->magic, entry_magic, sizeof(header->magic)) == 0 &&
+      header->version == cache_version &&
+      header->payload_size == map.length - sizeof(EntryHeader))
+  {
+    auto const out_fd = open(edg_filename.c_str(),
+                             O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (out_fd >= 0)
+    {
+      okay = write_all(out_fd, header + 1, header->payload_size);
+      close(out_fd);
+    }
+  }
+
+  // Refresh LRU position
+  if (okay)
+    futimens(fd, nullptr);
+
+  sysReleaseShmem(&map);
+  close(fd);
+  return okay;
+}
+
+void store(std::string const& cache_dir,
+           std::string const& key,
+           std::string const& edg_filename,
+           uint64_t begin_offset,
+           uint64_t max_bytes)
+{
+  auto const end_offset = file_size(edg_filename);
+  if (end_offset <= begin_offset)
+    return;
+
+  mkdir(cache_dir.c_str(), 0755);
+
+  auto const tmp_path = cache_dir + "/" + tmp_prefix +
+                        std::to_string(getpid()) + "-" + key;
+  auto const in_fd = open(edg_filename.c_str(), O_RDONLY);
+  auto const out_fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  auto okay = in_fd >= 0 && out_fd >= 0;
+  if (okay)
+  {
+    EntryHeader header;
+    memcpy(header.magic, entry_magic, sizeof(header.magic));
+    header.version = cache_version;
+    header.reserved = 0;
+    header.payload_size = end_offset - begin_offset;
+    okay = write_all(out_fd, &header, sizeof(header)) &&
+           lseek(in_fd, begin_offset, SEEK_SET) == (off_t)begin_offset;
+
+    std::vector<char> buff(1 << 16);
+    auto remaining = header.payload_size;
+    while (okay && remaining > 0)
+    {
+      auto const want = (std::size_t)std::min<uint64_t>(remaining, buff.size());
+      auto const got = read(in_fd, buff.data(), want);
+      okay = got > 0 && write_all(out_fd, buff.data(), got);
+      if (okay)
+        remaining -= got;
+    }
+  }
+
+  if (in_fd >= 0)
+    close(in_fd);
+  if (out_fd >= 0)
+    okay = (close(out_fd) == 0) && okay;
+
+  // Publish atomically; readers only ever open complete entries
+  if (!okay || rename(tmp_path.c_str(), entry_path(cache_dir, key).c_str()) != 0)
+  {
+    unlink(tmp_path.c_str());
+    return;
+  }
+
+  evict(cache_dir, max_bytes);
+}
+
+void evict(std::string const& cache_dir, uint64_t max_bytes)
+{
+  auto const lock_path = cache_dir + "/" + lock_filename;
+  auto const lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (lock_fd < 0)
+    return;
+  if (flock(lock_fd, LOCK_EX) != 0)
+  {
+    close(lock_fd);
+    return;
+  }
+
+  struct Entry
+  {
+    std::string path;
+    uint64_t size;
+    time_t mtime;
+  };
+  std::vector<Entry> entries;
+  uint64_t total_size = 0;
+  auto const now = time(nullptr);
+
+  if (auto dir = opendir(cache_dir.c_str()))
+  {
+    while (auto dirent = readdir(dir))
+    {
+      std::string const name = dirent->d_name;
+      auto const path = cache_dir + "/" + name;
+      struct stat st;
+      if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        continue;
+
+      if (name.compare(0, strlen(tmp_prefix), tmp_prefix) == 0)
+      {
+        if (now - st.st_mtime > stale_tmp_seconds)
+          unlink(path.c_str());
+      }
+      else if (ends_with(name, entry_suffix))
+      {
+        entries.push_back(Entry{path, (uint64_t)st.st_size, st.st_mtime});
+        total_size += st.st_size;
+      }
+    }
+    closedir(dir);
+  }
+
+  // Least recently used first
+  std::sort(entries.begin(), entries.end(),
+            [](Entry const& lhs, Entry const& rhs) {
+              return lhs.mtime < rhs.mtime;
+            });
+  for (auto const& entry : entries)
+  {
+    if (total_size <= max_bytes)
+      break;
+    if (unlink(entry.path.c_str()) == 0)
+      total_size -= entry.size;
+  }
+
+  flock(lock_fd, LOCK_UN);
+  close(lock_fd);
+}
+
+uint64_t file_size(std::string const& filename)
+{
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0)
+    return 0;
+  return st.st_size;
+}
+}
+}
@@ -0,0 +1,220 @@
+#include <array>
+
+#include <TreeConstructor/Liveness.h>
+
+namespace TreeConstructor
+{
+namespace Liveness
+{
+namespace
+{
+  // Register width (0 none, 1 single, 2 wide) of each operand role of an
+  // opcode. Argument lists of invokes and filled-new-array are read from
+  // the instruction format instead.
+  struct Roles
+  {
+    uint8_t def_a = 0;
+    uint8_t use_a = 0;
+    uint8_t use_b = 0;
+    uint8_t use_c = 0;
+  };
+
+  Roles roles(uint8_t def_a, uint8_t use_a, uint8_t use_b, uint8_t use_c)
+  {
+    Roles ret;
+    ret.def_a = def_a;
+    ret.use_a = use_a;
+    ret.use_b = use_b;
+    ret.use_c = use_c;
+    return ret;
+  }
+
+  void set_range(std::array<Roles, kNumDalvikInstructions>& table,
+                 int first, int last, Roles const& value)
+  {
+    for (int op = first; op <= last; op++)
+      table[op] = value;
+  }
+
+  std::array<Roles, kNumDalvikInstructions> const& role_table()
+  {
+    static std::array<Roles, kNumDalvikInstructions> const table = []() {
+      std::array<Roles, kNumDalvikInstructions> t;
+      // Moves and results
+      set_range(t, OP_MOVE, OP_MOVE_16, roles(1, 0, 1, 0));
+      set_range(t, OP_MOVE_WIDE, OP_MOVE_WIDE_16, roles(2, 0, 2, 0));
+      set_range(t, OP_MOVE_OBJECT, OP_MOVE_OBJECT_16, roles(1, 0, 1, 0));
+      t[OP_MOVE_RESULT] = roles(1, 0, 0, 0);
+      t[OP_MOVE_RESULT_WIDE] = roles(2, 0, 0, 0);
+      t[OP_MOVE_RESULT_OBJECT] = roles(1, 0, 0, 0);
+      t[OP_MOVE_EXCEPTION] = roles(1, 0, 0, 0);
+      t[OP_RETURN] = roles(0, 1, 0, 0);
+      t[OP_RETURN_WIDE] = roles(0, 2, 0, 0);
+      t[OP_RETURN_OBJECT] = roles(0, 1, 0, 0);
+      // Constants
+      set_range(t, OP_CONST_4, OP_CONST_HIGH16, roles(1, 0, 0, 0));
+      set_range(t, OP_CONST_WIDE_16, OP_CONST_WIDE_HIGH16, roles(2, 0, 0, 0));
+      set_range(t, OP_CONST_STRING, OP_CONST_CLASS, roles(1, 0, 0, 0));
+      // Objects and arrays
+      t[OP_MONITOR_ENTER] = roles(0, 1, 0, 0);
+      t[OP_MONITOR_EXIT] = roles(0, 1, 0, 0);
+      t[OP_CHECK_CAST] = roles(0, 1, 0, 0);
+      t[OP_INSTANCE_OF] = roles(1, 0, 1, 0);
+      t[OP_ARRAY_LENGTH] = roles(1, 0, 1, 0);
+      t[OP_NEW_INSTANCE] = roles(1, 0, 0, 0);
+      t[OP_NEW_ARRAY] = roles(1, 0, 1, 0);
+      t[OP_FILL_ARRAY_DATA] = roles(0, 1, 0, 0);
+      t[OP_THROW] = roles(0, 1, 0, 0);
+      // Branches
+      t[OP_PACKED_SWITCH] = roles(0, 1, 0, 0);
+      t[OP_SPARSE_SWITCH] = roles(0, 1, 0, 0);
+      set_range(t, OP_CMPL_FLOAT, OP_CMPG_FLOAT, roles(1, 0, 1, 1));
+      set_range(t, OP_CMPL_DOUBLE, OP_CMP_LONG, roles(1, 0, 2, 2));
+      set_range(t, OP_IF_EQ, OP_IF_LE, roles(0, 1, 1, 0));
+      set_range(t, OP_IF_EQZ, OP_IF_LEZ, roles(0, 1, 0, 0));
+      // Array, instance and static fields
+      set_range(t, OP_AGET, OP_AGET_SHORT, roles(1, 0, 1, 1));
+      t[OP_AGET_WIDE] = roles(2, 0, 1, 1);
+      set_range(t, OP_APUT, OP_APUT_SHORT, roles(0, 1, 1, 1));
+      t[OP_APUT_WIDE] = roles(0, 2, 1, 1);
+      set_range(t, OP_IGET, OP_IGET_SHORT, roles(1, 0, 1, 0));
+      t[OP_IGET_WIDE] = roles(2, 0, 1, 0);
+      set_range(t, OP_IPUT, OP_IPUT_SHORT, roles(0, 1, 1, 0));
+      t[OP_IPUT_WIDE] = roles(0, 2, 1, 0);
+      set_range(t, OP_SGET, OP_SGET_SHORT, roles(1, 0, 0, 0));
+      t[OP_SGET_WIDE] = roles(2, 0, 0, 0);
+      set_range(t, OP_SPUT, OP_SPUT_SHORT, roles(0, 1, 0, 0));
+      t[OP_SPUT_WIDE] = roles(0, 2, 0, 0);
+      // Unary operations and conversions
+      t[OP_NEG_INT] = roles(1, 0, 1, 0);
+      t[OP_NOT_INT] = roles(1, 0, 1, 0);
+      t[OP_NEG_LONG] = roles(2, 0, 2, 0);
+      t[OP_NOT_LONG] = roles(2, 0, 2, 0);
+      t[OP_NEG_FLOAT] = roles(1, 0, 1, 0);
+      t[OP_NEG_DOUBLE] = roles(2, 0, 2, 0);
+      t[OP_INT_TO_LONG] = roles(2, 0, 1, 0);
+      t[OP_INT_TO_FLOAT] = roles(1, 0, 1, 0);
+      t[OP_INT_TO_DOUBLE] = roles(2, 0, 1, 0);
+      t[OP_LONG_TO_INT] = roles(1, 0, 2, 0);
+      t[OP_LONG_TO_FLOAT] = roles(1, 0, 2, 0);
+      t[OP_LONG_TO_DOUBLE] = roles(2, 0, 2, 0);
+      t[OP_FLOAT_TO_INT] = roles(1, 0, 1, 0);
+      t[OP_FLOAT_TO_LONG] = roles(2, 0, 1, 0);
+      t[OP_FLOAT_TO_DOUBLE] = roles(2, 0, 1, 0);
+      t[OP_DOUBLE_TO_INT] = roles(1, 0, 2, 0);
+      t[OP_DOUBLE_TO_LONG] = roles(2, 0, 2, 0);
+      t[OP_DOUBLE_TO_FLOAT] = roles(1, 0, 2, 0);
+      set_range(t, OP_INT_TO_BYTE, OP_INT_TO_SHORT, roles(1, 0, 1, 0));
+      // Binary operations, vA = vB op vC
+      set_range(t, OP_ADD_INT, OP_USHR_INT, roles(1, 0, 1, 1));
+      set_range(t, OP_ADD_LONG, OP_XOR_LONG, roles(2, 0, 2, 2));
+      set_range(t, OP_SHL_LONG, OP_USHR_LONG, roles(2, 0, 2, 1));
+      set_range(t, OP_ADD_FLOAT, OP_REM_FLOAT, roles(1, 0, 1, 1));
+      set_range(t, OP_ADD_DOUBLE, OP_REM_DOUBLE, roles(2, 0, 2, 2));
+      // vA = vA op vB
+      set_range(t, OP_ADD_INT_2ADDR, OP_USHR_INT_2ADDR, roles(1, 1, 1, 0));
+      set_range(t, OP_ADD_LONG_2ADDR, OP_XOR_LONG_2ADDR, roles(2, 2, 2, 0));
+      set_range(t, OP_SHL_LONG_2ADDR, OP_USHR_LONG_2ADDR, roles(2, 2, 1, 0));
+      set_range(t, OP_ADD_FLOAT_2ADDR, OP_REM_FLOAT_2ADDR, roles(1, 1, 1, 0));
+      set_range(t, OP_ADD_DOUBLE_2ADDR, OP_REM_DOUBLE_2ADDR, roles(2, 2, 2, 0));
+      // vA = vB op literal
+      set_range(t, OP_ADD_INT_LIT16, OP_USHR_INT_LIT8, roles(1, 0, 1, 0));
+      // Optimized field accesses
+      t[OP_IGET_QUICK] = roles(1, 0, 1, 0);
+      t[OP_IGET_WIDE_QUICK] = roles(2, 0, 1, 0);
+      t[OP_IGET_OBJECT_QUICK] = roles(1, 0, 1, 0);
+      t[OP_IPUT_QUICK] = roles(0, 1, 1, 0);
+      t[OP_IPUT_WIDE_QUICK] = roles(0, 2, 1, 0);
+      t[OP_IPUT_OBJECT_QUICK] = roles(0, 1, 1, 0);
+      return t;
+    }();
+    return table;
+  }
+
+  void push(std::vector<uint16_t>& regs, u4 reg, uint8_t width)
+  {
+    for (uint8_t i = 0; i < width && reg + i <= 0xffff; i++)
+      regs.push_back((uint16_t)(reg + i));
+  }
+}
+
+void RegisterEffects::add(DecodedInstruction const& insn,
+                          InstructionFormat format)
+{
+  switch (format)
+  {
+  case kFmt35c: case kFmt35ms: case kFmt35fs: case kFmt3inline:
+    for (u4 i = 0; i < insn.vA && i < 5; i++)
+      push(uses, insn.arg[i], 1);
+    break;
+  case kFmt3rc: case kFmt3rms: case kFmt3rfs: case kFmt3rinline:
+    for (u4 i = 0; i < insn.vA; i++)
+      push(uses, insn.vC + i, 1);
+    break;
+  default:
+  {
+    auto const& r = role_table()[insn.opCode];
+    push(uses, insn.vA, r.use_a);
+    push(uses, insn.vB, r.use_b);
+    push(uses, insn.vC, r.use_c);
+    push(defs, insn.vA, r.def_a);
+    break;
+  }
+  }
+  use_begin.push_back(uses.size());
+  def_begin.push_back(defs.size());
+}
+
+void RegisterEffects::clear()
+{
+  use_begin.assign(1, 0);
+  def_begin.assign(1, 0);
+  uses.clear();
+  defs.clear();
+}
+
+Result analyze(std::vector<NodeSPtr> const& node_vec,
+               RegisterEffects const& effects,
+               uint16_t registers_size)
+{
+  using namespace Dataflow;
+  Result result;
+  result.graph = build_blocks(node_vec);
+  auto const block_count = result.graph.blocks.size();
+
+  // Upward exposed uses and definitions, walking each block backwards
+  Problem problem{ Direction::BACKWARD, Meet::UNION,
+                   BitMatrix(block_count, registers_size),
+                   BitMatrix(block_count, registers_size),
+                   BitMatrix() };
+  for (std::size_t b = 0; b < block_count; b++)
+  {
+    auto const& block = result.graph.blocks[b];
+    for (auto insn = (int64_t)block.last; insn >= (int64_t)block.first; insn--)
+    {
+      if ((std::size_t)insn >= effects.size())
+        continue;
+      for (auto reg = effects.defs_begin(insn); reg != effects.defs_end(insn);
+           reg++)
+      {
+        if (*reg >= registers_size)
+          continue;
+        problem.kill.set(b, *reg);
+        problem.gen.reset(b, *reg);
+      }
+      for (auto reg = effects.uses_begin(insn); reg != effects.uses_end(insn);
+           reg++)
+      {
+        if (*reg < registers_size)
+          problem.gen.set(b, *reg);
+      }
+    }
+  }
+
+  auto solution = solve(result.graph, problem);
+  result.live_in = std::move(solution.in);
+  result.live_out = std::move(solution.out);
+  return result;
+}
+}
+}
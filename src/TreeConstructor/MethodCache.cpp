@@ -0,0 +1,126 @@
+#include <unordered_map>
+
+#include <TreeConstructor/MethodCache.h>
+
+namespace TreeConstructor
+{
+MethodCache::MethodCache(std::size_t _max_nodes)
+  : max_nodes(_max_nodes)
+{
+}
+
+MethodTemplateSPtr MethodCache::find(std::string const& hash)
+{
+  auto const it = templates.find(hash);
+  if (it == templates.end())
+  {
+    total_stats.misses++;
+    file_stats.misses++;
+    return nullptr;
+  }
+
+  total_stats.hits++;
+  file_stats.hits++;
+  total_stats.reused_nodes += it->second->nodes.size() +
+                              it->second->emitted_nodes.size();
+  file_stats.reused_nodes += it->second->nodes.size() +
+                             it->second->emitted_nodes.size();
+  return it->second;
+}
+
+void MethodCache::insert(std::string const& hash,
+                         MethodTemplateSPtr const& method)
+{
+  auto const method_nodes = method->nodes.size() + method->emitted_nodes.size();
+  if (held_nodes + method_nodes > max_nodes)
+    return;
+  if (templates.emplace(hash, method).second)
+    held_nodes += method_nodes;
+}
+
+MethodCache::Stats MethodCache::take_file_stats()
+{
+  auto const ret = file_stats;
+  file_stats = Stats();
+  return ret;
+}
+
+void capture_links(MethodTemplate& method,
+                   std::vector<NodeSPtr> const& node_vec)
+{
+  std::unordered_map<Node const*, uint32_t> node_index;
+  method.nodes.reserve(node_vec.size());
+  for (auto const& nodesptr : node_vec)
+  {
+    node_index.emplace(nodesptr.get(), (uint32_t)method.nodes.size());
+    method.nodes.push_back(MethodTemplate::TemplateNode{
+        nodesptr->intern_offset, nodesptr->size, nodesptr->opcode});
+  }
+
+  for (auto const& nodesptr : node_vec)
+  {
+    auto const from = node_index[nodesptr.get()];
+    for (auto const& next_nodesptr : nodesptr->next_nodes)
+    {
+      auto const to_it = node_index.find(next_nodesptr.get());
+      if (to_it != node_index.end())
+        method.links.push_back(std::make_pair(from, to_it->second));
+    }
+  }
+}
+
+void capture_traversal(
+    MethodTemplate& method,
+    std::vector<NodeSPtr> const& nodesptr_vec,
+    std::vector<std::pair<NodeSPtr, NodeSPtr>> const& edges_vec)
+{
+  // Same cut-off rules as StreamWriter::dump_method
+  for (auto const& nodesptr : nodesptr_vec)
+  {
+    if (nodesptr == nullptr)
+      break;
+    method.emitted_nodes.push_back(
+        std::make_pair(nodesptr->intern_offset, nodesptr->opcode_type));
+  }
+  for (auto const& pair : edges_vec)
+  {
+    if (pair.first == nullptr || pair.second == nullptr)
+      break;
+    method.emitted_edges.push_back(
+        std::make_pair(pair.first->intern_offset, pair.second->intern_offset));
+  }
+  for (auto const& nodesptr : nodesptr_vec)
+  {
+    if (nodesptr != nullptr && nodesptr->opcode_type == OpCodeType::CALL)
+      method.call_sites.push_back(nodesptr->intern_offset);
+  }
+}
+
+void capture_node(MethodTemplate& method, Node const& node)
+{
+  method.emitted_nodes.push_back(
+      std::make_pair(node.intern_offset, node.opcode_type));
+  for (auto const& child : node.next_nodes)
+    method.emitted_edges.push_back(
+        std::make_pair(node.intern_offset, child->intern_offset));
+  if (node.opcode_type == OpCodeType::CALL)
+    method.call_sites.push_back(node.intern_offset);
+}
+
+std::vector<NodeSPtr> instantiate(MethodTemplate const& method,
+                                  uint32_t entry_addr)
+{
+  std::vector<NodeSPtr> node_vec;
+  node_vec.reserve(method.nodes.size());
+  for (auto const& node : method.nodes)
+  {
+    node_vec.push_back(std::make_shared<Node>(
+        entry_addr + node.intern_offset * 2, node.size, node.opcode,
+        MethodInfo(), node.intern_offset, std::vector<uint32_t>()));
+  }
+
+  for (auto const& link : method.links)
+    node_vec[link.first]->next_nodes.push_back(node_vec[link.second]);
+  return node_vec;
+}
+}
@@ -123,6 +123,7 @@ std::string OpCodeTypeToStr(OpCodeType const& opcodetype)
     case OpCodeType::THROW: return "THROW"; break;
     case OpCodeType::SYSCALL: return "SYSCALL"; break;
     case OpCodeType::RET: return "RET"; break;
+    case OpCodeType::EXTERN: return "EXTERN"; break;
   }
 }
 
@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <limits>
+
+#include <TreeConstructor/Sccp.h>
+
+namespace TreeConstructor
+{
+namespace Sccp
+{
+namespace
+{
+  int32_t read_s4(u2 const* units)
+  {
+    return (int32_t)(units[0] | ((uint32_t)units[1] << 16));
+  }
+
+  struct Value
+  {
+    enum : uint8_t
+    {
+      UNDEFINED,  // no executable definition reached yet
+      CONSTANT,
+      VARYING,
+    } state;
+    int32_t constant;
+
+    bool operator==(Value const& other) const
+    {
+      return state == other.state &&
+             (state != CONSTANT || constant == other.constant);
+    }
+  };
+
+  Value const undefined{ Value::UNDEFINED, 0 };
+  Value const varying{ Value::VARYING, 0 };
+
+  Value constant(int32_t value) { return Value{ Value::CONSTANT, value }; }
+
+  Value meet(Value const& lhs, Value const& rhs)
+  {
+    if (lhs.state == Value::UNDEFINED)
+      return rhs;
+    if (rhs.state == Value::UNDEFINED || lhs == rhs)
+      return lhs;
+    return varying;
+  }
+
+  enum class BinOp
+  {
+    ADD, SUB, MUL, DIV, REM, AND, OR, XOR, SHL, SHR, USHR, RSUB
+  };
+
+  // Java int semantics: wrapping, shift counts masked, and MIN_VALUE / -1
+  // is MIN_VALUE. Division by zero throws, the result is never written.
+  Value evaluate(BinOp op, Value const& lhs, Value const& rhs)
+  {
+    if (lhs.state == Value::VARYING || rhs.state == Value::VARYING)
+      return varying;
+    if (lhs.state == Value::UNDEFINED || rhs.state == Value::UNDEFINED)
+      return undefined;
+    auto const a = (uint32_t)lhs.constant;
+    auto const b = (uint32_t)rhs.constant;
+    switch (op)
+    {
+    case BinOp::ADD: return constant((int32_t)(a + b));
+    case BinOp::SUB: return constant((int32_t)(a - b));
+    case BinOp::RSUB: return constant((int32_t)(b - a));
+    case BinOp::MUL: return constant((int32_t)(a * b));
+    case BinOp::DIV:
+    case BinOp::REM:
+      if (rhs.constant == 0)
+        return varying;
+      if (lhs.constant == std::numeric_limits<int32_t>::min() &&
+          rhs.constant == -1)
+        return constant(op == BinOp::DIV ? lhs.constant : 0);
+      return constant(op == BinOp::DIV ? lhs.constant / rhs.constant
+                                       : lhs.constant % rhs.constant);
+    case BinOp::AND: return constant((int32_t)(a & b));
+    case BinOp::OR: return constant((int32_t)(a | b));
+    case BinOp::XOR: return constant((int32_t)(a ^ b));
+    case BinOp::SHL: return constant((int32_t)(a << (b & 31)));
+    case BinOp::SHR: return constant(lhs.constant >> (b & 31));
+    case BinOp::USHR: return constant((int32_t)(a >> (b & 31)));
+    }
+    return varying;
+  }
+
+  // Operation of the int arithmetic opcodes, false for any other.
+  bool binop_of(OpCode opcode, BinOp& op)
+  {
+    static BinOp const order[] = { BinOp::ADD, BinOp::SUB, BinOp::MUL,
+                                   BinOp::DIV, BinOp::REM, BinOp::AND,
+                                   BinOp::OR,  BinOp::XOR, BinOp::SHL,
+                                   BinOp::SHR, BinOp::USHR };
+    if (opcode >= OP_ADD_INT && opcode <= OP_USHR_INT)
+      op = order[opcode - OP_ADD_INT];
+    else if (opcode >= OP_ADD_INT_2ADDR && opcode <= OP_USHR_INT_2ADDR)
+      op = order[opcode - OP_ADD_INT_2ADDR];
+    else if (opcode >= OP_ADD_INT_LIT16 && opcode <= OP_XOR_INT_LIT16)
+      op = order[opcode - OP_ADD_INT_LIT16];
+    else if (opcode >= OP_ADD_INT_LIT8 && opcode <= OP_USHR_INT_LIT8)
+      op = order[opcode - OP_ADD_INT_LIT8];
+    else
+      return false;
+    if (opcode == OP_RSUB_INT || opcode == OP_RSUB_INT_LIT8)
+      op = BinOp::RSUB;
+    return true;
+  }
+
+  void transfer(DecodedInstruction const& insn,
+                Liveness::RegisterEffects const& effects, std::size_t index,
+                Value* regs, uint16_t registers_size)
+  {
+    auto const reg = [&](u4 r) { return r < registers_size ? regs[r] : varying; };
+    auto const set = [&](u4 r, Value const& value) {
+      if (r < registers_size)
+        regs[r] = value;
+    };
+
+    BinOp op;
+    switch (insn.opCode)
+    {
+    case OP_CONST_4: case OP_CONST_16: case OP_CONST:
+      set(insn.vA, constant((int32_t)insn.vB));
+      return;
+    case OP_CONST_HIGH16:
+      set(insn.vA, constant((int32_t)(insn.vB << 16)));
+      return;
+    case OP_MOVE: case OP_MOVE_FROM16: case OP_MOVE_16:
+    case OP_MOVE_OBJECT: case OP_MOVE_OBJECT_FROM16: case OP_MOVE_OBJECT_16:
+      set(insn.vA, reg(insn.vB));
+      return;
+    case OP_NEG_INT: case OP_NOT_INT: case OP_INT_TO_BYTE:
+    case OP_INT_TO_CHAR: case OP_INT_TO_SHORT:
+    {
+      auto value = reg(insn.vB);
+      if (value.state == Value::CONSTANT)
+      {
+        auto const v = value.constant;
+        value.constant =
+            insn.opCode == OP_NEG_INT ? (int32_t)(0u - (uint32_t)v)
+          : insn.opCode == OP_NOT_INT ? ~v
+          : insn.opCode == OP_INT_TO_BYTE ? (int32_t)(int8_t)v
+          : insn.opCode == OP_INT_TO_CHAR ? (int32_t)(uint16_t)v
+          : (int32_t)(int16_t)v;
+      }
+      set(insn.vA, value);
+      return;
+    }
+    default:
+      break;
+    }
+
+    if (binop_of(insn.opCode, op))
+    {
+      if (insn.opCode >= OP_ADD_INT_2ADDR && insn.opCode <= OP_USHR_INT_2ADDR)
+        set(insn.vA, evaluate(op, reg(insn.vA), reg(insn.vB)));
+      else if (insn.opCode >= OP_ADD_INT_LIT16)
+        set(insn.vA, evaluate(op, reg(insn.vB), constant((int32_t)insn.vC)));
+      else
+        set(insn.vA, evaluate(op, reg(insn.vB), reg(insn.vC)));
+      return;
+    }
+
+    // Anything else writes values not tracked
+    for (auto r = effects.defs_begin(index); r != effects.defs_end(index); r++)
+      set(*r, varying);
+  }
+
+  bool compare(OpCode opcode, int32_t lhs, int32_t rhs)
+  {
+    switch (opcode)
+    {
+    case OP_IF_EQ: case OP_IF_EQZ: return lhs == rhs;
+    case OP_IF_NE: case OP_IF_NEZ: return lhs != rhs;
+    case OP_IF_LT: case OP_IF_LTZ: return lhs < rhs;
+    case OP_IF_GE: case OP_IF_GEZ: return lhs >= rhs;
+    case OP_IF_GT: case OP_IF_GTZ: return lhs > rhs;
+    default: return lhs <= rhs;
+    }
+  }
+
+  // Position of the node at code unit offset in node_vec, or -1.
+  int64_t index_at(std::vector<NodeSPtr> const& node_vec, uint32_t offset)
+  {
+    auto const it = std::lower_bound(
+        node_vec.begin(), node_vec.end(), offset,
+        [](NodeSPtr const& lhs, uint32_t rhs) { return lhs->intern_offset < rhs; });
+    if (it == node_vec.end() || (*it)->intern_offset != offset)
+      return -1;
+    return it - node_vec.begin();
+  }
+
+  // Code unit offset a branch with known operands goes to, or -1 while an
+  // operand is undefined and -2 when it may go anywhere.
+  int64_t branch_target(Node const& node, DecodedInstruction const& insn,
+                        Code const& code, std::size_t index,
+                        Value const* regs, uint16_t registers_size)
+  {
+    auto const reg = [&](u4 r) { return r < registers_size ? regs[r] : varying; };
+    auto const fallthrough = (int64_t)node.intern_offset + node.size;
+
+    Value lhs = reg(insn.vA);
+    Value rhs = constant(0);
+    if (node.opcode_type == OpCodeType::IF)
+    {
+      if (insn.opCode >= OP_IF_EQ && insn.opCode <= OP_IF_LE)
+        rhs = reg(insn.vB);
+      if (node.opt_arg_offset.empty())
+        return -2;
+    }
+    if (lhs.state == Value::VARYING || rhs.state == Value::VARYING)
+      return -2;
+    if (lhs.state == Value::UNDEFINED || rhs.state == Value::UNDEFINED)
+      return -1;
+
+    if (node.opcode_type == OpCodeType::IF)
+      return compare(insn.opCode, lhs.constant, rhs.constant)
+                 ? node.opt_arg_offset.front()
+                 : fallthrough;
+    for (auto c = code.cases_begin(index); c != code.cases_end(index); c++)
+    {
+      if (c->key == lhs.constant)
+        return c->target;
+    }
+    return fallthrough;
+  }
+}
+
+void Code::add(DecodedInstruction const& insn, uint32_t insn_offset,
+               u2 const* insns)
+{
+  operands.push_back(insn);
+  if (insn.opCode == OP_PACKED_SWITCH || insn.opCode == OP_SPARSE_SWITCH)
+  {
+    auto const payload = insns + (int32_t)insn.vB;
+    auto const size = payload[1];
+    if (insn.opCode == OP_PACKED_SWITCH && payload[0] == kPackedSwitchSignature)
+    {
+      auto const first_key = read_s4(payload + 2);
+      for (u2 i = 0; i < size; i++)
+        cases.push_back(Case{ (int32_t)((uint32_t)first_key + i),
+                              insn_offset + read_s4(payload + 4 + 2 * i) });
+    }
+    else if (insn.opCode == OP_SPARSE_SWITCH &&
+             payload[0] == kSparseSwitchSignature)
+    {
+      for (u2 i = 0; i < size; i++)
+        cases.push_back(Case{ read_s4(payload + 2 + 2 * i),
+                              insn_offset +
+                                  read_s4(payload + 2 + 2 * (size + i)) });
+    }
+  }
+  case_begin.push_back(cases.size());
+}
+
+void Code::clear()
+{
+  operands.clear();
+  case_begin.assign(1, 0);
+  cases.clear();
+}
+
+Result analyze(std::vector<NodeSPtr> const& node_vec, Code const& code,
+               Liveness::RegisterEffects const& effects,
+               uint16_t registers_size,
+               std::vector<uint32_t> const& handlers)
+{
+  Result result;
+  result.graph = Dataflow::build_blocks(node_vec);
+  auto const& blocks = result.graph.blocks;
+  auto const block_count = blocks.size();
+  result.executable.assign(block_count, false);
+  if (block_count == 0 || code.size() < node_vec.size() ||
+      effects.size() < node_vec.size())
+    return result;
+
+  // Register values on exit of each block, and the links out of its last
+  // node found executable (node indices)
+  std::vector<Value> out(block_count * registers_size, undefined);
+  std::vector<std::vector<uint32_t>> taken(block_count);
+  std::vector<Value> regs(registers_size);
+
+  // The entry and the catch handlers, reached with unknown registers
+  std::vector<bool> handler(node_vec.size(), false);
+  std::vector<uint32_t> worklist{ 0 };
+  std::vector<bool> queued(block_count, false);
+  queued[0] = true;
+  for (auto const offset : handlers)
+  {
+    auto const h = index_at(node_vec, offset);
+    if (h < 0)
+      continue;
+    handler[h] = true;
+    auto const b = result.graph.block_of[h];
+    if (!queued[b])
+    {
+      queued[b] = true;
+      worklist.push_back(b);
+    }
+  }
+  while (!worklist.empty())
+  {
+    auto const b = worklist.back();
+    worklist.pop_back();
+    queued[b] = false;
+    auto const& block = blocks[b];
+
+    // Meet over the executable links in; parameters are unknown
+    std::fill(regs.begin(), regs.end(), b == 0 ? varying : undefined);
+    for (auto const p : block.preds)
+    {
+      if (std::find(taken[p].begin(), taken[p].end(), block.first) ==
+          taken[p].end())
+        continue;
+      auto const pred_out = out.data() + p * registers_size;
+      for (std::size_t r = 0; r < registers_size; r++)
+        regs[r] = meet(regs[r], pred_out[r]);
+    }
+
+    for (auto i = block.first; i <= block.last; i++)
+    {
+      // Handlers may also be reached by falling or branching into them
+      if (handler[i])
+        std::fill(regs.begin(), regs.end(), varying);
+      transfer(code[i], effects, i, regs.data(), registers_size);
+    }
+
+    auto const block_out = out.data() + b * registers_size;
+    bool const first_visit = !result.executable[b];
+    bool const changed =
+        first_visit || !std::equal(regs.begin(), regs.end(), block_out);
+    result.executable[b] = true;
+    std::copy(regs.begin(), regs.end(), block_out);
+
+    // Links out of the last node that may be taken
+    auto const& last = *node_vec[block.last];
+    int64_t target = -2;
+    if (last.opcode_type == OpCodeType::IF ||
+        last.opcode_type == OpCodeType::SWITCH)
+      target = branch_target(last, code[block.last], code, block.last,
+                             regs.data(), registers_size);
+    if (target == -1)
+      continue;
+    bool linked = false;
+    for (auto const& child : last.next_nodes)
+      linked |= child->intern_offset == target;
+    for (auto const& child : last.next_nodes)
+    {
+      if (linked && child->intern_offset != target)
+        continue;
+      auto const s = index_at(node_vec, child->intern_offset);
+      if (s < 0 || node_vec[s] != child)
+        continue;
+      bool const new_link =
+          std::find(taken[b].begin(), taken[b].end(), s) == taken[b].end();
+      if (new_link)
+        taken[b].push_back(s);
+      auto const t = result.graph.block_of[s];
+      if ((new_link || changed) && !queued[t])
+      {
+        queued[t] = true;
+        worklist.push_back(t);
+      }
+    }
+  }
+
+  for (std::size_t b = 0; b < block_count; b++)
+  {
+    auto const& last = *node_vec[blocks[b].last];
+    if (!result.executable[b] || (last.opcode_type != OpCodeType::IF &&
+                                  last.opcode_type != OpCodeType::SWITCH))
+      continue;
+    for (auto const& child : last.next_nodes)
+    {
+      auto const s = index_at(node_vec, child->intern_offset);
+      if (s < 0 || node_vec[s] != child ||
+          std::find(taken[b].begin(), taken[b].end(), s) != taken[b].end())
+        continue;
+      result.infeasible.emplace_back(blocks[b].last, s);
+    }
+  }
+  return result;
+}
+
+std::size_t prune(std::vector<NodeSPtr> const& node_vec, Result const& result)
+{
+  std::size_t ret = 0;
+  for (auto const& link : result.infeasible)
+  {
+    auto& next_nodes = node_vec[link.first]->next_nodes;
+    auto const target = node_vec[link.second];
+    auto const end = std::remove(next_nodes.begin(), next_nodes.end(), target);
+    ret += next_nodes.end() - end;
+    next_nodes.erase(end, next_nodes.end());
+  }
+  return ret;
+}
+}
+}
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iterator>
+#include <sstream>
+
+#include <sys/resource.h>
+
+#include <TreeConstructor/Stats.h>
+
+namespace
+{
+  using TreeConstructor::Stats::Memory;
+
+  auto constexpr memory_count = static_cast<std::size_t>(Memory::COUNT);
+
+  // Fed by CountingAllocator.cpp when it is linked in: a few relaxed
+  // atomics are noise next to the allocation itself.
+  std::atomic<uint64_t> allocation_count(0);
+  std::atomic<uint64_t> allocated_bytes(0);
+  std::atomic<int64_t> live_bytes[memory_count];
+  std::atomic<int64_t> peak_bytes[memory_count];
+  std::atomic<int64_t> heap_live(0);
+
+  thread_local Memory current_memory = Memory::OTHER;
+
+  void account(Memory memory, int64_t bytes)
+  {
+    auto const idx = static_cast<std::size_t>(memory);
+    auto const live = live_bytes[idx].fetch_add(bytes, std::memory_order_relaxed)
+                      + bytes;
+    if (memory != Memory::DEX_MAPPING)
+      heap_live.fetch_add(bytes, std::memory_order_relaxed);
+    auto peak = peak_bytes[idx].load(std::memory_order_relaxed);
+    while (live > peak &&
+           !peak_bytes[idx].compare_exchange_weak(peak, live,
+                                                  std::memory_order_relaxed))
+      ;
+  }
+}
+
+namespace TreeConstructor
+{
+namespace Stats
+{
+namespace
+{
+  struct PhaseTime
+  {
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+  };
+
+  auto constexpr phase_count = static_cast<std::size_t>(Phase::COUNT);
+  auto constexpr counter_count = static_cast<std::size_t>(Counter::COUNT);
+
+  char const* const phase_names[phase_count] = {
+    "open", "verify", "parse", "cache", "classes",
+    "calls", "traversal", "write", "total",
+  };
+  char const* const counter_names[counter_count] = {
+    "classes", "methods", "instructions", "nodes", "edges", "bytes_written",
+    "methods_skipped", "stream_fallbacks", "classes_filtered",
+    "edges_pruned", "calls_sharpened",
+  };
+  char const* const memory_names[memory_count] = {
+    "dex_mapping", "class_data", "nodes", "edges", "strings", "output", "other",
+  };
+
+  bool stats_enabled = false;
+  thread_local PhaseTime phases[phase_count];
+  thread_local uint64_t counters[counter_count];
+  thread_local uint64_t allocation_count_base = 0;
+  thread_local uint64_t allocated_bytes_base = 0;
+
+  uint64_t elapsed_ns(timespec const& begin, timespec const& end)
+  {
+    return (uint64_t)(end.tv_sec - begin.tv_sec) * 1000000000ull +
+           end.tv_nsec - begin.tv_nsec;
+  }
+
+  std::string json_string(std::string const& str)
+  {
+    std::string ret = "\"";
+    for (auto const c : str)
+    {
+      if (c == '"' || c == '\\')
+      {
+        ret += '\\';
+        ret += c;
+      }
+      else if ((unsigned char)c < 0x20)
+      {
+        char buff[8];
+        snprintf(buff, sizeof(buff), "\\u%04x", c);
+        ret += buff;
+      }
+      else
+        ret += c;
+    }
+    return ret + "\"";
+  }
+}
+
+void enable(bool enabled)
+{
+  stats_enabled = enabled;
+}
+
+bool enabled()
+{
+  return stats_enabled;
+}
+
+void reset()
+{
+  for (auto& phase : phases)
+    phase = PhaseTime{0, 0};
+  for (auto& counter : counters)
+    counter = 0;
+  allocation_count_base = allocation_count.load(std::memory_order_relaxed);
+  allocated_bytes_base = allocated_bytes.load(std::memory_order_relaxed);
+  // Peaks are per file, starting from what the previous files left live
+  for (std::size_t i = 0; i < memory_count; i++)
+    peak_bytes[i].store(live_bytes[i].load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+}
+
+void add(Counter counter, uint64_t value)
+{
+  counters[static_cast<std::size_t>(counter)] += value;
+}
+
+Counts thread_counts()
+{
+  Counts ret;
+  std::copy(std::begin(counters), std::end(counters), ret.begin());
+  return ret;
+}
+
+void add(Counts const& counts)
+{
+  for (std::size_t i = 0; i < counter_count; i++)
+    counters[i] += counts[i];
+}
+
+MemoryScope::MemoryScope(Memory memory)
+  : previous(current_memory)
+{
+  current_memory = memory;
+}
+
+MemoryScope::~MemoryScope()
+{
+  current_memory = previous;
+}
+
+void track(Memory memory, int64_t bytes)
+{
+  account(memory, bytes);
+}
+
+Memory allocating_memory()
+{
+  return current_memory;
+}
+
+void allocated(Memory memory, std::size_t bytes)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  account(memory, (int64_t)bytes);
+}
+
+void freed(Memory memory, std::size_t bytes)
+{
+  account(memory, -(int64_t)bytes);
+}
+
+uint64_t heap_live_bytes()
+{
+  auto const live = heap_live.load(std::memory_order_relaxed);
+  return live < 0 ? 0 : (uint64_t)live;
+}
+
+bool over_memory_budget(uint64_t budget_bytes, uint64_t extra_bytes)
+{
+  return budget_bytes != 0 && heap_live_bytes() + extra_bytes > budget_bytes;
+}
+
+ScopedTimer::ScopedTimer(Phase _phase)
+  : phase(_phase), active(stats_enabled)
+{
+  if (!active)
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &wall_begin);
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_begin);
+}
+
+ScopedTimer::~ScopedTimer()
+{
+  if (!active)
+    return;
+  timespec wall_end;
+  timespec cpu_end;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+  clock_gettime(CLOCK_MONOTONIC, &wall_end);
+
+  auto& time = phases[static_cast<std::size_t>(phase)];
+  time.wall_ns += elapsed_ns(wall_begin, wall_end);
+  time.cpu_ns += elapsed_ns(cpu_begin, cpu_end);
+}
+
+std::string to_json(std::string const& file_name, int result)
+{
+  // Before building the string, which allocates too
+  auto const file_allocations =
+      allocation_count.load(std::memory_order_relaxed) - allocation_count_base;
+  auto const file_allocated_bytes =
+      allocated_bytes.load(std::memory_order_relaxed) - allocated_bytes_base;
+
+  std::ostringstream json;
+  json.setf(std::ios::fixed);
+  json.precision(3);
+
+  json << "{\"file\":" << json_string(file_name)
+       << ",\"result\":" << result << ",\"phases\":{";
+  for (std::size_t i = 0; i < phase_count; i++)
+  {
+    json << (i == 0 ? "" : ",") << "\"" << phase_names[i] << "\":{"
+         << "\"wall_ms\":" << phases[i].wall_ns / 1e6 << ","
+         << "\"cpu_ms\":" << phases[i].cpu_ns / 1e6 << "}";
+  }
+  json << "}";
+
+  for (std::size_t i = 0; i < counter_count; i++)
+    json << ",\"" << counter_names[i] << "\":" << counters[i];
+
+  // Decoding happens in the classes phase
+  auto const decode_ns =
+      phases[static_cast<std::size_t>(Phase::CLASSES)].wall_ns;
+  auto const instructions =
+      counters[static_cast<std::size_t>(Counter::INSTRUCTIONS)];
+  json.precision(0);
+  json << ",\"instructions_per_sec\":"
+       << (decode_ns == 0 ? 0.0 : instructions * 1e9 / decode_ns);
+
+  json << ",\"allocations\":" << file_allocations
+       << ",\"allocated_bytes\":" << file_allocated_bytes;
+
+  json << ",\"memory\":{";
+  for (std::size_t i = 0; i < memory_count; i++)
+  {
+    json << (i == 0 ? "" : ",") << "\"" << memory_names[i] << "\":{"
+         << "\"live_bytes\":" << live_bytes[i].load(std::memory_order_relaxed)
+         << ",\"peak_bytes\":" << peak_bytes[i].load(std::memory_order_relaxed)
+         << "}";
+  }
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // ru_maxrss is in kilobytes, and for the whole process so far
+  json << "},\"peak_rss_bytes\":" << (uint64_t)usage.ru_maxrss * 1024 << "}";
+  return json.str();
+}
+}
+}
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <utility>
+
+#include <TreeConstructor/StringSearch.h>
+
+namespace TreeConstructor
+{
+namespace StringSearch
+{
+namespace
+{
+  uint32_t trigram(char const* at)
+  {
+    return (uint32_t)(uint8_t)at[0] << 16 | (uint32_t)(uint8_t)at[1] << 8 |
+           (uint8_t)at[2];
+  }
+
+  // (trigram, string) pairs of strings [first, last), sorted and unique
+  void collect(std::vector<char const*> const& strings, std::size_t first,
+               std::size_t last, std::vector<uint64_t>& pairs)
+  {
+    for (auto i = first; i < last; i++)
+    {
+      auto const s = strings[i];
+      if (s == nullptr)
+        continue;
+      auto const len = std::strlen(s);
+      for (std::size_t p = 0; p + 3 <= len; p++)
+        pairs.push_back((uint64_t)trigram(s + p) << 32 | i);
+    }
+    // Radix sort on the trigram, stable so that strings stay ascending
+    std::vector<uint64_t> sorted(pairs.size());
+    for (int shift = 32; shift < 56; shift += 8)
+    {
+      std::size_t count[257] = {};
+      for (auto const pair : pairs)
+        count[((pair >> shift) & 0xff) + 1]++;
+      for (int b = 0; b < 256; b++)
+        count[b + 1] += count[b];
+      for (auto const pair : pairs)
+        sorted[count[(pair >> shift) & 0xff]++] = pair;
+      pairs.swap(sorted);
+    }
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+  }
+}
+
+Index::Index(std::vector<char const*> strings, unsigned threads)
+    : strings(std::move(strings))
+{
+  auto const& pool = this->strings;
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  std::size_t const chunks =
+      std::max<std::size_t>(1, std::min<std::size_t>(threads,
+                                                     pool.size() / 4096));
+
+  // Chunks of consecutive strings, each sorted on its own thread
+  std::vector<std::vector<uint64_t>> parts(chunks);
+  std::vector<std::thread> workers;
+  for (std::size_t c = 1; c < chunks; c++)
+  {
+    workers.emplace_back(collect, std::cref(pool), pool.size() * c / chunks,
+                         pool.size() * (c + 1) / chunks, std::ref(parts[c]));
+  }
+  collect(pool, 0, pool.size() / chunks, parts[0]);
+  for (auto& worker : workers)
+    worker.join();
+
+  std::size_t total = 0;
+  for (auto const& part : parts)
+    total += part.size();
+  std::vector<uint64_t> pairs;
+  pairs.reserve(total);
+  for (auto& part : parts)
+  {
+    auto const middle = pairs.size();
+    pairs.insert(pairs.end(), part.begin(), part.end());
+    std::inplace_merge(pairs.begin(), pairs.begin() + middle, pairs.end());
+    std::vector<uint64_t>().swap(part);
+  }
+
+  postings.reserve(pairs.size());
+  for (auto const pair : pairs)
+  {
+    auto const key = (uint32_t)(pair >> 32);
+    if (trigrams.empty() || trigrams.back() != key)
+    {
+      trigrams.push_back(key);
+      begin.push_back(postings.size());
+    }
+    postings.push_back((uint32_t)pair);
+  }
+  begin.push_back(postings.size());
+}
+
+std::vector<uint32_t> Index::find(std::string const& needle) const
+{
+  std::vector<uint32_t> ret;
+  auto const contains = [&needle](char const* s) {
+    return s != nullptr && std::strstr(s, needle.c_str()) != nullptr;
+  };
+  if (needle.size() < 3)
+  {
+    for (uint32_t i = 0; i < strings.size(); i++)
+    {
+      if (contains(strings[i]))
+        ret.push_back(i);
+    }
+    return ret;
+  }
+
+  // Candidates from the rarest trigram, then checked
+  uint32_t const* first = nullptr;
+  uint32_t const* last = nullptr;
+  for (std::size_t p = 0; p + 3 <= needle.size(); p++)
+  {
+    auto const it = std::lower_bound(trigrams.begin(), trigrams.end(),
+                                     trigram(needle.data() + p));
+    if (it == trigrams.end() || *it != trigram(needle.data() + p))
+      return ret;
+    auto const t = it - trigrams.begin();
+    if (first == nullptr || begin[t + 1] - begin[t] < (std::size_t)(last - first))
+    {
+      first = postings.data() + begin[t];
+      last = postings.data() + begin[t + 1];
+    }
+  }
+  for (auto it = first; it != last; it++)
+  {
+    if (contains(strings[*it]))
+      ret.push_back(*it);
+  }
+  return ret;
+}
+}
+}
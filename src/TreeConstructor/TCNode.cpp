@@ -1,5 +1,6 @@
 #include <sstream>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <assert.h>
 
@@ -11,16 +12,16 @@ namespace TreeConstructor
 Node::Node(uint32_t const& _baseAddr,
            uint16_t const& _size,
 		       OpCode const& _opcode,
-					 MethodInfo const& _called_method_info,
+					 MethodInfo _called_method_info,
            uint32_t const& _internal_offset,
-           std::vector<uint32_t> const& _opt_arg_offset)
+           std::vector<uint32_t> _opt_arg_offset)
 {
 	this->baseAddr = _baseAddr;
   this->size = _size;
 	this->opcode = _opcode;
-	this->called_method_info = _called_method_info;
+	this->called_method_info = std::move(_called_method_info);
   this->intern_offset = _internal_offset;
-  this->opt_arg_offset = _opt_arg_offset;
+  this->opt_arg_offset = std::move(_opt_arg_offset);
   this->opcode_type = OpCodeClassifier::get_opcode_type(_opcode);
 }
 
@@ -39,219 +40,15 @@ namespace
   {
     return std::find(vec.begin(), vec.end(), value) != std::end(vec);
   }
-
-  // Called in a loop to traverse the tree from current_node
-  // descending via the leftest node each time
-  // and adding it to visiting_stack iif node has not been visited yet
-  void left_traversal_stack(std::vector<NodeSPtr> & visiting_nodeptr_stack,
-                            std::vector<NodeSPtr> & visited_nodeptr_vec,
-                            NodeSPtr & current_node)
-  {
-    if (current_node->next_nodes.empty())
-    {
-      if (!find<NodeSPtr>(visiting_nodeptr_stack, current_node))
-        visiting_nodeptr_stack.push_back(current_node);
-      return;
-    }
-    
-    do
-    {
-      if (!find<NodeSPtr>(visiting_nodeptr_stack, current_node))
-      {
-        visiting_nodeptr_stack.push_back(current_node);
-        auto const new_current_node = current_node->next_nodes[0];
-        if (!find<NodeSPtr>(visited_nodeptr_vec, new_current_node))
-          current_node = new_current_node;
-      }
-      else
-      {
-        break;
-      }
-    } while (!current_node->next_nodes.empty());
-    // Finally add leaf node
-    if (!find<NodeSPtr>(visiting_nodeptr_stack, current_node))
-      visiting_nodeptr_stack.push_back(current_node);
-  }
-
-  // Called in a loop to destack all the nodes in visiting_stack
-  // with only 1 next_nodes
-  void destack_and_dump_node(std::vector<NodeSPtr> & visiting_nodeptr_stack,
-                             std::vector<NodeSPtr> & visited_nodeptr_vec, 
-                             std::stringstream & dot_ss,
-														 FmtLambda dump_format_method)
-  {
-    auto const popped_node = visiting_nodeptr_stack.back();
-    visiting_nodeptr_stack.pop_back();
-    if (!find<NodeSPtr>(visited_nodeptr_vec, popped_node))
-    {
-      dot_ss << dump_format_method(popped_node); // Visitor operation
-      visited_nodeptr_vec.push_back(popped_node);
-    }
-  }
-
-	std::pair<NodeSPtr, std::vector<std::pair<NodeSPtr, NodeSPtr>>>
-  binary_destack_and_dump_node(std::vector<NodeSPtr> &visiting_nodeptr_stack,
-                               std::vector<NodeSPtr> &visited_nodeptr_vec,
-                               BinaryFmtLambda dump_format_method)
-	{
-		std::pair<NodeSPtr, std::vector<std::pair<NodeSPtr, NodeSPtr>>> pair;
-    auto const popped_node = visiting_nodeptr_stack.back();
-    visiting_nodeptr_stack.pop_back();
-    if (!find<NodeSPtr>(visited_nodeptr_vec, popped_node))
-    {
-      pair = dump_format_method(popped_node); // Visitor operation
-      visited_nodeptr_vec.push_back(popped_node);
-    }
-		return pair; 
-	}
-
-  NodeSPtr
-  get_next_unvisited_child(std::vector<NodeSPtr> &visiting_nodeptr_stack,
-                           std::vector<NodeSPtr> &visited_nodeptr_vec) 
-	{
-    if (visiting_nodeptr_stack.back()->next_nodes.empty())
-      return nullptr;
-    auto const children_next_nodes = visiting_nodeptr_stack.back()->next_nodes;
-    auto next_child_it = std::find_if(
-        children_next_nodes.begin(), children_next_nodes.end(),
-        [&](auto const nodesptr) {
-          auto const search_visiting_it = std::find_if(
-              visiting_nodeptr_stack.begin(), visiting_nodeptr_stack.end(),
-              [&](auto const visiting_nodesptr) {
-                return nodesptr->baseAddr == visiting_nodesptr->baseAddr;
-              });
-          return !find<NodeSPtr>(visited_nodeptr_vec, nodesptr) &&
-                 search_visiting_it == std::end(visiting_nodeptr_stack);
-        });
-    if (next_child_it == std::end(children_next_nodes))
-      return nullptr;
-    else
-      return *next_child_it;
-  }
-
-  // Called when all the next_nodes of visiting_stack.back()
-  // are already visited => Destack and move cursor up the stack
-  void process_cuttedfeet_node(std::vector<NodeSPtr> & visiting_nodeptr_stack,
-                               std::vector<NodeSPtr> & visited_nodeptr_vec,
-                               std::stringstream & dot_ss,
-                               NodeSPtr & current_node,
-															 FmtLambda dump_format_method)
-  {
-    destack_and_dump_node(visiting_nodeptr_stack,
-                          visited_nodeptr_vec,
-                          dot_ss,
-													dump_format_method);
-    // Move current_node cursor
-    if (!visiting_nodeptr_stack.empty())
-      current_node = visiting_nodeptr_stack.back();
-  }
-
-  std::pair<NodeSPtr, std::vector<std::pair<NodeSPtr, NodeSPtr>>>
-  binary_process_cuttedfeet_node(std::vector<NodeSPtr> &visiting_nodeptr_stack,
-                                 std::vector<NodeSPtr> &visited_nodeptr_vec,
-                                 NodeSPtr &current_node,
-                                 BinaryFmtLambda dump_format_method) 
-	{
-    auto const pair = binary_destack_and_dump_node(
-        visiting_nodeptr_stack, visited_nodeptr_vec, dump_format_method);
-    // Move current_node cursor
-    if (!visiting_nodeptr_stack.empty())
-      current_node = visiting_nodeptr_stack.back();
-		return pair;
-	}
-
-  // Called when destacking stop
-  // ie. visiting_stack.back() has multiple next_nodes
-  void process_multiplefeet_node(std::vector<NodeSPtr> & visiting_nodeptr_stack,
-                                 std::vector<NodeSPtr> & visited_nodeptr_vec,
-                                 std::stringstream & dot_ss,
-                                 NodeSPtr & current_node,
-																 FmtLambda dump_format_method)
-  {
-    auto const next_child =
-        get_next_unvisited_child(visiting_nodeptr_stack, visited_nodeptr_vec);
-    if (next_child != nullptr)
-      current_node = next_child;
-    else
-      process_cuttedfeet_node(visiting_nodeptr_stack,
-                              visited_nodeptr_vec,
-                              dot_ss,
-                              current_node,
-															dump_format_method);
-  }
-
-  std::pair<NodeSPtr, std::vector<std::pair<NodeSPtr, NodeSPtr>>>
-  binary_process_multiplefeet_node(
-      std::vector<NodeSPtr> &visiting_nodeptr_stack,
-      std::vector<NodeSPtr> &visited_nodeptr_vec, NodeSPtr &current_node,
-      BinaryFmtLambda dump_format_method) 
-	{
-    auto const next_child =
-        get_next_unvisited_child(visiting_nodeptr_stack, visited_nodeptr_vec);
-    if (next_child != nullptr)
-		{
-      current_node = next_child;
-      std::pair<NodeSPtr, std::vector<std::pair<NodeSPtr, NodeSPtr>>>
-          empty_pair;
-      return empty_pair;
-		}
-		else
-      return binary_process_cuttedfeet_node(visiting_nodeptr_stack,
-                                            visited_nodeptr_vec,
-																					 	current_node,
-                                            dump_format_method);
-  }
-
 }
 
 std::string dot_traversal(Node const& node, 
 													FmtLambda dump_format_method)
 {
   std::stringstream dot_ss;
-  std::vector<NodeSPtr> visiting_nodeptr_stack;
-  std::vector<NodeSPtr> visited_nodeptr_vec;
-  // Step 1: Initialized current node as root
-  NodeSPtr current_node = std::make_shared<Node>(node);
-  // Step 2: Push current node to S 
-  // and set current = current->left until no child
-  do
-  {
-    left_traversal_stack(visiting_nodeptr_stack, 
-                         visited_nodeptr_vec,
-                         current_node);
-    
-    // Step 3: If no childs and stack is not empty
-    // a) Pop the top item from the stack
-    // b) Do visitor operation, and set current_node = popped_item->right
-    // c) Go to Step 2
-    while (!visiting_nodeptr_stack.empty()
-      && visiting_nodeptr_stack.back()->next_nodes.size() < 2)
-    {
-      auto const search_visited_it =
-          std::find_if(visited_nodeptr_vec.begin(), visited_nodeptr_vec.end(),
-                       [&](auto const visited_nodesptr) {
-                         return visiting_nodeptr_stack.back()->baseAddr ==
-                                visited_nodesptr->baseAddr;
-                       });
-      if (search_visited_it == std::end(visited_nodeptr_vec))
-        destack_and_dump_node(visiting_nodeptr_stack,
-					 										visited_nodeptr_vec,
-                              dot_ss,
-															dump_format_method);
-      else
-        visiting_nodeptr_stack.pop_back();
-    }
-
-    if (!visiting_nodeptr_stack.empty())
-    {
-      process_multiplefeet_node(visiting_nodeptr_stack,
-                                visited_nodeptr_vec,
-                                dot_ss,
-                                current_node,
-																dump_format_method);
-    }
-     
-  } while (!visiting_nodeptr_stack.empty());
+  traverse(node, [&](NodeSPtr const& visited_node) {
+    dot_ss << dump_format_method(visited_node);
+  });
   return dot_ss.str();
 }
 
@@ -262,70 +59,11 @@ binary_traversal(Node const& node, BinaryFmtLambda dump_format_method)
 	std::vector<NodeSPtr> nodesptr_vec;
 	std::vector<std::pair<NodeSPtr, NodeSPtr>> edges_vec;
 
-  std::stringstream dot_ss;
-  std::vector<NodeSPtr> visiting_nodeptr_stack;
-  std::vector<NodeSPtr> visited_nodeptr_vec;
-  // Step 1: Initialized current node as root
-  NodeSPtr current_node = std::make_shared<Node>(node);
-  // Step 2: Push current node to S 
-  // and set current = current->left until no child
-  do
-  {
-    left_traversal_stack(visiting_nodeptr_stack,
-                         visited_nodeptr_vec,
-                         current_node);
-    
-    // Step 3: If no childs and stack is not empty
-    // a) Pop the top item from the stack
-    // b) Do visitor operation, and set current_node = popped_item->right
-    // c) Go to Step 2
-    while (!visiting_nodeptr_stack.empty()
-      && visiting_nodeptr_stack.back()->next_nodes.size() < 2)
-    {
-      auto const search_visited_it =
-          std::find_if(visited_nodeptr_vec.begin(), visited_nodeptr_vec.end(),
-                       [&](auto const visited_nodesptr) {
-                         return visiting_nodeptr_stack.back()->baseAddr ==
-                                visited_nodesptr->baseAddr;
-                       });
-      if (search_visited_it == std::end(visited_nodeptr_vec)) 
-			{
-        NodeSPtr destacked_node;
-        std::vector<std::pair<NodeSPtr, NodeSPtr>> destacked_egdes_vec;
-        std::tie(destacked_node, destacked_egdes_vec) =
-            binary_destack_and_dump_node(visiting_nodeptr_stack,
-                                         visited_nodeptr_vec,
-                                         dump_format_method);
-        // Update ret vectors
-        nodesptr_vec.push_back(destacked_node);
-        edges_vec.insert(edges_vec.end(), destacked_egdes_vec.begin(),
-                         destacked_egdes_vec.end());
-      }
-		 	else
-        visiting_nodeptr_stack.pop_back();
-    }
-
-    if (!visiting_nodeptr_stack.empty())
-    {
-			NodeSPtr destacked_node;
-			std::vector<std::pair<NodeSPtr, NodeSPtr>> destacked_egdes_vec;
-			std::tie(destacked_node, destacked_egdes_vec) = 
-				binary_process_multiplefeet_node(visiting_nodeptr_stack,
-																				 visited_nodeptr_vec,
-																				 current_node,
-																				 dump_format_method);
-
-			// Update ret vectors
-      if (destacked_node != nullptr)
-      {
-        nodesptr_vec.push_back(destacked_node);
-        edges_vec.insert(edges_vec.end(),
-                         destacked_egdes_vec.begin(),
-                         destacked_egdes_vec.end());
-      }
-    }
-     
-  } while (!visiting_nodeptr_stack.empty());
+  traverse(node, [&](NodeSPtr const& visited_node) {
+    auto const pair = dump_format_method(visited_node);
+    nodesptr_vec.push_back(pair.first);
+    edges_vec.insert(edges_vec.end(), pair.second.begin(), pair.second.end());
+  });
   return std::make_pair(nodesptr_vec, edges_vec);
 }
 
@@ -492,4 +230,30 @@ void process_calls(std::map<MethodInfo, NodeSPtr> &map,
       call_node->next_nodes.push_back(it->second);
   }
 }
+
+void release_nodes(std::vector<NodeSPtr> const &node_vec)
+{
+  for (auto const& nodesptr : node_vec)
+    nodesptr->next_nodes.clear();
+}
+
+void release_graph(std::map<MethodInfo, NodeSPtr> const &method_node_map)
+{
+  std::vector<NodeSPtr> reachable;
+  std::unordered_set<Node const*> visited;
+  for (auto const& pair : method_node_map)
+  {
+    if (pair.second != nullptr && visited.insert(pair.second.get()).second)
+      reachable.push_back(pair.second);
+  }
+  for (std::size_t i = 0; i < reachable.size(); i++)
+  {
+    for (auto const& child : reachable[i]->next_nodes)
+    {
+      if (visited.insert(child.get()).second)
+        reachable.push_back(child);
+    }
+  }
+  release_nodes(reachable);
+}
 }
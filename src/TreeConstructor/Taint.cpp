@@ -0,0 +1,294 @@
+#include <algorithm>
+
+#include <TreeConstructor/Taint.h>
+
+namespace TreeConstructor
+{
+namespace Taint
+{
+namespace
+{
+  struct Value
+  {
+    Labels labels = 0;
+    Site origin;  // invoke the SOURCE label came from
+
+    bool operator==(Value const& other) const
+    {
+      return labels == other.labels;
+    }
+  };
+
+  void join(Value& into, Value const& value)
+  {
+    if ((value.labels & source_bit()) && !(into.labels & source_bit()))
+      into.origin = value.origin;
+    into.labels |= value.labels;
+  }
+
+  bool is_invoke(OpCode opcode)
+  {
+    return (opcode >= OP_INVOKE_VIRTUAL && opcode <= OP_INVOKE_INTERFACE) ||
+           (opcode >= OP_INVOKE_VIRTUAL_RANGE &&
+            opcode <= OP_INVOKE_INTERFACE_RANGE);
+  }
+
+  // Registers of a method plus the pending result of the last invoke or
+  // filled-new-array, read by move-result.
+  class Transfer
+  {
+  public:
+    Transfer(Sccp::Code const& code, Liveness::RegisterEffects const& effects,
+             uint16_t registers_size, CalleeLookup const& callee,
+             Summary& summary)
+        : code(code), effects(effects), registers_size(registers_size),
+          callee(callee), summary(summary)
+    {
+    }
+
+    void operator()(Value* regs, std::size_t index, uint32_t offset)
+    {
+      auto const& insn = code[index];
+      auto const result = registers_size;
+      auto const uses_begin = effects.uses_begin(index);
+      auto const uses_end = effects.uses_end(index);
+      auto const reg = [&](uint16_t r) -> Value& {
+        return regs[r < registers_size ? r : result];
+      };
+
+      Value all;
+      for (auto r = uses_begin; r != uses_end; r++)
+        join(all, reg(*r));
+
+      switch (insn.opCode)
+      {
+      case OP_MOVE_RESULT: case OP_MOVE_RESULT_WIDE: case OP_MOVE_RESULT_OBJECT:
+        for (auto r = effects.defs_begin(index); r != effects.defs_end(index);
+             r++)
+        {
+          if (*r < registers_size)
+            regs[*r] = regs[result];
+        }
+        return;
+      case OP_RETURN: case OP_RETURN_WIDE: case OP_RETURN_OBJECT:
+        if ((all.labels & source_bit()) &&
+            !(summary.to_return & source_bit()))
+          summary.return_source = all.origin;
+        summary.to_return |= all.labels;
+        return;
+      case OP_FILLED_NEW_ARRAY: case OP_FILLED_NEW_ARRAY_RANGE:
+        regs[result] = all;
+        return;
+      case OP_APUT: case OP_APUT_WIDE: case OP_APUT_OBJECT:
+      case OP_APUT_BOOLEAN: case OP_APUT_BYTE: case OP_APUT_CHAR:
+      case OP_APUT_SHORT:
+      case OP_IPUT: case OP_IPUT_WIDE: case OP_IPUT_OBJECT:
+      case OP_IPUT_BOOLEAN: case OP_IPUT_BYTE: case OP_IPUT_CHAR:
+      case OP_IPUT_SHORT:
+      case OP_IPUT_QUICK: case OP_IPUT_WIDE_QUICK: case OP_IPUT_OBJECT_QUICK:
+        if (insn.vA < registers_size && insn.vB < registers_size)
+          join(regs[insn.vB], regs[insn.vA]);
+        return;
+      default:
+        break;
+      }
+
+      if (is_invoke(insn.opCode))
+      {
+        invoke(regs, insn.vB, offset, uses_begin, uses_end, all);
+        return;
+      }
+
+      // Anything else computes its results from its operands
+      for (auto r = effects.defs_begin(index); r != effects.defs_end(index); r++)
+      {
+        if (*r < registers_size)
+          regs[*r] = all;
+      }
+    }
+
+  private:
+    void invoke(Value* regs, uint32_t method_idx, uint32_t offset,
+                uint16_t const* uses_begin, uint16_t const* uses_end,
+                Value const& all)
+    {
+      auto const target = callee(method_idx);
+      auto const slots = std::min<std::size_t>(uses_end - uses_begin, MAX_SLOTS);
+      auto const arg = [&](std::size_t slot) -> Value const& {
+        auto const r = uses_begin[slot];
+        return regs[r < registers_size ? r : registers_size];
+      };
+      auto const site = [&](std::size_t slot) {
+        Site ret;
+        ret.offset = offset;
+        ret.callee = method_idx;
+        ret.slot = (uint8_t)slot;
+        return ret;
+      };
+
+      Value ret;
+      if (target.source || target.sink)
+      {
+        if (target.sink)
+        {
+          for (std::size_t slot = 0; slot < slots; slot++)
+            sink(arg(slot), site(slot));
+        }
+        if (target.source)
+        {
+          ret.labels = source_bit();
+          ret.origin = site(0);
+        }
+      }
+      else if (target.summary != nullptr)
+      {
+        auto const& callee_summary = *target.summary;
+        for (std::size_t slot = 0; slot < slots; slot++)
+        {
+          if ((callee_summary.to_sink >> slot) & 1)
+            sink(arg(slot), site(slot));
+          if ((callee_summary.to_return >> slot) & 1)
+            join(ret, arg(slot));
+        }
+        if (callee_summary.to_return & source_bit())
+        {
+          Value source;
+          source.labels = source_bit();
+          source.origin = site(0);
+          join(ret, source);
+        }
+      }
+      else
+      {
+        ret = all;
+        for (auto r = uses_begin; r != uses_end; r++)
+        {
+          if (*r < registers_size)
+            join(regs[*r], all);
+        }
+      }
+      regs[registers_size] = ret;
+    }
+
+    void sink(Value const& value, Site const& at)
+    {
+      if ((value.labels & source_bit()) && !summary.leak)
+      {
+        summary.leak = true;
+        summary.leak_source = value.origin;
+        summary.leak_sink = at;
+      }
+      auto const fresh = value.labels & ~source_bit() & ~summary.to_sink;
+      for (uint8_t slot = 0; slot < MAX_SLOTS; slot++)
+      {
+        if ((fresh >> slot) & 1)
+          summary.sinks.emplace_back(slot, at);
+      }
+      summary.to_sink |= fresh;
+    }
+
+    Sccp::Code const& code;
+    Liveness::RegisterEffects const& effects;
+    uint16_t registers_size;
+    CalleeLookup const& callee;
+    Summary& summary;
+  };
+}
+
+Site const* Summary::sink_site(uint8_t slot) const
+{
+  for (auto const& entry : sinks)
+  {
+    if (entry.first == slot)
+      return &entry.second;
+  }
+  return nullptr;
+}
+
+void Summary::keep_witnesses(Summary const& previous)
+{
+  if (previous.to_return & source_bit())
+    return_source = previous.return_source;
+  for (auto const& entry : previous.sinks)
+  {
+    for (auto& current : sinks)
+    {
+      if (current.first == entry.first)
+        current.second = entry.second;
+    }
+  }
+  if (previous.leak)
+  {
+    leak_source = previous.leak_source;
+    leak_sink = previous.leak_sink;
+  }
+}
+
+Summary summarize(std::vector<NodeSPtr> const& node_vec, Sccp::Code const& code,
+                  Liveness::RegisterEffects const& effects,
+                  uint16_t registers_size, uint16_t ins_size,
+                  CalleeLookup const& callee)
+{
+  Summary summary;
+  auto const graph = Dataflow::build_blocks(node_vec);
+  auto const& blocks = graph.blocks;
+  auto const block_count = blocks.size();
+  if (block_count == 0 || code.size() < node_vec.size() ||
+      effects.size() < node_vec.size())
+    return summary;
+
+  // Register values on exit of each block, plus the pending result
+  std::size_t const width = registers_size + 1;
+  std::vector<Value> out(block_count * width);
+  std::vector<bool> visited(block_count, false);
+  std::vector<Value> regs(width);
+  Transfer transfer(code, effects, registers_size, callee, summary);
+
+  // Every block once, so that unlinked ones are not skipped
+  std::vector<uint32_t> worklist;
+  for (auto b = block_count; b-- > 0;)
+    worklist.push_back(b);
+  std::vector<bool> queued(block_count, true);
+  while (!worklist.empty())
+  {
+    auto const b = worklist.back();
+    worklist.pop_back();
+    queued[b] = false;
+    auto const& block = blocks[b];
+
+    std::fill(regs.begin(), regs.end(), Value());
+    if (b == 0)
+    {
+      auto const first_in = registers_size - std::min(ins_size, registers_size);
+      for (std::size_t slot = 0;
+           slot < MAX_SLOTS && first_in + slot < registers_size; slot++)
+        regs[first_in + slot].labels = Labels(1) << slot;
+    }
+    for (auto const p : block.preds)
+    {
+      auto const pred_out = out.data() + p * width;
+      for (std::size_t r = 0; r < width; r++)
+        join(regs[r], pred_out[r]);
+    }
+
+    for (auto i = block.first; i <= block.last; i++)
+      transfer(regs.data(), i, node_vec[i]->intern_offset);
+
+    auto const block_out = out.data() + b * width;
+    if (visited[b] && std::equal(regs.begin(), regs.end(), block_out))
+      continue;
+    visited[b] = true;
+    std::copy(regs.begin(), regs.end(), block_out);
+    for (auto const s : block.succs)
+    {
+      if (!queued[s])
+      {
+        queued[s] = true;
+        worklist.push_back(s);
+      }
+    }
+  }
+  return summary;
+}
+}
+}
@@ -0,0 +1,198 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <TreeConstructor/Trace.h>
+
+namespace TreeConstructor
+{
+namespace Trace
+{
+namespace
+{
+  auto constexpr ring_capacity = 1u << 16;
+  auto constexpr detail_size = 64u;
+
+  struct Event
+  {
+    char const* name;
+    uint64_t begin_ns;
+    uint64_t dur_ns;
+    char detail[detail_size];
+  };
+
+  // Written by its owning thread only. head counts every event ever
+  // recorded; the flush reads the last ring_capacity of them.
+  struct ThreadBuffer
+  {
+    std::atomic<uint64_t> head;
+    long tid;
+    Event events[ring_capacity];
+  };
+
+  bool trace_enabled = false;
+  uint64_t min_span_ns = 0;
+  uint64_t origin_ns = 0;
+  std::string trace_filename;
+
+  std::mutex buffers_mutex;
+  std::vector<ThreadBuffer*> buffers;
+  thread_local ThreadBuffer* thread_buffer = nullptr;
+
+  uint64_t now_ns()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  }
+
+  ThreadBuffer* get_thread_buffer()
+  {
+    if (thread_buffer == nullptr)
+    {
+      // Default-initialized: ring pages are only touched as they fill
+      auto buffer = new ThreadBuffer;
+      buffer->head.store(0, std::memory_order_relaxed);
+      buffer->tid = syscall(SYS_gettid);
+      std::lock_guard<std::mutex> lock(buffers_mutex);
+      buffers.push_back(buffer);
+      thread_buffer = buffer;
+    }
+    return thread_buffer;
+  }
+
+  void write_json_string(FILE* file, char const* str)
+  {
+    fputc('"', file);
+    for (; *str != '\0'; str++)
+    {
+      if (*str == '"' || *str == '\\')
+        fprintf(file, "\\%c", *str);
+      else if ((unsigned char)*str < 0x20)
+        fprintf(file, "\\u%04x", *str);
+      else
+        fputc(*str, file);
+    }
+    fputc('"', file);
+  }
+
+  void flush()
+  {
+    if (!trace_enabled)
+      return;
+    trace_enabled = false;
+
+    auto file = fopen(trace_filename.c_str(), "w");
+    if (file == nullptr)
+    {
+      fprintf(stderr, "Can't write trace file '%s'\n", trace_filename.c_str());
+      return;
+    }
+
+    auto const pid = (long)getpid();
+    auto first = true;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    for (auto const buffer : buffers)
+    {
+      fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,"
+                    "\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+              first ? "" : ",\n", pid, buffer->tid,
+              buffer->tid == pid ? "main" : "worker");
+      first = false;
+
+      auto const head = buffer->head.load(std::memory_order_acquire);
+      auto const begin = head > ring_capacity ? head - ring_capacity : 0;
+      for (auto i = begin; i < head; i++)
+      {
+        auto const& event = buffer->events[i % ring_capacity];
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"dexgraph\",\"ph\":\"X\","
+                      "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld",
+                event.name, (event.begin_ns - origin_ns) / 1e3,
+                event.dur_ns / 1e3, pid, buffer->tid);
+        if (event.detail[0] != '\0')
+        {
+          fprintf(file, ",\"args\":{\"detail\":");
+          write_json_string(file, event.detail);
+          fputc('}', file);
+        }
+        fputc('}', file);
+      }
+      if (begin != 0)
+        fprintf(stderr, "trace: dropped %llu oldest events of thread %ld\n",
+                (unsigned long long)begin, buffer->tid);
+      delete buffer;
+    }
+    buffers.clear();
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+  }
+}
+
+bool start(std::string const& filename, uint64_t min_span_us)
+{
+  if (trace_enabled)
+    return true;
+  trace_filename = filename;
+  min_span_ns = min_span_us * 1000;
+  origin_ns = now_ns();
+  if (atexit(flush) != 0)
+    return false;
+  trace_enabled = true;
+  return true;
+}
+
+bool enabled()
+{
+  return trace_enabled;
+}
+
+Span::Span(char const* _name,
+           Keep _keep,
+           char const* _detail,
+           char const* _sub_detail)
+  : name(_name), detail(_detail), sub_detail(_sub_detail), keep(_keep),
+    active(trace_enabled), begin_ns(0)
+{
+  if (active)
+    begin_ns = now_ns();
+}
+
+void Span::set_detail(char const* _detail, char const* _sub_detail)
+{
+  detail = _detail;
+  sub_detail = _sub_detail;
+}
+
+Span::~Span()
+{
+  if (!active || !trace_enabled)
+    return;
+  auto const dur_ns = now_ns() - begin_ns;
+  if (keep == IF_SLOW && dur_ns < min_span_ns)
+    return;
+
+  auto const buffer = get_thread_buffer();
+  auto const head = buffer->head.load(std::memory_order_relaxed);
+  auto& event = buffer->events[head % ring_capacity];
+  event.name = name;
+  event.begin_ns = begin_ns;
+  event.dur_ns = dur_ns;
+  event.detail[0] = '\0';
+  if (detail != nullptr && sub_detail != nullptr)
+    snprintf(event.detail, detail_size, "%s->%s", detail, sub_detail);
+  else if (detail != nullptr)
+    snprintf(event.detail, detail_size, "%s", detail);
+  buffer->head.store(head + 1, std::memory_order_release);
+}
+}
+}
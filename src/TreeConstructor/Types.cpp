@@ -0,0 +1,216 @@
+#include <algorithm>
+
+#include <TreeConstructor/Types.h>
+
+namespace TreeConstructor
+{
+namespace Types
+{
+namespace
+{
+  struct Value
+  {
+    enum : uint8_t
+    {
+      UNDEFINED,  // no definition reached yet
+      KNOWN,
+      CONFLICT,   // not a reference, or paths disagree
+    } state;
+    bool exact;
+    uint32_t type_idx;
+
+    bool operator==(Value const& other) const
+    {
+      return state == other.state &&
+             (state != KNOWN ||
+              (type_idx == other.type_idx && exact == other.exact));
+    }
+  };
+
+  Value const undefined{ Value::UNDEFINED, false, NO_TYPE };
+  Value const conflict{ Value::CONFLICT, false, NO_TYPE };
+
+  Value known(uint32_t type_idx, bool exact)
+  {
+    return type_idx == NO_TYPE ? conflict : Value{ Value::KNOWN, exact, type_idx };
+  }
+
+  Value meet(Value const& lhs, Value const& rhs)
+  {
+    if (lhs.state == Value::UNDEFINED)
+      return rhs;
+    if (rhs.state == Value::UNDEFINED)
+      return lhs;
+    if (lhs.state == Value::KNOWN && rhs.state == Value::KNOWN &&
+        lhs.type_idx == rhs.type_idx)
+      return known(lhs.type_idx, lhs.exact && rhs.exact);
+    return conflict;
+  }
+
+  bool is_invoke(OpCode opcode)
+  {
+    return (opcode >= OP_INVOKE_VIRTUAL && opcode <= OP_INVOKE_INTERFACE) ||
+           (opcode >= OP_INVOKE_VIRTUAL_RANGE &&
+            opcode <= OP_INVOKE_INTERFACE_RANGE);
+  }
+
+  bool is_dispatched(OpCode opcode)
+  {
+    return opcode == OP_INVOKE_VIRTUAL || opcode == OP_INVOKE_INTERFACE ||
+           opcode == OP_INVOKE_VIRTUAL_RANGE ||
+           opcode == OP_INVOKE_INTERFACE_RANGE;
+  }
+
+  // regs holds registers_size registers, then the pending result of the
+  // last invoke.
+  void transfer(DecodedInstruction const& insn,
+                Liveness::RegisterEffects const& effects, std::size_t index,
+                Seeds const& seeds, Value* regs, uint16_t registers_size,
+                Type& receiver)
+  {
+    auto const result = registers_size;
+    auto const reg = [&](u4 r) { return r < registers_size ? regs[r] : conflict; };
+    auto const set = [&](u4 r, Value const& value) {
+      if (r < registers_size)
+        regs[r] = value;
+    };
+
+    switch (insn.opCode)
+    {
+    case OP_NEW_INSTANCE:
+      set(insn.vA, known(insn.vB, true));
+      return;
+    case OP_CHECK_CAST:
+    {
+      // An allocation is more precise than the cast
+      auto const value = reg(insn.vA);
+      if (value.state != Value::KNOWN || !value.exact)
+        set(insn.vA, known(insn.vB, false));
+      return;
+    }
+    case OP_MOVE_OBJECT: case OP_MOVE_OBJECT_FROM16: case OP_MOVE_OBJECT_16:
+      set(insn.vA, reg(insn.vB));
+      return;
+    case OP_MOVE_RESULT_OBJECT:
+      set(insn.vA, regs[result]);
+      return;
+    case OP_FILLED_NEW_ARRAY: case OP_FILLED_NEW_ARRAY_RANGE:
+      regs[result] = conflict;
+      return;
+    default:
+      break;
+    }
+
+    if (is_invoke(insn.opCode))
+    {
+      if (is_dispatched(insn.opCode) &&
+          effects.uses_begin(index) != effects.uses_end(index))
+      {
+        auto const value = reg(*effects.uses_begin(index));
+        if (value.state == Value::KNOWN)
+        {
+          receiver.type_idx = value.type_idx;
+          receiver.exact = value.exact;
+        }
+      }
+      regs[result] = seeds.return_type ? known(seeds.return_type(insn.vB), false)
+                                       : conflict;
+      return;
+    }
+
+    for (auto r = effects.defs_begin(index); r != effects.defs_end(index); r++)
+      set(*r, conflict);
+  }
+}
+
+std::vector<Type> receivers(std::vector<NodeSPtr> const& node_vec,
+                            Sccp::Code const& code,
+                            Liveness::RegisterEffects const& effects,
+                            uint16_t registers_size, Seeds const& seeds,
+                            std::vector<uint32_t> const& handlers)
+{
+  std::vector<Type> ret(node_vec.size());
+  auto const graph = Dataflow::build_blocks(node_vec);
+  auto const& blocks = graph.blocks;
+  auto const block_count = blocks.size();
+  if (block_count == 0 || code.size() < node_vec.size() ||
+      effects.size() < node_vec.size())
+    return ret;
+
+  std::size_t const width = registers_size + 1;
+  std::vector<Value> entry(width, undefined);
+  for (std::size_t r = 0; r < seeds.entry.size() && r < registers_size; r++)
+    entry[r] = known(seeds.entry[r].type_idx, seeds.entry[r].exact);
+
+  // Register types on exit of each block
+  std::vector<Value> out(block_count * width, undefined);
+  std::vector<bool> visited(block_count, false);
+  std::vector<Value> regs(width);
+
+  // The entry and the catch handlers
+  std::vector<bool> handler(node_vec.size(), false);
+  std::vector<uint32_t> worklist{ 0 };
+  std::vector<bool> queued(block_count, false);
+  queued[0] = true;
+  for (auto const offset : handlers)
+  {
+    auto const it = std::lower_bound(
+        node_vec.begin(), node_vec.end(), offset,
+        [](NodeSPtr const& lhs, uint32_t rhs) { return lhs->intern_offset < rhs; });
+    if (it == node_vec.end() || (*it)->intern_offset != offset)
+      continue;
+    handler[it - node_vec.begin()] = true;
+    auto const b = graph.block_of[it - node_vec.begin()];
+    if (!queued[b])
+    {
+      queued[b] = true;
+      worklist.push_back(b);
+    }
+  }
+  while (!worklist.empty())
+  {
+    auto const b = worklist.back();
+    worklist.pop_back();
+    queued[b] = false;
+    auto const& block = blocks[b];
+
+    if (b == 0)
+      std::copy(entry.begin(), entry.end(), regs.begin());
+    else
+      std::fill(regs.begin(), regs.end(), undefined);
+    for (auto const p : block.preds)
+    {
+      auto const pred_out = out.data() + p * width;
+      for (std::size_t r = 0; r < width; r++)
+        regs[r] = meet(regs[r], pred_out[r]);
+    }
+
+    // A later visit only lowers the receivers, the last one holds
+    for (auto i = block.first; i <= block.last; i++)
+    {
+      // Handlers may also be reached by falling or branching into them
+      if (handler[i])
+        std::fill(regs.begin(), regs.end(), conflict);
+      ret[i] = Type();
+      transfer(code[i], effects, i, seeds, regs.data(), registers_size,
+               ret[i]);
+    }
+
+    auto const block_out = out.data() + b * width;
+    if (visited[b] && std::equal(regs.begin(), regs.end(), block_out))
+      continue;
+    visited[b] = true;
+    std::copy(regs.begin(), regs.end(), block_out);
+    for (auto const s : block.succs)
+    {
+      if (!queued[s])
+      {
+        queued[s] = true;
+        worklist.push_back(s);
+      }
+    }
+  }
+  return ret;
+}
+}
+}
@@ -0,0 +1,50 @@
+#include <TreeConstructor/Xref.h>
+
+namespace TreeConstructor
+{
+namespace Xref
+{
+void Index::add(uint32_t id, Site const& site)
+{
+  pending.emplace_back(id, site);
+}
+
+void Index::finish(uint32_t id_count)
+{
+  // Counting sort, stable
+  begin.assign(id_count + 1, 0);
+  for (auto const& ref : pending)
+  {
+    if (ref.first < id_count)
+      begin[ref.first + 1]++;
+  }
+  for (uint32_t id = 0; id < id_count; id++)
+    begin[id + 1] += begin[id];
+
+  grouped.resize(begin[id_count]);
+  std::vector<uint32_t> next(begin.begin(), begin.end() - 1);
+  for (auto const& ref : pending)
+  {
+    if (ref.first < id_count)
+      grouped[next[ref.first]++] = ref.second;
+  }
+  pending.clear();
+  pending.shrink_to_fit();
+}
+
+void Index::clear()
+{
+  pending.clear();
+  begin.clear();
+  grouped.clear();
+}
+
+std::pair<Site const*, Site const*> Index::sites(uint32_t id) const
+{
+  if (id >= id_count())
+    return std::make_pair(nullptr, nullptr);
+  auto const data = grouped.data();
+  return std::make_pair(data + begin[id], data + begin[id + 1]);
+}
+}
+}
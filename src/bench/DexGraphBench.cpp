@@ -0,0 +1,761 @@
+/*
+ * dexgraph_bench: micro benchmarks of the decode / graph / Edg hot paths
+ * and macro benchmarks running the dexgraph CLI over generated (or given)
+ * dex files.
+ *
+ * Each benchmark runs a doubling number of iterations until one batch
+ * lasts the minimum time; the last batch is reported. Results can be
+ * written as JSON (one benchmark per line) and compared to a previous run.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <DexGen/DexBuilder.h>
+#include <DexGraph/DexGraph.h>
+#include <TreeConstructor/Dataflow.h>
+#include <TreeConstructor/FmtEdg.h>
+#include <TreeConstructor/TCHelper.h>
+#include <TreeConstructor/TCNode.h>
+#include <libdex/DexClass.h>
+#include <libdex/DexFile.h>
+#include <libdex/InstrUtils.h>
+#include <libdex/Leb128.h>
+
+#ifndef DEXGRAPH_CLI
+#define DEXGRAPH_CLI "dexgraph"
+#endif
+
+static const char* gProgName = "dexgraph_bench";
+
+struct Options {
+    const char* jsonFile;
+    const char* baselineFile;
+    const char* filter;
+    const char* cliPath;
+    double minTimeMs;
+};
+
+static Options gOptions;
+
+namespace
+{
+  // Keeps the optimizer from dropping benchmarked results
+  volatile uint64_t sink;
+
+  struct Benchmark
+  {
+    std::string name;
+    // Runs the operation n times.
+    std::function<void(uint64_t n)> run;
+    // Items processed per operation (e.g. instructions), 0 if meaningless.
+    std::function<uint64_t()> items_per_op;
+    std::string item_unit;
+  };
+
+  struct Result
+  {
+    std::string name;
+    uint64_t iterations;
+    double ns_per_op;
+    double items_per_sec;
+    std::string item_unit;
+  };
+
+  uint64_t now_ns()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  }
+
+  Result run_benchmark(Benchmark const& bench)
+  {
+    auto const min_ns = (uint64_t)(gOptions.minTimeMs * 1e6);
+    uint64_t iterations = 1;
+    uint64_t elapsed = 0;
+    for (;;)
+    {
+      auto const begin = now_ns();
+      bench.run(iterations);
+      elapsed = now_ns() - begin;
+      if (elapsed >= min_ns || iterations >= (1ull << 40))
+        break;
+      // Aim past the minimum, but never grow more than 100x at once
+      auto const target = elapsed == 0
+          ? iterations * 100
+          : (uint64_t)(iterations * 1.4 * min_ns / elapsed) + 1;
+      iterations = std::min(std::max(target, iterations * 2), iterations * 100);
+    }
+
+    Result result;
+    result.name = bench.name;
+    result.iterations = iterations;
+    result.ns_per_op = (double)elapsed / iterations;
+    result.item_unit = bench.item_unit;
+    auto const items = bench.items_per_op ? bench.items_per_op() : 0;
+    result.items_per_sec =
+        items == 0 ? 0.0 : items * 1e9 / result.ns_per_op;
+    return result;
+  }
+
+  /*
+   * Fixtures
+   */
+
+  DexGen::MethodRef const callee_ref = { "LBench;", "callee" };
+
+  // if-eqz / goto diamonds, with a call in each arm.
+  DexGen::CodeBuilder branchy_code(int diamonds)
+  {
+    DexGen::CodeBuilder code;
+    code.const4(0, 0);
+    for (auto i = 0; i < diamonds; i++)
+    {
+      // if-eqz (2) + invoke (3) + goto (2) | invoke (3)
+      code.if_eqz(0, 7).invoke_static(callee_ref).goto16(5);
+      code.invoke_static(callee_ref);
+    }
+    code.return_void();
+    return code;
+  }
+
+  // Class LC<i>; whose m() conditionally calls LC<i+1>;->m().
+  std::vector<DexGen::ClassDef> chain_classes(int count)
+  {
+    std::vector<DexGen::ClassDef> classes;
+    for (auto i = 0; i < count; i++)
+    {
+      char descriptor[32];
+      char callee[32];
+      snprintf(descriptor, sizeof(descriptor), "LC%06d;", i);
+      snprintf(callee, sizeof(callee), "LC%06d;", (i + 1) % count);
+      DexGen::MethodDef method;
+      method.name = "m";
+      method.code.const4(0, 0).if_eqz(0, 5)
+          .invoke_static(DexGen::MethodRef{ callee, "m" })
+          .return_void().return_void();
+      classes.push_back(DexGen::ClassDef{ descriptor, { method } });
+    }
+    return classes;
+  }
+
+  // Classes of independent methods with diamonds and a packed switch.
+  std::vector<DexGen::ClassDef> branchy_classes(int count, int methods)
+  {
+    std::vector<DexGen::ClassDef> classes;
+    for (auto i = 0; i < count; i++)
+    {
+      char descriptor[32];
+      snprintf(descriptor, sizeof(descriptor), "LB%06d;", i);
+      DexGen::ClassDef class_def{ descriptor, {} };
+      for (auto j = 0; j < methods; j++)
+      {
+        DexGen::MethodDef method;
+        method.name = "m" + std::to_string(j);
+        // packed-switch (3) + 3 cases (1 each) + fall through
+        method.code.const4(0, 0).packed_switch(0, { 3, 4, 5 })
+            .nop().nop().nop();
+        method.code.append(branchy_code(16));
+        class_def.methods.push_back(method);
+      }
+      classes.push_back(class_def);
+    }
+    return classes;
+  }
+
+  struct MicroFixture
+  {
+    std::vector<uint8_t> dex_bytes;
+    DexFile* dex_file = nullptr;
+    DexCode const* code = nullptr;
+    InstructionFormat* formats = nullptr;
+    InstructionWidth* widths = nullptr;
+    std::vector<uint8_t> leb128_bytes;
+    uint32_t leb128_count = 0;
+
+    ~MicroFixture()
+    {
+      if (dex_file != nullptr)
+        dexFileFree(dex_file);
+      free(formats);
+      free(widths);
+    }
+  };
+
+  bool setup_micro(MicroFixture& fixture)
+  {
+    DexGen::MethodDef method;
+    method.name = "branchy";
+    method.code = branchy_code(64);
+    DexGen::MethodDef callee;
+    callee.name = callee_ref.name;
+    callee.code.return_void();
+    fixture.dex_bytes =
+        DexGen::build({ DexGen::ClassDef{ "LBench;", { method, callee } } });
+
+    fixture.dex_file = dexFileParse(fixture.dex_bytes.data(),
+                                    fixture.dex_bytes.size(),
+                                    kDexParseVerifyChecksum);
+    if (fixture.dex_file == nullptr)
+      return false;
+
+    auto pEncodedData = dexGetClassData(fixture.dex_file,
+                                        dexGetClassDef(fixture.dex_file, 0));
+    auto pClassData = dexReadAndVerifyClassData(&pEncodedData, nullptr);
+    if (pClassData == nullptr)
+      return false;
+    for (u4 i = 0; i < pClassData->header.directMethodsSize; i++)
+    {
+      auto const pMethod = &pClassData->directMethods[i];
+      auto const pMethodId = dexGetMethodId(fixture.dex_file, pMethod->methodIdx);
+      if (strcmp(dexStringById(fixture.dex_file, pMethodId->nameIdx),
+                 method.name.c_str()) == 0)
+        fixture.code = dexGetCode(fixture.dex_file, pMethod);
+    }
+    free(pClassData);
+
+    fixture.formats = dexCreateInstrFormatTable();
+    fixture.widths = dexCreateInstrWidthTable();
+
+    // Mostly small values, like the sizes and index deltas of class data
+    fixture.leb128_bytes.resize(4096 * 5);
+    auto ptr = fixture.leb128_bytes.data();
+    for (uint32_t i = 0; i < 4096; i++)
+      ptr = writeUnsignedLeb128(ptr, (i * 2654435761u) >> (i % 4 == 0 ? 4 : 25));
+    fixture.leb128_bytes.resize(ptr - fixture.leb128_bytes.data());
+    fixture.leb128_count = 4096;
+
+    return fixture.code != nullptr && fixture.formats != nullptr &&
+           fixture.widths != nullptr;
+  }
+
+  // The node vector dexgraph builds for a code item (no switch payloads).
+  std::vector<TreeConstructor::NodeSPtr> decode_nodes(MicroFixture const& fixture)
+  {
+    std::vector<TreeConstructor::NodeSPtr> nodes;
+    auto const insns = fixture.code->insns;
+    for (u4 idx = 0; idx < fixture.code->insnsSize;)
+    {
+      DecodedInstruction dec;
+      dexDecodeInstruction(fixture.formats, insns + idx, &dec);
+      auto const width = dexGetInstrWidthAbs(fixture.widths, dec.opCode);
+
+      std::vector<uint32_t> arg_offset;
+      TreeConstructor::MethodInfo method_info;
+      switch (dexGetInstrFormat(fixture.formats, dec.opCode))
+      {
+        case kFmt10t: case kFmt20t:
+          arg_offset.push_back(idx + (s4)dec.vA);
+          break;
+        case kFmt21t:
+          arg_offset.push_back(idx + (s4)dec.vB);
+          break;
+        case kFmt22t:
+          arg_offset.push_back(idx + (s4)dec.vC);
+          break;
+        case kFmt35c:
+          method_info = TreeConstructor::get_method_info(*fixture.dex_file, dec.vB);
+          break;
+        default:
+          break;
+      }
+
+      auto const addr = (uint32_t)((u1 const*)(insns + idx) -
+                                   fixture.dex_file->baseAddr);
+      nodes.push_back(std::make_shared<TreeConstructor::Node>(
+          addr, (uint16_t)width, dec.opCode, method_info, idx, arg_offset));
+      idx += width;
+    }
+    return nodes;
+  }
+
+  void add_micro_benchmarks(std::vector<Benchmark>& benchmarks,
+                            MicroFixture const& fixture)
+  {
+    auto const node_count = decode_nodes(fixture).size();
+
+    benchmarks.push_back({ "micro/dexDecodeInstruction",
+      [&fixture](uint64_t n) {
+        auto const insns = fixture.code->insns;
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < n; i++)
+        {
+          for (u4 idx = 0; idx < fixture.code->insnsSize;)
+          {
+            DecodedInstruction dec;
+            dexDecodeInstruction(fixture.formats, insns + idx, &dec);
+            sum += dec.vB;
+            idx += dexGetInstrWidthAbs(fixture.widths, dec.opCode);
+          }
+        }
+        sink = sum;
+      },
+      [node_count]() { return (uint64_t)node_count; }, "instructions" });
+
+    benchmarks.push_back({ "micro/readUnsignedLeb128",
+      [&fixture](uint64_t n) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < n; i++)
+        {
+          u1 const* ptr = fixture.leb128_bytes.data();
+          for (uint32_t j = 0; j < fixture.leb128_count; j++)
+            sum += readUnsignedLeb128(&ptr);
+        }
+        sink = sum;
+      },
+      [&fixture]() { return (uint64_t)fixture.leb128_count; }, "values" });
+
+    benchmarks.push_back({ "micro/get_method_info",
+      [&fixture](uint64_t n) {
+        uint64_t sum = 0;
+        auto const method_count = fixture.dex_file->pHeader->methodIdsSize;
+        for (uint64_t i = 0; i < n; i++)
+          sum += TreeConstructor::get_method_info(*fixture.dex_file,
+                                                  i % method_count).name.size();
+        sink = sum;
+      }, nullptr, "" });
+
+    benchmarks.push_back({ "micro/construct_node_from_vec",
+      [&fixture](uint64_t n) {
+        auto const nodes = decode_nodes(fixture);
+        for (uint64_t i = 0; i < n; i++)
+        {
+          sink = TreeConstructor::construct_node_from_vec(nodes)->size;
+          TreeConstructor::release_nodes(nodes);
+        }
+      },
+      [node_count]() { return (uint64_t)node_count; }, "nodes" });
+
+    benchmarks.push_back({ "micro/binary_traversal",
+      [&fixture](uint64_t n) {
+        auto const nodes = decode_nodes(fixture);
+        auto const root = TreeConstructor::construct_node_from_vec(nodes);
+        for (uint64_t i = 0; i < n; i++)
+          sink = TreeConstructor::binary_traversal(
+              *root, Fmt::Edg::dump_single_node).first.size();
+        TreeConstructor::release_nodes(nodes);
+      },
+      [node_count]() { return (uint64_t)node_count; }, "nodes" });
+
+    benchmarks.push_back({ "micro/traverse",
+      [&fixture](uint64_t n) {
+        auto const nodes = decode_nodes(fixture);
+        auto const root = TreeConstructor::construct_node_from_vec(nodes);
+        for (uint64_t i = 0; i < n; i++)
+        {
+          uint64_t edges = 0;
+          TreeConstructor::traverse(*root,
+              [&edges](TreeConstructor::NodeSPtr const& node) {
+                edges += node->next_nodes.size();
+              });
+          sink = edges;
+        }
+        TreeConstructor::release_nodes(nodes);
+      },
+      [node_count]() { return (uint64_t)node_count; }, "nodes" });
+
+    benchmarks.push_back({ "micro/Dataflow::build_blocks",
+      [&fixture](uint64_t n) {
+        auto const nodes = decode_nodes(fixture);
+        TreeConstructor::construct_node_from_vec(nodes);
+        for (uint64_t i = 0; i < n; i++)
+          sink = TreeConstructor::Dataflow::build_blocks(nodes).blocks.size();
+        TreeConstructor::release_nodes(nodes);
+      },
+      [node_count]() { return (uint64_t)node_count; }, "nodes" });
+
+    // One solve of a backward may problem over the method's registers
+    benchmarks.push_back({ "micro/Dataflow::solve",
+      [&fixture](uint64_t n) {
+        using namespace TreeConstructor::Dataflow;
+        auto const nodes = decode_nodes(fixture);
+        TreeConstructor::construct_node_from_vec(nodes);
+        auto const graph = build_blocks(nodes);
+        TreeConstructor::release_nodes(nodes);
+
+        std::size_t const registers =
+            std::max<std::size_t>(fixture.code->registersSize, 1);
+        Problem problem{ Direction::BACKWARD, Meet::UNION,
+                         BitMatrix(graph.blocks.size(), registers),
+                         BitMatrix(graph.blocks.size(), registers),
+                         BitMatrix() };
+        for (std::size_t b = 0; b < graph.blocks.size(); b++)
+        {
+          problem.gen.set(b, b % registers);
+          problem.kill.set(b, (b + 1) % registers);
+        }
+        for (uint64_t i = 0; i < n; i++)
+          sink = solve(graph, problem).visits;
+      }, nullptr, "" });
+
+    // Multi-source search over a 100k method call graph, 4 callees each
+    benchmarks.push_back({ "micro/DexGraph::reachable",
+      [](uint64_t n) {
+        uint32_t const methods = 100000;
+        DexGraph::CallGraph graph;
+        graph.method_count = methods;
+        graph.callee_begin.push_back(0);
+        for (uint32_t m = 0; m < methods; m++)
+        {
+          for (uint32_t c = 1; c <= 4; c++)
+            graph.callees.push_back((m * 2654435761u + c * 40503u) % methods);
+          graph.callee_begin.push_back(graph.callees.size());
+        }
+        std::vector<uint32_t> const entries = { 0, methods / 2, methods - 1 };
+        for (uint64_t i = 0; i < n; i++)
+          sink = DexGraph::reachable(graph, entries)[0];
+      },
+      []() { return (uint64_t)100000; }, "methods" });
+
+    benchmarks.push_back({ "micro/Fmt::Edg::dump_all",
+      [&fixture](uint64_t n) {
+        auto const nodes = decode_nodes(fixture);
+        auto const root = TreeConstructor::construct_node_from_vec(nodes);
+        auto const graph = TreeConstructor::binary_traversal(
+            *root, Fmt::Edg::dump_single_node);
+        for (uint64_t i = 0; i < n; i++)
+          Fmt::Edg::dump_all(graph.first, graph.second);
+        TreeConstructor::release_nodes(nodes);
+        unlink(TreeConstructor::Helper::edg_filename);
+      },
+      [node_count]() { return (uint64_t)node_count; }, "nodes" });
+
+    benchmarks.push_back({ "micro/Fmt::Edg::StreamWriter",
+      [&fixture](uint64_t n) {
+        auto const nodes = decode_nodes(fixture);
+        auto const root = TreeConstructor::construct_node_from_vec(nodes);
+        auto const graph = TreeConstructor::binary_traversal(
+            *root, Fmt::Edg::dump_single_node);
+        {
+          Fmt::Edg::StreamWriter writer;
+          for (uint64_t i = 0; i < n; i++)
+            writer.dump_method(graph.first, graph.second);
+          writer.finish();
+        }
+        TreeConstructor::release_nodes(nodes);
+        unlink(TreeConstructor::Helper::edg_filename);
+      },
+      [node_count]() { return (uint64_t)node_count; }, "nodes" });
+  }
+
+  /*
+   * Macro benchmarks: one operation is one dexgraph run.
+   */
+
+  // "instructions" of the last JSON line of a -S json:FILE stats file.
+  uint64_t read_stats_instructions(char const* filename)
+  {
+    std::ifstream file(filename);
+    std::string line;
+    std::string last;
+    while (std::getline(file, line))
+      if (!line.empty())
+        last = line;
+    auto const key = std::string("\"instructions\":");
+    auto const pos = last.find(key);
+    if (pos == std::string::npos)
+      return 0;
+    return strtoull(last.c_str() + pos + key.size(), nullptr, 10);
+  }
+
+  bool run_cli(std::vector<std::string> const& args)
+  {
+    auto const pid = fork();
+    if (pid < 0)
+      return false;
+    if (pid == 0)
+    {
+      auto const null_fd = open("/dev/null", O_WRONLY);
+      if (null_fd >= 0)
+      {
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+      }
+      std::vector<char*> argv;
+      argv.push_back(const_cast<char*>(gOptions.cliPath));
+      for (auto const& arg : args)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+      argv.push_back(nullptr);
+      execv(gOptions.cliPath, argv.data());
+      _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+      if (errno != EINTR)
+        return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+
+  void add_macro_benchmark(std::vector<Benchmark>& benchmarks,
+                           std::string const& name,
+                           std::string const& dex_path,
+                           char const* mode_flag)
+  {
+    auto const stats_file = name.substr(name.rfind('/') + 1) + ".stats.json";
+    std::vector<std::string> args = { "-d" };
+    if (mode_flag != nullptr)
+      args.push_back(mode_flag);
+    args.push_back("-S");
+    args.push_back("json:" + stats_file);
+    args.push_back(dex_path);
+
+    benchmarks.push_back({ name,
+      [args](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++)
+        {
+          if (!run_cli(args))
+          {
+            fprintf(stderr, "%s: '%s' failed on %s\n", gProgName,
+                    gOptions.cliPath, args.back().c_str());
+            exit(1);
+          }
+          unlink(TreeConstructor::Helper::edg_filename);
+          unlink(TreeConstructor::Helper::metrics_filename);
+        }
+      },
+      [stats_file]() { return read_stats_instructions(stats_file.c_str()); },
+      "instructions" });
+  }
+
+  void add_macro_benchmarks(std::vector<Benchmark>& benchmarks,
+                            std::vector<std::string> const& dex_paths)
+  {
+    // The non-streaming call resolution is superlinear in chained calls,
+    // keep the chain small enough for both modes
+    auto const shapes = {
+      std::make_pair(std::string("chain"), chain_classes(50)),
+      std::make_pair(std::string("branchy"), branchy_classes(20, 4)),
+    };
+    for (auto const& shape : shapes)
+    {
+      auto const path = shape.first + ".dex";
+      if (!DexGen::write_file(path, DexGen::build(shape.second)))
+      {
+        fprintf(stderr, "%s: can't write '%s'\n", gProgName, path.c_str());
+        exit(1);
+      }
+      add_macro_benchmark(benchmarks, "macro/" + shape.first, path, nullptr);
+      add_macro_benchmark(benchmarks, "macro/" + shape.first + "_stream",
+                          path, "-s");
+      add_macro_benchmark(benchmarks, "macro/" + shape.first + "_metrics",
+                          path, "-q");
+    }
+
+    for (auto const& dex_path : dex_paths)
+    {
+      auto const base = dex_path.substr(dex_path.rfind('/') + 1);
+      add_macro_benchmark(benchmarks, "macro/" + base, dex_path, nullptr);
+      add_macro_benchmark(benchmarks, "macro/" + base + "_stream",
+                          dex_path, "-s");
+      add_macro_benchmark(benchmarks, "macro/" + base + "_metrics",
+                          dex_path, "-q");
+    }
+  }
+
+  /*
+   * Output
+   */
+
+  std::string to_json(Result const& result)
+  {
+    std::ostringstream json;
+    json.setf(std::ios::fixed);
+    json.precision(1);
+    json << "{\"name\":\"" << result.name << "\""
+         << ",\"iterations\":" << result.iterations
+         << ",\"ns_per_op\":" << result.ns_per_op;
+    if (result.items_per_sec != 0.0)
+    {
+      json.precision(0);
+      json << ",\"" << result.item_unit << "_per_sec\":" << result.items_per_sec;
+    }
+    json << "}";
+    return json.str();
+  }
+
+  // name -> ns_per_op of a file written with -j.
+  std::map<std::string, double> read_baseline(char const* filename)
+  {
+    std::map<std::string, double> baseline;
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line))
+    {
+      auto const name_pos = line.find("{\"name\":\"");
+      auto const ns_pos = line.find("\"ns_per_op\":");
+      if (name_pos == std::string::npos || ns_pos == std::string::npos)
+        continue;
+      auto const name_begin = name_pos + 9;
+      auto const name_end = line.find('"', name_begin);
+      baseline[line.substr(name_begin, name_end - name_begin)] =
+          strtod(line.c_str() + ns_pos + 12, nullptr);
+    }
+    return baseline;
+  }
+
+  int remove_entry(char const* path, struct stat const*, int, FTW*)
+  {
+    return remove(path);
+  }
+
+  std::string absolute_path(std::string const& path)
+  {
+    if (path.empty() || path[0] == '/')
+      return path;
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == nullptr)
+      return path;
+    return std::string(cwd) + "/" + path;
+  }
+}
+
+void usage(void)
+{
+    fprintf(stderr,
+        "%s: [-b baseline.json] [-f filter] [-j out.json] [-t minms] [-x dexgraph] [dexfile...]\n",
+        gProgName);
+    fprintf(stderr, "\n");
+    fprintf(stderr, " -b : compare ns/op to a previous -j output\n");
+    fprintf(stderr, " -f : only run benchmarks whose name contains filter\n");
+    fprintf(stderr, " -j : write results as JSON\n");
+    fprintf(stderr, " -t : minimum time per benchmark in ms (default 500)\n");
+    fprintf(stderr, " -x : dexgraph binary for the macro benchmarks\n");
+    fprintf(stderr, " dexfiles are added to the macro benchmarks\n");
+}
+
+int main(int argc, char* const argv[])
+{
+    bool wantUsage = false;
+    int ic;
+
+    memset(&gOptions, 0, sizeof(gOptions));
+    gOptions.filter = "";
+    gOptions.cliPath = DEXGRAPH_CLI;
+    gOptions.minTimeMs = 500;
+
+    while (1) {
+        ic = getopt(argc, argv, "b:f:j:t:x:");
+        if (ic < 0)
+            break;
+
+        switch (ic) {
+        case 'b':
+            gOptions.baselineFile = optarg;
+            break;
+        case 'f':
+            gOptions.filter = optarg;
+            break;
+        case 'j':
+            gOptions.jsonFile = optarg;
+            break;
+        case 't':
+            gOptions.minTimeMs = strtod(optarg, nullptr);
+            if (gOptions.minTimeMs <= 0)
+                wantUsage = true;
+            break;
+        case 'x':
+            gOptions.cliPath = optarg;
+            break;
+        default:
+            wantUsage = true;
+            break;
+        }
+    }
+
+    if (wantUsage) {
+        usage();
+        return 2;
+    }
+
+    // Everything below runs in a scratch directory: the Edg writers and
+    // the CLI append to graph.edg in the working directory
+    std::string const jsonFile =
+        gOptions.jsonFile == nullptr ? "" : absolute_path(gOptions.jsonFile);
+    std::map<std::string, double> baseline;
+    if (gOptions.baselineFile != nullptr)
+        baseline = read_baseline(gOptions.baselineFile);
+    std::vector<std::string> dexPaths;
+    for (int i = optind; i < argc; i++)
+        dexPaths.push_back(absolute_path(argv[i]));
+    std::string const cliPath = strchr(gOptions.cliPath, '/') == nullptr
+        ? gOptions.cliPath : absolute_path(gOptions.cliPath);
+    gOptions.cliPath = cliPath.c_str();
+
+    char scratchDir[] = "/tmp/dexgraph_bench.XXXXXX";
+    if (mkdtemp(scratchDir) == nullptr || chdir(scratchDir) != 0) {
+        fprintf(stderr, "%s: can't create scratch directory\n", gProgName);
+        return 1;
+    }
+
+    MicroFixture fixture;
+    if (!setup_micro(fixture)) {
+        fprintf(stderr, "%s: can't build the micro benchmark dex\n", gProgName);
+        return 1;
+    }
+
+    std::vector<Benchmark> benchmarks;
+    add_micro_benchmarks(benchmarks, fixture);
+    if (access(gOptions.cliPath, X_OK) == 0)
+        add_macro_benchmarks(benchmarks, dexPaths);
+    else
+        fprintf(stderr, "%s: '%s' not found, skipping macro benchmarks\n",
+                gProgName, gOptions.cliPath);
+
+    std::vector<Result> results;
+    printf("%-36s %12s %14s %20s\n", "benchmark", "iterations", "ns/op",
+           "items/s");
+    for (auto const& bench : benchmarks) {
+        if (bench.name.find(gOptions.filter) == std::string::npos)
+            continue;
+        auto const result = run_benchmark(bench);
+        results.push_back(result);
+
+        printf("%-36s %12llu %14.1f", result.name.c_str(),
+               (unsigned long long)result.iterations, result.ns_per_op);
+        if (result.items_per_sec != 0.0)
+            printf(" %14.0f %s", result.items_per_sec, result.item_unit.c_str());
+        auto const base = baseline.find(result.name);
+        if (base != baseline.end() && base->second > 0)
+            printf("  (%+.1f%% vs baseline)",
+                   (result.ns_per_op / base->second - 1.0) * 100.0);
+        printf("\n");
+        fflush(stdout);
+    }
+
+    // Remove generated inputs and outputs
+    if (chdir("/") != 0 ||
+        nftw(scratchDir, remove_entry, 16, FTW_DEPTH | FTW_PHYS) != 0)
+        fprintf(stderr, "%s: can't remove '%s'\n", gProgName, scratchDir);
+
+    if (!jsonFile.empty()) {
+        FILE* file = fopen(jsonFile.c_str(), "w");
+        if (file == nullptr) {
+            fprintf(stderr, "%s: can't write '%s'\n", gProgName, jsonFile.c_str());
+            return 1;
+        }
+        fprintf(file, "{\"benchmarks\":[\n");
+        for (size_t i = 0; i < results.size(); i++)
+            fprintf(file, "%s%s\n", to_json(results[i]).c_str(),
+                    i + 1 == results.size() ? "" : ",");
+        fprintf(file, "]}\n");
+        fclose(file);
+    }
+
+    return 0;
+}
@@ -35,7 +35,7 @@
 #include <libdex/DexProto.h>
 #include <libdex/InstrUtils.h>
 #include <libdex/SysUtil.h>
-#include <libdex/CmdUtils.h>
+#include <libdex/sha1.h>
 
 #include <dexdump/OpCodeNames.h>
 
@@ -44,25 +44,40 @@
 #include <fcntl.h>
 #include <string.h>
 #include <getopt.h>
+#include <unistd.h>
 #include <errno.h>
 #include <assert.h>
 #include <string>
 #include <memory>
+#include <vector>
 
 // Modified Tool
-#include <sstream>
+#include <DexGraph/DexGraph.h>
 #include <TreeConstructor/FmtEdg.h>
-#include <TreeConstructor/FmtDot.h>
+#include <TreeConstructor/GraphCache.h>
+#include <TreeConstructor/MethodCache.h>
+#include <TreeConstructor/Stats.h>
+#include <TreeConstructor/StringSearch.h>
+#include <TreeConstructor/Trace.h>
 #include <TreeConstructor/TCHelper.h>
-#include <TreeConstructor/TCNode.h>
+#include <TreeConstructor/Xref.h>
 
 static const char* gProgName = "dexdump";
 
-static InstructionWidth* gInstrWidth;
-static InstructionFormat* gInstrFormat;
+static TreeConstructor::MethodCache* gMethodCache;
 
-typedef std::pair<TreeConstructor::MethodInfo, TreeConstructor::NodeSPtr>
-    id_node_pair;
+/* -I and -X class filters, in command line order */
+static std::vector<std::string> gIncludeClasses;
+static std::vector<std::string> gExcludeClasses;
+
+/* -E reachability entry points */
+static std::vector<std::string> gEntryPoints;
+
+/* -F taint sources and sinks */
+static DexGraph::TaintSpec gTaintSpec;
+
+/* -k substrings searched in the string pool */
+static std::vector<std::string> gStringNeedles;
 
 typedef enum OutputFormat {
     OUTPUT_PLAIN = 0,               /* default */
@@ -77,10 +92,27 @@ struct {
     bool showSectionHeaders;
     bool ignoreBadChecksum;
     bool dumpRegisterMaps;
+    bool metricsOnly;
+    bool liveness;
+    bool pruneInfeasible;
+    bool sharpenCalls;
+    bool xrefs;
+    bool manifestEntries;
+    bool interprocedural;
+    bool taint;
     OutputFormat outputFormat;
-    const char* tempFileName;
     bool exportsOnly;
     bool verbose;
+    bool streamOutput;
+    bool lazyVerify;
+    int verifyThreads;
+    const char* cacheDir;
+    unsigned long long cacheMaxBytes;
+    bool methodCache;
+    FILE* statsFile;
+    const char* traceFile;
+    unsigned long long traceMinSpanUs;
+    unsigned long long memoryBudget;
 } gOptions;
 
 /* basic info about a field or method */
@@ -518,235 +550,6 @@ const char* getClassDescriptor(DexFile* pDexFile, u4 classIdx)
     return dexStringByTypeIdx(pDexFile, classIdx);
 }
 
-/*
- * Dump a single instruction.
- */
-TreeConstructor::Node dumpInstruction(DexFile* pDexFile, 
-	const DexCode* pCode,
-	int insnIdx,
-  int insnWidth,
-	const DecodedInstruction* pDecInsn)
-{
-	// Modified Tool
-  std::vector<uint32_t> arg_offset;
-  uint32_t payload_offset = 0;
-	TreeConstructor::MethodInfo opt_called_method_info;
-
-  u2 const* insns = pCode->insns;
-
-  switch (dexGetInstrFormat(gInstrFormat, pDecInsn->opCode)) 
-	{
-    case kFmt10t: case kFmt20t:    // op+AAcase  // op +AAAA
-    {
-      s4 targ = (s4)pDecInsn->vA;
-      arg_offset.push_back(insnIdx + targ);
-      break;
-    }
-    case kFmt21t: // op vAA, +BBBB
-    {
-      s4 targ = (s4)pDecInsn->vB;
-      arg_offset.push_back(insnIdx + targ);
-      break;
-    }
-    case kFmt22t: // op vA, vB, +CCCC
-    {
-      s4 targ = (s4)pDecInsn->vC;
-      arg_offset.push_back(insnIdx + targ);
-      break;
-    }
-    case kFmt22s: // op vA, vB, #+CCCC
-    {
-      arg_offset.push_back((s4)pDecInsn->vC);
-      break;
-    }
-    case kFmt22cs: // [opt] op vA, vB, field offset CCCC
-    {
-      arg_offset.push_back(pDecInsn->vC);
-      break;
-    }
-    case kFmt31t: // op vAA, offset +BBBBBBBB
-    {
-      payload_offset = insnIdx + pDecInsn->vB;
-      break;
-    }
-    case kFmt35c: // op vB, {vD, vE, vF, vG, vA}, thing@CCCC
-    {
-      if (pDecInsn->opCode != OP_FILLED_NEW_ARRAY) {
-				try 
-				{
-					auto const method_idx = pDecInsn->vB;
-					opt_called_method_info =
-            TreeConstructor::get_method_info(*pDexFile, method_idx);
-				}
-				catch (std::range_error const& e) {}
-      }
-      break;
-    }
-    case kFmt3rc: // op {vCCCC .. v(CCCC+AA-1)}, meth@BBBB
-    {
-      if (pDecInsn->opCode != OP_FILLED_NEW_ARRAY_RANGE) {
-				try
-				{
-					auto const method_idx = pDecInsn->vB;
-          opt_called_method_info =
-            TreeConstructor::get_method_info(*pDexFile, method_idx);
-				}
-				catch(std::range_error const& e) {}
-      }
-      break;
-    } 
-    default: break;
-	}
-   
-	// Get relevant addresses
-	intptr_t const method_base_addr = ((u1*)insns - pDexFile->baseAddr) + insnIdx * 2;
-	// Get Instruction size
-	auto const instr_size = insnWidth;
-	// Get OpCode
-	auto const instr_opcode = pDecInsn->opCode;
-	// Get Offset (relative to method base address)
-	int const internal_offset = insnIdx;
-
-	/// Additional processing for Switch instructions
-	if (instr_opcode == OpCode::OP_PACKED_SWITCH)
-	{
-		intptr_t const payload_addr = (intptr_t const)(insns + payload_offset);
-		auto const packed_switch_payload =
-				TreeConstructor::get_packed_switch_payload(internal_offset,
-																									 payload_addr);
-		for (auto const& offset : packed_switch_payload.targets)
-			arg_offset.push_back(offset);
-	}
-
-	if (instr_opcode == OpCode::OP_SPARSE_SWITCH)
-	{
-		auto const payload_addr = (intptr_t const)(insns + payload_offset);
-		auto const sparse_switch_payload =
-				TreeConstructor::get_sparse_switch_offsets(internal_offset,
-																									 payload_addr);
-		for (auto const& offset : sparse_switch_payload.targets)  
-			arg_offset.push_back(offset);
-	}
-
-	// Construct Tree Node
-	auto method_node =
-			TreeConstructor::Node(method_base_addr,
-														instr_size,
-														instr_opcode,
-														opt_called_method_info,
-														internal_offset,
-														arg_offset);
-
-	return method_node;
-}
-
-/*
- * Dump a bytecode disassembly.
- */
-std::pair<id_node_pair, std::vector<TreeConstructor::NodeSPtr>>
-dumpBytecodes(DexFile *pDexFile, const DexMethod *pDexMethod) 
-{
-  const DexCode* pCode = dexGetCode(pDexFile, pDexMethod);
-  const u2* insns;
-  int insnIdx;
-  FieldMethodInfo methInfo;
-  int startAddr;
-  char* className = nullptr;
-
-  assert(pCode->insnsSize > 0);
-  insns = pCode->insns;
-
-  getMethodInfo(pDexFile, pDexMethod->methodIdx, &methInfo);
-  startAddr = ((u1*)pCode - pDexFile->baseAddr);
-
-  className = descriptorToDot(methInfo.classDescriptor);
-
-  insnIdx = 0;
-  std::vector<TreeConstructor::NodeSPtr> node_vector;
-  while (insnIdx < (int) pCode->insnsSize) {
-    int insnWidth;
-    OpCode opCode;
-    DecodedInstruction decInsn;
-    u2 instr;
-
-    instr = get2LE((const u1*)insns);
-    if (instr == kPackedSwitchSignature) {
-      insnWidth = 4 + get2LE((const u1*)(insns+1)) * 2;
-    } else if (instr == kSparseSwitchSignature) {
-      insnWidth = 2 + get2LE((const u1*)(insns+1)) * 4;
-    } else if (instr == kArrayDataSignature) {
-      int width = get2LE((const u1*)(insns+1));
-      int size = get2LE((const u1*)(insns+2)) | 
-                  (get2LE((const u1*)(insns+3))<<16);
-      // The plus 1 is to round up for odd size and width 
-      insnWidth = 4 + ((size * width) + 1) / 2;
-    } else {
-      opCode = (OpCode)(instr & 0xff);
-      insnWidth = dexGetInstrWidthAbs(gInstrWidth, opCode);
-      if (insnWidth == 0) {
-        fprintf(stderr,
-            "GLITCH: zero-width instruction at idx=0x%04x\n", insnIdx);
-        break;
-      }
-    }
-
-    dexDecodeInstruction(gInstrFormat, insns, &decInsn);
-
-    auto const instr_node =
-        dumpInstruction(pDexFile, pCode, insnIdx, insnWidth, &decInsn);
-
-    insns += insnWidth;
-    insnIdx += insnWidth;
-
-    // Add to node vector
-    node_vector.push_back(std::make_shared<TreeConstructor::Node>(instr_node));
-  }
-
-  auto const method_info =
-      TreeConstructor::get_method_info(*pDexFile, pDexMethod->methodIdx);
-	auto const call_nodes = TreeConstructor::get_method_call_nodes(node_vector);
-  auto const nodeptr = TreeConstructor::construct_node_from_vec(node_vector);
-  free(className);
-
-	auto const methodid_node_pair = std::make_pair(method_info, nodeptr);
-	return std::make_pair(methodid_node_pair, call_nodes);
-}
-
-/*
- * Dump a "code" struct.
- */
-std::pair<id_node_pair, std::vector<TreeConstructor::NodeSPtr>>
-dumpCode(DexFile *pDexFile, const DexMethod *pDexMethod) 
-{
-  const DexCode *pCode = dexGetCode(pDexFile, pDexMethod);
-
-  if (gOptions.disassemble)
-    return dumpBytecodes(pDexFile, pDexMethod);
-  else
-    throw std::runtime_error("Could not dump byte_code for method_id " +
-                             std::to_string(pDexMethod->methodIdx));
-}
-
-/*
- * Dump a method.
- */
-std::pair<id_node_pair, std::vector<TreeConstructor::NodeSPtr>>
-dumpMethod(DexFile *pDexFile, const DexMethod *pDexMethod, int i) 
-{
-  if (gOptions.exportsOnly &&
-      (pDexMethod->accessFlags & (ACC_PUBLIC | ACC_PROTECTED)) == 0) {
-    throw std::runtime_error("Could not access method with method_idx: " +
-                             std::to_string(pDexMethod->methodIdx));
-  }
-
-  if (pDexMethod->codeOff != 0)
-    return dumpCode(pDexFile, pDexMethod);
-  else
-    throw std::runtime_error("codeOff for method_idx " +
-                             std::to_string(pDexMethod->methodIdx) +
-                             " equals 0.");
-}
-
 /*
  * Dump a static (class) field.
  */
@@ -778,132 +581,6 @@ void dumpIField(const DexFile* pDexFile, const DexField* pIField, int i)
     dumpSField(pDexFile, pIField, i);
 }
 
-/*
- * Dump the class.
- *
- * Note "idx" is a DexClassDef index, not a DexTypeId index.
- *
- * If "*pLastPackage" is nullptr or does not match the current class' package,
- * the value will be replaced with a newly-allocated string.
- */
-std::pair<std::map<TreeConstructor::MethodInfo, TreeConstructor::NodeSPtr>,
-          std::vector<TreeConstructor::NodeSPtr>>
-dumpClass(
-		DexFile *pDexFile,
-	 	int idx,
-	 	char **pLastPackage) 
-{
-  const DexTypeList *pInterfaces;
-  const DexClassDef *pClassDef;
-  DexClassData *pClassData = nullptr;
-  const u1 *pEncodedData;
-  const char *fileName;
-  const char *classDescriptor;
-  const char *superclassDescriptor;
-  char *accessStr = nullptr;
-  int i;
-
-  std::map<TreeConstructor::MethodInfo, TreeConstructor::NodeSPtr> ret;
-	std::vector<TreeConstructor::NodeSPtr> call_node_vec;
-
-  pClassDef = dexGetClassDef(pDexFile, idx);
-
-  pEncodedData = dexGetClassData(pDexFile, pClassDef);
-  pClassData = dexReadAndVerifyClassData(&pEncodedData, nullptr);
-
-  if (pClassData == nullptr) {
-    free(pClassData);
-    free(accessStr);
-    return std::make_pair(ret, call_node_vec);
-  }
-
-  classDescriptor = dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
-
-  /*
-   * For the XML output, show the package name.  Ideally we'd gather
-   * up the classes, sort them, and dump them alphabetically so the
-   * package name wouldn't jump around, but that's not a great plan
-   * for something that needs to run on the device.
-   */
-  if (!(classDescriptor[0] == 'L' &&
-        classDescriptor[strlen(classDescriptor) - 1] == ';')) {
-    /* arrays and primitives should not be defined explicitly */
-    fprintf(stderr, "Malformed class name '%s'\n", classDescriptor);
-    /* keep going? */
-  } else if (gOptions.outputFormat == OUTPUT_XML) {
-    char *mangle;
-    char *lastSlash;
-    char *cp;
-
-    mangle = strdup(classDescriptor + 1);
-    mangle[strlen(mangle) - 1] = '\0';
-
-    /* reduce to just the package name */
-    lastSlash = strrchr(mangle, '/');
-    if (lastSlash != nullptr) {
-      *lastSlash = '\0';
-    } else {
-      *mangle = '\0';
-    }
-
-    for (cp = mangle; *cp != '\0'; cp++) {
-      if (*cp == '/')
-        *cp = '.';
-    }
-
-    if (*pLastPackage == nullptr || strcmp(mangle, *pLastPackage) != 0) {
-      /* start of a new package */
-      free(*pLastPackage);
-      *pLastPackage = mangle;
-    } else {
-      free(mangle);
-    }
-  }
-
-  accessStr = createAccessFlagStr(pClassDef->accessFlags, kAccessForClass);
-
-  if (pClassDef->superclassIdx == kDexNoIndex) {
-    superclassDescriptor = nullptr;
-  } else {
-    superclassDescriptor =
-        dexStringByTypeIdx(pDexFile, pClassDef->superclassIdx);
-  }
-
-  pInterfaces = dexGetInterfacesList(pDexFile, pClassDef);
-
-  for (i = 0; i < (int)pClassData->header.directMethodsSize; i++) 
-	{
-    try 
-		{
-      auto const pair = dumpMethod(pDexFile, &pClassData->directMethods[i], i);
-      ret.emplace(pair.first.first, pair.first.second);
-      call_node_vec.insert(call_node_vec.end(), pair.second.begin(),
-                           pair.second.end());
-    } catch (std::runtime_error const &e) {}
-  }
-
-  for (i = 0; i < (int)pClassData->header.virtualMethodsSize; i++) 
-	{
-    try 
-		{
-      auto const pair = dumpMethod(pDexFile, &pClassData->virtualMethods[i], i);
-      ret.emplace(pair.first.first, pair.first.second);
-      call_node_vec.insert(call_node_vec.end(), pair.second.begin(),
-                           pair.second.end());
-    } catch (std::runtime_error const &e) {}
-  }
-
-  // TODO: Annotations.
-
-  if (pClassDef->sourceFileIdx != kDexNoIndex)
-    fileName = dexStringById(pDexFile, pClassDef->sourceFileIdx);
-  else
-    fileName = "unknown";
-
-  return std::make_pair(ret, call_node_vec);
-}
-
-
 /*
  * Advance "ptr" to ensure 32-bit alignment.
  */
@@ -1076,121 +753,568 @@ void dumpRegisterMaps(DexFile* pDexFile)
     }
 }
 
+
 /*
- * Dump the requested sections of the file.
+ * Print method cache hit rate.
  */
-void processDexFile(const char *fileName, DexFile *pDexFile)
+static void reportMethodCache(const char* label,
+    const TreeConstructor::MethodCache::Stats& stats)
 {
-  char *package = nullptr;
-  int i;
-
-  if (gOptions.dumpRegisterMaps) {
-    dumpRegisterMaps(pDexFile);
-    return;
-  }
-
-  if (gOptions.showFileHeaders)
-    dumpFileHeader(pDexFile);
-
-	// Construct {method, node} map for each method in the program.
-  std::map<TreeConstructor::MethodInfo, TreeConstructor::NodeSPtr>
-      method_node_map;
-  std::vector<TreeConstructor::NodeSPtr> call_node_vec;
-  for (i = 0; i < (int)pDexFile->pHeader->classDefsSize; i++)
-  {
-    if (gOptions.showSectionHeaders)
-      dumpClassDef(pDexFile, i);
-
-    auto const pair = dumpClass(pDexFile, i, &package);
-    auto const class_map = pair.first;
-    auto const node_vec = pair.second;
-    
-    method_node_map.insert(class_map.begin(), class_map.end());
-    call_node_vec.insert(call_node_vec.end(), node_vec.begin(), node_vec.end());
-  }
-
-  // Now that we have all the methods, we can resolve CALL instructions.
-  TreeConstructor::process_calls(method_node_map, call_node_vec);
-	
-	// Dump result using given format
-  //for (auto const& pair : method_node_map)
-    //Fmt::Dot::dump_tree(*(pair.second));
-  
-  std::vector<TreeConstructor::NodeSPtr> nodesptr_vec;
-  std::vector<std::pair<TreeConstructor::NodeSPtr,
-                        TreeConstructor::NodeSPtr>> edges_vec;
-  for (auto const& pair: method_node_map)
-  {
-    std::vector<TreeConstructor::NodeSPtr> current_nodesptr_vec;
-    std::vector<std::pair<TreeConstructor::NodeSPtr,
-                          TreeConstructor::NodeSPtr>> current_edges_vec;
-    std::tie(current_nodesptr_vec, current_edges_vec) =
-      TreeConstructor::binary_traversal(*pair.second,
-                                        Fmt::Edg::dump_single_node);
-    // Update global vecs
-		for (auto const& node : current_nodesptr_vec)
-		{
-			auto const it = std::find_if(nodesptr_vec.begin(),
-                                   nodesptr_vec.end(),
-                                   [&](TreeConstructor::NodeSPtr current_node) -> bool {
-                                     return current_node->baseAddr == node->baseAddr;
-                                   });
-			if (it == std::end(nodesptr_vec))
-				nodesptr_vec.push_back(node);
-		}
-															
-    edges_vec.insert(edges_vec.begin(),
-                     current_edges_vec.begin(),
-                     current_edges_vec.end());
-  }
-  // Dump all in Edg format
-  Fmt::Edg::dump_all(nodesptr_vec, edges_vec);
-  
-
-  /* free the last one allocated */
-  if (package != nullptr) {
-    free(package);
-  }
+    unsigned long long lookups = stats.hits + stats.misses;
+    fprintf(stderr,
+        "%s: method cache %llu/%llu hits (%.1f%%), %llu nodes reused\n",
+        label, (unsigned long long) stats.hits, lookups,
+        lookups == 0 ? 0.0 : 100.0 * stats.hits / lookups,
+        (unsigned long long) stats.reused_nodes);
+}
+
+/*
+ * Options that change the emitted graph, folded into the cache key.
+ */
+static std::string cacheOptionsTag()
+{
+    std::string tag;
+    tag += gOptions.disassemble ? 'd' : '-';
+    tag += gOptions.exportsOnly ? 'e' : '-';
+    tag += gOptions.streamOutput ? 's' : '-';
+    tag += gOptions.lazyVerify ? 'z' : '-';
+    tag += gOptions.verifyThreads > 0 ? 'V' : '-';
+    tag += gOptions.pruneInfeasible ? 'p' : '-';
+    tag += gOptions.sharpenCalls ? 'R' : '-';
+
+    /* patterns may hold '/' and '*', so only their digest goes in */
+    if (!gIncludeClasses.empty() || !gExcludeClasses.empty()) {
+        SHA1_CTX ctx;
+        unsigned char digest[HASHSIZE];
+        SHA1Init(&ctx);
+        for (const std::string& pattern : gIncludeClasses) {
+            SHA1Update(&ctx, (const unsigned char*) "I", 1);
+            SHA1Update(&ctx, (const unsigned char*) pattern.c_str(),
+                pattern.size() + 1);
+        }
+        for (const std::string& pattern : gExcludeClasses) {
+            SHA1Update(&ctx, (const unsigned char*) "X", 1);
+            SHA1Update(&ctx, (const unsigned char*) pattern.c_str(),
+                pattern.size() + 1);
+        }
+        SHA1Final(digest, &ctx);
+        char hex[9];
+        snprintf(hex, sizeof(hex), "%02x%02x%02x%02x",
+            digest[0], digest[1], digest[2], digest[3]);
+        tag += 'f';
+        tag += hex;
+    }
+    return tag;
+}
+
+/*
+ * Append the -q table of one file to metrics.tsv: a "# file" line, then
+ * one row per method.
+ */
+static bool writeMetrics(const char* fileName, const DexFile* pDexFile,
+    const std::vector<DexGraph::MethodMetrics>& metrics)
+{
+    FILE* fp = fopen(TreeConstructor::Helper::metrics_filename, "a");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open '%s': %s\n",
+            TreeConstructor::Helper::metrics_filename, strerror(errno));
+        return false;
+    }
+    fprintf(fp, "# %s\n", fileName);
+    for (const DexGraph::MethodMetrics& method : metrics) {
+        const DexMethodId* pMethodId = dexGetMethodId(pDexFile,
+            method.method_idx);
+        fprintf(fp, "%u\t%s\t%s\t%u\t%u\t%u\t%u\t%u\t%u\n",
+            method.method_idx,
+            dexStringByTypeIdx(pDexFile, pMethodId->classIdx),
+            dexStringById(pDexFile, pMethodId->nameIdx),
+            method.instructions, method.branches, method.invokes,
+            method.switches, method.switch_cases, method.cyclomatic);
+    }
+    fclose(fp);
+    return true;
+}
+
+/*
+ * Append the -G interprocedural CFG of one file to icfg.edg, in the Edg
+ * layout but for the "IPCFGBIN" magic and the edge records, tagged by
+ * kind: 'e' intraprocedural, 'c' call, 'r' return, 's' call-to-return.
+ */
+static bool writeIcfg(const DexGraph::Icfg& graph)
+{
+    static const char kKindTags[] = { 'e', 'c', 'r', 's' };
+    FILE* fp = fopen(TreeConstructor::Helper::icfg_filename, "a");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open '%s': %s\n",
+            TreeConstructor::Helper::icfg_filename, strerror(errno));
+        return false;
+    }
+    u4 const nodeCount = graph.node_count();
+    fwrite("IPCFGBIN", 1, 8, fp);
+    fwrite(&nodeCount, sizeof(nodeCount), 1, fp);
+    for (u4 n = 0; n < nodeCount; n++) {
+        u4 const type = (u4) graph.types[n];
+        fputc('n', fp);
+        fwrite(&graph.addrs[n], sizeof(uint64_t), 1, fp);
+        fwrite(&type, sizeof(type), 1, fp);
+    }
+    for (u4 n = 0; n < nodeCount; n++) {
+        for (u4 e = graph.succ_begin[n]; e < graph.succ_begin[n + 1]; e++) {
+            fputc(kKindTags[(int) graph.kinds[e]], fp);
+            fwrite(&graph.addrs[n], sizeof(uint64_t), 1, fp);
+            fwrite(&graph.addrs[graph.succs[e]], sizeof(uint64_t), 1, fp);
+        }
+    }
+    bool const ok = !ferror(fp);
+    fclose(fp);
+    return ok;
 }
 
+/*
+ * "Lclass;->name" of a method_id.
+ */
+static std::string methodName(const DexFile* pDexFile, u4 methodIdx)
+{
+    const DexMethodId* pMethodId = dexGetMethodId(pDexFile, methodIdx);
+    std::string name = dexStringByTypeIdx(pDexFile, pMethodId->classIdx);
+    name += "->";
+    name += dexStringById(pDexFile, pMethodId->nameIdx);
+    return name;
+}
+
+/*
+ * Append the -F leaks of one file to taint.txt: a "# file" line, then per
+ * leak the method, and the invokes of its source and sink witness paths
+ * as "method+offset callee".
+ */
+static bool writeTaint(const char* fileName, const DexFile* pDexFile,
+    const std::vector<DexGraph::TaintLeak>& leaks)
+{
+    FILE* fp = fopen(TreeConstructor::Helper::taint_filename, "a");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open '%s': %s\n",
+            TreeConstructor::Helper::taint_filename, strerror(errno));
+        return false;
+    }
+    fprintf(fp, "# %s\n", fileName);
+    for (const DexGraph::TaintLeak& leak : leaks) {
+        fprintf(fp, "leak %u %s\n", leak.method_idx,
+            methodName(pDexFile, leak.method_idx).c_str());
+        for (int p = 0; p < 2; p++) {
+            for (const DexGraph::TaintStep& step :
+                    p == 0 ? leak.source_path : leak.sink_path) {
+                fprintf(fp, "  %s %s+0x%04x %s\n", p == 0 ? "source" : "sink",
+                    methodName(pDexFile, step.method_idx).c_str(),
+                    step.offset, methodName(pDexFile, step.callee).c_str());
+            }
+        }
+    }
+    bool const ok = !ferror(fp);
+    fclose(fp);
+
+    printf("%s: %zu source to sink flows\n", fileName, leaks.size());
+    return ok;
+}
+
+/*
+ * Read the -F file: "source <method>" and "sink <method>" lines, '#'
+ * comments.
+ */
+static bool readTaintSpec(const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open taint spec '%s': %s\n", path,
+            strerror(errno));
+        return false;
+    }
+    char line[1024];
+    int lineNum = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char kind[16], method[1000];
+        lineNum++;
+        int const fields = sscanf(line, "%15s %999s", kind, method);
+        if (fields <= 0 || kind[0] == '#')
+            continue;
+        if (fields == 2 && strcmp(kind, "source") == 0) {
+            gTaintSpec.sources.push_back(method);
+        } else if (fields == 2 && strcmp(kind, "sink") == 0) {
+            gTaintSpec.sinks.push_back(method);
+        } else {
+            fprintf(stderr, "%s:%d: expected 'source' or 'sink' and a method\n",
+                path, lineNum);
+            ok = false;
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+/*
+ * Append the -A manifest components of one file to components.tsv: a
+ * "# file" line, then kind, class name and class_def index (- if the
+ * class is not in the dex) per component.
+ */
+static bool writeComponents(const char* fileName,
+    const std::vector<DexGraph::Component>& components)
+{
+    FILE* fp = fopen(TreeConstructor::Helper::components_filename, "a");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open '%s': %s\n",
+            TreeConstructor::Helper::components_filename, strerror(errno));
+        return false;
+    }
+    fprintf(fp, "# %s\n", fileName);
+    for (const DexGraph::Component& component : components) {
+        fprintf(fp, "%s\t%s\t",
+            TreeConstructor::Axml::component_kind_name(component.kind),
+            component.name.c_str());
+        if (component.class_def_idx < 0)
+            fprintf(fp, "-\n");
+        else
+            fprintf(fp, "%lld\n", (long long) component.class_def_idx);
+    }
+    fclose(fp);
+    return true;
+}
+
+/*
+ * Append the -E result of one file to reachable.bin: "REACHBIN", the
+ * method_ids count (u4), then the bitmaps of the methods with code and of
+ * the reachable ones, one bit per method_idx in little-endian u8 words.
+ */
+static bool writeReachable(const char* fileName,
+    const DexGraph::CallGraph& graph, size_t entryCount,
+    const std::vector<uint64_t>& reached)
+{
+    FILE* fp = fopen(TreeConstructor::Helper::reachable_filename, "a");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open '%s': %s\n",
+            TreeConstructor::Helper::reachable_filename, strerror(errno));
+        return false;
+    }
+    u4 defined = 0, live = 0;
+    for (size_t w = 0; w < graph.defined.size(); w++) {
+        defined += __builtin_popcountll(graph.defined[w]);
+        live += __builtin_popcountll(graph.defined[w] & reached[w]);
+    }
+    fwrite("REACHBIN", 1, 8, fp);
+    fwrite(&graph.method_count, sizeof(graph.method_count), 1, fp);
+    fwrite(graph.defined.data(), sizeof(uint64_t), graph.defined.size(), fp);
+    fwrite(reached.data(), sizeof(uint64_t), reached.size(), fp);
+    bool const ok = !ferror(fp);
+    fclose(fp);
+
+    printf("%s: %zu entry points, %u of %u methods reachable, %u dead\n",
+        fileName, entryCount, live, defined, defined - live);
+    return ok;
+}
+
+/*
+ * Append one xref index to a file: "XREFSBIN", the id count and the site
+ * count (u4), the id count + 1 offsets of the CSR layout (u4), then the
+ * sites as method_idx and code unit offset (u4 each).  The sites of id
+ * are found from the offsets at a fixed position, without a scan.
+ */
+static bool writeXrefs(const char* xrefFileName,
+    const TreeConstructor::Xref::Index& index)
+{
+    FILE* fp = fopen(xrefFileName, "a");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open '%s': %s\n", xrefFileName,
+            strerror(errno));
+        return false;
+    }
+    u4 const idCount = index.id_count();
+    u4 const siteCount = index.site_count();
+    fwrite("XREFSBIN", 1, 8, fp);
+    fwrite(&idCount, sizeof(idCount), 1, fp);
+    fwrite(&siteCount, sizeof(siteCount), 1, fp);
+    fwrite(index.offsets().data(), sizeof(u4), index.offsets().size(), fp);
+    for (const TreeConstructor::Xref::Site& site : index.all_sites()) {
+        fwrite(&site.method_idx, sizeof(site.method_idx), 1, fp);
+        fwrite(&site.offset, sizeof(site.offset), 1, fp);
+    }
+    bool const ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+/*
+ * Append the -k result of one file to strings.txt: a "# file" line, then
+ * per needle a "search" line, the strings containing it as index and
+ * text, and below each the "method+offset" of its const-string uses.
+ */
+static bool writeStrings(const char* fileName, const DexFile* pDexFile,
+    const TreeConstructor::StringSearch::Index& search,
+    const TreeConstructor::Xref::Index& xrefs)
+{
+    FILE* fp = fopen(TreeConstructor::Helper::strings_filename, "a");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open '%s': %s\n",
+            TreeConstructor::Helper::strings_filename, strerror(errno));
+        return false;
+    }
+    size_t matches = 0, references = 0;
+    fprintf(fp, "# %s\n", fileName);
+    for (const std::string& needle : gStringNeedles) {
+        fprintf(fp, "search %s\n", needle.c_str());
+        for (u4 stringIdx : search.find(needle)) {
+            fprintf(fp, "string %u %s\n", stringIdx,
+                dexStringById(pDexFile, stringIdx));
+            auto const sites = xrefs.sites(stringIdx);
+            for (auto site = sites.first; site != sites.second; site++) {
+                fprintf(fp, "  %s+0x%04x\n",
+                    methodName(pDexFile, site->method_idx).c_str(),
+                    site->offset);
+            }
+            matches++;
+            references += sites.second - sites.first;
+        }
+    }
+    bool const ok = !ferror(fp);
+    fclose(fp);
+
+    printf("%s: %zu matching strings, %zu references\n", fileName, matches,
+        references);
+    return ok;
+}
+
+/*
+ * -L output, appended to liveness.txt: a "# file" line, then per method
+ * its index, class and name, and the registers live on entry and exit of
+ * each block.
+ */
+class LivenessWriter : public DexGraph::LivenessSink {
+public:
+    LivenessWriter(const char* fileName, const DexFile* pDexFile)
+        : mpDexFile(pDexFile)
+    {
+        mFp = fopen(TreeConstructor::Helper::liveness_filename, "a");
+        if (mFp == NULL)
+            fprintf(stderr, "Can't open '%s': %s\n",
+                TreeConstructor::Helper::liveness_filename, strerror(errno));
+        else
+            fprintf(mFp, "# %s\n", fileName);
+    }
+    ~LivenessWriter() override
+    {
+        if (mFp != NULL)
+            fclose(mFp);
+    }
+
+    void method(uint32_t method_idx,
+        const std::vector<TreeConstructor::NodeSPtr>& nodes,
+        const TreeConstructor::Liveness::Result& result) override
+    {
+        if (mFp == NULL)
+            return;
+        const DexMethodId* pMethodId = dexGetMethodId(mpDexFile, method_idx);
+        fprintf(mFp, "method %u %s %s\n", method_idx,
+            dexStringByTypeIdx(mpDexFile, pMethodId->classIdx),
+            dexStringById(mpDexFile, pMethodId->nameIdx));
+        for (size_t b = 0; b < result.graph.blocks.size(); b++) {
+            const TreeConstructor::Dataflow::BasicBlock& block =
+                result.graph.blocks[b];
+            fprintf(mFp, "  0x%x-0x%x in %s out %s\n",
+                nodes[block.first]->baseAddr, nodes[block.last]->baseAddr,
+                result.live_in.format(b).c_str(),
+                result.live_out.format(b).c_str());
+        }
+    }
+
+private:
+    const DexFile* mpDexFile;
+    FILE* mFp;
+};
+
+/*
+ * Library options from the command line.
+ */
+static DexGraph::Options graphOptions()
+{
+    DexGraph::Options options;
+    options.disassemble = gOptions.disassemble;
+    options.exports_only = gOptions.exportsOnly;
+    options.stream = gOptions.streamOutput;
+    options.lazy_verify = gOptions.lazyVerify;
+    options.ignore_bad_checksum = gOptions.ignoreBadChecksum;
+    options.verify_threads = gOptions.verifyThreads;
+    options.memory_budget = gOptions.memoryBudget;
+    options.method_cache = gMethodCache;
+    options.prune_infeasible = gOptions.pruneInfeasible;
+    options.sharpen_calls = gOptions.sharpenCalls;
+    options.include_classes = gIncludeClasses;
+    options.exclude_classes = gExcludeClasses;
+    return options;
+}
 
 /*
  * Process one file.
  */
 int process(const char* fileName)
 {
-    DexFile* pDexFile = nullptr;
-    MemMapping map;
-    bool mapped = false;
-    int result = -1;
+    using TreeConstructor::Stats::ScopedTimer;
+    using TreeConstructor::Stats::Phase;
+
+    const DexGraph::Options options = graphOptions();
+    std::string error;
+    std::string cacheKey;
+    uint64_t edgOffset = 0;
+
+    std::unique_ptr<DexGraph::Dex> dex = DexGraph::Dex::map(fileName, error);
+    if (dex == nullptr) {
+        fprintf(stderr, "ERROR: %s\n", error.c_str());
+        return -1;
+    }
 
-    int flags = kDexParseVerifyChecksum;
+    /*
+     * A cache hit replays the stored Edg bytes and skips everything else.
+     */
+    if (gOptions.cacheDir != nullptr && !gOptions.checksumOnly &&
+            !gOptions.dumpRegisterMaps && !gOptions.metricsOnly &&
+            !gOptions.liveness && !gOptions.xrefs && gStringNeedles.empty() &&
+            gEntryPoints.empty() &&
+            !gOptions.manifestEntries && !gOptions.interprocedural &&
+            !gOptions.taint) {
+        ScopedTimer timer(Phase::CACHE);
+        TreeConstructor::Stats::MemoryScope memory(
+            TreeConstructor::Stats::Memory::OUTPUT);
+        cacheKey = TreeConstructor::GraphCache::make_key(
+            dex->data(), dex->length(), cacheOptionsTag());
+        bool hit = !cacheKey.empty() &&
+            TreeConstructor::GraphCache::replay(gOptions.cacheDir, cacheKey,
+                TreeConstructor::Helper::edg_filename);
+        if (hit)
+            return 0;
+        edgOffset = TreeConstructor::GraphCache::file_size(
+            TreeConstructor::Helper::edg_filename);
+    }
 
-    if (dexOpenAndMap(fileName, gOptions.tempFileName, &map, false) != 0)
-        goto bail;
-    mapped = true;
+    if (!dex->parse(options, error)) {
+        fprintf(stderr, "ERROR: %s\n", error.c_str());
+        return -1;
+    }
+    DexFile* pDexFile = dex->dex_file();
 
-    if (gOptions.ignoreBadChecksum)
-        flags |= kDexParseContinueOnError;
+    if (gOptions.checksumOnly)
+        return 0;
 
-	pDexFile = dexFileParse((const u1*)map.addr, map.length, flags);
-    if (pDexFile == nullptr) {
-        fprintf(stderr, "ERROR: DEX parse failed\n");
-        goto bail;
+    if (gOptions.dumpRegisterMaps) {
+        dumpRegisterMaps(pDexFile);
+        return 0;
     }
 
-    if (gOptions.checksumOnly) {
-    } else {
-        processDexFile(fileName, pDexFile);
+    if (gOptions.showFileHeaders)
+        dumpFileHeader(pDexFile);
+
+    if (gOptions.showSectionHeaders) {
+        for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++)
+            dumpClassDef(pDexFile, i);
     }
 
-    result = 0;
+    if (gOptions.metricsOnly || !gEntryPoints.empty() ||
+            gOptions.manifestEntries || gOptions.interprocedural ||
+            gOptions.taint) {
+        bool ok = true;
+        if (gOptions.taint) {
+            auto const leaks = DexGraph::taint(*dex, options, gTaintSpec);
+            ScopedTimer timer(Phase::WRITE);
+            ok = writeTaint(fileName, pDexFile, leaks);
+        }
+        if (gOptions.interprocedural) {
+            auto const graph = DexGraph::icfg(*dex, options);
+            ScopedTimer timer(Phase::WRITE);
+            ok = writeIcfg(graph) && ok;
+        }
+        if (gOptions.metricsOnly) {
+            auto const metrics = DexGraph::metrics(*dex, options);
+            ScopedTimer timer(Phase::WRITE);
+            ok = writeMetrics(fileName, pDexFile, metrics) && ok;
+        }
+        std::vector<std::string> entrySpecs = gEntryPoints;
+        if (gOptions.manifestEntries) {
+            std::vector<DexGraph::Component> components;
+            if (DexGraph::components(*dex, components, error)) {
+                ok = writeComponents(fileName, components) && ok;
+                std::vector<std::string> const lifecycle =
+                    DexGraph::lifecycle_entry_specs(components);
+                entrySpecs.insert(entrySpecs.end(), lifecycle.begin(),
+                    lifecycle.end());
+            } else {
+                fprintf(stderr, "WARNING: '%s': %s\n", fileName,
+                    error.c_str());
+            }
+        }
+        if (!gEntryPoints.empty() || gOptions.manifestEntries) {
+            auto const graph = DexGraph::call_graph(*dex, options);
+            auto const entries = DexGraph::entry_points(*dex, entrySpecs);
+            auto const reached = DexGraph::reachable(graph, entries);
+            ScopedTimer timer(Phase::WRITE);
+            ok = writeReachable(fileName, graph, entries.size(), reached) && ok;
+        }
+        return ok ? 0 : -1;
+    }
+
+    DexGraph::BuildReport report;
+    DexGraph::Xrefs xrefs;
+    {
+        Fmt::Edg::StreamWriter writer;
+        std::unique_ptr<LivenessWriter> liveness;
+        DexGraph::Options buildOptions = options;
+        if (gOptions.liveness) {
+            liveness.reset(new LivenessWriter(fileName, pDexFile));
+            buildOptions.liveness = liveness.get();
+        }
+        if (gOptions.xrefs || !gStringNeedles.empty())
+            buildOptions.xrefs = &xrefs;
+        report = DexGraph::build(*dex, buildOptions, writer);
+    }
+    int result = 0;
+    if (report.write_failed) {
+        fprintf(stderr, "ERROR: '%s': cannot write %s\n", fileName,
+            TreeConstructor::Helper::edg_filename);
+        result = -1;
+    }
+    if (gOptions.xrefs && !report.cancelled) {
+        ScopedTimer timer(Phase::WRITE);
+        if (!writeXrefs(TreeConstructor::Helper::fields_xref_filename,
+                xrefs.fields) ||
+            !writeXrefs(TreeConstructor::Helper::strings_xref_filename,
+                xrefs.strings))
+            result = -1;
+    }
+    if (!gStringNeedles.empty() && !report.cancelled) {
+        ScopedTimer timer(Phase::WRITE);
+        TreeConstructor::StringSearch::Index const search =
+            DexGraph::string_search(*dex);
+        if (!writeStrings(fileName, pDexFile, search, xrefs.strings))
+            result = -1;
+    }
+    if (report.stream_fallback)
+        fprintf(stderr,
+            "WARNING: '%s' is over the memory budget, streamed instead\n",
+            fileName);
+    if (report.skipped_methods != 0)
+        fprintf(stderr,
+            "WARNING: %llu methods over the memory budget reduced to their entry node\n",
+            (unsigned long long) report.skipped_methods);
+
+    if (gMethodCache != nullptr)
+        reportMethodCache(fileName, gMethodCache->take_file_stats());
+
+    /* a graph reduced by the memory budget is not worth keeping */
+    if (!cacheKey.empty() && report.skipped_methods == 0 &&
+            !report.write_failed) {
+        ScopedTimer timer(Phase::CACHE);
+        TreeConstructor::Stats::MemoryScope memory(
+            TreeConstructor::Stats::Memory::OUTPUT);
+        TreeConstructor::GraphCache::store(gOptions.cacheDir, cacheKey,
+            TreeConstructor::Helper::edg_filename, edgOffset,
+            gOptions.cacheMaxBytes);
+    }
 
-bail:
-    if (mapped)
-        sysReleaseShmem(&map);
-    if (pDexFile != nullptr)
-        dexFileFree(pDexFile);
     return result;
 }
 
@@ -1202,17 +1326,46 @@ void usage(void)
 {
     fprintf(stderr, "Copyright (C) 2007 The Android Open Source Project\n\n");
     fprintf(stderr,
-        "%s: [-c] [-d] [-f] [-h] [-i] [-l layout] [-m] [-t tempfile] dexfile...\n",
+        "%s: [-A] [-B budgetmb] [-c] [-C cachedir] [-d] [-E entry] [-f] [-F taintspec] [-G] [-h] [-i] [-I class] [-k substring] [-K cachemb] [-l layout] [-L] [-m] [-M] [-p] [-q] [-R] [-s] [-S json[:file]] [-T tracefile[:minus]] [-V threads] [-x] [-X class] [-z] dexfile...\n",
         gProgName);
     fprintf(stderr, "\n");
+    fprintf(stderr, " -A : list the AndroidManifest.xml components of an APK in components.tsv and\n");
+    fprintf(stderr, "      add their constructors and lifecycle methods to the -E entry points\n");
+    fprintf(stderr, " -B : heap budget in MB; over it, stream instead, then reduce methods to their entry node\n");
     fprintf(stderr, " -c : verify checksum and exit\n");
+    fprintf(stderr, " -C : cache graphs by dex signature in this directory\n");
     fprintf(stderr, " -d : disassemble code sections\n");
+    fprintf(stderr, " -E : reachability only: append the methods reachable from these entry points\n");
+    fprintf(stderr, "      (class pattern, or pattern->name glob; repeatable) to reachable.bin, no graph\n");
     fprintf(stderr, " -f : display summary information from file header\n");
+    fprintf(stderr, " -F : taint only: append the flows from the 'source <method>' to the 'sink <method>'\n");
+    fprintf(stderr, "      methods of this file (Lclass;->name[(proto)]) to taint.txt, no graph\n");
+    fprintf(stderr, " -G : interprocedural CFG only: append it to icfg.edg with call, return and\n");
+    fprintf(stderr, "      call-to-return edges tagged, no graph.edg\n");
     fprintf(stderr, " -h : display file header details\n");
     fprintf(stderr, " -i : ignore checksum failures\n");
+    fprintf(stderr, " -I : only build classes matching a descriptor prefix or glob (repeatable)\n");
+    fprintf(stderr, " -k : also append the strings containing a substring (repeatable) and the\n");
+    fprintf(stderr, "      methods loading them to strings.txt\n");
+    fprintf(stderr, " -K : cache size limit in MB (default 1024)\n");
     fprintf(stderr, " -l : output layout, either 'plain' or 'xml'\n");
+    fprintf(stderr, " -L : also append live registers per block of each method to liveness.txt\n");
     fprintf(stderr, " -m : dump register maps (and nothing else)\n");
-    fprintf(stderr, " -t : temp file name (defaults to /sdcard/dex-temp-*)\n");
+    fprintf(stderr, " -M : reuse method graphs across methods and files by content hash\n");
+    fprintf(stderr, " -p : prune IF and SWITCH edges constant propagation proves are never taken\n");
+    fprintf(stderr, " -q : metrics only: append one row per method to metrics.tsv, no graph\n");
+    fprintf(stderr, " -R : send virtual and interface calls to the override the receiver's\n");
+    fprintf(stderr, "      inferred class dispatches to\n");
+    fprintf(stderr, " -s : stream graphs method by method (two-pass, bounded memory)\n");
+    fprintf(stderr, " -S : per-file phase timings and counters as JSON lines, to stderr or file\n");
+    fprintf(stderr, " -T : write a Chrome trace; classes and methods under minus (default 100) are not recorded\n");
+    fprintf(stderr, " -V : verify structure with N threads (0 = one per CPU)\n");
+    fprintf(stderr, " -x : also append the methods and offsets reading or writing each field_idx\n");
+    fprintf(stderr, "      (iget, iput, sget, sput) to fields.xref, and loading each string_idx\n");
+    fprintf(stderr, "      (const-string) to strings.xref\n");
+    fprintf(stderr, " -X : skip classes matching a descriptor prefix or glob (repeatable);\n");
+    fprintf(stderr, "      calls into skipped classes land on an EXTERN stub node\n");
+    fprintf(stderr, " -z : verify lazily (header and map up front, classes on first use)\n");
 }
 
 /*
@@ -1223,32 +1376,64 @@ void usage(void)
 int main(int argc, char* const argv[])
 {
     bool wantUsage = false;
+    std::string traceFileName;
     int ic;
 
     memset(&gOptions, 0, sizeof(gOptions));
     gOptions.verbose = true;
+    gOptions.cacheMaxBytes = TreeConstructor::GraphCache::default_max_bytes;
+    gOptions.traceMinSpanUs = TreeConstructor::Trace::default_min_span_us;
 
     while (1) {
-        ic = getopt(argc, argv, "cdfhil:mt:");
+        ic = getopt(argc, argv, "AB:cC:dE:fF:GhiI:k:K:l:LmMpqRsS:T:V:xX:z");
         if (ic < 0)
             break;
 
         switch (ic) {
+        case 'A':       // manifest components as entry points
+            gOptions.manifestEntries = true;
+            break;
+        case 'B':       // heap budget in MB
+            gOptions.memoryBudget = strtoull(optarg, nullptr, 10) * 1024 * 1024;
+            break;
         case 'c':       // verify the checksum then exit
             gOptions.checksumOnly = true;
             break;
+        case 'C':       // graph cache directory
+            gOptions.cacheDir = optarg;
+            break;
         case 'd':       // disassemble Dalvik instructions
             gOptions.disassemble = true;
             break;
+        case 'E':       // reachability entry point
+            gEntryPoints.push_back(optarg);
+            break;
         case 'f':       // dump outer file header
             gOptions.showFileHeaders = true;
             break;
+        case 'F':       // taint sources and sinks
+            gOptions.taint = true;
+            if (!readTaintSpec(optarg))
+                wantUsage = true;
+            break;
+        case 'G':       // interprocedural CFG
+            gOptions.interprocedural = true;
+            break;
         case 'h':       // dump section headers, i.e. all meta-data
             gOptions.showSectionHeaders = true;
             break;
         case 'i':       // continue even if checksum is bad
             gOptions.ignoreBadChecksum = true;
             break;
+        case 'I':       // class include filter
+            gIncludeClasses.push_back(optarg);
+            break;
+        case 'k':       // string pool search
+            gStringNeedles.push_back(optarg);
+            break;
+        case 'K':       // graph cache size limit
+            gOptions.cacheMaxBytes = strtoull(optarg, nullptr, 10) * 1024 * 1024;
+            break;
         case 'l':       // layout
             if (strcmp(optarg, "plain") == 0) {
                 gOptions.outputFormat = OUTPUT_PLAIN;
@@ -1260,11 +1445,67 @@ int main(int argc, char* const argv[])
                 wantUsage = true;
             }
             break;
+        case 'L':       // register liveness
+            gOptions.liveness = true;
+            break;
         case 'm':       // dump register maps only
             gOptions.dumpRegisterMaps = true;
             break;
-        case 't':       // temp file, used when opening compressed Jar
-            gOptions.tempFileName = optarg;
+        case 'M':       // method graph cache
+            gOptions.methodCache = true;
+            break;
+        case 'p':       // drop infeasible branches
+            gOptions.pruneInfeasible = true;
+            break;
+        case 'q':       // per-method metrics, no graph
+            gOptions.metricsOnly = true;
+            break;
+        case 'R':       // sharpen virtual calls
+            gOptions.sharpenCalls = true;
+            break;
+        case 's':       // two-pass streaming output
+            gOptions.streamOutput = true;
+            break;
+        case 'S':       // stats, "json" or "json:file"
+            if (strcmp(optarg, "json") == 0) {
+                gOptions.statsFile = stderr;
+            } else if (strncmp(optarg, "json:", 5) == 0) {
+                gOptions.statsFile = fopen(optarg + 5, "a");
+                if (gOptions.statsFile == nullptr) {
+                    fprintf(stderr, "Can't open stats file '%s': %s\n",
+                        optarg + 5, strerror(errno));
+                    wantUsage = true;
+                }
+            } else {
+                wantUsage = true;
+            }
+            break;
+        case 'T':       // trace file, "file" or "file:minus"
+            {
+                const char* colon = strrchr(optarg, ':');
+                gOptions.traceFile = optarg;
+                if (colon != nullptr) {
+                    gOptions.traceMinSpanUs = strtoull(colon + 1, nullptr, 10);
+                    traceFileName.assign(optarg, colon - optarg);
+                    gOptions.traceFile = traceFileName.c_str();
+                }
+            }
+            break;
+        case 'V':       // structural verification, N threads
+            gOptions.verifyThreads = atoi(optarg);
+            if (gOptions.verifyThreads <= 0)
+                gOptions.verifyThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+            if (gOptions.verifyThreads <= 0)
+                gOptions.verifyThreads = 1;
+            break;
+        case 'x':       // field cross-references
+            gOptions.xrefs = true;
+            break;
+        case 'X':       // class exclude filter
+            gExcludeClasses.push_back(optarg);
+            break;
+        case 'z':       // verify classes on first use
+            gOptions.lazyVerify = true;
             break;
         default:
             wantUsage = true;
@@ -1282,22 +1523,59 @@ int main(int argc, char* const argv[])
         wantUsage = true;
     }
 
-    /* initialize some VM tables */
-    gInstrWidth = dexCreateInstrWidthTable();
-    gInstrFormat = dexCreateInstrFormatTable();
-
     if (wantUsage) {
         usage();
         return 2;
     }
 
+    if (gOptions.methodCache)
+        gMethodCache = new TreeConstructor::MethodCache();
+
+    TreeConstructor::Stats::enable(gOptions.statsFile != nullptr);
+    if (gOptions.traceFile != nullptr &&
+            !TreeConstructor::Trace::start(gOptions.traceFile,
+                gOptions.traceMinSpanUs)) {
+        fprintf(stderr, "Can't start tracing\n");
+        return 2;
+    }
+
     int result = 0;
+    int fileCount = argc - optind;
     while (optind < argc) {
-        result |= process(argv[optind++]);
+        const char* fileName = argv[optind++];
+        int fileResult;
+
+        TreeConstructor::Stats::reset();
+        uint64_t edgSize = TreeConstructor::GraphCache::file_size(
+            TreeConstructor::Helper::edg_filename);
+        {
+            TreeConstructor::Stats::ScopedTimer timer(
+                TreeConstructor::Stats::Phase::TOTAL);
+            TreeConstructor::Trace::Span span("process",
+                TreeConstructor::Trace::Span::ALWAYS, fileName);
+            fileResult = process(fileName);
+        }
+        result |= fileResult;
+
+        if (gOptions.statsFile != nullptr) {
+            TreeConstructor::Stats::add(
+                TreeConstructor::Stats::Counter::BYTES_WRITTEN,
+                TreeConstructor::GraphCache::file_size(
+                    TreeConstructor::Helper::edg_filename) - edgSize);
+            fprintf(gOptions.statsFile, "%s\n",
+                TreeConstructor::Stats::to_json(fileName, fileResult).c_str());
+            fflush(gOptions.statsFile);
+        }
     }
 
-    free(gInstrWidth);
-    free(gInstrFormat);
+    if (gOptions.statsFile != nullptr && gOptions.statsFile != stderr)
+        fclose(gOptions.statsFile);
+
+    if (gMethodCache != nullptr) {
+        if (fileCount > 1)
+            reportMethodCache("total", gMethodCache->stats());
+        delete gMethodCache;
+    }
 
     return (result != 0);
 }
@@ -99,8 +99,8 @@ bail:
  *
  * Returns 0 (kUTFRSuccess) on success.
  */
-UnzipToFileResult dexOpenAndMap(const char* fileName, const char* tempFileName,
-    MemMapping* pMap, bool quiet)
+static UnzipToFileResult openAndMap(const char* fileName,
+    const char* tempFileName, MemMapping* pMap, bool quiet, bool writable)
 {
     UnzipToFileResult result = kUTFRGenericFailure;
     int len = strlen(fileName);
@@ -163,7 +163,8 @@ UnzipToFileResult dexOpenAndMap(const char* fileName, const char* tempFileName,
         goto bail;
     }
 
-    if (sysMapFileInShmemReadOnly(fd, pMap) != 0) {
+    if ((writable ? sysMapFileInShmemWritableReadOnly(fd, pMap)
+                  : sysMapFileInShmemReadOnly(fd, pMap)) != 0) {
         fprintf(stderr, "ERROR: Unable to map %s\n", fileName);
         close(fd);
         goto bail;
@@ -185,3 +186,15 @@ bail:
     }
     return result;
 }
+
+UnzipToFileResult dexOpenAndMap(const char* fileName, const char* tempFileName,
+    MemMapping* pMap, bool quiet)
+{
+    return openAndMap(fileName, tempFileName, pMap, quiet, false);
+}
+
+UnzipToFileResult dexOpenAndMapWritable(const char* fileName,
+    const char* tempFileName, MemMapping* pMap, bool quiet)
+{
+    return openAndMap(fileName, tempFileName, pMap, quiet, true);
+}
@@ -19,6 +19,7 @@
  */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <libdex/DexClass.h>
 #include <libdex/Leb128.h>
@@ -190,3 +191,198 @@ DexClassData* dexReadAndVerifyClassData(const u1** pData, const u1* pLimit) {
 
     return result;
 }
+
+/* Check that a code_item, its tries and its encoded catch handler list fit
+ * inside the file, and that every try points into the handler list. */
+static bool verifyCodeItemBounds(const DexFile* pDexFile, u4 codeOff) {
+    u4 fileSize = pDexFile->pHeader->fileSize;
+    const u1* pLimit = pDexFile->baseAddr + fileSize;
+    const DexCode* pCode;
+    const DexTry* pTries;
+    const u1* pHandlers;
+    const u1* pData;
+    bool okay = true;
+    u8 end;
+    u4 handlersSize;
+    u4 i;
+
+    if ((codeOff & 3) != 0 || (u8) codeOff + offsetof(DexCode, insns) > fileSize) {
+        return false;
+    }
+
+    pCode = (const DexCode*) (pDexFile->baseAddr + codeOff);
+    if (pCode->insnsSize == 0) {
+        return false;
+    }
+
+    end = (u8) codeOff + offsetof(DexCode, insns) + (u8) pCode->insnsSize * 2;
+    if (pCode->triesSize == 0) {
+        return end <= fileSize;
+    }
+
+    end = ((end + 3) & ~3ULL) + (u8) pCode->triesSize * sizeof(DexTry);
+    if (end >= fileSize) {
+        return false;
+    }
+
+    /* encoded_catch_handler_list: a count, then each handler is a signed
+     * count of (type_idx, addr) pairs, followed by a catch-all addr when
+     * the count is not positive. */
+    pHandlers = dexGetCatchHandlerData(pCode);
+    pData = pHandlers;
+    handlersSize = readAndVerifyUnsignedLeb128(&pData, pLimit, &okay);
+    for (i = 0; okay && i < handlersSize; i++) {
+        int size = readAndVerifySignedLeb128(&pData, pLimit, &okay);
+        bool catchAll = size <= 0;
+        u4 count = catchAll ? -(u4) size : (u4) size;
+
+        while (okay && count-- != 0) {
+            readAndVerifyUnsignedLeb128(&pData, pLimit, &okay);
+            readAndVerifyUnsignedLeb128(&pData, pLimit, &okay);
+        }
+        if (okay && catchAll) {
+            readAndVerifyUnsignedLeb128(&pData, pLimit, &okay);
+        }
+    }
+    if (!okay) {
+        return false;
+    }
+
+    pTries = dexGetTries(pCode);
+    for (i = 0; i < pCode->triesSize; i++) {
+        if (pTries[i].handlerOff >= pData - pHandlers) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool verifyMethodsBounds(const DexFile* pDexFile,
+        const DexMethod* pMethods, u4 count) {
+    u4 i;
+
+    for (i = 0; i < count; i++) {
+        if (pMethods[i].methodIdx >= pDexFile->pHeader->methodIdsSize) {
+            return false;
+        }
+        if (pMethods[i].codeOff != 0 &&
+                !verifyCodeItemBounds(pDexFile, pMethods[i].codeOff)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Verify the items of class_def "idx" and return its class data (empty
+ * if it has none), or NULL if the class fails verification. */
+static DexClassData* readAndVerifyClassDefItems(const DexFile* pDexFile,
+        u4 idx) {
+    const DexClassDef* pClassDef = dexGetClassDef(pDexFile, idx);
+    const u1* pLimit = pDexFile->baseAddr + pDexFile->pHeader->fileSize;
+    const u1* pEncodedData;
+    DexClassData* pClassData;
+
+    if (pClassDef->classIdx >= pDexFile->pHeader->typeIdsSize) {
+        return NULL;
+    }
+
+    if (pClassDef->classDataOff >= pDexFile->pHeader->fileSize) {
+        return NULL;
+    }
+
+    pEncodedData = dexGetClassData(pDexFile, pClassDef);
+    pClassData = dexReadAndVerifyClassData(&pEncodedData, pLimit);
+    if (pClassData == NULL) {
+        return NULL;
+    }
+
+    if (!verifyMethodsBounds(pDexFile, pClassData->directMethods,
+                pClassData->header.directMethodsSize)
+        || !verifyMethodsBounds(pDexFile, pClassData->virtualMethods,
+                pClassData->header.virtualMethodsSize)) {
+        free(pClassData);
+        return NULL;
+    }
+
+    return pClassData;
+}
+
+/* The bitmaps are shared by every thread reading the DexFile. The failed
+ * bit is set before the verified bit is published (release), so whoever
+ * sees the verified bit (acquire) sees the outcome too. Two threads may
+ * both verify a class; they reach the same outcome. */
+static bool classVerified(const DexFile* pDexFile, u4 idx, bool* pOkay) {
+    u4 word = idx >> 5;
+    u4 mask = 1U << (idx & 31);
+
+    if ((__atomic_load_n(&pDexFile->pClassVerifiedBits[word], __ATOMIC_ACQUIRE)
+                & mask) == 0) {
+        return false;
+    }
+    *pOkay = (__atomic_load_n(&pDexFile->pClassFailedBits[word],
+                __ATOMIC_RELAXED) & mask) == 0;
+    return true;
+}
+
+static void recordClassVerified(const DexFile* pDexFile, u4 idx, bool okay) {
+    u4 word = idx >> 5;
+    u4 mask = 1U << (idx & 31);
+
+    if (!okay) {
+        LOGW("class_def %u failed verification\n", idx);
+        __atomic_fetch_or(&pDexFile->pClassFailedBits[word], mask,
+                __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_or(&pDexFile->pClassVerifiedBits[word], mask,
+            __ATOMIC_RELEASE);
+}
+
+bool dexVerifyClassDef(const DexFile* pDexFile, u4 idx) {
+    DexClassData* pClassData;
+    bool okay;
+
+    if (pDexFile->pClassVerifiedBits == NULL) {
+        return true;
+    }
+
+    if (idx >= pDexFile->pHeader->classDefsSize) {
+        return false;
+    }
+
+    if (classVerified(pDexFile, idx, &okay)) {
+        return okay;
+    }
+
+    pClassData = readAndVerifyClassDefItems(pDexFile, idx);
+    okay = pClassData != NULL;
+    free(pClassData);
+    recordClassVerified(pDexFile, idx, okay);
+
+    return okay;
+}
+
+DexClassData* dexReadVerifiedClassData(const DexFile* pDexFile, u4 idx) {
+    const u1* pEncodedData;
+    DexClassData* pClassData;
+    bool okay = true;
+
+    if (pDexFile->pClassVerifiedBits != NULL) {
+        if (idx >= pDexFile->pHeader->classDefsSize) {
+            return NULL;
+        }
+        if (!classVerified(pDexFile, idx, &okay)) {
+            /* first touch: verify from the decode that is returned */
+            pClassData = readAndVerifyClassDefItems(pDexFile, idx);
+            recordClassVerified(pDexFile, idx, pClassData != NULL);
+            return pClassData;
+        }
+        if (!okay) {
+            return NULL;
+        }
+    }
+
+    pEncodedData = dexGetClassData(pDexFile, dexGetClassDef(pDexFile, idx));
+    return dexReadAndVerifyClassData(&pEncodedData, NULL);
+}
@@ -22,6 +22,7 @@
 //#include "safe_iop/safe_iop.h"
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /*
  * Allocate and initialize a DexDataMap. Returns NULL on failure.
@@ -43,6 +44,10 @@ DexDataMap* dexDataMapAlloc(u4 maxCount) {
       return NULL;
     }
 #endif
+    if (maxCount > (SIZE_MAX - sizeof(DexDataMap)) / (sizeof(u4) + sizeof(u2))) {
+        return NULL;
+    }
+    size = sizeof(DexDataMap) + maxCount * (sizeof(u4) + sizeof(u2));
     map = (DexDataMap*)malloc(size);
 
     if (map == NULL) {
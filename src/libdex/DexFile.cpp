@@ -678,6 +678,75 @@ static bool parseAuxData(const u1* data, DexFile* pDexFile)
     return true;
 }
 
+/*
+ * Cheap structural checks done up front by kDexParseVerifyLazy: every id
+ * section and the map must lie inside the file.  Class data and code items
+ * are left to dexVerifyClassDef.
+ */
+static bool verifySectionBounds(u4 fileSize, u4 off, u4 count, u4 itemSize)
+{
+    u8 end = (u8) off + (u8) count * itemSize;
+    return count == 0 || end <= fileSize;
+}
+
+static bool verifyHeaderAndMap(const DexFile* pDexFile, size_t length)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+    u4 fileSize = pHeader->fileSize;
+
+    if (fileSize > length || pHeader->headerSize < sizeof(DexHeader) ||
+        pHeader->endianTag != kDexEndianConstant)
+    {
+        LOGE("ERROR: bad header (size=%u headerSize=%u endian=%08x)\n",
+            fileSize, pHeader->headerSize, pHeader->endianTag);
+        return false;
+    }
+
+    if (!verifySectionBounds(fileSize, pHeader->stringIdsOff,
+            pHeader->stringIdsSize, sizeof(DexStringId)) ||
+        !verifySectionBounds(fileSize, pHeader->typeIdsOff,
+            pHeader->typeIdsSize, sizeof(DexTypeId)) ||
+        !verifySectionBounds(fileSize, pHeader->protoIdsOff,
+            pHeader->protoIdsSize, sizeof(DexProtoId)) ||
+        !verifySectionBounds(fileSize, pHeader->fieldIdsOff,
+            pHeader->fieldIdsSize, sizeof(DexFieldId)) ||
+        !verifySectionBounds(fileSize, pHeader->methodIdsOff,
+            pHeader->methodIdsSize, sizeof(DexMethodId)) ||
+        !verifySectionBounds(fileSize, pHeader->classDefsOff,
+            pHeader->classDefsSize, sizeof(DexClassDef)))
+    {
+        LOGE("ERROR: id section out of bounds\n");
+        return false;
+    }
+
+    u4 mapOff = pHeader->mapOff;
+    if (mapOff == 0 || (mapOff & 3) != 0 || !verifySectionBounds(fileSize,
+            mapOff, 1, sizeof(u4)))
+    {
+        LOGE("ERROR: bad map offset (%u)\n", mapOff);
+        return false;
+    }
+
+    const DexMapList* pMap = dexGetMap(pDexFile);
+    if (!verifySectionBounds(fileSize, mapOff + sizeof(u4), pMap->size,
+            sizeof(DexMapItem)))
+    {
+        LOGE("ERROR: map list out of bounds (%u items)\n", pMap->size);
+        return false;
+    }
+
+    u4 i;
+    for (i = 0; i < pMap->size; i++) {
+        if (pMap->list[i].offset >= fileSize) {
+            LOGE("ERROR: map item %u (type 0x%04x) out of bounds\n",
+                i, pMap->list[i].type);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 /*
  * Parse an optimized or unoptimized .dex file sitting in memory.  This is
  * called after the byte-ordering and structure alignment has been fixed up.
@@ -745,12 +814,27 @@ DexFile* dexFileParse(const u1* data, size_t length, int flags)
         goto bail;
     }
 
+    /*
+     * Lazy verification replaces the whole-file checksum: only the header
+     * and map are checked here, each class is verified when first touched.
+     */
+    if (flags & kDexParseVerifyLazy) {
+        if (!verifyHeaderAndMap(pDexFile, length))
+            goto bail;
+
+        u4 words = (pHeader->classDefsSize + 31) / 32;
+        pDexFile->pClassVerifiedBits = (u4*) calloc(words * 2 + 1, sizeof(u4));
+        if (pDexFile->pClassVerifiedBits == NULL)
+            goto bail;
+        pDexFile->pClassFailedBits = pDexFile->pClassVerifiedBits + words;
+    }
+
     /*
      * Verify the checksum(s).  This is reasonably quick, but does require
      * touching every byte in the DEX file.  The base checksum changes after
      * byte-swapping and DEX optimization.
      */
-    if (flags & kDexParseVerifyChecksum) {
+    if ((flags & kDexParseVerifyChecksum) && !(flags & kDexParseVerifyLazy)) {
         u4 adler = dexComputeChecksum(pHeader);
         if (adler != pHeader->checksum) {
             LOGE("ERROR: bad checksum (%08x vs %08x)\n",
@@ -832,6 +916,7 @@ void dexFileFree(DexFile* pDexFile)
     if (pDexFile == NULL)
         return;
 
+    free(pDexFile->pClassVerifiedBits);
     free(pDexFile);
 }
 
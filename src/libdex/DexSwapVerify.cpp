@@ -23,9 +23,11 @@
 #include <libdex/DexDataMap.h>
 #include <libdex/DexProto.h>
 #include <libdex/Leb128.h>
+#include <TreeConstructor/Trace.h>
 
 //#include "safe_iop/safe_iop.h"
 #include <zlib.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -82,6 +84,8 @@ typedef struct CheckState {
     u4*               pDefinedClassBits;
 
     const void*       previousItem; // set during section iteration
+
+    int               numThreads;   // workers for large sections
 } CheckState;
 
 /*
@@ -2436,12 +2440,236 @@ static bool iterateSection(CheckState* state, u4 offset, u4 count,
 }
 
 /*
- * Like iterateSection(), but also check that the offset and count match
- * a given pair of expected values.
+ * Sections with fewer items than this are always walked on the calling
+ * thread; splitting them isn't worth the thread start-up cost.
+ */
+enum { kMinParallelSectionItems = 4096 };
+
+/*
+ * One slice of a section handed to a worker thread. Items are either
+ * fixed-size and consecutive from "offset", or listed in "itemOffsets"
+ * (data sections, whose offsets the data map recorded during the swap
+ * pass). Each chunk works on a private copy of the CheckState, with
+ * previousItem seeded to the item just before the chunk so ordering
+ * checks hold across chunk boundaries.
+ */
+typedef struct SectionChunk {
+    CheckState            state;
+    ItemVisitorFunction*  func;
+    const u4*             itemOffsets;
+    u4                    offset;
+    u4                    itemSize;
+    u4                    first;
+    u4                    count;
+    bool                  okay;
+} SectionChunk;
+
+static u4 chunkItemOffset(const SectionChunk* chunk, u4 i) {
+    if (chunk->itemOffsets != NULL) {
+        return chunk->itemOffsets[i];
+    }
+    return chunk->offset + i * chunk->itemSize;
+}
+
+static void* iterateSectionChunk(void* arg) {
+    SectionChunk* chunk = (SectionChunk*) arg;
+    CheckState* state = &chunk->state;
+    u4 end = chunk->first + chunk->count;
+    u4 i;
+    TreeConstructor::Trace::Span span("verifyChunk",
+        TreeConstructor::Trace::Span::ALWAYS);
+
+    chunk->okay = true;
+
+    for (i = chunk->first; i < end; i++) {
+        u4 offset = chunkItemOffset(chunk, i);
+        u1* ptr = (u1*)filePointer(state, offset);
+        u1* newPtr = (u1*) chunk->func(state, ptr);
+
+        if (newPtr == NULL) {
+            LOGE("Trouble with item %d @ offset 0x%x\n", i, offset);
+            chunk->okay = false;
+            break;
+        }
+
+        if (fileOffset(state, newPtr) > state->fileLen) {
+            LOGE("Item %d @ offset 0x%x ends out of bounds\n", i, offset);
+            chunk->okay = false;
+            break;
+        }
+
+        state->previousItem = ptr;
+    }
+
+    return NULL;
+}
+
+/*
+ * Set up "chunk" to visit items [first, first + count) of the section.
+ */
+static void initSectionChunk(SectionChunk* chunk, const CheckState* state,
+        const u4* itemOffsets, u4 offset, ItemVisitorFunction* func,
+        u4 itemSize, u4 first, u4 count) {
+    chunk->state = *state;
+    chunk->func = func;
+    chunk->itemOffsets = itemOffsets;
+    chunk->offset = offset;
+    chunk->itemSize = itemSize;
+    chunk->first = first;
+    chunk->count = count;
+    chunk->okay = false;
+    chunk->state.previousItem = (first == 0) ? NULL :
+        filePointer(state, chunkItemOffset(chunk, first - 1));
+}
+
+/*
+ * Visit "count" items split in contiguous chunks across state->numThreads
+ * threads (the calling thread takes the first chunk). Only for visitors
+ * that don't modify the CheckState and don't update the data map.
+ */
+static bool iterateChunksInParallel(CheckState* state, const u4* itemOffsets,
+        u4 offset, u4 count, ItemVisitorFunction* func, u4 itemSize) {
+    u4 numChunks = state->numThreads;
+    u4 perChunk;
+    SectionChunk* chunks;
+    pthread_t* threads;
+    bool* started;
+    bool okay = true;
+    u4 i;
+
+    if (numChunks > count / (kMinParallelSectionItems / 4)) {
+        numChunks = count / (kMinParallelSectionItems / 4);
+    }
+    if (numChunks < 1) {
+        numChunks = 1;
+    }
+    perChunk = (count + numChunks - 1) / numChunks;
+
+    chunks = (SectionChunk*) calloc(numChunks, sizeof(SectionChunk));
+    threads = (pthread_t*) calloc(numChunks, sizeof(pthread_t));
+    started = (bool*) calloc(numChunks, sizeof(bool));
+    if (chunks == NULL || threads == NULL || started == NULL) {
+        /* out of memory for the chunks: walk the section on this thread */
+        SectionChunk whole;
+
+        free(chunks);
+        free(threads);
+        free(started);
+        initSectionChunk(&whole, state, itemOffsets, offset, func, itemSize,
+                0, count);
+        iterateSectionChunk(&whole);
+        return whole.okay;
+    }
+
+    for (i = 0; i < numChunks; i++) {
+        SectionChunk* chunk = &chunks[i];
+        u4 first = i * perChunk;
+
+        initSectionChunk(chunk, state, itemOffsets, offset, func, itemSize,
+                first,
+                (first >= count) ? 0 :
+                    ((count - first < perChunk) ? count - first : perChunk));
+
+        if (i != 0) {
+            started[i] = pthread_create(&threads[i], NULL,
+                    iterateSectionChunk, chunk) == 0;
+        }
+    }
+
+    iterateSectionChunk(&chunks[0]);
+
+    for (i = 1; i < numChunks; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            /* couldn't get a thread; do the work here instead */
+            iterateSectionChunk(&chunks[i]);
+        }
+    }
+
+    for (i = 0; i < numChunks; i++) {
+        okay = okay && chunks[i].okay;
+    }
+
+    free(chunks);
+    free(threads);
+    free(started);
+
+    return okay;
+}
+
+/*
+ * Like iterateSection(), for sections of fixed-size items (the id
+ * sections). Large sections are split across state->numThreads threads.
+ */
+static bool iterateFixedSection(CheckState* state, u4 offset, u4 count,
+        ItemVisitorFunction* func, u4 itemSize, u4* nextOffset) {
+    u8 end = (u8) offset + (u8) count * itemSize;
+
+    if (state->numThreads <= 1 || count < kMinParallelSectionItems ||
+            (offset & (sizeof(u4) - 1)) != 0 || end > state->fileLen) {
+        /* the serial walk reports padding and bounds problems */
+        return iterateSection(state, offset, count, func, sizeof(u4),
+                nextOffset);
+    }
+
+    state->previousItem = NULL;
+    if (!iterateChunksInParallel(state, NULL, offset, count, func,
+                    itemSize)) {
+        return false;
+    }
+
+    if (nextOffset != NULL) {
+        *nextOffset = (u4) end;
+    }
+
+    return true;
+}
+
+/*
+ * Like iterateSection(), for the cross-verification of a data section.
+ * The item offsets recorded in the data map during the swap pass let
+ * large sections of variable-size items be split across threads too.
+ */
+static bool iterateMappedDataSection(CheckState* state, u4 offset,
+        u4 count, ItemVisitorFunction* func, u4 alignment) {
+    const DexDataMap* map = state->pDataMap;
+    int min = 0;
+    int max = (int) map->count - 1;
+    int found = -1;
+
+    if (state->numThreads > 1 && count >= kMinParallelSectionItems) {
+        while (max >= min) {
+            int guessIdx = (min + max) >> 1;
+            u4 guess = map->offsets[guessIdx];
+
+            if (offset < guess) {
+                max = guessIdx - 1;
+            } else if (offset > guess) {
+                min = guessIdx + 1;
+            } else {
+                found = guessIdx;
+                break;
+            }
+        }
+    }
+
+    if (found < 0 || (u4) found + count > map->count) {
+        return iterateSection(state, offset, count, func, alignment, NULL);
+    }
+
+    state->previousItem = NULL;
+    return iterateChunksInParallel(state, &map->offsets[found], 0, count,
+            func, 0);
+}
+
+/*
+ * Like iterateFixedSection(), but also check that the offset and count
+ * match a given pair of expected values.
  */
 static bool checkBoundsAndIterateSection(CheckState* state,
         u4 offset, u4 count, u4 expectedOffset, u4 expectedCount,
-        ItemVisitorFunction* func, u4 alignment, u4* nextOffset) {
+        ItemVisitorFunction* func, u4 itemSize, u4* nextOffset) {
     if (offset != expectedOffset) {
         LOGE("Bogus offset for section: got 0x%x; expected 0x%x\n",
                 offset, expectedOffset);
@@ -2454,7 +2682,8 @@ static bool checkBoundsAndIterateSection(CheckState* state,
         return false;
     }
 
-    return iterateSection(state, offset, count, func, alignment, nextOffset);
+    return iterateFixedSection(state, offset, count, func, itemSize,
+            nextOffset);
 }
 
 /*
@@ -2544,42 +2773,42 @@ static bool swapEverythingButHeaderAndMap(CheckState* state,
                 okay = checkBoundsAndIterateSection(state, sectionOffset,
                         sectionCount, state->pHeader->stringIdsOff,
                         state->pHeader->stringIdsSize, swapStringIdItem,
-                        sizeof(u4), &lastOffset);
+                        sizeof(DexStringId), &lastOffset);
                 break;
             }
             case kDexTypeTypeIdItem: {
                 okay = checkBoundsAndIterateSection(state, sectionOffset,
                         sectionCount, state->pHeader->typeIdsOff,
                         state->pHeader->typeIdsSize, swapTypeIdItem,
-                        sizeof(u4), &lastOffset);
+                        sizeof(DexTypeId), &lastOffset);
                 break;
             }
             case kDexTypeProtoIdItem: {
                 okay = checkBoundsAndIterateSection(state, sectionOffset,
                         sectionCount, state->pHeader->protoIdsOff,
                         state->pHeader->protoIdsSize, swapProtoIdItem,
-                        sizeof(u4), &lastOffset);
+                        sizeof(DexProtoId), &lastOffset);
                 break;
             }
             case kDexTypeFieldIdItem: {
                 okay = checkBoundsAndIterateSection(state, sectionOffset,
                         sectionCount, state->pHeader->fieldIdsOff,
                         state->pHeader->fieldIdsSize, swapFieldIdItem,
-                        sizeof(u4), &lastOffset);
+                        sizeof(DexFieldId), &lastOffset);
                 break;
             }
             case kDexTypeMethodIdItem: {
                 okay = checkBoundsAndIterateSection(state, sectionOffset,
                         sectionCount, state->pHeader->methodIdsOff,
                         state->pHeader->methodIdsSize, swapMethodIdItem,
-                        sizeof(u4), &lastOffset);
+                        sizeof(DexMethodId), &lastOffset);
                 break;
             }
             case kDexTypeClassDefItem: {
                 okay = checkBoundsAndIterateSection(state, sectionOffset,
                         sectionCount, state->pHeader->classDefsOff,
                         state->pHeader->classDefsSize, swapClassDefItem,
-                        sizeof(u4), &lastOffset);
+                        sizeof(DexClassDef), &lastOffset);
                 break;
             }
             case kDexTypeMapList: {
@@ -2692,34 +2921,34 @@ static bool crossVerifyEverything(CheckState* state, DexMapList* pMap)
                 break;
             }
             case kDexTypeStringIdItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyStringIdItem, sizeof(u4), NULL);
+                okay = iterateFixedSection(state, sectionOffset, sectionCount,
+                        crossVerifyStringIdItem, sizeof(DexStringId), NULL);
                 break;
             }
             case kDexTypeTypeIdItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyTypeIdItem, sizeof(u4), NULL);
+                okay = iterateFixedSection(state, sectionOffset, sectionCount,
+                        crossVerifyTypeIdItem, sizeof(DexTypeId), NULL);
                 break;
             }
             case kDexTypeProtoIdItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyProtoIdItem, sizeof(u4), NULL);
+                okay = iterateFixedSection(state, sectionOffset, sectionCount,
+                        crossVerifyProtoIdItem, sizeof(DexProtoId), NULL);
                 break;
             }
             case kDexTypeFieldIdItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyFieldIdItem, sizeof(u4), NULL);
+                okay = iterateFixedSection(state, sectionOffset, sectionCount,
+                        crossVerifyFieldIdItem, sizeof(DexFieldId), NULL);
                 break;
             }
             case kDexTypeMethodIdItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyMethodIdItem, sizeof(u4), NULL);
+                okay = iterateFixedSection(state, sectionOffset, sectionCount,
+                        crossVerifyMethodIdItem, sizeof(DexMethodId), NULL);
                 break;
             }
             case kDexTypeClassDefItem: {
                 // Allocate (on the stack) the "observed class_def" bits.
                 size_t arraySize = calcDefinedClassBitsSize(state);
-                u4* definedClassBits = (u4 *)malloc(arraySize);
+                u4* definedClassBits = (u4 *)malloc(arraySize * sizeof(u4));
                 memset(definedClassBits, 0, arraySize * sizeof(u4));
                 state->pDefinedClassBits = definedClassBits;
 
@@ -2731,23 +2960,23 @@ static bool crossVerifyEverything(CheckState* state, DexMapList* pMap)
                 break;
             }
             case kDexTypeAnnotationSetRefList: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyAnnotationSetRefList, sizeof(u4), NULL);
+                okay = iterateMappedDataSection(state, sectionOffset,
+                        sectionCount, crossVerifyAnnotationSetRefList, sizeof(u4));
                 break;
             }
             case kDexTypeAnnotationSetItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyAnnotationSetItem, sizeof(u4), NULL);
+                okay = iterateMappedDataSection(state, sectionOffset,
+                        sectionCount, crossVerifyAnnotationSetItem, sizeof(u4));
                 break;
             }
             case kDexTypeClassDataItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyClassDataItem, sizeof(u1), NULL);
+                okay = iterateMappedDataSection(state, sectionOffset,
+                        sectionCount, crossVerifyClassDataItem, sizeof(u1));
                 break;
             }
             case kDexTypeAnnotationsDirectoryItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyAnnotationsDirectoryItem, sizeof(u4), NULL);
+                okay = iterateMappedDataSection(state, sectionOffset,
+                        sectionCount, crossVerifyAnnotationsDirectoryItem, sizeof(u4));
                 break;
             }
             default: {
@@ -2777,6 +3006,17 @@ static bool crossVerifyEverything(CheckState* state, DexMapList* pMap)
  * Returns 0 on success, nonzero on failure.
  */
 int dexFixByteOrdering(u1* addr, int len)
+{
+    return dexFixByteOrderingParallel(addr, len, 1);
+}
+
+/*
+ * Same as dexFixByteOrdering(), but large sections are split across
+ * "numThreads" threads. Sections are still processed in map order, and
+ * class_defs and the swap of data sections stay serial, since they
+ * depend on shared state built up item by item.
+ */
+int dexFixByteOrderingParallel(u1* addr, int len, int numThreads)
 {
     DexHeader* pHeader;
     CheckState state;
@@ -2852,6 +3092,7 @@ int dexFixByteOrdering(u1* addr, int len)
         state.pDataMap = NULL;
         state.pDefinedClassBits = NULL;
         state.previousItem = NULL;
+        state.numThreads = (numThreads < 1) ? 1 : numThreads;
 
         /*
          * Swap the header and check the contents.
@@ -65,6 +65,10 @@ check files against their previous SHA-1 check values, kind of
 like md5sum does. Added functions hexval, verifyfile,
 and sha1file. Rewrote main().
 -----------------
+Words are now uint32_t rather than unsigned long, which is 64 bits on
+LP64 and made SHA1Transform() overrun its 64-byte workspace. The
+workspace is on the stack so concurrent hashing is safe.
+-----------------
 
 Test Vectors (from FIPS PUB 180-1)
 "abc"
@@ -104,7 +108,7 @@ A million repetitions of "a"
 
 #define LINESIZE 2048
 
-static void SHA1Transform(unsigned long state[5],
+static void SHA1Transform(uint32_t state[5],
     const unsigned char buffer[64]);
 
 #define rol(value,bits) \
@@ -132,18 +136,18 @@ static void SHA1Transform(unsigned long state[5],
 
 /* Hash a single 512-bit block. This is the core of the algorithm. */
 
-static void SHA1Transform(unsigned long state[5],
+static void SHA1Transform(uint32_t state[5],
     const unsigned char buffer[64])
 {
-unsigned long a, b, c, d, e;
+uint32_t a, b, c, d, e;
 typedef union {
     unsigned char c[64];
-    unsigned long l[16];
+    uint32_t l[16];
 } CHAR64LONG16;
 CHAR64LONG16* block;
 #ifdef SHA1HANDSOFF
-static unsigned char workspace[64];
-    block = (CHAR64LONG16*)workspace;
+CHAR64LONG16 workspace;
+    block = &workspace;
     memcpy(block, buffer, 64);
 #else
     block = (CHAR64LONG16*)buffer;
@@ -218,7 +222,7 @@ void SHA1Update(SHA1_CTX* context, const unsigned char* data,
     unsigned long i, j; /* JHB */
 
     j = (context->count[0] >> 3) & 63;
-    if ((context->count[0] += len << 3) < (len << 3))
+    if ((context->count[0] += (uint32_t)(len << 3)) < (uint32_t)(len << 3))
         context->count[1]++;
     context->count[1] += (len >> 29);
     if ((j + len) > 63)
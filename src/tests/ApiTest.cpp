@@ -0,0 +1,88 @@
+/*
+ * The embeddable API: a dex opened from a path or from memory builds the
+ * same graph, builds on separate Dex objects run concurrently, and
+ * failures come back as an error string, not an exit.
+ */
+#include <thread>
+#include <unistd.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+
+  std::vector<DexGen::ClassDef> classes()
+  {
+    DexGen::ClassDef a{ "LA;", {} };
+    a.methods.push_back(Tests::method("f", CodeBuilder()
+        .const4(0, 0)                   // 0
+        .if_eqz(0, 5)                   // 1 -> 6
+        .invoke_static({ "LA;", "g" })  // 3
+        .return_void()));               // 6
+    a.methods.push_back(Tests::method("g", CodeBuilder().return_void()));
+    return { a };
+  }
+
+  std::string edg(DexGraph::Dex const& dex)
+  {
+    DexGraph::Graph graph;
+    DexGraph::build(dex, DexGraph::Options(), graph);
+    return graph.to_edg();
+  }
+}
+
+int main()
+{
+  auto const image = DexGen::build(classes());
+  DexGraph::Options options;
+  std::string error;
+
+  auto const from_memory = Tests::open(image, options);
+  auto const expected = edg(*from_memory);
+  CHECK(!expected.empty());
+
+  char path[] = "/tmp/ApiTestXXXXXX";
+  int const fd = mkstemp(path);
+  CHECK(fd >= 0);
+  CHECK(write(fd, image.data(), image.size()) == (ssize_t)image.size());
+  close(fd);
+  auto const from_path = DexGraph::Dex::open(path, options, error);
+  CHECK(from_path != nullptr);
+  if (from_path != nullptr)
+  {
+    CHECK(from_path->length() == image.size());
+    CHECK(edg(*from_path) == expected);
+  }
+  unlink(path);
+
+  // One Dex per thread, no shared state
+  std::vector<std::string> built(4);
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < built.size(); t++)
+  {
+    threads.emplace_back([&image, &built, t]() {
+      std::string thread_error;
+      auto const dex = DexGraph::Dex::open_memory(
+          image.data(), image.size(), DexGraph::Options(), thread_error);
+      if (dex != nullptr)
+        built[t] = edg(*dex);
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  for (auto const& graph : built)
+    CHECK(graph == expected);
+
+  // Errors
+  error.clear();
+  CHECK(DexGraph::Dex::open("/nonexistent/classes.dex", options, error) ==
+        nullptr);
+  CHECK(!error.empty());
+  error.clear();
+  std::vector<uint8_t> const garbage(128, 0x5a);
+  CHECK(DexGraph::Dex::open_memory(garbage.data(), garbage.size(), options,
+                                   error) == nullptr);
+  CHECK(!error.empty());
+  return Tests::finish("ApiTest");
+}
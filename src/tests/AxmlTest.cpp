@@ -0,0 +1,180 @@
+/*
+ * The manifest reader (-A) on a hand-encoded binary AndroidManifest.xml,
+ * including attribute names emptied by an obfuscator.
+ */
+#include <TreeConstructor/Axml.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using TreeConstructor::Axml::ComponentKind;
+
+  auto constexpr ANDROID_NAME_ATTR = 0x01010003u;
+  auto constexpr NO_INDEX = 0xffffffffu;
+  auto constexpr TYPE_REFERENCE = 0x01;
+  auto constexpr TYPE_STRING = 0x03;
+
+  // Indices into the string pool; the first two map to android:name
+  enum : uint32_t
+  {
+    NAME, EMPTY, PACKAGE, LABEL,
+    MANIFEST, APPLICATION, ACTIVITY, SERVICE,
+    COM_EXAMPLE, DOT_APP, MAIN, OTHER_SERVICE,
+  };
+  char const* const strings[] = {
+    "name", "", "package", "label",
+    "manifest", "application", "activity", "service",
+    "com.example", ".App", "Main", "org.other.Service",
+  };
+
+  struct Attribute
+  {
+    uint32_t name;
+    uint32_t raw_value;
+    uint8_t data_type;
+    uint32_t data;
+  };
+
+  struct Chunk
+  {
+    std::vector<uint8_t> bytes;
+
+    void u1(uint8_t value) { bytes.push_back(value); }
+    void u2(uint16_t value)
+    {
+      u1(value & 0xff);
+      u1(value >> 8);
+    }
+    void u4(uint32_t value)
+    {
+      u2(value & 0xffff);
+      u2(value >> 16);
+    }
+    void append(Chunk const& other)
+    {
+      bytes.insert(bytes.end(), other.bytes.begin(), other.bytes.end());
+    }
+    // ResChunk_header, the body following it
+    Chunk wrap(uint16_t type, uint16_t header_size) const
+    {
+      Chunk ret;
+      ret.u2(type);
+      ret.u2(header_size);
+      ret.u4((uint32_t)(8 + bytes.size()));
+      ret.append(*this);
+      return ret;
+    }
+  };
+
+  Chunk string_pool()
+  {
+    auto constexpr count = sizeof(strings) / sizeof(strings[0]);
+    Chunk data;
+    std::vector<uint32_t> offsets;
+    for (auto const str : strings)
+    {
+      offsets.push_back((uint32_t)data.bytes.size());
+      data.u1((uint8_t)strlen(str));  // UTF-16 length
+      data.u1((uint8_t)strlen(str));  // UTF-8 length
+      for (auto p = str; *p != 0; p++)
+        data.u1((uint8_t)*p);
+      data.u1(0);
+    }
+    while (data.bytes.size() % 4 != 0)
+      data.u1(0);
+
+    Chunk body;
+    body.u4(count);
+    body.u4(0);        // styles
+    body.u4(1u << 8);  // UTF-8
+    body.u4(28 + 4 * count);
+    body.u4(0);
+    for (auto const offset : offsets)
+      body.u4(offset);
+    body.append(data);
+    return body.wrap(0x0001, 28);
+  }
+
+  Chunk start_element(uint32_t name, std::vector<Attribute> const& attributes)
+  {
+    Chunk body;
+    body.u4(1);         // line
+    body.u4(NO_INDEX);  // comment
+    body.u4(NO_INDEX);  // namespace
+    body.u4(name);
+    body.u2(20);        // attribute start
+    body.u2(20);        // attribute size
+    body.u2((uint16_t)attributes.size());
+    body.u2(0);         // id, class and style attributes
+    body.u2(0);
+    body.u2(0);
+    for (auto const& attribute : attributes)
+    {
+      body.u4(NO_INDEX);
+      body.u4(attribute.name);
+      body.u4(attribute.raw_value);
+      body.u2(8);
+      body.u1(0);
+      body.u1(attribute.data_type);
+      body.u4(attribute.data);
+    }
+    return body.wrap(0x0102, 16);
+  }
+
+  Attribute string_attribute(uint32_t name, uint32_t value)
+  {
+    return Attribute{ name, value, TYPE_STRING, value };
+  }
+
+  std::vector<uint8_t> manifest()
+  {
+    Chunk resource_map;
+    resource_map.u4(ANDROID_NAME_ATTR);  // NAME
+    resource_map.u4(ANDROID_NAME_ATTR);  // EMPTY
+
+    Chunk body = string_pool();
+    body.append(resource_map.wrap(0x0180, 8));
+    body.append(start_element(MANIFEST,
+        { string_attribute(PACKAGE, COM_EXAMPLE) }));
+    body.append(start_element(APPLICATION,
+        { string_attribute(NAME, DOT_APP) }));
+    // Obfuscated: no attribute name, only the resource id
+    body.append(start_element(ACTIVITY,
+        { string_attribute(LABEL, DOT_APP), string_attribute(EMPTY, MAIN) }));
+    // Named through a resource reference: left out
+    body.append(start_element(SERVICE,
+        { Attribute{ NAME, NO_INDEX, TYPE_REFERENCE, 0x7f0a0001 } }));
+    body.append(start_element(SERVICE,
+        { string_attribute(NAME, OTHER_SERVICE) }));
+    return body.wrap(0x0003, 8).bytes;
+  }
+}
+
+int main()
+{
+  auto const document = manifest();
+  TreeConstructor::Axml::Manifest parsed;
+  std::string error;
+  CHECK(TreeConstructor::Axml::parse_manifest(document.data(), document.size(),
+                                              parsed, error));
+  CHECK(parsed.package == "com.example");
+  CHECK(parsed.components.size() == 3);
+  if (parsed.components.size() == 3)
+  {
+    CHECK(parsed.components[0].kind == ComponentKind::APPLICATION);
+    CHECK(parsed.components[0].name == "com.example.App");
+    CHECK(parsed.components[1].kind == ComponentKind::ACTIVITY);
+    CHECK(parsed.components[1].name == "com.example.Main");
+    CHECK(parsed.components[2].kind == ComponentKind::SERVICE);
+    CHECK(parsed.components[2].name == "org.other.Service");
+  }
+  CHECK(TreeConstructor::Axml::class_descriptor("com.example.Main") ==
+        "Lcom/example/Main;");
+
+  // Cut in the middle of a chunk
+  CHECK(!TreeConstructor::Axml::parse_manifest(document.data(),
+                                               document.size() - 4, parsed,
+                                               error));
+  return Tests::finish("AxmlTest");
+}
@@ -0,0 +1,62 @@
+/*
+ * dexgraph_bench: the macro benchmarks of one generated shape run the
+ * dexgraph binary in each mode, report instructions per second, write
+ * them as JSON, and compare a second run against that file.
+ */
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  std::string run(std::string const& args)
+  {
+    auto const command = std::string(DEXGRAPH_BENCH) + " -t 1 " + args;
+    std::string output;
+    if (FILE* pipe = popen(command.c_str(), "r"))
+    {
+      char buff[4096];
+      std::size_t got;
+      while ((got = fread(buff, 1, sizeof(buff), pipe)) > 0)
+        output.append(buff, got);
+      if (pclose(pipe) != 0)
+        output += "\nexit status not 0";
+    }
+    return output;
+  }
+}
+
+int main()
+{
+  char path[] = "/tmp/BenchTestXXXXXX";
+  int const fd = mkstemp(path);
+  CHECK(fd >= 0);
+  close(fd);
+
+  auto const first = run(std::string("-f macro/chain -j ") + path);
+  CHECK(first.find("exit status") == std::string::npos);
+  std::ifstream in(path);
+  std::string const json((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  CHECK(json.find("{\"benchmarks\":[\n") == 0);
+  for (char const* name : { "macro/chain\"", "macro/chain_stream\"",
+                            "macro/chain_metrics\"" })
+  {
+    auto const pos = json.find(std::string("{\"name\":\"") + name);
+    CHECK(pos != std::string::npos);
+    auto const line = json.substr(pos, json.find('\n', pos) - pos);
+    CHECK(line.find("\"iterations\":") != std::string::npos);
+    CHECK(line.find("\"iterations\":0,") == std::string::npos);
+    CHECK(line.find("\"instructions_per_sec\":") != std::string::npos);
+  }
+  // Only the filtered benchmarks ran
+  CHECK(json.find("micro/") == std::string::npos);
+
+  auto const second = run(std::string("-f macro/chain_metrics -b ") + path);
+  CHECK(second.find("macro/chain_metrics") != std::string::npos);
+  CHECK(second.find("vs baseline)") != std::string::npos);
+  unlink(path);
+  return Tests::finish("BenchTest");
+}
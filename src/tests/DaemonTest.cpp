@@ -0,0 +1,141 @@
+/*
+ * dexgraphd over its socket: query counts each edge once, although the
+ * whole-file build repeats some, -a lists the neighbours of a node, and
+ * -B is refused.
+ */
+#include <algorithm>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+
+  std::vector<DexGen::ClassDef> classes()
+  {
+    DexGen::ClassDef a{ "LA;", {} };
+    a.methods.push_back(Tests::method("leaf", CodeBuilder()
+        .const4(0, 0)              // 0
+        .if_eqz(0, 3)              // 1 -> 4
+        .return_void()             // 3
+        .return_void()));          // 4
+    a.methods.push_back(Tests::method("caller", CodeBuilder()
+        .invoke_static({ "LA;", "leaf" })
+        .invoke_static({ "LA;", "leaf" })
+        .return_void()));
+    return { a };
+  }
+
+  std::size_t unique_edges(DexGraph::Graph const& graph)
+  {
+    std::vector<std::pair<uint64_t, uint64_t>> edges;
+    for (auto const& edge : graph.edges)
+      edges.emplace_back(edge.from, edge.to);
+    std::sort(edges.begin(), edges.end());
+    return std::unique(edges.begin(), edges.end()) - edges.begin();
+  }
+
+  int connect_to(std::string const& path)
+  {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    // The daemon may not be listening yet
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+      int const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0)
+        return fd;
+      close(fd);
+      usleep(50 * 1000);
+    }
+    return -1;
+  }
+
+  // Send one request line, read its one line reply
+  std::string request(int fd, std::string const& line)
+  {
+    auto const data = line + "\n";
+    if (send(fd, data.data(), data.size(), MSG_NOSIGNAL) !=
+        (ssize_t)data.size())
+      return "";
+    std::string reply;
+    char c;
+    while (recv(fd, &c, 1, 0) == 1 && c != '\n')
+      reply += c;
+    return reply;
+  }
+}
+
+int main()
+{
+  char dir[] = "/tmp/DaemonTestXXXXXX";
+  if (mkdtemp(dir) == nullptr)
+    return EXIT_FAILURE;
+  auto const dex_path = std::string(dir) + "/classes.dex";
+  auto const socket_path = std::string(dir) + "/sock";
+  auto const image = DexGen::build(classes());
+  FILE* file = fopen(dex_path.c_str(), "wb");
+  CHECK(file != nullptr &&
+        fwrite(image.data(), 1, image.size(), file) == image.size());
+  if (file != nullptr)
+    fclose(file);
+
+  DexGraph::Options options;
+  auto const dex = Tests::open(image, options);
+  DexGraph::Graph whole;
+  DexGraph::build(*dex, options, whole);
+  auto const edges = unique_edges(whole);
+  // The fixture must have repeated edges for the count to mean anything
+  CHECK(edges < whole.edges.size());
+
+  pid_t const pid = fork();
+  if (pid == 0)
+  {
+    execl(DEXGRAPHD, "dexgraphd", "-j", "2", socket_path.c_str(),
+          (char*)nullptr);
+    _exit(127);
+  }
+  int const fd = connect_to(socket_path);
+  CHECK(fd >= 0);
+  if (fd >= 0)
+  {
+    CHECK(request(fd, "1 query " + dex_path) ==
+          "1 ok nodes " + std::to_string(whole.nodes.size()) + " edges " +
+              std::to_string(edges));
+    // Same count from a streamed build
+    CHECK(request(fd, "2 query -s " + dex_path) ==
+          "2 ok nodes " + std::to_string(whole.nodes.size()) + " edges " +
+              std::to_string(edges));
+
+    // The caller's first invoke, into leaf
+    auto const hex = [](uint64_t value) {
+      char buff[24];
+      snprintf(buff, sizeof(buff), "0x%llx", (unsigned long long)value);
+      return std::string(buff);
+    };
+    auto const call = hex(Tests::entry_addr(*dex, "LA;", "caller"));
+    auto const leaf = hex(Tests::entry_addr(*dex, "LA;", "leaf"));
+    auto const reply = request(fd, "3 query -a " + call + " " + dex_path);
+    CHECK(reply.find("3 ok node " + call + " type ") == 0);
+    CHECK(reply.find(" next " + leaf) != std::string::npos);
+
+    CHECK(request(fd, "4 analyze -B 16 " + dex_path).compare(0, 8,
+                                                             "4 error ") == 0);
+    close(fd);
+  }
+  kill(pid, SIGTERM);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  CHECK(WIFEXITED(status));
+
+  unlink(dex_path.c_str());
+  rmdir(dir);
+  return Tests::finish("DaemonTest");
+}
@@ -0,0 +1,110 @@
+/*
+ * The gen/kill dataflow solver: blocks of a method graph with a diamond
+ * and a back edge, reaching definitions (forward, union) and available
+ * expressions (forward, intersection) to their fixed points, and blocks
+ * not reached from the entry left empty.
+ */
+#include <TreeConstructor/Dataflow.h>
+#include <TreeConstructor/TCNode.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using TreeConstructor::NodeSPtr;
+  namespace Dataflow = TreeConstructor::Dataflow;
+
+  NodeSPtr node(uint32_t offset, uint16_t size, OpCode opcode,
+                std::vector<uint32_t> targets = {})
+  {
+    return std::make_shared<TreeConstructor::Node>(
+        0x100 + offset * 2, size, opcode, TreeConstructor::MethodInfo(),
+        offset, targets);
+  }
+
+  // Blocks 0: [0, 1], 1: [2, 3], 2: [4], 3: [5], 4: [6], 5: [7]
+  std::vector<NodeSPtr> method()
+  {
+    return {
+      node(0, 1, OP_CONST_4),
+      node(1, 2, OP_IF_EQZ, { 5 }),
+      node(3, 1, OP_CONST_4),
+      node(4, 1, OP_GOTO, { 6 }),
+      node(5, 1, OP_CONST_4),
+      node(6, 2, OP_IF_EQZ, { 0 }),  // back to the top
+      node(8, 1, OP_RETURN_VOID),
+      node(9, 1, OP_RETURN_VOID),    // unreachable
+    };
+  }
+
+  Dataflow::Problem problem(Dataflow::Meet meet, std::size_t blocks)
+  {
+    return Dataflow::Problem{ Dataflow::Direction::FORWARD, meet,
+                              Dataflow::BitMatrix(blocks, 3),
+                              Dataflow::BitMatrix(blocks, 3),
+                              Dataflow::BitMatrix() };
+  }
+}
+
+int main()
+{
+  auto const nodes = method();
+  TreeConstructor::construct_node_from_vec(nodes);
+  auto const graph = Dataflow::build_blocks(nodes);
+
+  CHECK(graph.blocks.size() == 6);
+  CHECK(graph.block_of == (std::vector<uint32_t>{ 0, 0, 1, 1, 2, 3, 4, 5 }));
+  CHECK(graph.blocks[0].succs == (std::vector<uint32_t>{ 1, 2 }));
+  CHECK(graph.blocks[0].preds == (std::vector<uint32_t>{ 3 }));
+  CHECK(graph.blocks[3].succs == (std::vector<uint32_t>{ 4, 0 }));
+  CHECK(graph.blocks[3].preds.size() == 2);
+  CHECK(graph.blocks[5].preds.empty());
+  CHECK(graph.rpo.size() == 5);
+  CHECK(graph.rpo.front() == 0);
+  CHECK(graph.rpo.back() == 4);
+
+  // Reaching definitions: blocks 0, 1 and 2 each define the same register
+  auto reaching = problem(Dataflow::Meet::UNION, graph.blocks.size());
+  for (uint32_t b = 0; b < 3; b++)
+  {
+    reaching.gen.set(b, b);
+    reaching.kill.fill(b);
+    reaching.kill.reset(b, b);
+  }
+  auto const defs = Dataflow::solve(graph, reaching);
+  CHECK(defs.in.format(0) == "{1,2}");  // around the loop
+  CHECK(defs.out.format(0) == "{0}");
+  CHECK(defs.in.format(3) == "{1,2}");
+  CHECK(defs.out.format(4) == "{1,2}");
+  CHECK(defs.in.format(5) == "{}");
+  CHECK(defs.visits >= graph.rpo.size());
+
+  // Available expressions: 0 computed in block 0, 1 on both arms, 2 on one
+  auto available = problem(Dataflow::Meet::INTERSECTION, graph.blocks.size());
+  available.gen.set(0, 0);
+  available.gen.set(1, 1);
+  available.gen.set(2, 1);
+  available.gen.set(2, 2);
+  auto const exprs = Dataflow::solve(graph, available);
+  CHECK(exprs.in.format(0) == "{}");  // nothing on entry
+  CHECK(exprs.in.format(3) == "{0,1}");
+  CHECK(exprs.in.format(4) == "{0,1}");
+  CHECK(exprs.out.format(2) == "{0,1,2}");
+  CHECK(exprs.in.format(5) == "{}");
+  CHECK(exprs.out.format(5) == "{}");
+
+  // A boundary flows into the entry block
+  available.boundary = Dataflow::BitMatrix(1, 3);
+  available.boundary.set(0, 2);
+  auto const bounded = Dataflow::solve(graph, available);
+  CHECK(bounded.in.format(0) == "{2}");
+  CHECK(bounded.in.format(4) == "{0,1,2}");
+  // Killed on one arm, it is lost at the join and around the loop
+  available.kill.set(1, 2);
+  auto const killed = Dataflow::solve(graph, available);
+  CHECK(killed.in.format(3) == "{0,1}");
+  CHECK(killed.in.format(0) == "{}");
+
+  TreeConstructor::release_nodes(nodes);
+  return Tests::finish("DataflowTest");
+}
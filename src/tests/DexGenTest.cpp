@@ -0,0 +1,94 @@
+/*
+ * The synthetic dex generator (dexgen): shapes are reproducible from
+ * their seed, every method has the switch, branches and calls asked
+ * for, the output passes the structural verifier, and a multidex split
+ * keeps each dex within its id limit.
+ */
+#include <stdexcept>
+
+#include <DexGen/Shapes.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  bool verifies(std::vector<uint8_t> bytes)
+  {
+    return dexFixByteOrdering(bytes.data(), (int)bytes.size()) == 0;
+  }
+}
+
+int main()
+{
+  DexGen::Shape shape;
+  shape.classes = 20;
+  shape.methods_per_class = 3;
+  shape.switch_cases = 5;
+  shape.loop_depth = 2;
+  shape.branches_per_method = 3;
+  shape.calls_per_method = 2;
+
+  auto const image = DexGen::build(DexGen::generate(shape));
+  CHECK(image == DexGen::build(DexGen::generate(shape)));
+  auto reseeded = shape;
+  reseeded.seed = 2;
+  CHECK(image != DexGen::build(DexGen::generate(reseeded)));
+  CHECK(verifies(image));
+
+  DexGraph::Options options;
+  auto const dex = Tests::open(image, options);
+  CHECK(dex->dex_file()->pHeader->classDefsSize == shape.classes);
+
+  auto const metrics = DexGraph::metrics(*dex, options);
+  CHECK(metrics.size() == shape.classes * shape.methods_per_class);
+  for (auto const& method : metrics)
+  {
+    CHECK(method.switches == 1);
+    CHECK(method.switch_cases == shape.switch_cases);
+    // The diamonds, and the test of each loop
+    CHECK(method.branches == shape.branches_per_method + shape.loop_depth);
+    CHECK(method.invokes == shape.calls_per_method);
+  }
+
+  // Calls stay within the generated methods
+  auto const calls = DexGraph::call_graph(*dex, options);
+  for (auto const callee : calls.callees)
+    CHECK(((calls.defined[callee / 64] >> (callee % 64)) & 1) != 0);
+
+  // Multidex: every class once, in order, each dex within max_ids
+  DexGen::Shape large;
+  large.classes = 300;
+  large.methods_per_class = 10;
+  auto const classes = DexGen::generate(large);
+  auto const max_ids = 1000u;
+  auto const parts = DexGen::split_multidex(classes, max_ids);
+  CHECK(parts.size() > 1);
+  std::size_t next = 0;
+  for (auto const& part : parts)
+  {
+    for (auto const& def : part)
+    {
+      CHECK(next < classes.size() &&
+            def.descriptor == classes[next].descriptor);
+      next++;
+    }
+    auto const bytes = DexGen::build(part);
+    CHECK(verifies(bytes));
+    auto const part_dex = Tests::open(bytes, options);
+    CHECK(part_dex->dex_file()->pHeader->methodIdsSize <= max_ids);
+    CHECK(part_dex->dex_file()->pHeader->typeIdsSize <= max_ids);
+  }
+  CHECK(next == classes.size());
+
+  bool thrown = false;
+  try
+  {
+    DexGen::split_multidex(classes, 5);
+  }
+  catch (std::length_error const&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  return Tests::finish("DexGenTest");
+}
@@ -0,0 +1,110 @@
+/*
+ * Class filters (-I, -X): left out classes are not built, and calls into
+ * them land on one EXTERN stub node per callee, at the offset of its
+ * method_id_item, in whole-file and streamed mode alike.
+ */
+#include <algorithm>
+
+#include <TreeConstructor/Stats.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+
+  std::vector<DexGen::ClassDef> classes()
+  {
+    DexGen::ClassDef main_class{ "Lcom/app/Main;", {} };
+    main_class.methods.push_back(Tests::method("main", CodeBuilder()
+        .invoke_static({ "Lcom/lib/Util;", "u" })
+        .invoke_static({ "Lcom/lib/Util;", "u" })
+        .invoke_static({ "Lcom/app/Helper;", "h" })
+        .return_void()));
+    DexGen::ClassDef helper{ "Lcom/app/Helper;",
+        { Tests::method("h", CodeBuilder().nop().return_void()) } };
+    DexGen::ClassDef util{ "Lcom/lib/Util;",
+        { Tests::method("u", CodeBuilder().nop().nop().return_void()) } };
+    return { main_class, helper, util };
+  }
+
+  std::size_t count_type(DexGraph::Graph const& graph, OpCodeType type,
+                         uint64_t addr)
+  {
+    std::size_t count = 0;
+    for (auto const& node : graph.nodes)
+      count += node.type == type && node.addr == addr;
+    return count;
+  }
+
+  bool has_node(DexGraph::Graph const& graph, uint64_t addr)
+  {
+    for (auto const& node : graph.nodes)
+    {
+      if (node.addr == addr)
+        return true;
+    }
+    return false;
+  }
+
+  bool has_edge(DexGraph::Graph const& graph, uint64_t from, uint64_t to)
+  {
+    auto const next = Tests::successors(graph, from);
+    return std::find(next.begin(), next.end(), to) != next.end();
+  }
+}
+
+int main()
+{
+  DexGraph::Options options;
+  auto const dex = Tests::open(DexGen::build(classes()), options);
+  DexFile* pDexFile = dex->dex_file();
+  auto const main_entry = Tests::entry_addr(*dex, "Lcom/app/Main;", "main");
+  auto const helper = Tests::entry_addr(*dex, "Lcom/app/Helper;", "h");
+  auto const util = Tests::entry_addr(*dex, "Lcom/lib/Util;", "u");
+  auto const stub = pDexFile->pHeader->methodIdsOff +
+      Tests::method_idx(*dex, "Lcom/lib/Util;", "u") * sizeof(DexMethodId);
+
+  CHECK(DexGraph::class_selected(options, "Lcom/lib/Util;"));
+  DexGraph::Options exclude;
+  exclude.exclude_classes.push_back("Lcom/lib/");
+  DexGraph::Options include;
+  include.include_classes.push_back("Lcom/app/");
+  DexGraph::Options glob;
+  glob.exclude_classes.push_back("L*/Util;");
+  for (auto const& filter : { exclude, include, glob })
+  {
+    CHECK(!DexGraph::class_selected(filter, "Lcom/lib/Util;"));
+    CHECK(DexGraph::class_selected(filter, "Lcom/app/Main;"));
+  }
+  CHECK(DexGraph::class_selected(glob, "Lcom/lib/Other;"));
+
+  for (auto filter : { exclude, include, glob })
+  {
+    for (bool stream : { false, true })
+    {
+      filter.stream = stream;
+      TreeConstructor::Stats::reset();
+      DexGraph::Graph graph;
+      DexGraph::build(*dex, filter, graph);
+
+      CHECK(has_node(graph, helper));
+      CHECK(!has_node(graph, util));
+      CHECK(count_type(graph, OpCodeType::EXTERN, stub) == 1);
+      // Both calls into Util reach the stub, Helper keeps its edge
+      CHECK(has_edge(graph, main_entry, stub));
+      CHECK(has_edge(graph, main_entry + 3 * 2, stub));
+      CHECK(has_edge(graph, main_entry + 6 * 2, helper));
+      CHECK(TreeConstructor::Stats::thread_counts()[static_cast<std::size_t>(
+          TreeConstructor::Stats::Counter::CLASSES_FILTERED)] == 1);
+    }
+  }
+
+  // Unfiltered, Util is built and nothing is a stub
+  DexGraph::Graph graph;
+  DexGraph::build(*dex, options, graph);
+  CHECK(has_node(graph, util));
+  CHECK(!has_node(graph, stub));
+  CHECK(has_edge(graph, main_entry, util));
+  return Tests::finish("FilterTest");
+}
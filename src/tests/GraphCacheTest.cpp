@@ -0,0 +1,98 @@
+/*
+ * The on-disk graph cache (-C): a stored graph replays the same Edg
+ * bytes, other options or another dex miss, and eviction keeps the
+ * directory under its budget.
+ */
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <TreeConstructor/FmtEdg.h>
+#include <TreeConstructor/GraphCache.h>
+#include <TreeConstructor/TCHelper.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+  using TreeConstructor::Helper::edg_filename;
+
+  std::vector<uint8_t> image(char const* descriptor)
+  {
+    DexGen::ClassDef a{ descriptor, {} };
+    a.methods.push_back(Tests::method("f", CodeBuilder()
+        .const4(0, 0)              // 0
+        .if_eqz(0, 3)              // 1 -> 4
+        .return_void()             // 3
+        .return_void()));          // 4
+    return DexGen::build({ a });
+  }
+
+  std::string contents(char const* filename)
+  {
+    std::ifstream in(filename, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)),
+                       std::istreambuf_iterator<char>());
+  }
+}
+
+int main()
+{
+  char dir[] = "/tmp/GraphCacheTestXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  CHECK(chdir(dir) == 0);
+  std::string const cache_dir = std::string(dir) + "/cache";
+  CHECK(mkdir(cache_dir.c_str(), 0700) == 0);
+
+  auto const bytes = image("LA;");
+  DexGraph::Options options;
+  auto const dex = Tests::open(bytes, options);
+  auto const key = TreeConstructor::GraphCache::make_key(bytes.data(),
+                                                         bytes.size(), "-");
+  CHECK(!key.empty());
+  CHECK(!TreeConstructor::GraphCache::replay(cache_dir, key, edg_filename));
+
+  // A graph appended after what graph.edg already holds is stored alone
+  {
+    std::ofstream(edg_filename, std::ios::binary) << "earlier output";
+  }
+  auto const offset = TreeConstructor::GraphCache::file_size(edg_filename);
+  {
+    Fmt::Edg::StreamWriter writer;
+    DexGraph::build(*dex, options, writer);
+  }
+  auto const built = contents(edg_filename).substr(offset);
+  CHECK(!built.empty());
+  TreeConstructor::GraphCache::store(cache_dir, key, edg_filename, offset,
+      TreeConstructor::GraphCache::default_max_bytes);
+
+  unlink(edg_filename);
+  CHECK(TreeConstructor::GraphCache::replay(cache_dir, key, edg_filename));
+  CHECK(contents(edg_filename) == built);
+  // Replays append
+  CHECK(TreeConstructor::GraphCache::replay(cache_dir, key, edg_filename));
+  CHECK(contents(edg_filename) == built + built);
+
+  // Keyed by the signature and the options
+  auto const other = image("LB;");
+  auto const other_key = TreeConstructor::GraphCache::make_key(
+      other.data(), other.size(), "-");
+  CHECK(other_key != key);
+  CHECK(!TreeConstructor::GraphCache::replay(cache_dir, other_key,
+                                             edg_filename));
+  CHECK(TreeConstructor::GraphCache::make_key(bytes.data(), bytes.size(),
+                                              "e") != key);
+  std::vector<uint8_t> const not_dex(bytes.size(), 0);
+  CHECK(TreeConstructor::GraphCache::make_key(not_dex.data(), not_dex.size(),
+                                              "-").empty());
+
+  // Over the budget, entries go
+  TreeConstructor::GraphCache::evict(cache_dir, 1);
+  CHECK(!TreeConstructor::GraphCache::replay(cache_dir, key, edg_filename));
+
+  CHECK(chdir("/") == 0);
+  CHECK(system(("rm -rf " + std::string(dir)).c_str()) == 0);
+  return Tests::finish("GraphCacheTest");
+}
@@ -0,0 +1,85 @@
+/*
+ * The interprocedural CFG (-I): a call into a built method gets a CALL
+ * edge to its entry, a RETURN edge from each of its returns to the return
+ * site, and a CALL_TO_RETURN edge over the call.
+ */
+#include <algorithm>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+  using DexGraph::EdgeKind;
+
+  // Targets of the kind edges out of addr, sorted
+  std::vector<uint64_t> successors(DexGraph::Icfg const& graph, uint64_t addr,
+                                   EdgeKind kind)
+  {
+    std::vector<uint64_t> ret;
+    auto const node = graph.find(addr);
+    if (node < 0)
+      return ret;
+    for (auto i = graph.succ_begin[node]; i < graph.succ_begin[node + 1]; i++)
+    {
+      if (graph.kinds[i] == kind)
+        ret.push_back(graph.addrs[graph.succs[i]]);
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  }
+
+  typedef std::vector<uint64_t> Addrs;
+}
+
+int main()
+{
+  DexGen::ClassDef a{ "LA;", {} };
+  a.methods.push_back(Tests::method("callee", CodeBuilder()
+      .const4(0, 0)                 // 0
+      .if_eqz(0, 3)                 // 1 -> 4
+      .return_void()                // 3
+      .return_void()));             // 4
+  a.methods.push_back(Tests::method("caller", CodeBuilder()
+      .invoke_static({ "LA;", "callee" })  // 0
+      .nop()                               // 3, the return site
+      .return_void()));                    // 4
+
+  DexGraph::Options options;
+  auto const dex = Tests::open(DexGen::build({ a }), options);
+  auto const callee = Tests::entry_addr(*dex, "LA;", "callee");
+  auto const caller = Tests::entry_addr(*dex, "LA;", "caller");
+  auto const call = caller;
+  auto const return_site = caller + 3 * 2;
+
+  for (int liveness = 0; liveness < 2; liveness++)
+  {
+    // Recording the register effects changes nothing here
+    struct : DexGraph::LivenessSink
+    {
+      void method(uint32_t, std::vector<TreeConstructor::NodeSPtr> const&,
+                  TreeConstructor::Liveness::Result const&) override
+      {
+      }
+    } ignored;
+    DexGraph::Options icfg_options;
+    if (liveness != 0)
+      icfg_options.liveness = &ignored;
+    auto const graph = DexGraph::icfg(*dex, icfg_options);
+    CHECK(graph.method_idx.size() == 2);
+
+    CHECK(successors(graph, call, EdgeKind::CALL) == Addrs{ callee });
+    CHECK(successors(graph, call, EdgeKind::CALL_TO_RETURN) ==
+          Addrs{ return_site });
+    CHECK(successors(graph, callee + 3 * 2, EdgeKind::RETURN) ==
+          Addrs{ return_site });
+    CHECK(successors(graph, callee + 4 * 2, EdgeKind::RETURN) ==
+          Addrs{ return_site });
+    // The if is not a return
+    CHECK(successors(graph, callee + 1 * 2, EdgeKind::RETURN).empty());
+    CHECK(successors(graph, callee + 1 * 2, EdgeKind::INTRA).size() == 2);
+    // Nothing returns from the caller's own return
+    CHECK(successors(graph, caller + 4 * 2, EdgeKind::RETURN).empty());
+  }
+  return Tests::finish("IcfgTest");
+}
@@ -0,0 +1,120 @@
+/*
+ * Lazy verification (-z) must reject a class whose try points past its
+ * catch handler list, keep the other classes, give the same answer on
+ * every later touch, and agree across threads touching the classes at
+ * once.
+ */
+#include <thread>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+
+  // try { f(); } catch { }
+  DexGen::MethodDef guarded(char const* name)
+  {
+    DexGen::MethodDef method = Tests::method(name, CodeBuilder()
+        .invoke_static({ "LA;", "f" })  // 0
+        .return_void()                  // 3
+        .return_void());                // 4, the handler
+    method.tries.push_back(DexGen::TryBlock{ 0, 3, 4 });
+    return method;
+  }
+
+  std::vector<DexGen::ClassDef> classes()
+  {
+    DexGen::ClassDef a{ "LA;", { Tests::method("f",
+        CodeBuilder().return_void()), guarded("good") } };
+    DexGen::ClassDef b{ "LB;", { guarded("bad") } };
+    return { a, b };
+  }
+
+  // The image with the handler_off of LB;->bad past its handler list
+  std::vector<uint8_t> corrupt(std::vector<uint8_t> image)
+  {
+    DexGraph::Options options;
+    auto const dex = Tests::open(image, options);
+    DexFile* pDexFile = dex->dex_file();
+    auto const insns = Tests::entry_addr(*dex, "LB;", "bad");
+    auto const pCode = (DexCode const*)(pDexFile->baseAddr + insns -
+                                        offsetof(DexCode, insns));
+    auto const handler_off = (u1 const*)&dexGetTries(pCode)->handlerOff -
+                             pDexFile->baseAddr;
+    image[handler_off] = 0x40;
+    return image;
+  }
+
+  u4 class_def(DexFile* pDexFile, char const* descriptor)
+  {
+    for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++)
+    {
+      if (strcmp(dexStringByTypeIdx(pDexFile,
+              dexGetClassDef(pDexFile, i)->classIdx), descriptor) == 0)
+        return i;
+    }
+    return kDexNoIndex;
+  }
+}
+
+int main()
+{
+  auto const image = corrupt(DexGen::build(classes()));
+  DexGraph::Options options;
+  options.lazy_verify = true;
+
+  {
+    auto const dex = Tests::open(image, options);
+    DexFile* pDexFile = dex->dex_file();
+    u4 const a = class_def(pDexFile, "LA;");
+    u4 const b = class_def(pDexFile, "LB;");
+
+    // First touch verifies from the decode it returns
+    DexClassData* pClassData = dexReadVerifiedClassData(pDexFile, a);
+    CHECK(pClassData != nullptr);
+    if (pClassData != nullptr)
+      CHECK(pClassData->header.directMethodsSize == 2);
+    free(pClassData);
+    CHECK(dexReadVerifiedClassData(pDexFile, b) == nullptr);
+
+    // Later touches read the bitmaps
+    CHECK(dexVerifyClassDef(pDexFile, a));
+    CHECK(!dexVerifyClassDef(pDexFile, b));
+    pClassData = dexReadVerifiedClassData(pDexFile, a);
+    CHECK(pClassData != nullptr);
+    free(pClassData);
+    CHECK(dexReadVerifiedClassData(pDexFile, b) == nullptr);
+    CHECK(!dexVerifyClassDef(pDexFile, pDexFile->pHeader->classDefsSize));
+  }
+
+  // Threads racing on the first touch agree with the serial outcome
+  for (int round = 0; round < 20; round++)
+  {
+    auto const dex = Tests::open(image, options);
+    DexFile* pDexFile = dex->dex_file();
+    u4 const b = class_def(pDexFile, "LB;");
+    std::vector<std::thread> threads;
+    int verified[8] = {};
+    for (int t = 0; t < 8; t++)
+    {
+      threads.emplace_back([pDexFile, &verified, t]() {
+        for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++)
+          verified[t] += dexVerifyClassDef(pDexFile, i) ? 1 : 0;
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+    for (int t = 0; t < 8; t++)
+      CHECK(verified[t] == 1);
+    CHECK(!dexVerifyClassDef(pDexFile, b));
+  }
+
+  // Eager parsing leaves it to the checksum
+  DexGraph::Options eager;
+  auto const dex = Tests::open(DexGen::build(classes()), eager);
+  DexClassData* pClassData = dexReadVerifiedClassData(dex->dex_file(), 0);
+  CHECK(pClassData != nullptr);
+  free(pClassData);
+  return Tests::finish("LazyVerifyTest");
+}
@@ -0,0 +1,74 @@
+/*
+ * Register liveness (Options::liveness): the live-in and live-out sets of
+ * each block of a known method, with a dead store left out, reported for
+ * every method built in whole-file and streamed mode alike.
+ */
+#include <map>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+
+  std::vector<DexGen::ClassDef> classes()
+  {
+    DexGen::ClassDef a{ "LA;", {} };
+    a.methods.push_back(Tests::method("pick", CodeBuilder()
+        .const4(0, 1)         // 0
+        .const4(1, 2)         // 1
+        .const4(2, 3)         // 2, dead
+        .if_eqz(0, 3)         // 3 -> 6
+        .return_value(1)      // 5
+        .const4(2, 0)         // 6
+        .return_value(2)));   // 7
+    a.methods.push_back(Tests::method("arg", CodeBuilder()
+        .return_value(3), 4, 1));
+    return { a };
+  }
+
+  // Live sets of each block, "in/out"
+  struct Collect : DexGraph::LivenessSink
+  {
+    void method(uint32_t method_idx,
+                std::vector<TreeConstructor::NodeSPtr> const& nodes,
+                TreeConstructor::Liveness::Result const& result) override
+    {
+      auto& blocks = methods[method_idx];
+      CHECK(result.graph.block_of.size() == nodes.size());
+      CHECK(result.live_in.bits() == 4);
+      for (std::size_t b = 0; b < result.graph.blocks.size(); b++)
+        blocks.push_back(result.live_in.format(b) + "/" +
+                         result.live_out.format(b));
+    }
+
+    std::map<uint32_t, std::vector<std::string>> methods;
+  };
+
+  typedef std::vector<std::string> Blocks;
+}
+
+int main()
+{
+  DexGraph::Options options;
+  auto const dex = Tests::open(DexGen::build(classes()), options);
+  auto const pick = Tests::method_idx(*dex, "LA;", "pick");
+  auto const arg = Tests::method_idx(*dex, "LA;", "arg");
+
+  for (bool stream : { false, true })
+  {
+    Collect sink;
+    DexGraph::Options liveness;
+    liveness.liveness = &sink;
+    liveness.stream = stream;
+    DexGraph::Graph graph;
+    DexGraph::build(*dex, liveness, graph);
+
+    CHECK(sink.methods.size() == 2);
+    // The if's block, then each return
+    CHECK(sink.methods[pick] == (Blocks{ "{}/{1}", "{1}/{}", "{}/{}" }));
+    // The parameter is live on entry
+    CHECK(sink.methods[arg] == Blocks{ "{3}/{}" });
+  }
+  return Tests::finish("LivenessTest");
+}
@@ -0,0 +1,65 @@
+/*
+ * The counting operator new and delete (-S memory, -B): bytes go to the
+ * MemoryScope they were allocated in and come back to it when freed,
+ * through the sized and unsized deletes alike.
+ */
+#include <TreeConstructor/Stats.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using TreeConstructor::Stats::Memory;
+
+  // live_bytes of one subsystem, from the -S JSON
+  uint64_t live_bytes(char const* memory)
+  {
+    auto const json = TreeConstructor::Stats::to_json("", 0);
+    auto const key = std::string("\"") + memory + "\":{\"live_bytes\":";
+    auto const pos = json.find(key, json.find("\"memory\":{"));
+    if (pos == std::string::npos)
+      return 0;
+    return strtoull(json.c_str() + pos + key.size(), nullptr, 10);
+  }
+
+  // Out of line, so the compiler cannot elide the allocations
+  void* volatile sink;
+}
+
+int main()
+{
+  auto const nodes = live_bytes("nodes");
+  auto const heap = TreeConstructor::Stats::heap_live_bytes();
+
+  char* array;
+  std::string* object;
+  {
+    TreeConstructor::Stats::MemoryScope scope(Memory::NODES);
+    array = new char[1000];
+    object = new std::string();
+    sink = array;
+  }
+  CHECK(live_bytes("nodes") == nodes + 1000 + sizeof(std::string));
+  CHECK(TreeConstructor::Stats::heap_live_bytes() >= heap + 1000);
+  CHECK(TreeConstructor::Stats::over_memory_budget(heap + 1000));
+  CHECK(!TreeConstructor::Stats::over_memory_budget(0));
+
+  // Freed outside the scope, given back to NODES
+  delete[] array;
+  delete object;  // sized delete
+  CHECK(live_bytes("nodes") == nodes);
+
+  {
+    TreeConstructor::Stats::MemoryScope scope(Memory::EDGES);
+    auto const edges = live_bytes("edges");
+    void* ptr = ::operator new(64);
+    sink = ptr;
+    CHECK(live_bytes("edges") >= edges + 64);
+    ::operator delete(ptr, 64);
+    ptr = ::operator new[](32);
+    sink = ptr;
+    ::operator delete[](ptr, 32);
+    CHECK(live_bytes("edges") == edges);
+  }
+  return Tests::finish("MemoryTest");
+}
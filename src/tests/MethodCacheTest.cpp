@@ -0,0 +1,78 @@
+/*
+ * The cross-file method cache (-M): a method bundled unchanged in another
+ * dex, at another offset and with other indices, hashes the same and is
+ * relocated into the graph an uncached build gives; a changed method
+ * misses.
+ */
+#include <TreeConstructor/MethodCache.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+
+  DexGen::ClassDef library(int8_t constant)
+  {
+    DexGen::ClassDef lib{ "LLib;", {} };
+    lib.methods.push_back(Tests::method("f", CodeBuilder()
+        .const4(0, constant)             // 0
+        .if_eqz(0, 5)                    // 1 -> 6
+        .invoke_static({ "LLib;", "g" }) // 3
+        .return_void()));                // 6
+    lib.methods.push_back(Tests::method("g", CodeBuilder().return_void()));
+    return lib;
+  }
+
+  // The library after classes of its own, so its code moves
+  std::vector<uint8_t> app(int8_t constant)
+  {
+    DexGen::ClassDef pad{ "LApp;", {} };
+    int8_t value = 0;
+    for (char const* name : { "a", "b", "c" })
+      pad.methods.push_back(Tests::method(name, CodeBuilder()
+          .const4(0, value++).invoke_static({ "LApp;", "a" }).return_void()));
+    return DexGen::build({ pad, library(constant) });
+  }
+
+  std::string edg(std::vector<uint8_t> const& image, bool stream,
+                  TreeConstructor::MethodCache* cache)
+  {
+    DexGraph::Options options;
+    options.stream = stream;
+    options.method_cache = cache;
+    auto const dex = Tests::open(image, options);
+    DexGraph::Graph graph;
+    DexGraph::build(*dex, options, graph);
+    return graph.to_edg();
+  }
+}
+
+int main()
+{
+  auto const first = DexGen::build({ library(0) });
+  auto const second = app(0);
+
+  for (bool stream : { false, true })
+  {
+    TreeConstructor::MethodCache cache;
+    CHECK(edg(first, stream, &cache) == edg(first, stream, nullptr));
+    auto const after_first = cache.take_file_stats();
+    CHECK(after_first.hits == 0);
+    CHECK(after_first.misses == 2);
+
+    CHECK(edg(second, stream, &cache) == edg(second, stream, nullptr));
+    auto const after_second = cache.take_file_stats();
+    CHECK(after_second.hits == 2);
+    CHECK(after_second.misses == 3);
+    CHECK(after_second.reused_nodes != 0);
+
+    // f changed, g did not
+    auto const changed = app(1);
+    CHECK(edg(changed, stream, &cache) == edg(changed, stream, nullptr));
+    auto const after_changed = cache.take_file_stats();
+    CHECK(after_changed.hits == 4);  // g, and a, b, c from the app
+    CHECK(after_changed.misses == 1);
+  }
+  return Tests::finish("MethodCacheTest");
+}
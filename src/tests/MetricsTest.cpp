@@ -0,0 +1,76 @@
+/*
+ * Triage metrics (-q): one linear scan per method counts instructions
+ * (payloads left out), branches, invokes and switch cases, with the
+ * cyclomatic complexity from them, and honours the class filters.
+ */
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+
+  std::vector<DexGen::ClassDef> classes()
+  {
+    DexGen::ClassDef a{ "LA;", {} };
+    a.methods.push_back(Tests::method("mixed", CodeBuilder()
+        .const4(0, 1)                        // 0
+        .packed_switch(0, { 3, 4, 5 })       // 1 -> 4, 5, 6
+        .nop()                               // 4
+        .nop()                               // 5
+        .if_eqz(0, 5)                        // 6 -> 11
+        .invoke_static({ "LA;", "plain" })   // 8
+        .if_eqz(0, 2)                        // 11 -> 13
+        .return_void()));                    // 13, then the payload
+    a.methods.push_back(Tests::method("plain", CodeBuilder().return_void()));
+    DexGen::ClassDef b{ "LB;",
+        { Tests::method("other", CodeBuilder().nop().return_void()) } };
+    return { a, b };
+  }
+
+  DexGraph::MethodMetrics const* find(
+      std::vector<DexGraph::MethodMetrics> const& metrics, uint32_t method_idx)
+  {
+    for (auto const& method : metrics)
+    {
+      if (method.method_idx == method_idx)
+        return &method;
+    }
+    return nullptr;
+  }
+}
+
+int main()
+{
+  DexGraph::Options options;
+  auto const dex = Tests::open(DexGen::build(classes()), options);
+  auto const metrics = DexGraph::metrics(*dex, options);
+  CHECK(metrics.size() == 3);
+
+  auto const mixed = find(metrics, Tests::method_idx(*dex, "LA;", "mixed"));
+  CHECK(mixed != nullptr);
+  if (mixed != nullptr)
+  {
+    CHECK(mixed->instructions == 8);
+    CHECK(mixed->branches == 2);
+    CHECK(mixed->invokes == 1);
+    CHECK(mixed->switches == 1);
+    CHECK(mixed->switch_cases == 3);
+    CHECK(mixed->cyclomatic == 1 + 2 + 3);
+  }
+  auto const plain = find(metrics, Tests::method_idx(*dex, "LA;", "plain"));
+  CHECK(plain != nullptr);
+  if (plain != nullptr)
+  {
+    CHECK(plain->instructions == 1);
+    CHECK(plain->cyclomatic == 1);
+  }
+
+  // In class_def order, and filtered like a build
+  CHECK(metrics.back().method_idx == Tests::method_idx(*dex, "LB;", "other"));
+  DexGraph::Options filtered;
+  filtered.exclude_classes.push_back("LB;");
+  auto const kept = DexGraph::metrics(*dex, filtered);
+  CHECK(kept.size() == 2);
+  CHECK(find(kept, Tests::method_idx(*dex, "LB;", "other")) == nullptr);
+  return Tests::finish("MetricsTest");
+}
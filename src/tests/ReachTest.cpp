@@ -0,0 +1,52 @@
+/*
+ * Reachability (-E) must follow invokes to the method they resolve to up
+ * the superclasses, and virtual and interface invokes to every override
+ * and implementation in the dex.
+ */
+#include "TestHelpers.h"
+
+namespace
+{
+  DexGen::MethodDef empty(char const* name)
+  {
+    return Tests::method(name, DexGen::CodeBuilder().return_void());
+  }
+}
+
+int main()
+{
+  // Base { foo, bar }, Sub extends Base { foo }, Impl implements Task { run }
+  DexGen::ClassDef base{ "LBase;", { empty("foo"), empty("bar") } };
+  DexGen::ClassDef sub{ "LSub;", { empty("foo") } };
+  sub.superclass = "LBase;";
+  DexGen::ClassDef impl{ "LImpl;", { empty("run") } };
+  impl.interfaces.push_back("LTask;");
+  DexGen::ClassDef dead{ "LDead;", { empty("unused") } };
+
+  DexGen::ClassDef main_class{ "LMain;", {} };
+  main_class.methods.push_back(Tests::method("main", DexGen::CodeBuilder()
+      .const4(0, 0)
+      .invoke_virtual({ "LBase;", "foo" }, 0)   // overridden by Sub
+      .invoke_virtual({ "LSub;", "bar" }, 0)    // inherited from Base
+      .invoke_interface({ "LTask;", "run" }, 0) // implemented by Impl
+      .return_void()));
+
+  DexGraph::Options options;
+  auto const dex = Tests::open(
+      DexGen::build({ base, sub, impl, dead, main_class }), options);
+  auto const graph = DexGraph::call_graph(*dex, options);
+  auto const reached = DexGraph::reachable(graph,
+      DexGraph::entry_points(*dex, { "LMain;->main" }));
+  auto const is_reached = [&](char const* descriptor, char const* name) {
+    auto const m = Tests::method_idx(*dex, descriptor, name);
+    return m < graph.method_count && ((reached[m / 64] >> (m % 64)) & 1) != 0;
+  };
+
+  CHECK(is_reached("LMain;", "main"));
+  CHECK(is_reached("LBase;", "foo"));
+  CHECK(is_reached("LSub;", "foo"));
+  CHECK(is_reached("LBase;", "bar"));
+  CHECK(is_reached("LImpl;", "run"));
+  CHECK(!is_reached("LDead;", "unused"));
+  return Tests::finish("ReachTest");
+}
@@ -0,0 +1,62 @@
+/*
+ * Constant propagation (-p) must not prune branches whose operands a
+ * catch handler may change, although the handlers are not linked.
+ */
+#include <algorithm>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  DexGen::MethodRef const callee{ "LA;", "f" };
+
+  // v0 = 0; try { f(); } catch { v0 = 1; } if (v0 == 0) ...
+  DexGen::MethodDef join(char const* name, bool with_handler)
+  {
+    DexGen::MethodDef method;
+    method.name = name;
+    method.code.const4(0, 0)       // 0
+        .invoke_static(callee)     // 1
+        .goto16(3)                 // 4 -> 7
+        .const4(0, 1)              // 6, the handler
+        .if_eqz(0, 3)              // 7 -> 10
+        .return_void()             // 9
+        .return_void();            // 10
+    if (with_handler)
+      method.tries.push_back(DexGen::TryBlock{ 1, 3, 6 });
+    return method;
+  }
+
+  std::size_t if_successors(char const* name, bool prune)
+  {
+    DexGen::ClassDef a{ "LA;", {} };
+    DexGen::MethodDef f;
+    f.name = "f";
+    f.code.return_void();
+    a.methods.push_back(f);
+    a.methods.push_back(join("caught", true));
+    a.methods.push_back(join("plain", false));
+
+    DexGraph::Options options;
+    options.prune_infeasible = prune;
+    auto const dex = Tests::open(DexGen::build({ a }), options);
+    DexGraph::Graph graph;
+    DexGraph::build(*dex, options, graph);
+    auto const if_addr = Tests::entry_addr(*dex, "LA;", name) + 7 * 2;
+    auto succs = Tests::successors(graph, if_addr);
+    std::sort(succs.begin(), succs.end());
+    return std::unique(succs.begin(), succs.end()) - succs.begin();
+  }
+}
+
+int main()
+{
+  // Without a handler v0 is always 0: the fallthrough goes
+  CHECK(if_successors("plain", false) == 2);
+  CHECK(if_successors("plain", true) == 1);
+
+  // The handler sets v0 to 1 before the join: both links stay
+  CHECK(if_successors("caught", false) == 2);
+  CHECK(if_successors("caught", true) == 2);
+  return Tests::finish("SccpTest");
+}
@@ -0,0 +1,90 @@
+/*
+ * The -S JSON: counters match the graph built, in whole-file and
+ * streamed mode alike, reset() clears them, timers only run when
+ * enabled, and the file name is escaped.
+ */
+#include <TreeConstructor/Stats.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+  using TreeConstructor::Stats::Phase;
+
+  // Value of the counter "name" of the JSON; phases are objects, skipped
+  uint64_t counter(std::string const& json, char const* name)
+  {
+    auto const key = std::string("\"") + name + "\":";
+    for (auto pos = json.find(key); pos != std::string::npos;
+         pos = json.find(key, pos + 1))
+    {
+      auto const value = json.c_str() + pos + key.size();
+      if (*value >= '0' && *value <= '9')
+        return strtoull(value, nullptr, 10);
+    }
+    return ~0ull;
+  }
+
+  std::vector<DexGen::ClassDef> classes()
+  {
+    DexGen::ClassDef a{ "LA;", {} };
+    a.methods.push_back(Tests::method("f", CodeBuilder()
+        .const4(0, 0)              // 0
+        .if_eqz(0, 3)              // 1 -> 4
+        .return_void()             // 3
+        .return_void()));          // 4
+    DexGen::ClassDef b{ "LB;", {} };
+    b.methods.push_back(Tests::method("g", CodeBuilder()
+        .invoke_static({ "LA;", "f" })
+        .return_void()));
+    return { a, b };
+  }
+}
+
+int main()
+{
+  DexGraph::Options options;
+  auto const dex = Tests::open(DexGen::build(classes()), options);
+
+  TreeConstructor::Stats::enable(true);
+  for (bool stream : { false, true })
+  {
+    TreeConstructor::Stats::reset();
+    DexGraph::Options build_options;
+    build_options.stream = stream;
+    DexGraph::Graph graph;
+    {
+      TreeConstructor::Stats::ScopedTimer timer(Phase::TOTAL);
+      DexGraph::build(*dex, build_options, graph);
+    }
+    auto const json = TreeConstructor::Stats::to_json("a \"quoted\" name", 0);
+    CHECK(json.find("{\"file\":\"a \\\"quoted\\\" name\",\"result\":0,") == 0);
+    CHECK(counter(json, "classes") == 2);
+    CHECK(counter(json, "methods") == 2);
+    CHECK(counter(json, "instructions") == 6);
+    CHECK(counter(json, "nodes") == graph.nodes.size());
+    CHECK(counter(json, "edges") == graph.edges.size());
+    CHECK(counter(json, "methods_skipped") == 0);
+    CHECK(json.find("\"total\":{\"wall_ms\":0.000,\"cpu_ms\":0.000}") ==
+          std::string::npos);
+  }
+
+  TreeConstructor::Stats::reset();
+  auto const cleared = TreeConstructor::Stats::to_json("", 0);
+  CHECK(counter(cleared, "nodes") == 0);
+  CHECK(cleared.find("\"total\":{\"wall_ms\":0.000,\"cpu_ms\":0.000}") !=
+        std::string::npos);
+
+  // Disabled, timers leave the phases alone
+  TreeConstructor::Stats::enable(false);
+  {
+    TreeConstructor::Stats::ScopedTimer timer(Phase::TOTAL);
+    DexGraph::Graph graph;
+    DexGraph::build(*dex, options, graph);
+  }
+  CHECK(TreeConstructor::Stats::to_json("", 0).find(
+            "\"total\":{\"wall_ms\":0.000,\"cpu_ms\":0.000}") !=
+        std::string::npos);
+  return Tests::finish("StatsTest");
+}
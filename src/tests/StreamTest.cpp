@@ -0,0 +1,115 @@
+/*
+ * A streamed build (-s) must emit the nodes and edges of a whole-file
+ * build, StreamWriter must write them as Graph lays them out, and an
+ * Edg file it cannot write must fail finish().
+ */
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <TreeConstructor/FmtEdg.h>
+#include <TreeConstructor/TCHelper.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+
+  std::vector<DexGen::ClassDef> classes()
+  {
+    DexGen::ClassDef a{ "LA;", {} };
+    a.methods.push_back(Tests::method("leaf", CodeBuilder()
+        .const4(0, 0)              // 0
+        .if_eqz(0, 3)              // 1 -> 4
+        .return_void()             // 3
+        .return_void()));          // 4
+    a.methods.push_back(Tests::method("caller", CodeBuilder()
+        .invoke_static({ "LA;", "leaf" })
+        .invoke_static({ "LA;", "leaf" })
+        .return_void()));
+    a.methods.push_back(Tests::method("switch", CodeBuilder()
+        .const4(0, 1)              // 0
+        .packed_switch(0, { 3, 4 }) // 1 -> 4, 5
+        .nop()                     // 4
+        .invoke_static({ "LA;", "caller" }) // 5
+        .return_void()));
+    return { a };
+  }
+
+  struct Sorted
+  {
+    std::vector<std::pair<uint64_t, uint32_t>> nodes;
+    std::vector<std::pair<uint64_t, uint64_t>> edges;
+  };
+
+  // Nodes and unique edges, in address order
+  Sorted sorted(DexGraph::Graph const& graph)
+  {
+    Sorted ret;
+    for (auto const& node : graph.nodes)
+      ret.nodes.emplace_back(node.addr, static_cast<uint32_t>(node.type));
+    for (auto const& edge : graph.edges)
+      ret.edges.emplace_back(edge.from, edge.to);
+    std::sort(ret.nodes.begin(), ret.nodes.end());
+    std::sort(ret.edges.begin(), ret.edges.end());
+    ret.edges.erase(std::unique(ret.edges.begin(), ret.edges.end()),
+                    ret.edges.end());
+    return ret;
+  }
+
+  DexGraph::Graph build(DexGraph::Dex const& dex, bool stream)
+  {
+    DexGraph::Options options;
+    options.stream = stream;
+    DexGraph::Graph graph;
+    DexGraph::build(dex, options, graph);
+    return graph;
+  }
+}
+
+int main()
+{
+  DexGraph::Options options;
+  auto const dex = Tests::open(DexGen::build(classes()), options);
+
+  auto const whole = build(*dex, false);
+  auto const streamed = build(*dex, true);
+  CHECK(!whole.nodes.empty());
+  CHECK(sorted(streamed).nodes == sorted(whole).nodes);
+  CHECK(sorted(streamed).edges == sorted(whole).edges);
+  // Streaming emits each edge once
+  CHECK(sorted(streamed).edges.size() == streamed.edges.size());
+
+  // graph.edg is written in the working directory
+  char dir[] = "/tmp/StreamTestXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  CHECK(chdir(dir) == 0);
+  auto const edg = TreeConstructor::Helper::edg_filename;
+  {
+    DexGraph::Options stream_options;
+    stream_options.stream = true;
+    Fmt::Edg::StreamWriter writer;
+    CHECK(!DexGraph::build(*dex, stream_options, writer).write_failed);
+  }
+  std::ifstream in(edg, std::ios::binary);
+  std::string const written((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+  CHECK(written == streamed.to_edg());
+  unlink(edg);
+
+  // A directory in the way of graph.edg
+  CHECK(mkdir(edg, 0700) == 0);
+  {
+    Fmt::Edg::StreamWriter writer;
+    writer.dump_node(0x70, OpCodeType::SEQ);
+    writer.dump_edge(0x70, 0x72);
+    CHECK(!writer.finish());
+  }
+  rmdir(edg);
+  CHECK(chdir("/") == 0);
+  rmdir(dir);
+  return Tests::finish("StreamTest");
+}
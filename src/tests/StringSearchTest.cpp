@@ -0,0 +1,138 @@
+/*
+ * Substring search over a string pool (-k): the trigram index finds the
+ * same strings as a brute-force scan for needles of every length,
+ * including those under 3 bytes and the empty one, whatever the thread
+ * count; and over a dex, the const-string sites of the strings found.
+ */
+#include <algorithm>
+#include <random>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+  using TreeConstructor::StringSearch::Index;
+
+  std::vector<uint32_t> brute_force(std::vector<std::string> const& pool,
+                                    std::vector<bool> const& missing,
+                                    std::string const& needle)
+  {
+    std::vector<uint32_t> ret;
+    for (uint32_t i = 0; i < pool.size(); i++)
+    {
+      if (!missing[i] && pool[i].find(needle) != std::string::npos)
+        ret.push_back(i);
+    }
+    return ret;
+  }
+
+  void check_pool()
+  {
+    // Enough strings for several chunks, over a small alphabet so that
+    // trigrams are shared, some with bytes over 0x7f
+    std::mt19937 rng(1);
+    std::string const alphabet = "ab:/\xc3\xa9";
+    std::vector<std::string> pool = { "", "a", "ab", "aaa", "aaaa",
+                                      "http://a", "\xc3\xa9t\xc3\xa9" };
+    while (pool.size() < 20000)
+    {
+      std::string s(rng() % 12, ' ');
+      for (auto& c : s)
+        c = alphabet[rng() % alphabet.size()];
+      pool.push_back(s);
+    }
+    std::vector<bool> missing(pool.size(), false);
+    std::vector<char const*> strings;
+    for (uint32_t i = 0; i < pool.size(); i++)
+    {
+      missing[i] = i % 1000 == 999;  // no string_data
+      strings.push_back(missing[i] ? nullptr : pool[i].c_str());
+    }
+
+    std::vector<std::string> needles = { "", "a", "b", "\xc3", "ab", "aa",
+                                         "aaa", "aaaa", "aaaaa", "http://",
+                                         "t\xc3\xa9", "zz", "zzz", "abz" };
+    for (int i = 0; i < 200; i++)
+    {
+      std::string s(1 + rng() % 6, ' ');
+      for (auto& c : s)
+        c = alphabet[rng() % alphabet.size()];
+      needles.push_back(s);
+    }
+
+    Index const serial(strings, 1);
+    Index const parallel(strings, 4);
+    CHECK(serial.size() == pool.size());
+    for (auto const& needle : needles)
+    {
+      auto const expected = brute_force(pool, missing, needle);
+      CHECK(serial.find(needle) == expected);
+      CHECK(parallel.find(needle) == expected);
+    }
+    CHECK(serial.find("").size() == pool.size() - pool.size() / 1000);
+    CHECK(serial.find("zzz").empty());
+  }
+
+  std::vector<DexGen::ClassDef> classes()
+  {
+    DexGen::ClassDef a{ "LA;", {} };
+    a.methods.push_back(Tests::method("connect", CodeBuilder()
+        .const_string(0, "http://a.example/x")   // 0
+        .const_string(1, "https://b.example")    // 2
+        .return_void()));
+    a.methods.push_back(Tests::method("key", CodeBuilder()
+        .nop()                                   // 0
+        .const_string(0, "http://a.example/x")   // 1
+        .const_string(0, "key=1")                // 3
+        .return_void()));
+    return { a };
+  }
+
+  void check_dex()
+  {
+    DexGraph::Options options;
+    auto const dex = Tests::open(DexGen::build(classes()), options);
+    DexFile* pDexFile = dex->dex_file();
+    auto const index = DexGraph::string_search(*dex, 2);
+    CHECK(index.size() == pDexFile->pHeader->stringIdsSize);
+
+    auto const found = index.find("http://");
+    CHECK(found.size() == 1);
+    auto const https = index.find("https:");
+    CHECK(https.size() == 1);
+    CHECK(index.find("://").size() == 2);
+    CHECK(index.find("L").size() == 2);  // "LA;" and "Ljava/lang/Object;"
+    if (found.size() != 1 || https.size() != 1)
+      return;
+    CHECK(strcmp(dexStringById(pDexFile, found[0]), "http://a.example/x") == 0);
+
+    DexGraph::Xrefs xrefs;
+    options.xrefs = &xrefs;
+    DexGraph::Graph graph;
+    DexGraph::build(*dex, options, graph);
+    auto const connect = Tests::method_idx(*dex, "LA;", "connect");
+    auto const key = Tests::method_idx(*dex, "LA;", "key");
+    std::vector<std::pair<uint32_t, uint32_t>> sites;
+    auto const range = xrefs.strings.sites(found[0]);
+    for (auto site = range.first; site != range.second; site++)
+      sites.emplace_back(site->method_idx, site->offset);
+    std::sort(sites.begin(), sites.end());
+    std::vector<std::pair<uint32_t, uint32_t>> expected = { { connect, 0 },
+                                                            { key, 1 } };
+    std::sort(expected.begin(), expected.end());
+    CHECK(sites == expected);
+    auto const https_sites = xrefs.strings.sites(https[0]);
+    CHECK(https_sites.second - https_sites.first == 1 &&
+          https_sites.first->method_idx == connect &&
+          https_sites.first->offset == 2);
+    CHECK(xrefs.strings.site_count() == 4);
+  }
+}
+
+int main()
+{
+  check_pool();
+  check_dex();
+  return Tests::finish("StringSearchTest");
+}
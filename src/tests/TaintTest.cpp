@@ -0,0 +1,140 @@
+/*
+ * Taint (-F) must follow a call to the methods it dispatches to: an
+ * override returning a source, a method inherited from the superclass,
+ * an override sinking its argument. Worker thread counters must reach
+ * the caller.
+ */
+#include <algorithm>
+
+#include <TreeConstructor/Stats.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+
+  DexGen::MethodRef const secret{ "LLib;", "secret" };
+  DexGen::MethodRef const send{ "LLib;", "send" };
+
+  // v0 = secret(); return v0
+  CodeBuilder returns_secret()
+  {
+    return CodeBuilder().invoke_static(secret).move_result(0).return_value(0);
+  }
+
+  std::vector<DexGen::ClassDef> classes()
+  {
+    // Base.get returns a constant, Sub.get overrides it with a source;
+    // Base.put drops its argument, Sub.put sinks it
+    DexGen::ClassDef base{ "LBase;", {} };
+    base.methods.push_back(Tests::method("get",
+        CodeBuilder().const4(0, 0).return_value(0)));
+    base.methods.push_back(Tests::method("put", CodeBuilder().return_void(),
+                                         2, 1));
+    base.methods.push_back(Tests::method("fetch", returns_secret()));
+    DexGen::ClassDef sub{ "LSub;", {} };
+    sub.superclass = "LBase;";
+    sub.methods.push_back(Tests::method("get", returns_secret()));
+    sub.methods.push_back(Tests::method("put",
+        CodeBuilder().invoke(0x71, send, { 1 }).return_void(), 2, 1));
+
+    DexGen::ClassDef main_class{ "LMain;", {} };
+    // Through the override of the method named
+    main_class.methods.push_back(Tests::method("overridden", CodeBuilder()
+        .const4(0, 0)
+        .invoke_virtual({ "LBase;", "get" }, 0)
+        .move_result(1)
+        .invoke(0x71, send, { 1 })
+        .return_void()));
+    // Sub.fetch is not defined, Base.fetch is
+    main_class.methods.push_back(Tests::method("inherited", CodeBuilder()
+        .const4(0, 0)
+        .invoke_virtual({ "LSub;", "fetch" }, 0)
+        .move_result(1)
+        .invoke(0x71, send, { 1 })
+        .return_void()));
+    // The source goes into an argument an override sinks
+    main_class.methods.push_back(Tests::method("argument", CodeBuilder()
+        .invoke_static(secret)
+        .move_result(0)
+        .invoke(0x6e, { "LBase;", "put" }, { 0 })
+        .return_void()));
+    main_class.methods.push_back(Tests::method("clean", CodeBuilder()
+        .const4(0, 0)
+        .invoke(0x71, send, { 0 })
+        .return_void()));
+
+    // Independent methods for the worker threads to take
+    DexGen::ClassDef filler{ "LFiller;", {} };
+    for (int i = 0; i < 64; i++)
+    {
+      auto const name = "f" + std::to_string(i);
+      filler.methods.push_back(Tests::method(name.c_str(),
+          CodeBuilder().nop().nop().nop().return_void()));
+    }
+    return { base, sub, main_class, filler };
+  }
+
+  std::vector<DexGraph::TaintLeak> leaks(DexGraph::Dex const& dex,
+                                         unsigned threads)
+  {
+    DexGraph::TaintSpec spec;
+    spec.sources.push_back("LLib;->secret");
+    spec.sinks.push_back("LLib;->send");
+    spec.threads = threads;
+    return DexGraph::taint(dex, DexGraph::Options(), spec);
+  }
+
+  bool leaks_in(std::vector<DexGraph::TaintLeak> const& found,
+                uint32_t method_idx)
+  {
+    return std::any_of(found.begin(), found.end(),
+                       [method_idx](DexGraph::TaintLeak const& leak) {
+                         return leak.method_idx == method_idx;
+                       });
+  }
+}
+
+int main()
+{
+  DexGraph::Options options;
+  auto const dex = Tests::open(DexGen::build(classes()), options);
+  auto const found = leaks(*dex, 1);
+  auto const idx = [&](char const* descriptor, char const* name) {
+    return Tests::method_idx(*dex, descriptor, name);
+  };
+
+  CHECK(leaks_in(found, idx("LMain;", "overridden")));
+  CHECK(leaks_in(found, idx("LMain;", "inherited")));
+  CHECK(leaks_in(found, idx("LMain;", "argument")));
+  CHECK(!leaks_in(found, idx("LMain;", "clean")));
+
+  // The witnesses go down into the methods dispatched to
+  for (auto const& leak : found)
+  {
+    if (leak.method_idx == idx("LMain;", "overridden"))
+    {
+      CHECK(leak.source_path.size() == 2);
+      CHECK(leak.source_path.back().method_idx == idx("LSub;", "get"));
+    }
+    if (leak.method_idx == idx("LMain;", "argument"))
+    {
+      CHECK(leak.sink_path.size() == 2);
+      CHECK(leak.sink_path.back().method_idx == idx("LSub;", "put"));
+    }
+  }
+
+  // The same instructions are counted on one thread or several
+  using TreeConstructor::Stats::Counter;
+  auto const instructions = [&](unsigned threads) {
+    TreeConstructor::Stats::reset();
+    leaks(*dex, threads);
+    return TreeConstructor::Stats::thread_counts()[
+        static_cast<std::size_t>(Counter::INSTRUCTIONS)];
+  };
+  auto const serial = instructions(1);
+  CHECK(serial != 0);
+  CHECK(instructions(4) == serial);
+  return Tests::finish("TaintTest");
+}
@@ -0,0 +1,131 @@
+#pragma once
+// Shared by the tests under src/tests: each is one executable, run by
+// ctest, failing with the checks that did not hold.
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <DexGen/DexBuilder.h>
+#include <DexGraph/DexGraph.h>
+#include <libdex/DexClass.h>
+
+namespace Tests
+{
+inline int& failures()
+{
+  static int count = 0;
+  return count;
+}
+
+#define CHECK(cond)                                                     \
+  do                                                                    \
+  {                                                                     \
+    if (!(cond))                                                        \
+    {                                                                   \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,  \
+              #cond);                                                   \
+      Tests::failures()++;                                              \
+    }                                                                   \
+  } while (0)
+
+inline int finish(char const* name)
+{
+  if (failures() != 0)
+    fprintf(stderr, "%s: %d checks failed\n", name, failures());
+  return failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Parse a built dex image; aborts the test if it does not open.
+inline std::unique_ptr<DexGraph::Dex> open(std::vector<uint8_t> const& image,
+                                           DexGraph::Options const& options)
+{
+  std::string error;
+  auto dex = DexGraph::Dex::open_memory(image.data(), image.size(), options,
+                                        error);
+  if (dex == nullptr)
+  {
+    fprintf(stderr, "cannot open the test dex: %s\n", error.c_str());
+    exit(EXIT_FAILURE);
+  }
+  return dex;
+}
+
+// A method of a test class.
+inline DexGen::MethodDef method(char const* name,
+                                DexGen::CodeBuilder const& code,
+                                uint16_t registers = 4, uint16_t ins = 0)
+{
+  DexGen::MethodDef def;
+  def.name = name;
+  def.code = code;
+  def.registers = registers;
+  def.ins = ins;
+  return def;
+}
+
+// method_idx of the first method_id class->name, 0xffffffff if none.
+inline uint32_t method_idx(DexGraph::Dex const& dex, char const* descriptor,
+                           char const* name)
+{
+  DexFile* pDexFile = dex.dex_file();
+  for (u4 m = 0; m < pDexFile->pHeader->methodIdsSize; m++)
+  {
+    const DexMethodId* pMethodId = dexGetMethodId(pDexFile, m);
+    if (strcmp(dexStringByTypeIdx(pDexFile, pMethodId->classIdx), descriptor) == 0 &&
+        strcmp(dexStringById(pDexFile, pMethodId->nameIdx), name) == 0)
+      return m;
+  }
+  return 0xffffffffu;
+}
+
+// Address of the first instruction of class->name, 0 if not found.
+inline uint64_t entry_addr(DexGraph::Dex const& dex, char const* descriptor,
+                           char const* name)
+{
+  DexFile* pDexFile = dex.dex_file();
+  for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++)
+  {
+    const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+    const u1* pData = dexGetClassData(pDexFile, pClassDef);
+    if (pData == nullptr ||
+        strcmp(dexStringByTypeIdx(pDexFile, pClassDef->classIdx), descriptor) != 0)
+      continue;
+    DexClassData* pClassData = dexReadAndVerifyClassData(&pData, nullptr);
+    if (pClassData == nullptr)
+      return 0;
+    uint64_t addr = 0;
+    u4 const count = pClassData->header.directMethodsSize +
+                     pClassData->header.virtualMethodsSize;
+    for (u4 j = 0; j < count && addr == 0; j++)
+    {
+      const DexMethod* pMethod =
+          j < pClassData->header.directMethodsSize
+              ? &pClassData->directMethods[j]
+              : &pClassData->virtualMethods[j - pClassData->header.directMethodsSize];
+      const DexMethodId* pMethodId = dexGetMethodId(pDexFile, pMethod->methodIdx);
+      if (strcmp(dexStringById(pDexFile, pMethodId->nameIdx), name) == 0)
+        addr = (u1 const*)dexGetCode(pDexFile, pMethod)->insns - pDexFile->baseAddr;
+    }
+    free(pClassData);
+    return addr;
+  }
+  return 0;
+}
+
+// Targets of the edges out of addr, in emission order.
+inline std::vector<uint64_t> successors(DexGraph::Graph const& graph,
+                                        uint64_t addr)
+{
+  std::vector<uint64_t> ret;
+  for (auto const& edge : graph.edges)
+  {
+    if (edge.from == addr)
+      ret.push_back(edge.to);
+  }
+  return ret;
+}
+}
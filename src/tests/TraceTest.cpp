@@ -0,0 +1,74 @@
+/*
+ * The trace-event recorder (-T): a child process records spans, on its
+ * main thread and a worker, and the trace written at its exit holds the
+ * kept ones, escaped, and none of the short IF_SLOW ones.
+ */
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <TreeConstructor/Trace.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using TreeConstructor::Trace::Span;
+
+  void record(std::string const& filename)
+  {
+    {
+      Span before("beforeStart", Span::ALWAYS);
+    }
+    if (!TreeConstructor::Trace::start(filename, 1000 * 1000))
+      _exit(EXIT_FAILURE);
+    {
+      Span span("kept", Span::ALWAYS, "LA;", "say \"hi\"");
+    }
+    {
+      Span span("tooShort", Span::IF_SLOW);
+    }
+    std::thread([]() { Span span("onWorker", Span::ALWAYS); }).join();
+
+    DexGraph::Options options;
+    auto const dex = Tests::open(DexGen::build({ DexGen::ClassDef{ "LA;",
+        { Tests::method("f", DexGen::CodeBuilder().return_void()) } } }),
+        options);
+    DexGraph::Graph graph;
+    DexGraph::build(*dex, options, graph);
+    exit(EXIT_SUCCESS);  // writes the trace
+  }
+}
+
+int main()
+{
+  char path[] = "/tmp/TraceTestXXXXXX";
+  int const fd = mkstemp(path);
+  CHECK(fd >= 0);
+  close(fd);
+
+  pid_t const pid = fork();
+  if (pid == 0)
+    record(path);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+  std::ifstream in(path, std::ios::binary);
+  std::string const trace((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+  unlink(path);
+  CHECK(trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[") == 0);
+  CHECK(trace.size() > 4 && trace.compare(trace.size() - 4, 4, "\n]}\n") == 0);
+  CHECK(trace.find("\"name\":\"kept\"") != std::string::npos);
+  CHECK(trace.find("\"args\":{\"detail\":\"LA;->say \\\"hi\\\"\"}") !=
+        std::string::npos);
+  CHECK(trace.find("\"name\":\"onWorker\"") != std::string::npos);
+  CHECK(trace.find("\"args\":{\"name\":\"worker\"}") != std::string::npos);
+  CHECK(trace.find("\"name\":\"processDexFile\"") != std::string::npos);
+  CHECK(trace.find("tooShort") == std::string::npos);
+  CHECK(trace.find("beforeStart") == std::string::npos);
+  return Tests::finish("TraceTest");
+}
@@ -0,0 +1,81 @@
+/*
+ * traverse() with a static visitor: every node of a method graph with a
+ * diamond and a back edge is visited once, and Fmt::Edg::Emitter emits
+ * the nodes and edges binary_traversal() and dump_method() would.
+ */
+#include <algorithm>
+
+#include <TreeConstructor/FmtEdg.h>
+#include <TreeConstructor/TCNode.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using TreeConstructor::NodeSPtr;
+
+  auto constexpr BASE = 0x100u;
+
+  NodeSPtr node(uint32_t offset, uint16_t size, OpCode opcode,
+                std::vector<uint32_t> targets = {})
+  {
+    return std::make_shared<TreeConstructor::Node>(
+        BASE + offset * 2, size, opcode, TreeConstructor::MethodInfo(), offset,
+        targets);
+  }
+
+  std::vector<NodeSPtr> method()
+  {
+    return {
+      node(0, 1, OP_CONST_4),
+      node(1, 2, OP_IF_EQZ, { 5 }),
+      node(3, 1, OP_CONST_4),
+      node(4, 1, OP_GOTO, { 6 }),
+      node(5, 1, OP_CONST_4),
+      node(6, 2, OP_IF_EQZ, { 0 }),  // back to the top
+      node(8, 1, OP_RETURN_VOID),
+    };
+  }
+
+  std::vector<std::pair<uint64_t, uint64_t>> sorted_edges(
+      DexGraph::Graph const& graph)
+  {
+    std::vector<std::pair<uint64_t, uint64_t>> ret;
+    for (auto const& edge : graph.edges)
+      ret.emplace_back(edge.from - BASE, edge.to - BASE);
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  }
+}
+
+int main()
+{
+  auto const nodes = method();
+  auto const root = TreeConstructor::construct_node_from_vec(nodes);
+
+  std::vector<uint32_t> visited;
+  TreeConstructor::traverse(*root, [&](NodeSPtr const& visited_node) {
+    visited.push_back(visited_node->baseAddr);
+  });
+  CHECK(visited.size() == nodes.size());
+  std::sort(visited.begin(), visited.end());
+  CHECK(std::unique(visited.begin(), visited.end()) == visited.end());
+
+  DexGraph::Graph emitted;
+  TreeConstructor::traverse(*root, Fmt::Edg::Emitter<DexGraph::Graph>{ emitted });
+  DexGraph::Graph dumped;
+  auto const traversal =
+      TreeConstructor::binary_traversal(*root, Fmt::Edg::dump_single_node);
+  dumped.dump_method(traversal.first, traversal.second);
+  CHECK(emitted.to_edg() == dumped.to_edg());
+
+  // In byte offsets from the method: the diamond, then the loop
+  std::vector<std::pair<uint64_t, uint64_t>> const expected = {
+    { 0, 2 }, { 2, 6 }, { 2, 10 }, { 6, 8 }, { 8, 12 }, { 10, 12 },
+    { 12, 0 }, { 12, 16 },
+  };
+  CHECK(sorted_edges(emitted) == expected);
+
+  TreeConstructor::release_nodes(nodes);
+  return Tests::finish("TraverseTest");
+}
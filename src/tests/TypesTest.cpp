@@ -0,0 +1,90 @@
+/*
+ * Call sharpening (-R) must only move a call to the override of a class
+ * its receiver may not be a subclass of, and must not trust types across
+ * catch handlers.
+ */
+#include <algorithm>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  DexGen::MethodRef const foo{ "LBase;", "foo" };
+
+  DexGen::ClassDef with_foo(char const* descriptor, char const* superclass)
+  {
+    DexGen::ClassDef def{ descriptor, {} };
+    def.superclass = superclass;
+    def.methods.push_back(
+        Tests::method("foo", DexGen::CodeBuilder().return_void()));
+    return def;
+  }
+
+  // Whether the invoke at code unit at of LT;->name calls descriptor->foo.
+  bool calls(char const* name, uint32_t at, char const* descriptor)
+  {
+    DexGen::ClassDef t{ "LT;", {} };
+    t.methods.push_back(
+        Tests::method("g", DexGen::CodeBuilder().return_void()));
+
+    // Allocated: exact, SubSub overriding below does not matter
+    t.methods.push_back(Tests::method("exact", DexGen::CodeBuilder()
+        .new_instance(0, "LSub;")      // 0
+        .invoke_virtual(foo, 0)        // 2
+        .return_void()));
+    // Cast: may be a SubSub, which overrides foo
+    t.methods.push_back(Tests::method("cast", DexGen::CodeBuilder()
+        .const4(0, 0)                  // 0
+        .check_cast(0, "LSub;")        // 1
+        .invoke_virtual(foo, 0)        // 3
+        .return_void()));
+    // Cast to a class nothing in the dex extends
+    t.methods.push_back(Tests::method("leaf", DexGen::CodeBuilder()
+        .const4(0, 0)                  // 0
+        .check_cast(0, "LSubSub;")     // 1
+        .invoke_virtual(foo, 0)        // 3
+        .return_void()));
+    // The handler joins with v0 unknown
+    auto caught = Tests::method("caught", DexGen::CodeBuilder()
+        .new_instance(0, "LSub;")      // 0
+        .invoke_static({ "LT;", "g" }) // 2
+        .goto16(3)                     // 5 -> 8
+        .nop()                         // 7, the handler
+        .invoke_virtual(foo, 0)        // 8
+        .return_void());
+    caught.tries.push_back(DexGen::TryBlock{ 2, 3, 7 });
+    t.methods.push_back(caught);
+
+    std::vector<DexGen::ClassDef> const classes = {
+      with_foo("LBase;", "Ljava/lang/Object;"),
+      with_foo("LSub;", "LBase;"),
+      with_foo("LSubSub;", "LSub;"),
+      t,
+    };
+    DexGraph::Options options;
+    options.sharpen_calls = true;
+    auto const dex = Tests::open(DexGen::build(classes), options);
+    DexGraph::Graph graph;
+    DexGraph::build(*dex, options, graph);
+    auto const succs = Tests::successors(graph,
+        Tests::entry_addr(*dex, "LT;", name) + at * 2);
+    auto const target = Tests::entry_addr(*dex, descriptor, "foo");
+    return std::find(succs.begin(), succs.end(), target) != succs.end();
+  }
+}
+
+int main()
+{
+  CHECK(calls("exact", 2, "LSub;"));
+  CHECK(!calls("exact", 2, "LBase;"));
+
+  CHECK(calls("cast", 3, "LBase;"));
+  CHECK(!calls("cast", 3, "LSub;"));
+
+  CHECK(calls("leaf", 3, "LSubSub;"));
+  CHECK(!calls("leaf", 3, "LBase;"));
+
+  CHECK(calls("caught", 8, "LBase;"));
+  CHECK(!calls("caught", 8, "LSub;"));
+  return Tests::finish("TypesTest");
+}
@@ -0,0 +1,90 @@
+/*
+ * Structural verification (-V) split across threads must accept and
+ * reject the same files as the serial walk, including out of order ids
+ * on either side of a chunk boundary.
+ */
+#include <zlib.h>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  auto constexpr METHOD_COUNT = 5000u;  // over kMinParallelSectionItems
+  auto constexpr THREADS = 4;
+
+  std::vector<uint8_t> image()
+  {
+    DexGen::ClassDef a{ "LA;", {} };
+    for (unsigned i = 0; i < METHOD_COUNT; i++)
+    {
+      auto const name = "m" + std::to_string(i);
+      a.methods.push_back(Tests::method(name.c_str(),
+          DexGen::CodeBuilder().return_void()));
+    }
+    return DexGen::build({ a });
+  }
+
+  uint32_t u4_at(std::vector<uint8_t> const& bytes, std::size_t offset)
+  {
+    uint32_t value;
+    memcpy(&value, bytes.data() + offset, sizeof(value));
+    return value;
+  }
+
+  // Recompute the header checksum after a change
+  void fix_checksum(std::vector<uint8_t>& bytes)
+  {
+    uint32_t const checksum =
+        adler32(adler32(0L, Z_NULL, 0), bytes.data() + 12, bytes.size() - 12);
+    memcpy(bytes.data() + 8, &checksum, sizeof(checksum));
+  }
+
+  // Both walks verify a copy, as they swap in place
+  bool verifies(std::vector<uint8_t> bytes, int threads)
+  {
+    return dexFixByteOrderingParallel(bytes.data(), (int)bytes.size(),
+                                      threads) == 0;
+  }
+
+  // method_id i copied over i + 1, breaking the sort order there
+  std::vector<uint8_t> duplicate_method_id(std::vector<uint8_t> bytes,
+                                           uint32_t i)
+  {
+    auto const method_ids = u4_at(bytes, 0x5c);
+    auto const size = sizeof(DexMethodId);
+    memcpy(bytes.data() + method_ids + (i + 1) * size,
+           bytes.data() + method_ids + i * size, size);
+    fix_checksum(bytes);
+    return bytes;
+  }
+}
+
+int main()
+{
+  auto const good = image();
+  CHECK(u4_at(good, 0x58) >= METHOD_COUNT);
+  CHECK(verifies(good, 1));
+  CHECK(verifies(good, THREADS));
+
+  // Chunk boundaries of the method_ids split across THREADS
+  auto const count = u4_at(good, 0x58);
+  auto const per_chunk = (count + THREADS - 1) / THREADS;
+  for (uint32_t i : { 0u, per_chunk - 2, per_chunk - 1, per_chunk,
+                      2 * per_chunk - 1, count - 2 })
+  {
+    auto const bad = duplicate_method_id(good, i);
+    CHECK(!verifies(bad, 1));
+    CHECK(!verifies(bad, THREADS));
+  }
+
+  // A name out of range in the last chunk
+  auto bad = good;
+  auto const last = u4_at(good, 0x5c) + (count - 1) * sizeof(DexMethodId);
+  uint32_t const name_idx = 0x7fffffff;
+  memcpy(bad.data() + last + offsetof(DexMethodId, nameIdx), &name_idx,
+         sizeof(name_idx));
+  fix_checksum(bad);
+  CHECK(!verifies(bad, 1));
+  CHECK(!verifies(bad, THREADS));
+  return Tests::finish("VerifyTest");
+}
@@ -0,0 +1,115 @@
+/*
+ * Field cross-references (Options::xrefs): every iget, iput, sget and
+ * sput of the methods built is a site of its field_idx, in whole-file and
+ * streamed mode alike, and left out classes add none.
+ */
+#include <algorithm>
+
+#include "TestHelpers.h"
+
+namespace
+{
+  using DexGen::CodeBuilder;
+  using DexGen::FieldRef;
+
+  FieldRef const count{ "LA;", "count", "I" };
+  FieldRef const x{ "LA;", "x", "I" };
+  FieldRef const name{ "LB;", "name", "Ljava/lang/String;" };
+
+  std::vector<DexGen::ClassDef> classes()
+  {
+    DexGen::ClassDef a{ "LA;", {} };
+    a.methods.push_back(Tests::method("write", CodeBuilder()
+        .const4(0, 1)                        // 0
+        .static_field(0x67, 0, count)        // 1, sput
+        .instance_field(0x59, 0, 1, x)       // 3, iput
+        .instance_field(0x52, 2, 1, x)       // 5, iget
+        .return_void()));                    // 7
+    a.methods.push_back(Tests::method("read", CodeBuilder()
+        .static_field(0x60, 0, count)        // 0, sget
+        .static_field(0x62, 0, name)         // 2, sget-object
+        .return_void()));
+    DexGen::ClassDef b{ "LB;",
+        { Tests::method("other", CodeBuilder()
+              .instance_field(0x52, 0, 1, x)
+              .return_void()) } };
+    return { a, b };
+  }
+
+  uint32_t field_idx(DexGraph::Dex const& dex, char const* field_name)
+  {
+    DexFile* pDexFile = dex.dex_file();
+    for (u4 f = 0; f < pDexFile->pHeader->fieldIdsSize; f++)
+    {
+      const DexFieldId* pFieldId = dexGetFieldId(pDexFile, f);
+      if (strcmp(dexStringById(pDexFile, pFieldId->nameIdx), field_name) == 0)
+        return f;
+    }
+    return 0xffffffffu;
+  }
+
+  typedef std::vector<std::pair<uint32_t, uint32_t>> Sites;
+
+  Sites sorted(Sites sites)
+  {
+    std::sort(sites.begin(), sites.end());
+    return sites;
+  }
+
+  // Sites of id as (method_idx, offset), sorted
+  Sites sites(TreeConstructor::Xref::Index const& index, uint32_t id)
+  {
+    Sites ret;
+    auto const range = index.sites(id);
+    for (auto site = range.first; site != range.second; site++)
+      ret.emplace_back(site->method_idx, site->offset);
+    return sorted(ret);
+  }
+}
+
+int main()
+{
+  DexGraph::Options options;
+  auto const dex = Tests::open(DexGen::build(classes()), options);
+  CHECK(dex->dex_file()->pHeader->fieldIdsSize == 3);
+  auto const write = Tests::method_idx(*dex, "LA;", "write");
+  auto const read = Tests::method_idx(*dex, "LA;", "read");
+  auto const other = Tests::method_idx(*dex, "LB;", "other");
+
+  for (bool stream : { false, true })
+  {
+    DexGraph::Xrefs xrefs;
+    DexGraph::Options xref_options;
+    xref_options.xrefs = &xrefs;
+    xref_options.stream = stream;
+    DexGraph::Graph graph;
+    DexGraph::build(*dex, xref_options, graph);
+
+    CHECK(xrefs.fields.id_count() == 3);
+    CHECK(xrefs.fields.site_count() == 6);
+    CHECK(sites(xrefs.fields, field_idx(*dex, "count")) ==
+          sorted({ { write, 1 }, { read, 0 } }));
+    CHECK(sites(xrefs.fields, field_idx(*dex, "x")) ==
+          sorted({ { write, 3 }, { write, 5 }, { other, 0 } }));
+    CHECK(sites(xrefs.fields, field_idx(*dex, "name")) == (Sites{ { read, 2 } }));
+    CHECK(sites(xrefs.fields, 3).empty());
+    // No const-string anywhere
+    CHECK(xrefs.strings.site_count() == 0);
+
+    // The CSR arrays cover every site
+    auto const& offsets = xrefs.fields.offsets();
+    CHECK(offsets.size() == 4 && offsets.front() == 0 && offsets.back() == 6);
+    CHECK(xrefs.fields.all_sites().size() == 6);
+  }
+
+  DexGraph::Xrefs filtered;
+  DexGraph::Options exclude;
+  exclude.xrefs = &filtered;
+  exclude.exclude_classes.push_back("LB;");
+  DexGraph::Graph graph;
+  DexGraph::build(*dex, exclude, graph);
+  CHECK(sites(filtered.fields, field_idx(*dex, "x")) ==
+        (Sites{ { write, 3 }, { write, 5 } }));
+  CHECK(filtered.fields.site_count() == 5);
+  return Tests::finish("XrefTest");
+}